@@ -0,0 +1,135 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The test exercises the clock model that is internal to the module.
+#include <utils/clock.cpp>
+
+#include "stub_runtime.h"
+
+namespace {
+
+    // Keeps the benchmarked conversions from being optimized away.
+    volatile XrTime g_conversionSink;
+
+} // namespace
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+
+    ClockServiceTestResult runClockServiceTest(uint32_t sampleCount, double driftPpm) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(
+            local, "ClockServiceTest", TLArg(sampleCount, "SampleCount"), TLArg(driftPpm, "DriftPpm"));
+
+        // A 10 MHz performance counter, and a runtime clock wandering by about 1 ppm every 2 minutes.
+        constexpr int64_t Frequency = 10'000'000;
+        const stub::RuntimeClock runtimeClock{static_cast<double>(Frequency), driftPpm, 20'000.0, 120.0};
+        stub::setClock(runtimeClock);
+        // Called through a volatile pointer so that the compiler cannot see through it.
+        const PFN_xrConvertWin32PerformanceCounterToTimeKHR volatile stubConvert =
+            stub::getFunction<PFN_xrConvertWin32PerformanceCounterToTimeKHR>(
+                "xrConvertWin32PerformanceCounterToTimeKHR");
+
+        std::mt19937 random(1234);
+        std::uniform_int_distribution<int64_t> schedulingJitter(0, Frequency / 200);
+
+        ClockCalibrator calibrator(Frequency);
+        ClockModel model;
+        ClockServiceTestResult result{};
+        int64_t performanceCounter = 100 * Frequency;
+        for (uint32_t i = 0; i < sampleCount; i++) {
+            XrTime time;
+            stubConvert(XR_NULL_HANDLE, reinterpret_cast<const LARGE_INTEGER*>(&performanceCounter), &time);
+            model.publish(calibrator.addSample(performanceCounter, time));
+
+            // The model is used until the next sample (the sampler thread might also wake up late).
+            const int64_t nextPerformanceCounter =
+                performanceCounter + calibrator.getSamplingPeriod().count() * Frequency / 1000 +
+                schedulingJitter(random);
+            const ClockParameters parameters = model.read();
+            const bool isSettled = calibrator.getSamplingPeriod() >= 1000ms;
+            for (int64_t counter = performanceCounter; counter < nextPerformanceCounter;
+                 counter += (nextPerformanceCounter - performanceCounter) / 16) {
+                const XrDuration error = std::abs(parameters.toXrTime(counter) - runtimeClock.toXrTime(counter));
+                if (isSettled) {
+                    result.maxErrorNanoseconds = std::max(result.maxErrorNanoseconds, static_cast<double>(error));
+                }
+                if (error > parameters.errorBound ||
+                    std::abs(parameters.toPerformanceCounter(parameters.toXrTime(counter)) - counter) > 1) {
+                    result.boundViolations++;
+                }
+            }
+            if (isSettled) {
+                result.maxErrorBoundNanoseconds =
+                    std::max(result.maxErrorBoundNanoseconds, static_cast<double>(parameters.errorBound));
+            }
+
+            performanceCounter = nextPerformanceCounter;
+        }
+
+        // Measure the cost of the conversions.
+        using clock = std::chrono::high_resolution_clock;
+        constexpr uint32_t Iterations = 1'000'000;
+
+        XrTime sum = 0;
+        auto start = clock::now();
+        for (uint32_t i = 0; i < Iterations; i++) {
+            sum += model.read().toXrTime(performanceCounter + i);
+        }
+        result.conversionNanoseconds =
+            std::chrono::duration<double, std::nano>(clock::now() - start).count() / Iterations;
+
+        start = clock::now();
+        for (uint32_t i = 0; i < Iterations; i++) {
+            LARGE_INTEGER counter;
+            counter.QuadPart = performanceCounter + i;
+            XrTime time;
+            stubConvert(XR_NULL_HANDLE, &counter, &time);
+            sum -= time;
+        }
+        result.runtimeNanoseconds =
+            std::chrono::duration<double, std::nano>(clock::now() - start).count() / Iterations;
+
+        g_conversionSink = sum;
+
+        Log(fmt::format("Clock service: {} samples, max error {:.2f} us (max bound {:.2f} us, {} violations), "
+                        "{:.1f} ns per conversion ({:.1f} ns with the stub runtime)\n",
+                        sampleCount,
+                        result.maxErrorNanoseconds / 1000.0,
+                        result.maxErrorBoundNanoseconds / 1000.0,
+                        result.boundViolations,
+                        result.conversionNanoseconds,
+                        result.runtimeNanoseconds));
+
+        TraceLoggingWriteStop(local,
+                              "ClockServiceTest",
+                              TLArg(result.maxErrorNanoseconds, "MaxErrorNanoseconds"),
+                              TLArg(result.boundViolations, "BoundViolations"),
+                              TLArg(result.conversionNanoseconds, "ConversionNanoseconds"));
+
+        return result;
+    }
+
+} // namespace openxr_api_layer::tests
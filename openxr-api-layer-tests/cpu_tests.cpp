@@ -0,0 +1,153 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+#include "tests.h"
+#include "log.h"
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+    std::vector<CpuDeviceScalingResult>
+    runCpuDeviceScalingBenchmark(uint32_t width, uint32_t height, uint32_t iterations) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "CpuDevice_Benchmark",
+                               TLArg(width, "Width"),
+                               TLArg(height, "Height"),
+                               TLArg(iterations, "Iterations"));
+
+        std::vector<uint32_t> threadCounts;
+        const uint32_t maxThreadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (uint32_t threadCount = 1; threadCount < maxThreadCount; threadCount *= 2) {
+            threadCounts.push_back(threadCount);
+        }
+        threadCounts.push_back(maxThreadCount);
+
+        // Fill the textures with a fixed pseudo-random pattern, so that tiles executed out of order show in the output.
+        const auto fill = [](uint8_t* data, size_t size, uint32_t seed, uint8_t mask) {
+            for (size_t i = 0; i < size; i++) {
+                seed = seed * 1664525 + 1013904223;
+                data[i] = static_cast<uint8_t>(seed >> 24) & mask;
+            }
+        };
+
+        std::vector<uint8_t> reference;
+        std::vector<CpuDeviceScalingResult> results;
+        for (const uint32_t threadCount : threadCounts) {
+            auto device = createCpuDevice(general::createWorkerPool(threadCount));
+            ICpuCommandContext* const context = device->getNativeContext<CPU>();
+
+            // A typical stereo composition: the application's half-float images are converted to the submission
+            // format, then an overlay is blended over each eye.
+            XrSwapchainCreateInfo info{XR_TYPE_SWAPCHAIN_CREATE_INFO};
+            info.width = width;
+            info.height = height;
+            info.arraySize = 2;
+            info.mipCount = info.sampleCount = info.faceCount = 1;
+            info.format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+            auto eyes = device->createTexture(info, false /* shareable */);
+
+            // Keep the sign clear and the exponent of each half below 15, for values in [0, 1) with no Inf or NaN.
+            uint8_t* const eyesData = eyes->getNativeTexture<CPU>();
+            const size_t eyesSize = static_cast<size_t>(width) * height * info.arraySize * 8;
+            fill(eyesData, eyesSize, 1, 0xff);
+            for (size_t i = 1; i < eyesSize; i += 2) {
+                eyesData[i] &= 0x3b;
+            }
+
+            info.format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+            auto output = device->createTexture(info, false /* shareable */);
+            info.width = std::max(1u, width / 2);
+            info.height = std::max(1u, height / 2);
+            info.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            auto overlay = device->createTexture(info, false /* shareable */);
+            const size_t overlaySize = static_cast<size_t>(info.width) * info.height * info.arraySize * 4;
+            fill(overlay->getNativeTexture<CPU>(), overlaySize, 2, 0x7f);
+
+            // A patch written over part of the overlay, starting in the middle of a band of rows of the blend. Its
+            // result depends on the tiles of both commands executing in submission order.
+            auto patch = device->createTexture(info, false /* shareable */);
+            fill(patch->getNativeTexture<CPU>(), overlaySize, 3, 0xff);
+
+            auto fence = device->createFence(false /* shareable */);
+            const XrRect2Di eyeRect{{0, 0}, {static_cast<int32_t>(width), static_cast<int32_t>(height)}};
+            const XrOffset2Di overlayOffset{static_cast<int32_t>(width / 4), static_cast<int32_t>(height / 4)};
+            const XrRect2Di patchRect{{0, 0}, {static_cast<int32_t>(info.width), static_cast<int32_t>(info.height)}};
+            const XrOffset2Di patchOffset{static_cast<int32_t>(width / 8), static_cast<int32_t>(height / 2 + 3)};
+
+            uint64_t fenceValue = 0;
+            const auto frame = [&] {
+                for (uint32_t eye = 0; eye < 2; eye++) {
+                    context->blit(eyes.get(), eyeRect, output.get(), {0, 0}, eye);
+                    context->blendPremultiplied(overlay.get(), output.get(), overlayOffset, eye);
+                    context->blit(patch.get(), patchRect, output.get(), patchOffset, eye);
+                }
+                fence->signal(++fenceValue);
+                fence->waitOnCpu(fenceValue);
+            };
+
+            // Warm up the worker threads and the caches.
+            frame();
+
+            auto timer = general::createTimer();
+            timer->start();
+            for (uint32_t i = 0; i < iterations; i++) {
+                frame();
+            }
+            timer->stop();
+
+            const double milliseconds = std::max<uint64_t>(timer->query(), 1) / 1e3 / std::max(1u, iterations);
+            const double speedup = results.empty() ? 1.0 : results[0].milliseconds / milliseconds;
+
+            const uint8_t* const outputData = output->getNativeTexture<CPU>();
+            const size_t outputSize = static_cast<size_t>(width) * height * 2 * 4;
+            if (reference.empty()) {
+                reference.assign(outputData, outputData + outputSize);
+            }
+            const bool matchesSingleThreaded = !memcmp(outputData, reference.data(), outputSize);
+            if (!matchesSingleThreaded) {
+                ErrorLog(fmt::format("CPU device output with {} threads differs from the single-threaded output\n",
+                                     threadCount));
+            }
+            results.push_back({threadCount, milliseconds, speedup, matchesSingleThreaded});
+
+            TraceLoggingWriteTagged(local,
+                                    "CpuDevice_Benchmark",
+                                    TLArg(threadCount, "ThreadCount"),
+                                    TLArg(milliseconds, "Milliseconds"),
+                                    TLArg(speedup, "Speedup"),
+                                    TLArg(matchesSingleThreaded, "MatchesSingleThreaded"));
+            Log(fmt::format(
+                "CPU device {:>3} threads {:8.2f} ms/frame {:6.2f}x\n", threadCount, milliseconds, speedup));
+        }
+
+        TraceLoggingWriteStop(local, "CpuDevice_Benchmark");
+
+        return results;
+    }
+
+} // namespace openxr_api_layer::tests
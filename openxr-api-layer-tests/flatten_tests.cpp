@@ -0,0 +1,244 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The test exercises the reference rasterization that is internal to the module.
+#include <utils/flatten.cpp>
+
+#include "tests.h"
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+    QuadFlatteningTestResult runQuadFlatteningTest(uint32_t eyeResolution) {
+        using namespace xr::math;
+        using clock = std::chrono::high_resolution_clock;
+
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local, "QuadFlatteningTest", TLArg(eyeResolution, "EyeResolution"));
+
+        eyeResolution = std::max(eyeResolution, 64u);
+
+        // Side-by-side stereo projection images, over a uniform background.
+        const uint8_t background[4] = {40, 80, 120, 255};
+        const uint32_t width = 2 * eyeResolution;
+        const uint32_t height = eyeResolution;
+        std::vector<uint8_t> destinationData(static_cast<size_t>(width) * height * 4);
+        const image::Image destination{
+            destinationData.data(), width * 4, width, height, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB};
+
+        // Asymmetric fields of view, like on most headsets.
+        const XrFovf fovs[2] = {{-0.9f, 0.75f, 0.8f, -0.85f}, {-0.75f, 0.9f, 0.8f, -0.85f}};
+        const XrPosef eyePoses[2] = {Pose::Translation({-0.032f, 0, 0}), Pose::Translation({0.032f, 0, 0})};
+        const XrRect2Di eyeRects[2] = {{{0, 0}, {static_cast<int32_t>(eyeResolution), static_cast<int32_t>(height)}},
+                                       {{static_cast<int32_t>(eyeResolution), 0},
+                                        {static_cast<int32_t>(eyeResolution), static_cast<int32_t>(height)}}};
+
+        // The quad is the left half of an atlas with red, green, blue and white quadrants, and a transparent alpha
+        // channel that must be ignored. The right half of the atlas is magenta, and must never be sampled.
+        constexpr uint32_t AtlasWidth = 128;
+        constexpr uint32_t AtlasHeight = 64;
+        const uint8_t quadrantColors[4][3] = {{255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 255}};
+        std::vector<uint8_t> sourceData(AtlasWidth * AtlasHeight * 4);
+        for (uint32_t y = 0; y < AtlasHeight; y++) {
+            for (uint32_t x = 0; x < AtlasWidth; x++) {
+                uint8_t* const pixel = &sourceData[(y * AtlasWidth + x) * 4];
+                if (x < AtlasWidth / 2) {
+                    const uint32_t quadrant = (y < AtlasHeight / 2 ? 0 : 2) + (x < AtlasWidth / 4 ? 0 : 1);
+                    memcpy(pixel, quadrantColors[quadrant], 3);
+                } else {
+                    pixel[0] = pixel[2] = 255;
+                    pixel[1] = 0;
+                }
+                pixel[3] = 0;
+            }
+        }
+        const image::Image source{
+            sourceData.data(), AtlasWidth * 4, AtlasWidth, AtlasHeight, DXGI_FORMAT_R8G8B8A8_UNORM};
+        const XrRect2Di sourceRect{{0, 0}, {AtlasWidth / 2, AtlasHeight}};
+
+        const auto makeOrientation = [](float yawDegrees, float rollDegrees) {
+            const float halfYaw = static_cast<float>(yawDegrees * M_PI / 360);
+            const float halfRoll = static_cast<float>(rollDegrees * M_PI / 360);
+            return Pose::Multiply(Pose::MakePose({0, 0, std::sin(halfRoll), std::cos(halfRoll)}, XrVector3f{}),
+                                  Pose::MakePose({0, std::sin(halfYaw), 0, std::cos(halfYaw)}, XrVector3f{}))
+                .orientation;
+        };
+
+        struct TestCase {
+            const char* name;
+            XrPosef pose;
+            XrExtent2Df size;
+            XrEyeVisibility eyeVisibility;
+        };
+        const TestCase testCases[] = {
+            {"Facing", Pose::Translation({0, 0, -1}), {1.f, 1.f}, XR_EYE_VISIBILITY_BOTH},
+            {"Rotated", Pose::MakePose(makeOrientation(40, 15), XrVector3f{0.2f, 0.1f, -1.5f}),
+             {0.8f, 0.6f},
+             XR_EYE_VISIBILITY_BOTH},
+            {"LeftEye", Pose::Translation({0, 0, -1}), {1.f, 1.f}, XR_EYE_VISIBILITY_LEFT},
+            {"Behind", Pose::Translation({0, 0, 1}), {1.f, 1.f}, XR_EYE_VISIBILITY_BOTH},
+            {"Crossing", Pose::MakePose(makeOrientation(80, 0), XrVector3f{0.3f, 0, -0.2f}),
+             {2.f, 0.5f},
+             XR_EYE_VISIBILITY_BOTH},
+        };
+
+        const auto readPixel = [&](int32_t x, int32_t y) { return &destinationData[(y * width + x) * 4]; };
+        const auto isColor = [](const uint8_t* pixel, const uint8_t* color, uint8_t alpha) {
+            for (uint32_t c = 0; c < 3; c++) {
+                if (std::abs(pixel[c] - color[c]) > 1) {
+                    return false;
+                }
+            }
+            return pixel[3] == alpha;
+        };
+
+        // Project a point of the quad onto the destination image. The point must be in front of the eye.
+        const auto project = [&](const XrPosef& quadInView,
+                                 const XrFovf& fov,
+                                 const XrRect2Di& eyeRect,
+                                 const XrVector2f& point) {
+            const XrVector3f p = Pose::Multiply(Pose::Translation({point.x, point.y, 0}), quadInView).position;
+            const float depth = -p.z;
+            const float tanLeft = std::tan(fov.angleLeft);
+            const float tanUp = std::tan(fov.angleUp);
+            const float u = (p.x / depth - tanLeft) / (std::tan(fov.angleRight) - tanLeft);
+            const float v = (tanUp - p.y / depth) / (tanUp - std::tan(fov.angleDown));
+            const XrVector2f pixel{eyeRect.offset.x + u * eyeRect.extent.width,
+                                   eyeRect.offset.y + v * eyeRect.extent.height};
+            return std::make_pair(pixel, depth);
+        };
+
+        QuadFlatteningTestResult result{};
+        clock::duration rasterizationDuration{};
+        uint64_t rasterizedPixels = 0;
+        for (const TestCase& testCase : testCases) {
+            for (size_t i = 0; i < destinationData.size(); i += 4) {
+                memcpy(&destinationData[i], background, 4);
+            }
+
+            uint64_t pixelsWritten = 0;
+            uint64_t mismatches = 0;
+            for (uint32_t eye = 0; eye < 2; eye++) {
+                const XrPosef quadInView = Pose::Multiply(testCase.pose, Pose::Invert(eyePoses[eye]));
+                const bool isVisible = isVisibleInView(testCase.eyeVisibility, eye, 2);
+                if (isVisible) {
+                    const auto start = clock::now();
+                    pixelsWritten += rasterizeQuadReference(
+                        source, sourceRect, quadInView, testCase.size, fovs[eye], destination, eyeRects[eye]);
+                    rasterizationDuration += clock::now() - start;
+                    rasterizedPixels += static_cast<uint64_t>(eyeResolution) * height;
+                }
+
+                // Golden pixels at the center of each cell of a 4x4 grid over the quad, and around the quad.
+                for (int32_t j = -3; j <= 3; j += 2) {
+                    for (int32_t i = -3; i <= 3; i += 2) {
+                        const float fx = i / 8.f;
+                        const float fy = j / 8.f;
+                        const auto checkPoint = [&](float x, float y, const uint8_t* color, uint8_t alpha) {
+                            const auto [pixel, depth] = project(quadInView, fovs[eye], eyeRects[eye], {x, y});
+                            const XrOffset2Di& offset = eyeRects[eye].offset;
+                            const XrExtent2Di& extent = eyeRects[eye].extent;
+                            if (depth < 0.1f || pixel.x < offset.x || pixel.y < offset.y ||
+                                pixel.x >= offset.x + extent.width || pixel.y >= offset.y + extent.height) {
+                                return;
+                            }
+                            const uint8_t* const actual =
+                                readPixel(static_cast<int32_t>(pixel.x), static_cast<int32_t>(pixel.y));
+                            if (!isColor(actual, color, alpha)) {
+                                mismatches++;
+                            }
+                        };
+
+                        const uint32_t quadrant = (fy > 0 ? 0 : 2) + (fx < 0 ? 0 : 1);
+                        checkPoint(fx * testCase.size.width,
+                                   fy * testCase.size.height,
+                                   isVisible ? quadrantColors[quadrant] : background,
+                                   255);
+                        checkPoint(fx * 6 * testCase.size.width, fy * 6 * testCase.size.height, background, 255);
+                    }
+                }
+
+                // The triangle strip of the flattening pass covers the same pixels.
+                const std::array<XrVector4f, 4> corners = getClipSpaceCorners(quadInView, testCase.size, fovs[eye]);
+                const XrVector2f cornerPoints[4] = {{-testCase.size.width / 2, testCase.size.height / 2},
+                                                    {testCase.size.width / 2, testCase.size.height / 2},
+                                                    {-testCase.size.width / 2, -testCase.size.height / 2},
+                                                    {testCase.size.width / 2, -testCase.size.height / 2}};
+                if (std::all_of(corners.cbegin(), corners.cend(), [](const XrVector4f& c) { return c.z > 0; })) {
+                    for (uint32_t c = 0; c < 4; c++) {
+                        const XrVector2f expected =
+                            project(quadInView, fovs[eye], eyeRects[eye], cornerPoints[c]).first;
+                        const float x =
+                            eyeRects[eye].offset.x + (corners[c].x / corners[c].w + 1) / 2 * eyeRects[eye].extent.width;
+                        const float y = eyeRects[eye].offset.y +
+                                        (1 - corners[c].y / corners[c].w) / 2 * eyeRects[eye].extent.height;
+                        if (std::abs(x - expected.x) > 0.01f || std::abs(y - expected.y) > 0.01f) {
+                            mismatches++;
+                        }
+                    }
+                }
+            }
+
+            // Only the quad rectangle of the atlas may be sampled.
+            for (size_t i = 0; i < destinationData.size(); i += 4) {
+                if (destinationData[i] > 200 && destinationData[i + 1] < 50 && destinationData[i + 2] > 200) {
+                    mismatches++;
+                }
+            }
+
+            const bool expectEmpty = testCase.pose.position.z > 0;
+            const bool passed = !mismatches && (pixelsWritten == 0) == expectEmpty;
+
+            result.casesCount++;
+            result.failedCases += passed ? 0 : 1;
+            result.mismatchedPixels += mismatches;
+
+            Log(fmt::format("Quad flattening {}: {} pixels written, {} mismatches: {}\n",
+                            testCase.name,
+                            pixelsWritten,
+                            mismatches,
+                            passed ? "passed" : "FAILED"));
+        }
+
+        const double seconds = std::chrono::duration<double>(rasterizationDuration).count();
+        result.megapixelsPerSecond = seconds > 0 ? rasterizedPixels / 1e6 / seconds : 0;
+
+        Log(fmt::format("Quad flattening: {}/{} cases passed, {:.1f} Mpixels/s for the reference rasterization\n",
+                        result.casesCount - result.failedCases,
+                        result.casesCount,
+                        result.megapixelsPerSecond));
+
+        TraceLoggingWriteStop(local,
+                              "QuadFlatteningTest",
+                              TLArg(result.failedCases, "FailedCases"),
+                              TLArg(result.mismatchedPixels, "MismatchedPixels"),
+                              TLArg(result.megapixelsPerSecond, "MegapixelsPerSecond"));
+
+        return result;
+    }
+
+} // namespace openxr_api_layer::tests
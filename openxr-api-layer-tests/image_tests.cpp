@@ -0,0 +1,428 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The tests and the benchmarks use the format tables that are internal to the module.
+#include <utils/image.cpp>
+
+#include "stub_runtime.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::image;
+
+    // The SIMD kernels saturate to the largest finite value of the destination format instead of producing Inf, and
+    // might also saturate NaN or map it to 0. This is the smallest of these values, the largest 10-bit float.
+    constexpr float SaturatedMagnitude = 64512.f;
+
+    // Zeros, denormals (of each float format), the sRGB thresholds, values around 1, the limits of the float formats,
+    // negative values, Inf and NaN.
+    const float SpecialValues[] = {
+        0.f,
+        -0.f,
+        1e-40f,
+        6e-8f,
+        3e-5f,
+        1e-6f,
+        4e-7f,
+        0.0031308f,
+        0.04045f,
+        0.5f,
+        0.99999f,
+        1.f,
+        1.0001f,
+        1.5f,
+        255.f,
+        65024.f,
+        65504.f,
+        65519.f,
+        65520.f,
+        70000.f,
+        1e10f,
+        -0.25f,
+        -1.f,
+        -70000.f,
+        std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::quiet_NaN(),
+        -std::numeric_limits<float>::quiet_NaN(),
+    };
+
+    // A channel of an encoded pixel.
+    struct Channel {
+        // Monotonic in the value, with adjacent representable values 1 apart.
+        int64_t ordered;
+        float value;
+    };
+
+    // Decode an unsigned float with a 5-bit exponent (the magnitude of a 16-bit float, or an 11-bit or 10-bit float).
+    float decodeSmallFloat(uint32_t bits, int mantissaBits) {
+        const uint32_t exponent = bits >> mantissaBits;
+        const uint32_t mantissa = bits & ((1u << mantissaBits) - 1);
+        if (exponent == 31) {
+            return mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+        }
+        if (!exponent) {
+            return std::ldexp(static_cast<float>(mantissa), -14 - mantissaBits);
+        }
+        return std::ldexp(static_cast<float>((1u << mantissaBits) | mantissa),
+                          static_cast<int>(exponent) - 15 - mantissaBits);
+    }
+
+    // Returns the number of channels of the format. The 8-bit formats are compared in their encoding, including sRGB.
+    uint32_t getChannels(int format, const uint8_t* pixel, Channel* channels) {
+        switch (format) {
+        case RGBA16F:
+            for (uint32_t c = 0; c < 4; c++) {
+                uint16_t bits;
+                std::memcpy(&bits, pixel + c * 2, sizeof(bits));
+                const int64_t magnitude = bits & 0x7fff;
+                const float value = decodeSmallFloat(bits & 0x7fff, 10);
+                channels[c] = bits & 0x8000 ? Channel{-magnitude, -value} : Channel{magnitude, value};
+            }
+            return 4;
+
+        case R11G11B10F: {
+            const uint32_t packed = load32(pixel);
+            channels[0] = {packed & 0x7ff, decodeSmallFloat(packed & 0x7ff, 6)};
+            channels[1] = {(packed >> 11) & 0x7ff, decodeSmallFloat((packed >> 11) & 0x7ff, 6)};
+            channels[2] = {packed >> 22, decodeSmallFloat(packed >> 22, 5)};
+            return 3;
+        }
+
+        case RGBA32F:
+            for (uint32_t c = 0; c < 4; c++) {
+                uint32_t bits;
+                std::memcpy(&bits, pixel + c * 4, sizeof(bits));
+                float value;
+                std::memcpy(&value, &bits, sizeof(value));
+                const int64_t magnitude = bits & 0x7fffffff;
+                channels[c] = {bits & 0x80000000 ? -magnitude : magnitude, value};
+            }
+            return 4;
+
+        default:
+            for (uint32_t c = 0; c < 4; c++) {
+                channels[c] = {pixel[c], static_cast<float>(pixel[c])};
+            }
+            return 4;
+        }
+    }
+
+    bool isSaturated(float value) {
+        return std::isfinite(value) && std::abs(value) >= SaturatedMagnitude;
+    }
+
+    // The tolerance is 1 in the last place of the destination encoding. Where the reference is Inf or NaN, the value
+    // might also be saturated (see image.h).
+    bool isWithinTolerance(const Channel& reference, const Channel& channel) {
+        if (std::isnan(reference.value)) {
+            return std::isnan(channel.value) || channel.value == 0.f || isSaturated(channel.value);
+        }
+        if (std::isinf(reference.value)) {
+            return (std::isinf(channel.value) || isSaturated(channel.value)) &&
+                   std::signbit(channel.value) == std::signbit(reference.value);
+        }
+        return std::isfinite(channel.value) && std::abs(channel.ordered - reference.ordered) <= 1;
+    }
+
+    // Returns the number of channels out of tolerance. The first one is written to the log.
+    uint32_t compareToReference(int format,
+                                const std::vector<uint8_t>& reference,
+                                const std::vector<uint8_t>& result,
+                                const std::string& name) {
+        uint32_t mismatches = 0;
+        for (size_t offset = 0; offset < reference.size(); offset += FormatSizes[format]) {
+            Channel expected[4];
+            Channel actual[4];
+            const uint32_t channelCount = getChannels(format, &reference[offset], expected);
+            getChannels(format, &result[offset], actual);
+            for (uint32_t c = 0; c < channelCount; c++) {
+                if (!isWithinTolerance(expected[c], actual[c])) {
+                    if (!mismatches) {
+                        Log(fmt::format("{}: pixel {} channel {} is {} instead of {}\n",
+                                        name,
+                                        offset / FormatSizes[format],
+                                        c,
+                                        actual[c].value,
+                                        expected[c].value));
+                    }
+                    mismatches++;
+                }
+            }
+        }
+        return mismatches;
+    }
+
+} // namespace
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::image;
+
+    TestResult runImageKernelTests(uint32_t width) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local, "ImageKernelTests", TLArg(width, "Width"));
+
+        Checks checks("Image kernels");
+
+        constexpr uint32_t height = 2;
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+
+        // Every other pixel takes its channels from the special values (each of them ends up in each channel), the
+        // others are a ramp going slightly above 1.
+        std::vector<float> pixels(pixelCount * 4);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            const size_t pixel = i / 4;
+            const size_t channel = i % 4;
+            pixels[i] = pixel % 2 ? SpecialValues[(pixel / 2 + channel * 11) % std::size(SpecialValues)]
+                                  : 1.25f * pixel / pixelCount + 0.01f * channel;
+        }
+
+        // The blending operands are premultiplied colors, with an alpha within [0, 1]. The destination has no negative
+        // values, so that fused multiply-adds cannot cancel out.
+        const float blendColors[] = {0.f,
+                                     1e-40f,
+                                     3e-5f,
+                                     0.25f,
+                                     0.5f,
+                                     1.f,
+                                     1.5f,
+                                     16.f,
+                                     70000.f,
+                                     std::numeric_limits<float>::infinity(),
+                                     std::numeric_limits<float>::quiet_NaN()};
+        const float blendAlphas[] = {0.f, 1e-40f, 0.25f, 0.5f, 0.999f, 1.f};
+        std::vector<float> blendSourcePixels(pixelCount * 4);
+        std::vector<float> blendDestinationPixels(pixelCount * 4);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            const size_t pixel = i / 4;
+            const size_t channel = i % 4;
+            blendSourcePixels[i] = channel == 3 ? blendAlphas[pixel % std::size(blendAlphas)]
+                                                : blendColors[(pixel + channel * 3) % std::size(blendColors)];
+            blendDestinationPixels[i] = std::abs(pixels[i]);
+        }
+
+        const auto makeImage = [&](void* data, int format) {
+            return Image{static_cast<uint8_t*>(data),
+                         width * static_cast<size_t>(FormatSizes[format]),
+                         width,
+                         height,
+                         DxgiFormats[format]};
+        };
+
+        const Isa previousIsa = getIsa();
+
+        // The inputs are encoded in each format by the scalar reference, so that every instruction set reads the same
+        // bytes.
+        setIsa(Isa::Scalar);
+        const auto encode = [&](std::vector<float>& source, int format) {
+            std::vector<uint8_t> data(pixelCount * FormatSizes[format]);
+            blit(makeImage(source.data(), RGBA32F), makeImage(data.data(), format));
+            return data;
+        };
+        std::vector<uint8_t> sources[FormatCount];
+        std::vector<uint8_t> blendSources[FormatCount];
+        std::vector<uint8_t> blendDestinations[FormatCount];
+        for (int format = 0; format < FormatCount; format++) {
+            sources[format] = encode(pixels, format);
+            blendSources[format] = encode(blendSourcePixels, format);
+            blendDestinations[format] = encode(blendDestinationPixels, format);
+        }
+
+        // With the kernels of the current instruction set.
+        const auto convert = [&](int sourceFormat, int destinationFormat) {
+            std::vector<uint8_t> destination(pixelCount * FormatSizes[destinationFormat]);
+            blit(makeImage(sources[sourceFormat].data(), sourceFormat),
+                 makeImage(destination.data(), destinationFormat));
+            return destination;
+        };
+        const auto blend = [&](int format) {
+            std::vector<uint8_t> destination = blendDestinations[format];
+            blendPremultiplied(makeImage(blendSources[format].data(), format), makeImage(destination.data(), format));
+            return destination;
+        };
+
+        std::vector<uint8_t> conversionReferences[FormatCount][FormatCount];
+        std::vector<uint8_t> blendReferences[FormatCount];
+        for (int sourceFormat = 0; sourceFormat < FormatCount; sourceFormat++) {
+            for (int destinationFormat = 0; destinationFormat < FormatCount; destinationFormat++) {
+                conversionReferences[sourceFormat][destinationFormat] = convert(sourceFormat, destinationFormat);
+            }
+            blendReferences[sourceFormat] = blend(sourceFormat);
+        }
+
+        for (const Isa isa : {Isa::SSE4, Isa::AVX2, Isa::NEON}) {
+            if (!isIsaSupported(isa)) {
+                continue;
+            }
+            setIsa(isa);
+
+            for (int sourceFormat = 0; sourceFormat < FormatCount; sourceFormat++) {
+                for (int destinationFormat = 0; destinationFormat < FormatCount; destinationFormat++) {
+                    const std::string name = fmt::format("{} convert {} to {}",
+                                                         xr::ToString(isa),
+                                                         FormatNames[sourceFormat],
+                                                         FormatNames[destinationFormat]);
+                    checks.check(!compareToReference(destinationFormat,
+                                                     conversionReferences[sourceFormat][destinationFormat],
+                                                     convert(sourceFormat, destinationFormat),
+                                                     name),
+                                 name);
+                }
+
+                const std::string name = fmt::format("{} blend {}", xr::ToString(isa), FormatNames[sourceFormat]);
+                checks.check(
+                    !compareToReference(sourceFormat, blendReferences[sourceFormat], blend(sourceFormat), name), name);
+            }
+        }
+        setIsa(previousIsa);
+
+        const TestResult testResult = checks.getResult();
+
+        TraceLoggingWriteStop(local,
+                              "ImageKernelTests",
+                              TLArg(testResult.testCount, "TestCount"),
+                              TLArg(testResult.failureCount, "FailureCount"));
+
+        return testResult;
+    }
+
+    std::vector<ImageKernelBenchmarkResult>
+    runImageKernelBenchmarks(uint32_t width, uint32_t height, uint32_t iterations) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "Image_RunBenchmarks",
+                               TLArg(width, "Width"),
+                               TLArg(height, "Height"),
+                               TLArg(iterations, "Iterations"));
+
+        std::vector<ImageKernelBenchmarkResult> results;
+
+        // Large enough for any of the formats. The content is a gradient with varying alpha, so that no kernel hits a
+        // fast path (eg: fully opaque or transparent) or a slow path (eg: denormals).
+        const size_t rowPitch = width * 16ull;
+        std::vector<uint8_t> gradientData(rowPitch * height);
+        std::vector<uint8_t> sourceData(rowPitch * height);
+        std::vector<uint8_t> destinationData(rowPitch * height);
+        for (uint32_t y = 0; y < height; y++) {
+            float* const row = reinterpret_cast<float*>(gradientData.data() + y * rowPitch);
+            for (uint32_t x = 0; x < width; x++) {
+                const float alpha = 0.25f + 0.5f * y / height;
+                row[x * 4 + 0] = alpha * x / width;
+                row[x * 4 + 1] = alpha * y / height;
+                row[x * 4 + 2] = alpha * (x + y) / (width + height);
+                row[x * 4 + 3] = alpha;
+            }
+        }
+        const Image gradient{gradientData.data(), rowPitch, width, height, DXGI_FORMAT_R32G32B32A32_FLOAT};
+
+        const auto measure = [&](const char* kernel,
+                                 Isa isa,
+                                 int sourceFormat,
+                                 int destinationFormat,
+                                 uint64_t bytesPerIteration,
+                                 const std::function<void()>& body) {
+            // Warm up the caches and the page tables.
+            body();
+
+            const std::shared_ptr<general::ITimer> timer = general::createTimer();
+            timer->start();
+            for (uint32_t i = 0; i < iterations; i++) {
+                body();
+            }
+            timer->stop();
+
+            const uint64_t durationUs = std::max<uint64_t>(timer->query(), 1);
+            const double gigabytesPerSecond = static_cast<double>(bytesPerIteration) * iterations / durationUs / 1e3;
+            results.push_back(
+                {kernel, isa, DxgiFormats[sourceFormat], DxgiFormats[destinationFormat], gigabytesPerSecond});
+
+            TraceLoggingWriteTagged(local,
+                                    "Image_Benchmark",
+                                    TLArg(kernel, "Kernel"),
+                                    TLArg(xr::ToString(isa).c_str(), "Isa"),
+                                    TLArg(FormatNames[sourceFormat], "SourceFormat"),
+                                    TLArg(FormatNames[destinationFormat], "DestinationFormat"),
+                                    TLArg(gigabytesPerSecond, "GBps"));
+            Log(fmt::format("{:<8} {:<6} {:>10} -> {:<10} {:8.2f} GB/s\n",
+                            kernel,
+                            xr::ToString(isa),
+                            FormatNames[sourceFormat],
+                            FormatNames[destinationFormat],
+                            gigabytesPerSecond));
+        };
+
+        const Isa previousIsa = getIsa();
+        for (const Isa isa : {Isa::Scalar, Isa::SSE4, Isa::AVX2, Isa::NEON}) {
+            if (!isIsaSupported(isa)) {
+                continue;
+            }
+            setIsa(isa);
+
+            const uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+            for (int sourceFormat = 0; sourceFormat < FormatCount; sourceFormat++) {
+                const Image source{sourceData.data(), rowPitch, width, height, DxgiFormats[sourceFormat]};
+                blit(gradient, source);
+
+                for (int destinationFormat = 0; destinationFormat < FormatCount; destinationFormat++) {
+                    const Image destination{
+                        destinationData.data(), rowPitch, width, height, DxgiFormats[destinationFormat]};
+                    measure(sourceFormat == destinationFormat ? "blit" : "convert",
+                            isa,
+                            sourceFormat,
+                            destinationFormat,
+                            pixelCount * (FormatSizes[sourceFormat] + FormatSizes[destinationFormat]),
+                            [&] { blit(source, destination); });
+                }
+
+                const Image halfSize{
+                    destinationData.data(), rowPitch, width / 2, height / 2, DxgiFormats[sourceFormat]};
+                measure("scale",
+                        isa,
+                        sourceFormat,
+                        sourceFormat,
+                        (pixelCount + pixelCount / 4) * FormatSizes[sourceFormat],
+                        [&] { scale(source, halfSize, Filter::Bilinear); });
+
+                // Blending reads the destination as well.
+                const Image destination{destinationData.data(), rowPitch, width, height, DxgiFormats[sourceFormat]};
+                blit(gradient, destination);
+                measure("blend",
+                        isa,
+                        sourceFormat,
+                        sourceFormat,
+                        pixelCount * 3 * FormatSizes[sourceFormat],
+                        [&] { blendPremultiplied(source, destination); });
+            }
+        }
+        setIsa(previousIsa);
+
+        TraceLoggingWriteStop(local, "Image_RunBenchmarks", TLArg(results.size(), "Results"));
+
+        return results;
+    }
+
+} // namespace openxr_api_layer::tests
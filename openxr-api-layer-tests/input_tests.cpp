@@ -0,0 +1,495 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The benchmarks and the test exercise the caches and the eye gaze classifier that are internal to the module.
+#include <utils/input.cpp>
+
+#include "stub_runtime.h"
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::inputs;
+
+    ActionStateCacheBenchmarkResult runActionStateCacheBenchmark(uint32_t actionCount,
+                                                                 uint32_t queriesPerAction,
+                                                                 uint32_t syncCount,
+                                                                 double runtimeCallCostUs) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "ActionStateCacheBenchmark",
+                               TLArg(actionCount, "ActionCount"),
+                               TLArg(queriesPerAction, "QueriesPerAction"),
+                               TLArg(syncCount, "SyncCount"),
+                               TLArg(runtimeCallCostUs, "RuntimeCallCostUs"));
+
+        using clock = std::chrono::high_resolution_clock;
+
+        // The stub runtime busy-waits to simulate a call going through the layers. Each action toggles every few
+        // syncs, in order to exercise changedSinceLastSync and lastChangeTime.
+        uint32_t currentSync = 0;
+        uint64_t runtimeCalls = 0;
+        const auto stubRuntime = [&](const XrActionStateGetInfo& getInfo, XrActionStateBoolean& state) {
+            spendCallCost(runtimeCallCostUs);
+            runtimeCalls++;
+
+            const uint64_t phase = (uint64_t)getInfo.action + currentSync;
+            state.currentState = (phase / 4) % 2 ? XR_TRUE : XR_FALSE;
+            state.changedSinceLastSync = phase % 4 == 0 ? XR_TRUE : XR_FALSE;
+            state.lastChangeTime = (currentSync - phase % 4) * 1000;
+            state.isActive = XR_TRUE;
+            return XR_SUCCESS;
+        };
+
+        // Run the same queries with and without the cache. The checksums must match.
+        const auto run = [&](ActionStateCache* cache, uint64_t& checksum) {
+            const auto start = clock::now();
+            for (currentSync = 0; currentSync < syncCount; currentSync++) {
+                if (cache) {
+                    cache->invalidate();
+                }
+                for (uint32_t i = 0; i < queriesPerAction; i++) {
+                    for (uint32_t j = 0; j < actionCount; j++) {
+                        XrActionStateGetInfo getInfo{XR_TYPE_ACTION_STATE_GET_INFO};
+                        getInfo.action = (XrAction)(j + 1ull);
+                        XrActionStateBoolean state{XR_TYPE_ACTION_STATE_BOOLEAN};
+                        if (cache) {
+                            CHECK_XRCMD(cache->getActionState(getInfo, state, [&](XrActionStateBoolean& runtimeState) {
+                                return stubRuntime(getInfo, runtimeState);
+                            }));
+                        } else {
+                            CHECK_XRCMD(stubRuntime(getInfo, state));
+                        }
+                        checksum = checksum * 31 + state.currentState + 2 * state.changedSinceLastSync +
+                                   4 * state.lastChangeTime + 8 * state.isActive;
+                    }
+                }
+            }
+            return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        };
+
+        ActionStateCacheBenchmarkResult result{};
+        uint64_t uncachedChecksum = 0;
+        runtimeCalls = 0;
+        result.uncachedMilliseconds = run(nullptr, uncachedChecksum);
+        result.uncachedRuntimeCalls = runtimeCalls;
+
+        ActionStateCache cache;
+        uint64_t cachedChecksum = 0;
+        runtimeCalls = 0;
+        result.cachedMilliseconds = run(&cache, cachedChecksum);
+        result.cachedRuntimeCalls = runtimeCalls;
+        result.speedup = result.uncachedMilliseconds / result.cachedMilliseconds;
+
+        if (cachedChecksum != uncachedChecksum) {
+            throw std::runtime_error("Cached action states differ from the runtime");
+        }
+
+        Log(fmt::format("Action state cache: {} queries, {:.2f} ms uncached, {:.2f} ms cached ({:.1f}x), {} of {} "
+                        "runtime calls\n",
+                        uint64_t(syncCount) * queriesPerAction * actionCount,
+                        result.uncachedMilliseconds,
+                        result.cachedMilliseconds,
+                        result.speedup,
+                        result.cachedRuntimeCalls,
+                        result.uncachedRuntimeCalls));
+
+        TraceLoggingWriteStop(local,
+                              "ActionStateCacheBenchmark",
+                              TLArg(result.uncachedMilliseconds, "UncachedMilliseconds"),
+                              TLArg(result.cachedMilliseconds, "CachedMilliseconds"),
+                              TLArg(result.uncachedRuntimeCalls, "UncachedRuntimeCalls"),
+                              TLArg(result.cachedRuntimeCalls, "CachedRuntimeCalls"));
+
+        return result;
+    }
+
+    InteractionProfileTrackingBenchmarkResult runInteractionProfileTrackingBenchmark(uint32_t frameCount,
+                                                                                     uint32_t profileChangeCount,
+                                                                                     double frameRate) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "InteractionProfileTrackingBenchmark",
+                               TLArg(frameCount, "FrameCount"),
+                               TLArg(profileChangeCount, "ProfileChangeCount"),
+                               TLArg(frameRate, "FrameRate"));
+
+        // The stub runtime switches the interaction profile of one hand at regular intervals, and reports it with an
+        // event.
+        XrPath runtimeProfiles[Hands::Count]{};
+        uint64_t runtimeCalls = 0;
+        const auto getCurrentInteractionProfile = [&](uint32_t side, XrInteractionProfileState& state) {
+            runtimeCalls++;
+            state.interactionProfile = runtimeProfiles[side];
+            return XR_SUCCESS;
+        };
+        const auto pathToString = [&](XrPath path) { runtimeCalls++; };
+
+        const uint32_t changeInterval = std::max(frameCount / (profileChangeCount + 1), 1u);
+        const auto run = [&](InteractionProfileTracker* tracker) {
+            runtimeProfiles[Hands::Left] = runtimeProfiles[Hands::Right] = XR_NULL_PATH;
+            runtimeCalls = 0;
+            for (uint32_t frame = 0; frame < frameCount; frame++) {
+                if (frame % changeInterval == changeInterval - 1) {
+                    runtimeProfiles[frame % 2] = frame + 1;
+                    if (tracker) {
+                        tracker->invalidate();
+                    }
+                }
+
+                if (tracker) {
+                    const auto changed = tracker->update(false, getCurrentInteractionProfile);
+                    CHECK_XREXPECTED(changed);
+                    for (uint32_t side = 0; side < Hands::Count; side++) {
+                        if (tracker->getInteractionProfile(side) != runtimeProfiles[side]) {
+                            throw std::runtime_error("Tracked interaction profile differs from the runtime");
+                        }
+                        if (*changed) {
+                            pathToString(tracker->getInteractionProfile(side));
+                        }
+                    }
+                } else {
+                    for (uint32_t side = 0; side < Hands::Count; side++) {
+                        XrInteractionProfileState state{XR_TYPE_INTERACTION_PROFILE_STATE};
+                        CHECK_XRCMD(getCurrentInteractionProfile(side, state));
+                        pathToString(state.interactionProfile);
+                    }
+                }
+            }
+            return runtimeCalls;
+        };
+
+        InteractionProfileTrackingBenchmarkResult result{};
+        result.pollingRuntimeCalls = run(nullptr);
+        InteractionProfileTracker tracker;
+        result.trackingRuntimeCalls = run(&tracker);
+        const double minutes = frameCount / frameRate / 60.0;
+        result.savedRuntimeCallsPerMinute = (result.pollingRuntimeCalls - result.trackingRuntimeCalls) / minutes;
+
+        Log(fmt::format("Interaction profile tracking: {} frames, {} runtime calls polling, {} tracking ({:.0f} saved "
+                        "per minute)\n",
+                        frameCount,
+                        result.pollingRuntimeCalls,
+                        result.trackingRuntimeCalls,
+                        result.savedRuntimeCallsPerMinute));
+
+        TraceLoggingWriteStop(local,
+                              "InteractionProfileTrackingBenchmark",
+                              TLArg(result.pollingRuntimeCalls, "PollingRuntimeCalls"),
+                              TLArg(result.trackingRuntimeCalls, "TrackingRuntimeCalls"),
+                              TLArg(result.savedRuntimeCallsPerMinute, "SavedRuntimeCallsPerMinute"));
+
+        return result;
+    }
+
+    InputSourceCacheBenchmarkResult runInputSourceCacheBenchmark(uint32_t actionCount,
+                                                                 uint32_t frameCount,
+                                                                 uint32_t profileChangeCount,
+                                                                 double runtimeCallCostUs) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "InputSourceCacheBenchmark",
+                               TLArg(actionCount, "ActionCount"),
+                               TLArg(frameCount, "FrameCount"),
+                               TLArg(profileChangeCount, "ProfileChangeCount"),
+                               TLArg(runtimeCallCostUs, "RuntimeCallCostUs"));
+
+        using clock = std::chrono::high_resolution_clock;
+
+        // The stub runtime busy-waits to simulate a slow lookup. Each action is bound to 1 to 3 sources, which depend
+        // on the current interaction profile.
+        uint32_t currentProfile = 0;
+        uint64_t runtimeCalls = 0;
+        const auto simulateCall = [&]() {
+            spendCallCost(runtimeCallCostUs);
+            runtimeCalls++;
+        };
+        const auto enumerateBoundSources =
+            [&](uint32_t action, uint32_t capacityInput, uint32_t* countOutput, XrPath* sources) {
+                simulateCall();
+                *countOutput = action % 3 + 1;
+                if (capacityInput && capacityInput < *countOutput) {
+                    return XR_ERROR_SIZE_INSUFFICIENT;
+                }
+                for (uint32_t i = 0; i < capacityInput && i < *countOutput; i++) {
+                    sources[i] = (uint64_t(currentProfile) << 32) | (uint64_t(action) << 8) | i;
+                }
+                return XR_SUCCESS;
+            };
+        const auto getLocalizedName =
+            [&](XrPath sourcePath, uint32_t capacityInput, uint32_t* countOutput, char* buffer) {
+                simulateCall();
+                const std::string name = fmt::format("Profile {} source {}", sourcePath >> 32, sourcePath & 0xffffffff);
+                *countOutput = static_cast<uint32_t>(name.size() + 1);
+                if (capacityInput && capacityInput < *countOutput) {
+                    return XR_ERROR_SIZE_INSUFFICIENT;
+                }
+                if (capacityInput) {
+                    std::memcpy(buffer, name.c_str(), *countOutput);
+                }
+                return XR_SUCCESS;
+            };
+
+        // Run the same queries with and without the cache, the way a UI showing button prompts would. The checksums
+        // must match.
+        const uint32_t changeInterval = std::max(frameCount / (profileChangeCount + 1), 1u);
+        const auto run = [&](InputSourceCache* cache, uint64_t& checksum) {
+            const auto start = clock::now();
+            currentProfile = 0;
+            for (uint32_t frame = 0; frame < frameCount; frame++) {
+                if (frame % changeInterval == changeInterval - 1) {
+                    currentProfile++;
+                    if (cache) {
+                        cache->invalidate();
+                    }
+                }
+
+                for (uint32_t action = 0; action < actionCount; action++) {
+                    const auto enumerate = [&](uint32_t capacityInput, uint32_t* countOutput, XrPath* sources) {
+                        return enumerateBoundSources(action, capacityInput, countOutput, sources);
+                    };
+                    const XrAction actionHandle = (XrAction)(action + 1ull);
+                    XrPath sources[4];
+                    uint32_t sourceCount;
+                    if (cache) {
+                        CHECK_XRCMD(cache->enumerateBoundSources(actionHandle, 0, &sourceCount, nullptr, enumerate));
+                        CHECK_XRCMD(
+                            cache->enumerateBoundSources(actionHandle, sourceCount, &sourceCount, sources, enumerate));
+                    } else {
+                        CHECK_XRCMD(enumerate(0, &sourceCount, nullptr));
+                        CHECK_XRCMD(enumerate(sourceCount, &sourceCount, sources));
+                    }
+
+                    for (uint32_t i = 0; i < sourceCount; i++) {
+                        const auto getName = [&](uint32_t capacityInput, uint32_t* countOutput, char* buffer) {
+                            return getLocalizedName(sources[i], capacityInput, countOutput, buffer);
+                        };
+                        char name[XR_MAX_PATH_LENGTH];
+                        uint32_t nameLength;
+                        const XrInputSourceLocalizedNameFlags whichComponents =
+                            XR_INPUT_SOURCE_LOCALIZED_NAME_COMPONENT_BIT;
+                        if (cache) {
+                            CHECK_XRCMD(cache->getLocalizedName(
+                                sources[i], whichComponents, 0, &nameLength, nullptr, getName));
+                            CHECK_XRCMD(cache->getLocalizedName(
+                                sources[i], whichComponents, nameLength, &nameLength, name, getName));
+                        } else {
+                            CHECK_XRCMD(getName(0, &nameLength, nullptr));
+                            CHECK_XRCMD(getName(nameLength, &nameLength, name));
+                        }
+
+                        checksum = checksum * 31 + sources[i];
+                        for (uint32_t j = 0; j < nameLength; j++) {
+                            checksum = checksum * 31 + name[j];
+                        }
+                    }
+                }
+            }
+            return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        };
+
+        InputSourceCacheBenchmarkResult result{};
+        uint64_t uncachedChecksum = 0;
+        runtimeCalls = 0;
+        result.uncachedMilliseconds = run(nullptr, uncachedChecksum);
+        result.uncachedRuntimeCalls = runtimeCalls;
+
+        InputSourceCache cache;
+        uint64_t cachedChecksum = 0;
+        runtimeCalls = 0;
+        result.cachedMilliseconds = run(&cache, cachedChecksum);
+        result.cachedRuntimeCalls = runtimeCalls;
+        result.speedup = result.uncachedMilliseconds / result.cachedMilliseconds;
+
+        if (cachedChecksum != uncachedChecksum) {
+            throw std::runtime_error("Cached input sources differ from the runtime");
+        }
+
+        Log(fmt::format("Input source cache: {} frames, {:.2f} ms uncached, {:.2f} ms cached ({:.1f}x), {} of {} "
+                        "runtime calls\n",
+                        frameCount,
+                        result.uncachedMilliseconds,
+                        result.cachedMilliseconds,
+                        result.speedup,
+                        result.cachedRuntimeCalls,
+                        result.uncachedRuntimeCalls));
+
+        TraceLoggingWriteStop(local,
+                              "InputSourceCacheBenchmark",
+                              TLArg(result.uncachedMilliseconds, "UncachedMilliseconds"),
+                              TLArg(result.cachedMilliseconds, "CachedMilliseconds"),
+                              TLArg(result.uncachedRuntimeCalls, "UncachedRuntimeCalls"),
+                              TLArg(result.cachedRuntimeCalls, "CachedRuntimeCalls"));
+
+        return result;
+    }
+
+    EyeGazeClassifierTestResult runEyeGazeClassifierTest(uint32_t fixationCount, float noiseDegrees) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "EyeGazeClassifierTest",
+                               TLArg(fixationCount, "FixationCount"),
+                               TLArg(noiseDegrees, "NoiseDegrees"));
+
+        const EyeGazeFilterSettings settings;
+        constexpr XrDuration FramePeriod = 11'111'111;
+        constexpr float DegreesToRadians = 1.f / RadiansToDegrees;
+        const auto getDirection = [](float yaw, float pitch) {
+            return XrVector3f{std::sin(yaw) * std::cos(pitch), std::sin(pitch), -std::cos(yaw) * std::cos(pitch)};
+        };
+
+        // Synthesize the trace, along with its ground truth.
+        struct Sample {
+            XrTime time;
+            XrVector3f direction;
+            XrVector3f target;
+            EyeMovement truth;
+            bool isTracked;
+            bool isCounted;
+        };
+        std::vector<Sample> trace;
+        {
+            std::mt19937 random(1234);
+            std::uniform_real_distribution<float> targetDistribution(-20.f, 20.f);
+            std::uniform_int_distribution<XrDuration> fixationDurationDistribution(200'000'000, 500'000'000);
+            std::normal_distribution<float> noiseDistribution(0.f, noiseDegrees);
+
+            XrTime time = 1'000'000'000;
+            float yaw = 0.f;
+            float pitch = 0.f;
+            for (uint32_t i = 0; i < fixationCount; i++) {
+                const XrVector3f target = getDirection(yaw * DegreesToRadians, pitch * DegreesToRadians);
+                const XrDuration fixationDuration = fixationDurationDistribution(random);
+                const bool hasBlink = i % 10 == 9;
+                for (XrDuration elapsed = 0; elapsed < fixationDuration; elapsed += FramePeriod) {
+                    Sample sample{time, {}, target, EyeMovement::Fixation, true, false};
+                    sample.direction = getDirection((yaw + noiseDistribution(random)) * DegreesToRadians,
+                                                    (pitch + noiseDistribution(random)) * DegreesToRadians);
+                    sample.isTracked = !hasBlink || elapsed < fixationDuration / 2 ||
+                                       elapsed >= fixationDuration / 2 + 3 * FramePeriod;
+                    sample.isCounted = sample.isTracked && elapsed >= settings.minFixationDuration && !hasBlink;
+                    trace.push_back(sample);
+                    time += FramePeriod;
+                }
+
+                // Saccades of at least 3 degrees, lasting 21 ms + 2.2 ms per degree.
+                float nextYaw, nextPitch, amplitude;
+                do {
+                    nextYaw = targetDistribution(random);
+                    nextPitch = targetDistribution(random);
+                    amplitude = std::hypot(nextYaw - yaw, nextPitch - pitch);
+                } while (amplitude < 3.f);
+                const XrDuration saccadeDuration = static_cast<XrDuration>((21.f + 2.2f * amplitude) * 1e6f);
+                for (XrDuration elapsed = 0; elapsed < saccadeDuration; elapsed += FramePeriod) {
+                    const float progress =
+                        (1.f - std::cos(static_cast<float>(M_PI) * elapsed / saccadeDuration)) / 2.f;
+                    Sample sample{time, {}, target, EyeMovement::Saccade, true, true};
+                    sample.direction = getDirection((yaw + progress * (nextYaw - yaw)) * DegreesToRadians,
+                                                    (pitch + progress * (nextPitch - pitch)) * DegreesToRadians);
+                    trace.push_back(sample);
+                    time += FramePeriod;
+                }
+                yaw = nextYaw;
+                pitch = nextPitch;
+            }
+        }
+
+        // The stub runtime reports the samples of the trace like xrLocateSpace() on the eye gaze action space.
+        const auto locate = [&](const Sample& sample, XrSpaceLocation& location, XrEyeGazeSampleTimeEXT& sampleTime) {
+            location.locationFlags =
+                sample.isTracked ? XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT |
+                                       XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_POSITION_TRACKED_BIT
+                                 : 0;
+            location.pose = Pose::MakePose(EyeGazeClassifier::getOrientation(sample.direction), XrVector3f{0, 0, 0});
+            sampleTime.time = sample.time;
+        };
+
+        std::vector<EyeMovement> movements(trace.size());
+        std::vector<XrVector3f> filteredDirections(trace.size());
+        EyeGazeClassifier classifier;
+        classifier.setSettings(settings);
+
+        using clock = std::chrono::high_resolution_clock;
+        const auto start = clock::now();
+        for (size_t i = 0; i < trace.size(); i++) {
+            XrEyeGazeSampleTimeEXT sampleTime{XR_TYPE_EYE_GAZE_SAMPLE_TIME_EXT};
+            XrSpaceLocation location{XR_TYPE_SPACE_LOCATION, &sampleTime};
+            locate(trace[i], location, sampleTime);
+            if (classifier.addLocation(location, sampleTime.time)) {
+                movements[i] = classifier.getMovement();
+                filteredDirections[i] = classifier.getFilteredDirection();
+            } else {
+                movements[i] = EyeMovement::Undetermined;
+            }
+        }
+        const auto duration = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        EyeGazeClassifierTestResult result{};
+        result.sampleCount = trace.size();
+        result.nanosecondsPerSample = duration / trace.size();
+
+        const auto getAngle = [](const XrVector3f& a, const XrVector3f& b) {
+            return std::acos(std::clamp(Dot(a, b), -1.f, 1.f)) * RadiansToDegrees;
+        };
+        uint64_t fixationCountedSamples = 0, fixationMatches = 0, saccadeCountedSamples = 0, saccadeMatches = 0;
+        for (size_t i = 0; i < trace.size(); i++) {
+            const Sample& sample = trace[i];
+            if (!sample.isCounted) {
+                continue;
+            }
+            if (sample.truth == EyeMovement::Fixation) {
+                fixationCountedSamples++;
+                fixationMatches += movements[i] == EyeMovement::Fixation ? 1 : 0;
+                result.fixationErrorDegrees += getAngle(filteredDirections[i], sample.target);
+                result.rawFixationErrorDegrees += getAngle(sample.direction, sample.target);
+            } else {
+                saccadeCountedSamples++;
+                saccadeMatches += movements[i] == EyeMovement::Saccade ? 1 : 0;
+            }
+        }
+        result.fixationAccuracy = fixationCountedSamples ? (double)fixationMatches / fixationCountedSamples : 0;
+        result.saccadeAccuracy = saccadeCountedSamples ? (double)saccadeMatches / saccadeCountedSamples : 0;
+        result.fixationErrorDegrees /= std::max(fixationCountedSamples, uint64_t{1});
+        result.rawFixationErrorDegrees /= std::max(fixationCountedSamples, uint64_t{1});
+
+        Log(fmt::format("Eye gaze classifier: {} samples, {:.1f}% fixations and {:.1f}% saccades detected, {:.3f} deg "
+                        "fixation error ({:.3f} deg raw), {:.0f} ns/sample\n",
+                        result.sampleCount,
+                        result.fixationAccuracy * 100,
+                        result.saccadeAccuracy * 100,
+                        result.fixationErrorDegrees,
+                        result.rawFixationErrorDegrees,
+                        result.nanosecondsPerSample));
+
+        TraceLoggingWriteStop(local,
+                              "EyeGazeClassifierTest",
+                              TLArg(result.fixationAccuracy, "FixationAccuracy"),
+                              TLArg(result.saccadeAccuracy, "SaccadeAccuracy"),
+                              TLArg(result.fixationErrorDegrees, "FixationErrorDegrees"),
+                              TLArg(result.rawFixationErrorDegrees, "RawFixationErrorDegrees"));
+
+        return result;
+    }
+
+} // namespace openxr_api_layer::tests
@@ -0,0 +1,138 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The benchmark exercises the locate cache that is internal to the module.
+#include <utils/locate.cpp>
+
+#include "stub_runtime.h"
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+
+    LocateCacheBenchmarkResult runLocateCacheBenchmark(uint32_t spaceCount,
+                                                       uint32_t locatesPerSpace,
+                                                       uint32_t viewLocatesPerFrame,
+                                                       uint32_t frameCount,
+                                                       double locateCostUs) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "LocateCacheBenchmark",
+                               TLArg(spaceCount, "SpaceCount"),
+                               TLArg(locatesPerSpace, "LocatesPerSpace"),
+                               TLArg(viewLocatesPerFrame, "ViewLocatesPerFrame"),
+                               TLArg(frameCount, "FrameCount"),
+                               TLArg(locateCostUs, "LocateCostUs"));
+
+        // The stub runtime derives the poses from the handles and the time, so that results can be compared.
+        stub::setLocateCost(locateCostUs);
+        const auto stubLocateSpace = stub::getFunction<PFN_xrLocateSpace>("xrLocateSpace");
+        const auto stubLocateViews = stub::getFunction<PFN_xrLocateViews>("xrLocateViews");
+
+        const auto run = [&](LocateCache* cache, double& checksum) {
+            const auto start = Clock::now();
+            for (uint32_t frame = 0; frame < frameCount; frame++) {
+                const XrTime time = 1000 + frame;
+                if (cache) {
+                    cache->clear();
+                }
+
+                for (uint32_t i = 0; i < viewLocatesPerFrame; i++) {
+                    XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
+                    viewLocateInfo.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+                    viewLocateInfo.displayTime = time;
+                    viewLocateInfo.space = (XrSpace)1ull;
+                    XrViewState viewState{XR_TYPE_VIEW_STATE};
+                    XrView views[2]{{XR_TYPE_VIEW}, {XR_TYPE_VIEW}};
+                    uint32_t viewCount = 0;
+                    if (cache) {
+                        CHECK_XRCMD(cache->locateViews(viewLocateInfo, viewState, 2, &viewCount, views, [&]() {
+                            return stubLocateViews(XR_NULL_HANDLE, &viewLocateInfo, &viewState, 2, &viewCount, views);
+                        }));
+                    } else {
+                        CHECK_XRCMD(stubLocateViews(XR_NULL_HANDLE, &viewLocateInfo, &viewState, 2, &viewCount, views));
+                    }
+                    checksum += views[0].pose.position.x + views[1].pose.position.y + viewCount;
+                }
+
+                for (uint32_t i = 0; i < locatesPerSpace; i++) {
+                    for (uint32_t j = 0; j < spaceCount; j++) {
+                        const XrSpace space = (XrSpace)(j + 2ull);
+                        XrSpaceLocation location{XR_TYPE_SPACE_LOCATION};
+                        if (cache) {
+                            CHECK_XRCMD(cache->locateSpace(
+                                space, (XrSpace)1ull, time, location, [&](XrSpaceLocation& runtimeLocation) {
+                                    return stubLocateSpace(space, (XrSpace)1ull, time, &runtimeLocation);
+                                }));
+                        } else {
+                            CHECK_XRCMD(stubLocateSpace(space, (XrSpace)1ull, time, &location));
+                        }
+                        checksum += location.pose.position.x + location.pose.position.y;
+                    }
+                }
+            }
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        };
+
+        LocateCacheBenchmarkResult result{};
+        double uncachedChecksum = 0;
+        stub::resetLocateSpaceCount();
+        result.uncachedMilliseconds = run(nullptr, uncachedChecksum);
+        result.uncachedLocateSpaceCalls = stub::getLocateSpaceCount();
+
+        LocateCache cache;
+        double cachedChecksum = 0;
+        stub::resetLocateSpaceCount();
+        result.cachedMilliseconds = run(&cache, cachedChecksum);
+        result.cachedLocateSpaceCalls = stub::getLocateSpaceCount();
+        result.statistics = cache.getStatistics();
+        stub::setLocateCost(0);
+
+        if (cachedChecksum != uncachedChecksum) {
+            throw std::runtime_error("Cached locations differ from the runtime");
+        }
+
+        const uint64_t lookups = result.statistics.hitCount + result.statistics.missCount;
+        Log(fmt::format("Locate cache: {:.1f}% hit rate, {} of {} xrLocateSpace() calls, {:.2f} ms uncached, {:.2f} ms "
+                        "cached, {:.2f} ms saved\n",
+                        lookups ? 100.0 * result.statistics.hitCount / lookups : 0.0,
+                        result.cachedLocateSpaceCalls,
+                        result.uncachedLocateSpaceCalls,
+                        result.uncachedMilliseconds,
+                        result.cachedMilliseconds,
+                        result.statistics.timeSavedUs / 1000));
+
+        TraceLoggingWriteStop(local,
+                              "LocateCacheBenchmark",
+                              TLArg(result.uncachedMilliseconds, "UncachedMilliseconds"),
+                              TLArg(result.cachedMilliseconds, "CachedMilliseconds"),
+                              TLArg(result.statistics.hitCount, "HitCount"),
+                              TLArg(result.statistics.missCount, "MissCount"),
+                              TLArg(result.uncachedLocateSpaceCalls, "UncachedLocateSpaceCalls"),
+                              TLArg(result.cachedLocateSpaceCalls, "CachedLocateSpaceCalls"));
+
+        return result;
+    }
+
+} // namespace openxr_api_layer::tests
@@ -0,0 +1,142 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+#include "tests.h"
+#include "log.h"
+
+namespace openxr_api_layer::log {
+    extern std::ofstream logStream;
+} // namespace openxr_api_layer::log
+
+namespace {
+
+    using namespace openxr_api_layer;
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::tests;
+
+    // Runs the tests and the benchmarks in order. A benchmark passes when the optimization it measures pays off. The
+    // details are written to the log.
+    class Runner {
+      public:
+        void run(const char* name, const std::function<bool()>& test) {
+            bool passed = false;
+            try {
+                passed = test();
+            } catch (std::exception& exc) {
+                ErrorLog(fmt::format("{} threw: {}\n", name, exc.what()));
+            }
+
+            std::cout << fmt::format("{:<32} {}\n", name, passed ? "passed" : "FAILED");
+            if (!passed) {
+                m_failureCount++;
+            }
+        }
+
+        uint32_t getFailureCount() const {
+            return m_failureCount;
+        }
+
+      private:
+        uint32_t m_failureCount{0};
+    };
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::string logFile = LAYER_NAME "-tests.log";
+    logStream.open(logFile);
+
+    Runner runner;
+
+    // Tests.
+    runner.run("Clock service", [] {
+        bool passed = true;
+        for (const double driftPpm : {0.0, 50.0, -200.0}) {
+            if (runClockServiceTest(600, driftPpm).boundViolations) {
+                passed = false;
+            }
+        }
+        return passed;
+    });
+    runner.run("Thread scheduling", [] {
+        const SchedulingTestResult result = runSchedulingTest();
+        return result.detectionFrames && result.isIsolated && result.isReleased && result.isPriorityRestored &&
+               result.migrations == result.expectedMigrations &&
+               result.contextSwitches == result.expectedContextSwitches;
+    });
+    runner.run("Prediction error", [] {
+        const PredictionErrorTestResult result = runPredictionErrorTest();
+        const auto isClose = [](double measured, double expected) {
+            return std::abs(measured - expected) <= expected * 0.02;
+        };
+        return result.sampleCount && isClose(result.measuredP50Degrees, result.expectedP50Degrees) &&
+               isClose(result.measuredP99Degrees, result.expectedP99Degrees);
+    });
+    runner.run("Spaces locator", [] { return !runSpacesLocatorTests().failureCount; });
+    runner.run("Visibility mask", [] { return !runVisibilityMaskTests().failureCount; });
+    runner.run("Eye gaze classifier", [] {
+        const EyeGazeClassifierTestResult result = runEyeGazeClassifierTest();
+        return result.fixationAccuracy >= 0.95 && result.saccadeAccuracy >= 0.8 &&
+               result.fixationErrorDegrees < result.rawFixationErrorDegrees;
+    });
+    runner.run("Quad flattening", [] {
+        const QuadFlatteningTestResult result = runQuadFlatteningTest();
+        return result.casesCount && !result.failedCases;
+    });
+    runner.run("Image kernels", [] { return !runImageKernelTests().failureCount; });
+
+    // Benchmarks.
+    runner.run("Locate cache", [] {
+        const LocateCacheBenchmarkResult result = runLocateCacheBenchmark();
+        return result.statistics.hitCount > 0 && result.cachedLocateSpaceCalls < result.uncachedLocateSpaceCalls;
+    });
+    runner.run("Action state cache", [] {
+        const ActionStateCacheBenchmarkResult result = runActionStateCacheBenchmark();
+        return result.cachedRuntimeCalls < result.uncachedRuntimeCalls;
+    });
+    runner.run("Interaction profile tracking", [] {
+        const InteractionProfileTrackingBenchmarkResult result = runInteractionProfileTrackingBenchmark();
+        return result.trackingRuntimeCalls < result.pollingRuntimeCalls;
+    });
+    runner.run("Input source cache", [] {
+        const InputSourceCacheBenchmarkResult result = runInputSourceCacheBenchmark();
+        return result.cachedRuntimeCalls < result.uncachedRuntimeCalls;
+    });
+    runner.run("Error path", [] {
+        const ErrorPathBenchmarkResult result = runErrorPathBenchmark();
+        return result.exceptionFailures == result.iterations && result.expectedFailures == result.iterations &&
+               result.runtimeCalls == 2ull * result.iterations;
+    });
+    runner.run("CPU device scaling", [] {
+        const std::vector<CpuDeviceScalingResult> results = runCpuDeviceScalingBenchmark();
+        return !results.empty() && std::all_of(results.cbegin(), results.cend(), [](const auto& result) {
+            return result.matchesSingleThreaded;
+        });
+    });
+    runner.run("Image kernel throughput", [] { return !runImageKernelBenchmarks().empty(); });
+
+    std::cout << fmt::format("{} failure(s), see {} for the details\n", runner.getFailureCount(), logFile);
+
+    return runner.getFailureCount() ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The test exercises the prediction error sampler that is internal to the module.
+#include <utils/prediction.cpp>
+
+#include "tests.h"
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::tracking;
+
+    PredictionErrorTestResult runPredictionErrorTest(uint32_t frameCount, const PredictionErrorSettings& settings) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local,
+                               "PredictionErrorTest",
+                               TLArg(frameCount, "FrameCount"),
+                               TLArg(settings.samplingPeriod, "SamplingPeriod"),
+                               TLArg(settings.relocateDelay, "RelocateDelay"));
+
+        constexpr XrDuration FramePeriod = 11'111'111;
+        constexpr XrDuration PredictionHorizon = 2 * FramePeriod;
+
+        // The head turns with a 30 degrees amplitude every 2 seconds.
+        const auto getYaw = [](XrTime time) {
+            return 30.0 * std::sin(2 * M_PI * 0.5 * time / 1e9);
+        };
+        const auto getYawVelocity = [](XrTime time) {
+            return 30.0 * 2 * M_PI * 0.5 * std::cos(2 * M_PI * 0.5 * time / 1e9);
+        };
+
+        // The stub runtime extrapolates the future poses from the current one with a constant velocity, and reports
+        // the actual past poses.
+        XrTime now = 0;
+        const auto getPredictedYaw = [&](XrTime time) {
+            return time > now ? getYaw(now) + getYawVelocity(now) * (time - now) / 1e9 : getYaw(time);
+        };
+        const auto stubLocate = [&](uint32_t device, XrTime time, XrSpaceLocation& location) {
+            if (device != View) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+
+            const float halfYaw = static_cast<float>(getPredictedYaw(time) / RadiansToDegrees / 2);
+            location.locationFlags = XR_SPACE_LOCATION_ORIENTATION_VALID_BIT |
+                                     XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT | XR_SPACE_LOCATION_POSITION_VALID_BIT |
+                                     XR_SPACE_LOCATION_POSITION_TRACKED_BIT;
+            location.pose = Pose::MakePose(XrQuaternionf{0, std::sin(halfYaw), 0, std::cos(halfYaw)},
+                                           XrVector3f{0, 1.6f, 0});
+            return XR_SUCCESS;
+        };
+
+        PredictionErrorSampler sampler;
+        sampler.setSettings(settings);
+        openxr_api_layer::statistics::HdrHistogram measured;
+        openxr_api_layer::statistics::HdrHistogram expected;
+        const uint32_t samplingPeriod = std::max(settings.samplingPeriod, 1u);
+        const uint32_t relocateDelay =
+            std::clamp(settings.relocateDelay, 1u, PredictionErrorSettings::MaxRelocateDelay);
+        for (uint32_t frame = 0; frame < frameCount; frame++) {
+            now = 1'000'000'000 + frame * FramePeriod;
+            const XrTime predictedDisplayTime = now + PredictionHorizon;
+
+            // The errors of the last samples are never measured.
+            if (frame % samplingPeriod == 0 && frame + relocateDelay < frameCount) {
+                expected.record(
+                    std::llround(std::abs(getPredictedYaw(predictedDisplayTime) - getYaw(predictedDisplayTime)) * 1e6));
+            }
+            sampler.onWaitFrame(
+                predictedDisplayTime, stubLocate, [&](uint32_t device, int64_t angularError, int64_t positionalError) {
+                    if (angularError >= 0) {
+                        measured.record(angularError);
+                    }
+                });
+        }
+
+        PredictionErrorTestResult result{};
+        result.sampleCount = measured.getCount();
+        result.measuredP50Degrees = measured.getValueAtPercentile(50) / 1e6;
+        result.measuredP99Degrees = measured.getValueAtPercentile(99) / 1e6;
+        result.expectedP50Degrees = expected.getValueAtPercentile(50) / 1e6;
+        result.expectedP99Degrees = expected.getValueAtPercentile(99) / 1e6;
+
+        Log(fmt::format("Prediction error: {} samples, p50 {:.3f} deg (expected {:.3f}), p99 {:.3f} deg (expected "
+                        "{:.3f})\n",
+                        result.sampleCount,
+                        result.measuredP50Degrees,
+                        result.expectedP50Degrees,
+                        result.measuredP99Degrees,
+                        result.expectedP99Degrees));
+
+        TraceLoggingWriteStop(local,
+                              "PredictionErrorTest",
+                              TLArg(result.sampleCount, "SampleCount"),
+                              TLArg(result.measuredP50Degrees, "MeasuredP50Degrees"),
+                              TLArg(result.expectedP50Degrees, "ExpectedP50Degrees"));
+
+        return result;
+    }
+
+} // namespace openxr_api_layer::tests
@@ -0,0 +1,113 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+#include "tests.h"
+#include "log.h"
+
+namespace {
+
+    uint64_t g_runtimeCallCount = 0;
+
+    // A runtime call failing with a common non-fatal error. Called through a volatile pointer so that the compiler
+    // cannot see through it.
+    XrResult failingRuntimeCall(uint32_t* value) {
+        g_runtimeCallCount++;
+        *value = 0;
+        return XR_ERROR_SESSION_LOST;
+    }
+    XrResult (*volatile g_runtimeCall)(uint32_t*) = failingRuntimeCall;
+
+    uint32_t throwingFrameCall() {
+        uint32_t value;
+        CHECK_XRCMD(g_runtimeCall(&value));
+        return value;
+    }
+
+    openxr_api_layer::XrExpected<uint32_t> expectedFrameCall() {
+        uint32_t value;
+        RETURN_IF_XR_FAILED(g_runtimeCall(&value));
+        return value;
+    }
+
+} // namespace
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+
+    ErrorPathBenchmarkResult runErrorPathBenchmark(uint32_t iterations) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local, "ErrorPathBenchmark", TLArg(iterations, "Iterations"));
+
+        using clock = std::chrono::high_resolution_clock;
+
+        g_runtimeCallCount = 0;
+        uint32_t exceptionFailures = 0;
+        auto start = clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            try {
+                throwingFrameCall();
+            } catch (std::exception&) {
+                exceptionFailures++;
+            }
+        }
+        const double exceptionDuration = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        uint32_t expectedFailures = 0;
+        start = clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            const XrExpected<uint32_t> value = expectedFrameCall();
+            if (!value && value.result() == XR_ERROR_SESSION_LOST) {
+                expectedFailures++;
+            }
+        }
+        const double expectedDuration = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        ErrorPathBenchmarkResult result{};
+        result.iterations = iterations;
+        result.exceptionFailures = exceptionFailures;
+        result.expectedFailures = expectedFailures;
+        result.runtimeCalls = g_runtimeCallCount;
+        result.exceptionNanoseconds = exceptionDuration / std::max(1u, iterations);
+        result.expectedNanoseconds = expectedDuration / std::max(1u, iterations);
+        result.speedup = result.exceptionNanoseconds / std::max(result.expectedNanoseconds, 0.001);
+
+        Log(fmt::format("Error path: {} failures, {:.1f} ns with exceptions, {:.1f} ns with XrExpected ({:.1f}x)\n",
+                        iterations,
+                        result.exceptionNanoseconds,
+                        result.expectedNanoseconds,
+                        result.speedup));
+
+        TraceLoggingWriteStop(local,
+                              "ErrorPathBenchmark",
+                              TLArg(result.exceptionNanoseconds, "ExceptionNanoseconds"),
+                              TLArg(result.expectedNanoseconds, "ExpectedNanoseconds"),
+                              TLArg(result.exceptionFailures, "ExceptionFailures"),
+                              TLArg(result.expectedFailures, "ExpectedFailures"),
+                              TLArg(result.runtimeCalls, "RuntimeCalls"));
+
+        return result;
+    }
+
+} // namespace openxr_api_layer::tests
@@ -0,0 +1,213 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The test exercises the frame thread tracker that is internal to the module.
+#include <utils/scheduling.cpp>
+
+#include "tests.h"
+
+namespace {
+
+    using namespace openxr_api_layer::utils::general;
+
+    // 8 cores of 2 logical processors each. The threads and their placement are driven by the test.
+    class StubThreadScheduler : public IThreadScheduler {
+      public:
+        uint32_t getCurrentThreadId() const override {
+            return currentThreadId;
+        }
+
+        uint32_t getCurrentProcessor() const override {
+            return currentProcessor;
+        }
+
+        std::vector<uint32_t> getProcessorCores() const override {
+            std::vector<uint32_t> cores;
+            for (uint32_t processor = 0; processor < 16; processor++) {
+                cores.push_back(processor / 2);
+            }
+            return cores;
+        }
+
+        bool raiseCurrentThreadPriority() override {
+            raisedThreads.insert(currentThreadId);
+            return true;
+        }
+
+        void restoreCurrentThreadPriority() override {
+            raisedThreads.erase(currentThreadId);
+        }
+
+        void setCurrentThreadIdealProcessor(uint32_t processor) override {
+        }
+
+        bool setThreadAffinity(uint32_t threadId, uint64_t processorMask) override {
+            affinities[threadId] = processorMask;
+            return true;
+        }
+
+        std::vector<uint64_t> getContextSwitchCounts(const std::vector<uint32_t>& threadIds) override {
+            std::vector<uint64_t> counts;
+            for (const uint32_t threadId : threadIds) {
+                const auto it = contextSwitches.find(threadId);
+                counts.push_back(it != contextSwitches.cend() ? it->second : 0);
+            }
+            return counts;
+        }
+
+        uint32_t currentThreadId{0};
+        uint32_t currentProcessor{0};
+        std::set<uint32_t> raisedThreads;
+        std::unordered_map<uint32_t, uint64_t> affinities;
+        std::unordered_map<uint32_t, uint64_t> contextSwitches;
+    };
+
+} // namespace
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::general;
+
+    SchedulingTestResult runSchedulingTest(uint32_t frameCount) {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local, "SchedulingTest", TLArg(frameCount, "FrameCount"));
+
+        // The application waits on its main thread (1) and submits on its render thread (2), which later hands over
+        // to another thread (3). The layer has 2 threads.
+        constexpr uint32_t MainThread = 1;
+        constexpr uint32_t RenderThread = 2;
+        constexpr uint32_t NewRenderThread = 3;
+        constexpr uint32_t LayerThreads[] = {100, 101};
+        constexpr uint32_t LateLayerThread = 102;
+
+        // The main thread runs on the first core, and the render thread on the third core, except during every 50th
+        // frame where it is moved to the fourth core.
+        constexpr uint32_t MainProcessor = 0;
+        constexpr uint32_t RenderProcessor = 4;
+        constexpr uint32_t MigratedRenderProcessor = 6;
+        constexpr uint64_t ReservedMask = 0b110011;
+
+        const auto scheduler = std::make_shared<StubThreadScheduler>();
+        LayerThreadRegistry registry;
+        for (const uint32_t threadId : LayerThreads) {
+            registry.add(threadId);
+        }
+
+        SchedulingTestResult result{};
+        {
+            FrameThreadTracker tracker({}, scheduler, registry);
+
+            uint32_t renderProcessor = RenderProcessor;
+            for (uint32_t frame = 0; frame < frameCount; frame++) {
+                scheduler->currentThreadId = MainThread;
+                scheduler->currentProcessor = MainProcessor;
+                tracker.onWaitFrame();
+
+                const uint32_t processor = frame % 50 == 49 ? MigratedRenderProcessor : RenderProcessor;
+                if (processor != renderProcessor && result.detectionFrames) {
+                    result.expectedMigrations++;
+                }
+                renderProcessor = processor;
+                scheduler->currentThreadId = RenderThread;
+                scheduler->currentProcessor = renderProcessor;
+                tracker.onEndFrame();
+
+                const SchedulingStatistics statistics = tracker.getStatistics();
+                if (!result.detectionFrames && statistics.waitFrameThreadId && statistics.endFrameThreadId) {
+                    result.detectionFrames = frame + 1;
+                }
+            }
+
+            // Registered after the detection.
+            registry.add(LateLayerThread);
+
+            // The context switches are measured from the first sample.
+            scheduler->contextSwitches[MainThread] = 1000;
+            scheduler->contextSwitches[RenderThread] = 5000;
+            tracker.sampleContextSwitches();
+            scheduler->contextSwitches[MainThread] += 300;
+            scheduler->contextSwitches[RenderThread] += 200;
+            tracker.sampleContextSwitches();
+            result.expectedContextSwitches = 500;
+
+            const uint64_t availableMask = 0xffff;
+            const uint64_t expectedMask = availableMask & ~ReservedMask;
+            result.isIsolated = tracker.getStatistics().layerThreadsAffinityMask == expectedMask;
+            for (const uint32_t threadId : {LayerThreads[0], LayerThreads[1], LateLayerThread}) {
+                result.isIsolated = result.isIsolated && scheduler->affinities[threadId] == expectedMask;
+            }
+
+            // The render thread hands over, and makes a last call afterwards.
+            scheduler->currentThreadId = NewRenderThread;
+            scheduler->currentProcessor = RenderProcessor;
+            for (uint32_t frame = 0; frame < FrameThreadTracker::DetectionFrames; frame++) {
+                tracker.onEndFrame();
+            }
+            scheduler->currentThreadId = RenderThread;
+            tracker.onEndFrame();
+            result.isPriorityRestored = !scheduler->raisedThreads.count(RenderThread) &&
+                                        scheduler->raisedThreads.count(NewRenderThread) &&
+                                        scheduler->raisedThreads.count(MainThread);
+
+            const SchedulingStatistics statistics = tracker.getStatistics();
+            result.migrations = statistics.migrations;
+            result.contextSwitches = statistics.contextSwitches;
+
+            // The session is destroyed from the main thread, and the render thread restores its own priority on its
+            // next call.
+            scheduler->currentThreadId = MainThread;
+            tracker.onDestroySession();
+            const bool isRenderThreadPending = scheduler->raisedThreads.count(NewRenderThread);
+            scheduler->currentThreadId = NewRenderThread;
+            tracker.onCall();
+            result.isReleased = !tracker.getStatistics().layerThreadsAffinityMask && isRenderThreadPending &&
+                                scheduler->raisedThreads.empty();
+            for (const uint32_t threadId : {LayerThreads[0], LayerThreads[1], LateLayerThread}) {
+                result.isReleased = result.isReleased && scheduler->affinities[threadId] == availableMask;
+            }
+        }
+
+        Log(fmt::format("Scheduling: detected after {} frames, isolated {}, released {}, priority restored {}, "
+                        "{} migrations (expected {}), {} context switches (expected {})\n",
+                        result.detectionFrames,
+                        result.isIsolated,
+                        result.isReleased,
+                        result.isPriorityRestored,
+                        result.migrations,
+                        result.expectedMigrations,
+                        result.contextSwitches,
+                        result.expectedContextSwitches));
+
+        TraceLoggingWriteStop(local,
+                              "SchedulingTest",
+                              TLArg(result.detectionFrames, "DetectionFrames"),
+                              TLArg(result.isIsolated, "IsIsolated"),
+                              TLArg(result.isReleased, "IsReleased"),
+                              TLArg(result.migrations, "Migrations"));
+
+        return result;
+    }
+
+} // namespace openxr_api_layer::tests
@@ -0,0 +1,175 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+#include "stub_runtime.h"
+#include "log.h"
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::tracking;
+
+    TestResult runSpacesLocatorTests() {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local, "SpacesLocatorTests");
+
+        Checks checks("Spaces locator");
+
+        struct Batch {
+            Batch(uint32_t spaceCount, bool withVelocities) : spaces(spaceCount), locations(spaceCount) {
+                for (uint32_t i = 0; i < spaceCount; i++) {
+                    spaces[i] = reinterpret_cast<XrSpace>(static_cast<uintptr_t>(i + 1));
+                }
+                locateInfo.baseSpace = reinterpret_cast<XrSpace>(static_cast<uintptr_t>(1000));
+                locateInfo.time = 42;
+                locateInfo.spaceCount = spaceCount;
+                locateInfo.spaces = spaces.data();
+                spaceLocations.locationCount = spaceCount;
+                spaceLocations.locations = locations.data();
+                if (withVelocities) {
+                    velocities.resize(spaceCount);
+                    spaceVelocities.velocityCount = spaceCount;
+                    spaceVelocities.velocities = velocities.data();
+                    spaceLocations.next = &spaceVelocities;
+                }
+            }
+
+            bool isLocated() const {
+                for (uint32_t i = 0; i < spaces.size(); i++) {
+                    const float value = static_cast<float>(i + 1);
+                    if (locations[i].pose.position.x != value ||
+                        locations[i].pose.position.y != static_cast<float>(locateInfo.time) ||
+                        !(locations[i].locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT)) {
+                        return false;
+                    }
+                    if (!velocities.empty() &&
+                        (velocities[i].linearVelocity.y != value || velocities[i].angularVelocity.z != value ||
+                         velocities[i].velocityFlags != XR_SPACE_VELOCITY_LINEAR_VALID_BIT)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            std::vector<XrSpace> spaces;
+            std::vector<XrSpaceLocationDataKHR> locations;
+            std::vector<XrSpaceVelocityDataKHR> velocities;
+            XrSpacesLocateInfoKHR locateInfo{XR_TYPE_SPACES_LOCATE_INFO_KHR};
+            XrSpaceLocationsKHR spaceLocations{XR_TYPE_SPACE_LOCATIONS_KHR};
+            XrSpaceVelocitiesKHR spaceVelocities{XR_TYPE_SPACE_VELOCITIES_KHR};
+        };
+
+        const auto stubLocateSpace = stub::getFunction<PFN_xrLocateSpace>("xrLocateSpace");
+        const auto serialLocator = createSpacesLocator(stubLocateSpace);
+        const auto parallelLocator = createSpacesLocator(stubLocateSpace, general::createWorkerPool(3), 8);
+        for (const auto& [locator, label] :
+             {std::make_pair(serialLocator, "serial"), std::make_pair(parallelLocator, "parallel")}) {
+            const auto checkResult = [&](XrResult result, XrResult expected, const char* name) {
+                checks.check(result == expected,
+                             fmt::format("{} {}: {} instead of {}",
+                                         label,
+                                         name,
+                                         xr::ToCString(result),
+                                         xr::ToCString(expected)));
+            };
+
+            {
+                Batch batch(100, false);
+                stub::resetLocateSpaceCount();
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations), XR_SUCCESS, "locations");
+                checks.check(batch.isLocated(), fmt::format("{} locations: poses", label));
+                checks.check(stub::getLocateSpaceCount() == 100, fmt::format("{} locations: runtime calls", label));
+            }
+            {
+                Batch batch(37, true);
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations), XR_SUCCESS, "velocities");
+                checks.check(batch.isLocated(), fmt::format("{} velocities: poses and velocities", label));
+            }
+            {
+                Batch batch(1, true);
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations), XR_SUCCESS, "single space");
+                checks.check(batch.isLocated(), fmt::format("{} single space: pose", label));
+            }
+            {
+                Batch batch(50, false);
+                batch.spaces[45] = XR_NULL_HANDLE;
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations),
+                            XR_ERROR_HANDLE_INVALID,
+                            "invalid space");
+            }
+            {
+                Batch batch(50, false);
+                batch.locateInfo.baseSpace = XR_NULL_HANDLE;
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations),
+                            XR_ERROR_HANDLE_INVALID,
+                            "invalid base space");
+            }
+            {
+                Batch batch(8, false);
+                batch.locateInfo.time = 0;
+                checkResult(
+                    locator->locateSpaces(batch.locateInfo, batch.spaceLocations), XR_ERROR_TIME_INVALID, "zero time");
+            }
+            {
+                Batch batch(8, false);
+                batch.locateInfo.spaceCount = 0;
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations),
+                            XR_ERROR_VALIDATION_FAILURE,
+                            "zero spaces");
+            }
+            {
+                Batch batch(8, false);
+                batch.spaceLocations.locationCount = 7;
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations),
+                            XR_ERROR_VALIDATION_FAILURE,
+                            "location count mismatch");
+            }
+            {
+                Batch batch(8, true);
+                batch.spaceVelocities.velocityCount = 9;
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations),
+                            XR_ERROR_VALIDATION_FAILURE,
+                            "velocity count mismatch");
+            }
+            {
+                Batch batch(8, false);
+                batch.locateInfo.type = XR_TYPE_SPACE_LOCATION;
+                checkResult(locator->locateSpaces(batch.locateInfo, batch.spaceLocations),
+                            XR_ERROR_VALIDATION_FAILURE,
+                            "wrong structure type");
+            }
+        }
+
+        const TestResult testResult = checks.getResult();
+
+        TraceLoggingWriteStop(local,
+                              "SpacesLocatorTests",
+                              TLArg(testResult.testCount, "TestCount"),
+                              TLArg(testResult.failureCount, "FailureCount"));
+
+        return testResult;
+    }
+
+} // namespace openxr_api_layer::tests
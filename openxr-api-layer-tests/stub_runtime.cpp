@@ -0,0 +1,179 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+#include "stub_runtime.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::tests;
+
+    stub::RuntimeClock g_clock;
+    double g_locateCostUs = 0;
+    std::atomic<uint32_t> g_locateSpaceCount{0};
+
+    XrResult XRAPI_CALL stubLocateSpace(XrSpace space, XrSpace baseSpace, XrTime time, XrSpaceLocation* location) {
+        spendCallCost(g_locateCostUs);
+        g_locateSpaceCount++;
+        if (space == XR_NULL_HANDLE || baseSpace == XR_NULL_HANDLE) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+        if (location->type != XR_TYPE_SPACE_LOCATION) {
+            return XR_ERROR_VALIDATION_FAILURE;
+        }
+
+        location->locationFlags = XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_POSITION_VALID_BIT;
+        location->pose = stub::getPose(space, time);
+
+        XrSpaceVelocity* velocity = reinterpret_cast<XrSpaceVelocity*>(location->next);
+        if (velocity) {
+            if (velocity->type != XR_TYPE_SPACE_VELOCITY) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+            const float value = location->pose.position.x;
+            velocity->velocityFlags = XR_SPACE_VELOCITY_LINEAR_VALID_BIT;
+            velocity->linearVelocity = {0, value, 0};
+            velocity->angularVelocity = {0, 0, value};
+        }
+
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL stubLocateViews(XrSession session,
+                                        const XrViewLocateInfo* viewLocateInfo,
+                                        XrViewState* viewState,
+                                        uint32_t viewCapacityInput,
+                                        uint32_t* viewCountOutput,
+                                        XrView* views) {
+        spendCallCost(g_locateCostUs);
+        if (viewLocateInfo->space == XR_NULL_HANDLE) {
+            return XR_ERROR_HANDLE_INVALID;
+        }
+
+        *viewCountOutput = 2;
+        if (!viewCapacityInput) {
+            return XR_SUCCESS;
+        }
+        if (viewCapacityInput < 2) {
+            return XR_ERROR_SIZE_INSUFFICIENT;
+        }
+
+        viewState->viewStateFlags = XR_VIEW_STATE_ORIENTATION_VALID_BIT | XR_VIEW_STATE_POSITION_VALID_BIT;
+        for (uint32_t i = 0; i < 2; i++) {
+            views[i].pose =
+                xr::math::Pose::Translation({i ? 0.03f : -0.03f, static_cast<float>(viewLocateInfo->displayTime), 0});
+            views[i].fov = {-0.8f, 0.8f, 0.8f, -0.8f};
+        }
+
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL stubConvertWin32PerformanceCounterToTimeKHR(XrInstance instance,
+                                                                    const LARGE_INTEGER* performanceCounter,
+                                                                    XrTime* time) {
+        *time = g_clock.toXrTime(performanceCounter->QuadPart);
+        return XR_SUCCESS;
+    }
+
+} // namespace
+
+namespace openxr_api_layer::tests {
+
+    Checks::Checks(const std::string& suite) : m_suite(suite) {
+    }
+
+    void Checks::check(bool condition, const std::string& name) {
+        m_result.testCount++;
+        if (!condition) {
+            m_result.failureCount++;
+            ErrorLog(fmt::format("{} test failed: {}\n", m_suite, name));
+        }
+    }
+
+    TestResult Checks::getResult() const {
+        Log(fmt::format(
+            "{} tests: {} of {} passed\n", m_suite, m_result.testCount - m_result.failureCount, m_result.testCount));
+        return m_result;
+    }
+
+    void spendCallCost(double microseconds) {
+        using clock = std::chrono::high_resolution_clock;
+        const auto deadline =
+            clock::now() +
+            std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::micro>(microseconds));
+        while (clock::now() < deadline) {
+        }
+    }
+
+    namespace stub {
+
+        XrTime RuntimeClock::toXrTime(int64_t performanceCounter) const {
+            const double seconds = performanceCounter / frequency;
+            const double nanoseconds = 5e9 + seconds * 1e9 * (1 + driftPpm * 1e-6) +
+                                       wanderAmplitudeNanoseconds * std::sin(2 * M_PI * seconds / wanderPeriodSeconds);
+            return std::llround(nanoseconds / 100) * 100;
+        }
+
+        void setClock(const RuntimeClock& clock) {
+            g_clock = clock;
+        }
+
+        void setLocateCost(double microseconds) {
+            g_locateCostUs = microseconds;
+        }
+
+        uint32_t getLocateSpaceCount() {
+            return g_locateSpaceCount;
+        }
+
+        void resetLocateSpaceCount() {
+            g_locateSpaceCount = 0;
+        }
+
+        XrPosef getPose(XrSpace space, XrTime time) {
+            return xr::math::Pose::Translation(
+                {static_cast<float>(reinterpret_cast<uintptr_t>(space)), static_cast<float>(time), 0});
+        }
+
+        XrResult XRAPI_CALL xrGetInstanceProcAddr(XrInstance instance,
+                                                  const char* name,
+                                                  PFN_xrVoidFunction* function) {
+            const std::string apiName(name);
+            if (apiName == "xrLocateSpace") {
+                *function = reinterpret_cast<PFN_xrVoidFunction>(stubLocateSpace);
+            } else if (apiName == "xrLocateViews") {
+                *function = reinterpret_cast<PFN_xrVoidFunction>(stubLocateViews);
+            } else if (apiName == "xrConvertWin32PerformanceCounterToTimeKHR") {
+                *function = reinterpret_cast<PFN_xrVoidFunction>(stubConvertWin32PerformanceCounterToTimeKHR);
+            } else {
+                *function = nullptr;
+                return XR_ERROR_FUNCTION_UNSUPPORTED;
+            }
+            return XR_SUCCESS;
+        }
+
+    } // namespace stub
+
+} // namespace openxr_api_layer::tests
@@ -0,0 +1,86 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "tests.h"
+
+namespace openxr_api_layer::tests {
+
+    // Counts the checks of a test suite. The failed checks are written to the log.
+    class Checks {
+      public:
+        explicit Checks(const std::string& suite);
+
+        void check(bool condition, const std::string& name);
+
+        // Write the summary to the log.
+        TestResult getResult() const;
+
+      private:
+        const std::string m_suite;
+        TestResult m_result{};
+    };
+
+    // Busy-wait, to simulate the cost of a call going through the other layers and the runtime.
+    void spendCallCost(double microseconds);
+
+    // A stub OpenXR runtime, shared by the tests and the benchmarks.
+    namespace stub {
+
+        // The runtime clock runs at (1 + driftPpm) the rate of the performance counter, with a slow wander on top of
+        // it, and has a 100 ns resolution.
+        struct RuntimeClock {
+            double frequency{10'000'000.0};
+            double driftPpm{0.0};
+            double wanderAmplitudeNanoseconds{0.0};
+            double wanderPeriodSeconds{1.0};
+
+            XrTime toXrTime(int64_t performanceCounter) const;
+        };
+
+        void setClock(const RuntimeClock& clock);
+
+        // The cost of each call to xrLocateSpace() and xrLocateViews().
+        void setLocateCost(double microseconds);
+
+        // The number of calls to xrLocateSpace().
+        uint32_t getLocateSpaceCount();
+        void resetLocateSpaceCount();
+
+        // The poses encode the handle of the space and the time (in X and Y), and the velocities encode the handle of
+        // the space. The null handle is invalid.
+        XrPosef getPose(XrSpace space, XrTime time);
+
+        // Resolves xrLocateSpace(), xrLocateViews() (2 views) and xrConvertWin32PerformanceCounterToTimeKHR().
+        XrResult XRAPI_CALL xrGetInstanceProcAddr(XrInstance instance, const char* name, PFN_xrVoidFunction* function);
+
+        template <typename T>
+        T getFunction(const char* name) {
+            PFN_xrVoidFunction function = nullptr;
+            CHECK_XRCMD(xrGetInstanceProcAddr(XR_NULL_HANDLE, name, &function));
+            return reinterpret_cast<T>(function);
+        }
+
+    } // namespace stub
+
+} // namespace openxr_api_layer::tests
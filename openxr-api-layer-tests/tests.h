@@ -0,0 +1,278 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+namespace openxr_api_layer::tests {
+
+    struct TestResult {
+        uint32_t testCount;
+        uint32_t failureCount;
+    };
+
+    // Clock service (utils/clock.cpp).
+
+    struct ClockServiceTestResult {
+        // The largest conversion error against the stub runtime, and the largest error bound that was reported, once
+        // the sampling has settled.
+        double maxErrorNanoseconds;
+        double maxErrorBoundNanoseconds;
+        // The conversions whose error exceeded the error bound reported at the time.
+        uint32_t boundViolations;
+        // Average cost of one conversion through the model, and through the stub runtime.
+        double conversionNanoseconds;
+        double runtimeNanoseconds;
+    };
+
+    // Run the clock model against a stub runtime whose clock drifts from the performance counter by driftPpm, with a
+    // slow wander on top of it. The runtime is sampled sampleCount times on the service's schedule, and conversions are
+    // checked in between. The results are also written to the log.
+    ClockServiceTestResult runClockServiceTest(uint32_t sampleCount = 600, double driftPpm = 50.0);
+
+    // Thread scheduling (utils/scheduling.cpp).
+
+    struct SchedulingTestResult {
+        // The frames it took to detect the frame threads.
+        uint32_t detectionFrames;
+
+        // Whether the layer threads were kept off the cores of the frame threads (including their SMT siblings), and
+        // whether they were released at the end of the session (along with the priority of the frame threads).
+        bool isIsolated;
+        bool isReleased;
+
+        // Whether the priority of a frame thread was restored once another thread took over.
+        bool isPriorityRestored;
+
+        // The migrations and context switches that were reported, and that were simulated.
+        uint64_t migrations;
+        uint64_t expectedMigrations;
+        uint64_t contextSwitches;
+        uint64_t expectedContextSwitches;
+    };
+
+    // Run the frame thread detection and the placement of the layer threads against a stub scheduler with 8 cores of
+    // 2 logical processors each. The results are also written to the log.
+    SchedulingTestResult runSchedulingTest(uint32_t frameCount = 1000);
+
+    // Locate cache (utils/locate.cpp).
+
+    struct LocateCacheBenchmarkResult {
+        double uncachedMilliseconds;
+        double cachedMilliseconds;
+        utils::tracking::LocateCacheStatistics statistics;
+
+        // Calls to xrLocateSpace() reaching the stub runtime, without and with the cache.
+        uint32_t uncachedLocateSpaceCalls;
+        uint32_t cachedLocateSpaceCalls;
+    };
+
+    // Measure the locate cache against a stub runtime spending locateCostUs in each call. Each of the frameCount frames
+    // locates spaceCount spaces locatesPerSpace times, and the views viewLocatesPerFrame times. The results are also
+    // written to the log.
+    LocateCacheBenchmarkResult runLocateCacheBenchmark(uint32_t spaceCount = 8,
+                                                       uint32_t locatesPerSpace = 4,
+                                                       uint32_t viewLocatesPerFrame = 3,
+                                                       uint32_t frameCount = 500,
+                                                       double locateCostUs = 5.0);
+
+    // Prediction error (utils/prediction.cpp).
+
+    struct PredictionErrorTestResult {
+        uint64_t sampleCount;
+
+        // The percentiles of the angular error measured by the sampler, and of the error induced by the stub runtime.
+        double measuredP50Degrees;
+        double measuredP99Degrees;
+        double expectedP50Degrees;
+        double expectedP99Degrees;
+    };
+
+    // Run the prediction error sampler against a stub runtime that extrapolates a sinusoidal head motion with a
+    // constant velocity, for frameCount frames at 90 Hz. The results are also written to the log.
+    PredictionErrorTestResult runPredictionErrorTest(uint32_t frameCount = 9000,
+                                                     const utils::tracking::PredictionErrorSettings& settings = {});
+
+    // Spaces locator (utils/spaces.cpp).
+
+    // Run conformance checks of the spaces locator against a stub runtime, serially and with a worker pool. The
+    // failures are written to the log.
+    TestResult runSpacesLocatorTests();
+
+    // Visibility mask (utils/visibility.cpp).
+
+    // Run checks of the mesh generation and the two-call idiom. The failures are written to the log.
+    TestResult runVisibilityMaskTests();
+
+    // Inputs (utils/input.cpp).
+
+    struct ActionStateCacheBenchmarkResult {
+        double uncachedMilliseconds;
+        double cachedMilliseconds;
+        double speedup;
+
+        // Calls reaching the stub runtime, without and with the cache.
+        uint64_t uncachedRuntimeCalls;
+        uint64_t cachedRuntimeCalls;
+    };
+
+    // Measure the action state cache against a stub runtime spending runtimeCallCostUs in each call. Each of the
+    // syncCount frames queries actionCount (action, subaction path) pairs queriesPerAction times. The results are also
+    // written to the log.
+    ActionStateCacheBenchmarkResult runActionStateCacheBenchmark(uint32_t actionCount = 32,
+                                                                 uint32_t queriesPerAction = 8,
+                                                                 uint32_t syncCount = 500,
+                                                                 double runtimeCallCostUs = 1.0);
+
+    struct InteractionProfileTrackingBenchmarkResult {
+        // Calls reaching the stub runtime (xrGetCurrentInteractionProfile() and xrPathToString()).
+        uint64_t pollingRuntimeCalls;
+        uint64_t trackingRuntimeCalls;
+        double savedRuntimeCallsPerMinute;
+    };
+
+    // Compare querying the interaction profiles every frame against tracking the interaction profile changed events,
+    // with a stub runtime running frameCount frames at frameRate, and changing profiles profileChangeCount times. The
+    // results are also written to the log.
+    InteractionProfileTrackingBenchmarkResult runInteractionProfileTrackingBenchmark(uint32_t frameCount = 54000,
+                                                                                     uint32_t profileChangeCount = 10,
+                                                                                     double frameRate = 90.0);
+
+    struct InputSourceCacheBenchmarkResult {
+        double uncachedMilliseconds;
+        double cachedMilliseconds;
+        double speedup;
+
+        // Calls reaching the stub runtime, without and with the cache.
+        uint64_t uncachedRuntimeCalls;
+        uint64_t cachedRuntimeCalls;
+    };
+
+    // Measure the input source cache against a stub runtime spending runtimeCallCostUs in each call. Each of the
+    // frameCount frames enumerates the bound sources of actionCount actions and gets the localized name of each source,
+    // with the two-call idiom. The interaction profiles change profileChangeCount times. The results are also written
+    // to the log.
+    InputSourceCacheBenchmarkResult runInputSourceCacheBenchmark(uint32_t actionCount = 8,
+                                                                 uint32_t frameCount = 50,
+                                                                 uint32_t profileChangeCount = 2,
+                                                                 double runtimeCallCostUs = 500.0);
+
+    struct EyeGazeClassifierTestResult {
+        uint64_t sampleCount;
+
+        // The proportion of the fixation (resp. saccade) samples of the trace classified as such.
+        double fixationAccuracy;
+        double saccadeAccuracy;
+
+        // The angular error of the filtered gaze during fixations, against the fixation targets.
+        double fixationErrorDegrees;
+        double rawFixationErrorDegrees;
+
+        double nanosecondsPerSample;
+    };
+
+    // Replay an eye gaze trace sampled once per frame at 90 Hz through the classifier and the smoothing filter of the
+    // EyeGaze input method, as located by a stub runtime. The trace is synthesized from a fixed seed, and alternates
+    // fixationCount fixations (with noiseDegrees of sensor noise, and occasional blinks) with saccades following the
+    // main sequence. Fixation samples are only counted once minFixationDuration into the fixation. The results are also
+    // written to the log.
+    EyeGazeClassifierTestResult runEyeGazeClassifierTest(uint32_t fixationCount = 200, float noiseDegrees = 0.1f);
+
+    // CPU device (utils/cpu.cpp).
+
+    struct CpuDeviceScalingResult {
+        uint32_t threadCount;
+        double milliseconds;
+
+        // Relative to the single-threaded execution.
+        double speedup;
+
+        // The output texture is identical, byte for byte, to the one of the single-threaded execution.
+        bool matchesSingleThreaded;
+    };
+
+    // Measure the duration of a typical stereo workload (format conversion followed by an overlay blend, then a patch
+    // copied over part of the overlay) on the CPU device, with increasing worker pool sizes up to the number of logical
+    // processors. The results are also written to the log.
+    std::vector<CpuDeviceScalingResult>
+    runCpuDeviceScalingBenchmark(uint32_t width = 2048, uint32_t height = 2048, uint32_t iterations = 5);
+
+    // Quad flattening (utils/flatten.cpp).
+
+    struct QuadFlatteningTestResult {
+        uint32_t casesCount;
+        uint32_t failedCases;
+
+        // Golden pixels that the reference rasterization did not reproduce.
+        uint64_t mismatchedPixels;
+
+        // The throughput of the reference rasterization.
+        double megapixelsPerSecond;
+    };
+
+    // Flatten quads into stereo projection images with the CPU reference rasterization of the flattening pass (which
+    // also validates the composition device in Debug builds), and compare the results against golden pixels computed
+    // by projecting points of the quads. The results are also written to the log.
+    QuadFlatteningTestResult runQuadFlatteningTest(uint32_t eyeResolution = 512);
+
+    // Image kernels (utils/image.cpp).
+
+    struct ImageKernelBenchmarkResult {
+        std::string kernel;
+        utils::image::Isa isa;
+        DXGI_FORMAT sourceFormat;
+        DXGI_FORMAT destinationFormat;
+
+        // Bytes read plus bytes written, per second.
+        double gigabytesPerSecond;
+    };
+
+    // Compare the conversions between each pair of formats and the blending in each format, for each instruction set
+    // supported by the CPU, against the scalar reference. The inputs include denormals, Inf, NaN and values above 1,
+    // and the width spans two chunks of conversion with a remainder after the vector loops. The mismatches are written
+    // to the log.
+    TestResult runImageKernelTests(uint32_t width = 263);
+
+    // Measure the throughput of each kernel and format pair, for each instruction set supported by the CPU. The
+    // results are also written to the log.
+    std::vector<ImageKernelBenchmarkResult>
+    runImageKernelBenchmarks(uint32_t width = 2048, uint32_t height = 2048, uint32_t iterations = 10);
+
+    // Error handling (framework/result.h).
+
+    struct ErrorPathBenchmarkResult {
+        // Average cost of surfacing one failed call.
+        double exceptionNanoseconds;
+        double expectedNanoseconds;
+        double speedup;
+
+        // Failures surfaced by each path, and calls reaching the failing runtime call across both paths.
+        uint32_t iterations;
+        uint32_t exceptionFailures;
+        uint32_t expectedFailures;
+        uint64_t runtimeCalls;
+    };
+
+    // Measure the cost of surfacing a failed runtime call through CHECK_XRCMD() and a catch block, against
+    // RETURN_IF_XR_FAILED() and an XrExpected. The results are also written to the log.
+    ErrorPathBenchmarkResult runErrorPathBenchmark(uint32_t iterations = 100000);
+
+} // namespace openxr_api_layer::tests
@@ -0,0 +1,192 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+// The tests use the tolerance of the module to the changes of the field of view.
+#include <utils/visibility.cpp>
+
+#include "stub_runtime.h"
+
+namespace {
+
+    float getTriangleArea(const XrVector2f& a, const XrVector2f& b, const XrVector2f& c) {
+        return ((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y)) / 2;
+    }
+
+    float getMeshArea(const VisibilityMesh& mesh) {
+        float area = 0;
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            area += getTriangleArea(
+                mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]], mesh.vertices[mesh.indices[i + 2]]);
+        }
+        return area;
+    }
+
+} // namespace
+
+namespace openxr_api_layer::tests {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::visibility;
+
+    TestResult runVisibilityMaskTests() {
+        TraceLocalActivity(local);
+        TraceLoggingWriteStart(local, "VisibilityMaskTests");
+
+        Checks checks("Visibility mask");
+
+        const XrFovf fov{-0.9f, 0.75f, 0.8f, -0.85f};
+        const float fovArea =
+            (std::tan(fov.angleRight) - std::tan(fov.angleLeft)) * (std::tan(fov.angleUp) - std::tan(fov.angleDown));
+        const auto isInFov = [&](const XrVector2f& point) {
+            return point.x >= std::tan(fov.angleLeft) - 1e-5f && point.x <= std::tan(fov.angleRight) + 1e-5f &&
+                   point.y >= std::tan(fov.angleDown) - 1e-5f && point.y <= std::tan(fov.angleUp) + 1e-5f;
+        };
+
+        const LensProfile fallback;
+        LensProfile offCenter;
+        offCenter.center = {0.15f, -0.1f};
+        offCenter.radius = {1.1f, 0.95f};
+        offCenter.exponent = 2.5f;
+        LensProfile oversized;
+        oversized.radius = {3.f, 3.f};
+
+        for (const auto& [profile, label] : {std::make_pair(fallback, "fallback"),
+                                             std::make_pair(offCenter, "off-center"),
+                                             std::make_pair(oversized, "oversized")}) {
+            for (const bool mirror : {false, true}) {
+                const std::string name = fmt::format("{}{}", label, mirror ? " mirrored" : "");
+
+                const VisibilityMesh hidden =
+                    generateVisibilityMesh(fov, profile, mirror, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR);
+                const VisibilityMesh visible =
+                    generateVisibilityMesh(fov, profile, mirror, XR_VISIBILITY_MASK_TYPE_VISIBLE_TRIANGLE_MESH_KHR);
+                const VisibilityMesh lineLoop =
+                    generateVisibilityMesh(fov, profile, mirror, XR_VISIBILITY_MASK_TYPE_LINE_LOOP_KHR);
+
+                bool isValid = true;
+                for (const VisibilityMesh* mesh : {&hidden, &visible, &lineLoop}) {
+                    isValid = isValid && std::all_of(mesh->vertices.cbegin(), mesh->vertices.cend(), isInFov);
+                    const auto isValidIndex = [&](uint32_t index) { return index < mesh->vertices.size(); };
+                    isValid = isValid && std::all_of(mesh->indices.cbegin(), mesh->indices.cend(), isValidIndex);
+                }
+                checks.check(isValid, fmt::format("{}: vertices within the field of view", name));
+
+                bool isCounterClockwise = hidden.indices.size() % 3 == 0 && visible.indices.size() % 3 == 0;
+                for (const VisibilityMesh* mesh : {&hidden, &visible}) {
+                    for (size_t i = 0; i + 2 < mesh->indices.size(); i += 3) {
+                        const float area = getTriangleArea(mesh->vertices[mesh->indices[i]],
+                                                           mesh->vertices[mesh->indices[i + 1]],
+                                                           mesh->vertices[mesh->indices[i + 2]]);
+                        isCounterClockwise = isCounterClockwise && area > 0;
+                    }
+                }
+                checks.check(isCounterClockwise, fmt::format("{}: counter-clockwise triangles", name));
+
+                // The hidden and visible meshes must tile the field of view.
+                checks.check(std::abs(getMeshArea(hidden) + getMeshArea(visible) - fovArea) < fovArea * 1e-4f,
+                             fmt::format("{}: hidden and visible areas", name));
+
+                checks.check(lineLoop.indices.size() == lineLoop.vertices.size() && lineLoop.vertices.size() >= 64,
+                             fmt::format("{}: line loop", name));
+            }
+        }
+
+        // The fallback must not hide anything.
+        for (const auto& [profile, label] :
+             {std::make_pair(fallback, "fallback"), std::make_pair(oversized, "oversized")}) {
+            for (const bool mirror : {false, true}) {
+                const VisibilityMesh hidden =
+                    generateVisibilityMesh(fov, profile, mirror, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR);
+                checks.check(hidden.indices.empty(),
+                             fmt::format("{}{}: nothing hidden", label, mirror ? " mirrored" : ""));
+            }
+        }
+
+        // The two-call idiom and the change notifications.
+        {
+            auto visibilityMask = createVisibilityMask(offCenter);
+            const auto viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+            const auto hiddenType = XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR;
+
+            XrVisibilityMaskKHR mask{XR_TYPE_VISIBILITY_MASK_KHR};
+            checks.check(visibilityMask->getVisibilityMask(viewConfigurationType, 0, hiddenType, mask) == XR_SUCCESS &&
+                             !mask.vertexCountOutput && !mask.indexCountOutput,
+                         "empty mask before the views are located");
+
+            XrView views[2]{{XR_TYPE_VIEW}, {XR_TYPE_VIEW}};
+            views[0].fov = fov;
+            views[1].fov = {-fov.angleRight, -fov.angleLeft, fov.angleUp, fov.angleDown};
+            checks.check(visibilityMask->updateViews(viewConfigurationType, views, 2).size() == 2,
+                         "first views changed");
+            checks.check(visibilityMask->updateViews(viewConfigurationType, views, 2).empty(), "same views unchanged");
+            const XrFovf rightFov = views[1].fov;
+            views[1].fov.angleLeft += FovTolerance / 2;
+            checks.check(visibilityMask->updateViews(viewConfigurationType, views, 2).empty(), "jitter ignored");
+
+            checks.check(visibilityMask->getVisibilityMask(viewConfigurationType, 1, hiddenType, mask) == XR_SUCCESS &&
+                             mask.vertexCountOutput && mask.indexCountOutput,
+                         "sizing call");
+
+            std::vector<XrVector2f> vertices(mask.vertexCountOutput);
+            std::vector<uint32_t> indices(mask.indexCountOutput - 1);
+            mask.vertexCapacityInput = static_cast<uint32_t>(vertices.size());
+            mask.vertices = vertices.data();
+            mask.indexCapacityInput = static_cast<uint32_t>(indices.size());
+            mask.indices = indices.data();
+            checks.check(visibilityMask->getVisibilityMask(viewConfigurationType, 1, hiddenType, mask) ==
+                             XR_ERROR_SIZE_INSUFFICIENT,
+                         "insufficient capacity");
+
+            indices.resize(mask.indexCountOutput);
+            mask.indexCapacityInput = static_cast<uint32_t>(indices.size());
+            mask.indices = indices.data();
+            checks.check(visibilityMask->getVisibilityMask(viewConfigurationType, 1, hiddenType, mask) == XR_SUCCESS,
+                         "retrieval");
+
+            const VisibilityMesh expected = generateVisibilityMesh(rightFov, offCenter, true, hiddenType);
+            checks.check(indices == expected.indices && vertices.size() == expected.vertices.size() &&
+                             std::equal(vertices.cbegin(),
+                                        vertices.cend(),
+                                        expected.vertices.cbegin(),
+                                        [](const XrVector2f& a, const XrVector2f& b) {
+                                            return a.x == b.x && a.y == b.y;
+                                        }),
+                         "right view is mirrored");
+
+            views[0].fov.angleUp += 0.05f;
+            const auto changedViews = visibilityMask->updateViews(viewConfigurationType, views, 2);
+            checks.check(changedViews.size() == 1 && changedViews[0] == 0, "field of view change");
+        }
+
+        const TestResult testResult = checks.getResult();
+
+        TraceLoggingWriteStop(local,
+                              "VisibilityMaskTests",
+                              TLArg(testResult.testCount, "TestCount"),
+                              TLArg(testResult.failureCount, "FailureCount"));
+
+        return testResult;
+    }
+
+} // namespace openxr_api_layer::tests
@@ -60,14 +60,29 @@ namespace openxr_api_layer {
             }
         }
 
-        // Only request implicit extensions that are supported.
+        // The advertised extensions requested by the application, which the layer implements unless the runtime does.
+        std::vector<std::string> requestedAdvertisedExtensions;
+        for (uint32_t i = 0; i < instanceCreateInfo->enabledExtensionCount; i++) {
+            const std::string_view ext(instanceCreateInfo->enabledExtensionNames[i]);
+            const auto matchExtensionName = [&](const std::pair<std::string, uint32_t>& extension) {
+                return extension.first == ext;
+            };
+            if (std::any_of(advertisedExtensions.cbegin(), advertisedExtensions.cend(), matchExtensionName)) {
+                requestedAdvertisedExtensions.push_back(std::string(ext));
+            }
+        }
+
+        // Only request implicit extensions that are supported, and only implement the advertised extensions that are
+        // not supported.
         //
         // While the OpenXR standard states that xrEnumerateInstanceExtensionProperties() can be queried without an
         // instance, this does not stand for API layers, since API layers implementation might rely on the next
         // xrGetInstanceProcAddr() pointer, which is not (yet) populated if no instance is created.
-        // We create a dummy instance in order to do these checks.
+        // We create a dummy instance in order to do these checks. When it cannot be created, the layer implements all
+        // the requested advertised extensions.
         std::vector<std::string> filteredImplicitExtensions;
-        if (!implicitExtensions.empty()) {
+        std::vector<std::string> implementedExtensions = requestedAdvertisedExtensions;
+        if (!implicitExtensions.empty() || !requestedAdvertisedExtensions.empty()) {
             XrInstance dummyInstance = XR_NULL_HANDLE;
 
             // Call the chain to create a dummy instance. Request no extensions in order to speed things up.
@@ -115,6 +130,16 @@ namespace openxr_api_layer {
                     }
                 }
 
+                implementedExtensions.clear();
+                for (const std::string& extensionName : requestedAdvertisedExtensions) {
+                    const auto matchExtensionName = [&](const XrExtensionProperties& properties) {
+                        return properties.extensionName == extensionName;
+                    };
+                    if (std::find_if(extensions.cbegin(), extensions.cend(), matchExtensionName) == extensions.cend()) {
+                        implementedExtensions.push_back(extensionName);
+                    }
+                }
+
                 // Workaround: the Vive runtime does not seem to like our flow of destroying the instance
                 // mid-initialization. We skip destruction and we will just create a second instance.
                 if (xrGetSystem && xrGetSystemProperties) {
@@ -143,14 +168,23 @@ namespace openxr_api_layer {
             const std::string_view ext(chainInstanceCreateInfo.enabledExtensionNames[i]);
             TraceLoggingWriteTagged(local, "xrCreateApiLayerInstance", TLArg(ext.data(), "ExtensionName"));
 
-            if (std::find(blockedExtensions.cbegin(), blockedExtensions.cend(), ext) == blockedExtensions.cend()) {
+            if (std::find(blockedExtensions.cbegin(), blockedExtensions.cend(), ext) != blockedExtensions.cend()) {
+                Log(fmt::format("Blocking extension: {}\n", ext));
+            } else if (std::find(implementedExtensions.cbegin(), implementedExtensions.cend(), ext) !=
+                       implementedExtensions.cend()) {
+                // The runtime lacks it, and must not see it.
+                Log(fmt::format("Implementing extension: {}\n", ext));
+            } else {
                 Log(fmt::format("Requested extension: {}\n", ext));
                 newEnabledExtensionNames.push_back(ext.data());
-            } else {
-                Log(fmt::format("Blocking extension: {}\n", ext));
             }
         }
         for (const auto& ext : filteredImplicitExtensions) {
+            // The application might have requested it already.
+            if (std::find(newEnabledExtensionNames.cbegin(), newEnabledExtensionNames.cend(), ext) !=
+                newEnabledExtensionNames.cend()) {
+                continue;
+            }
             Log(fmt::format("Requesting extension: {}\n", ext));
             newEnabledExtensionNames.push_back(ext.c_str());
         }
@@ -167,6 +201,7 @@ namespace openxr_api_layer {
             openxr_api_layer::GetInstance()->SetGetInstanceProcAddr(apiLayerInfo->nextInfo->nextGetInstanceProcAddr,
                                                                     *instance);
             openxr_api_layer::GetInstance()->SetGrantedExtensions(filteredImplicitExtensions);
+            openxr_api_layer::GetInstance()->SetImplementedExtensions(implementedExtensions);
 
             // Forward the xrCreateInstance() call to the layer.
             try {
@@ -103,6 +103,65 @@ class DispatchGenOutputGenerator(AutomaticSourceOutputGenerator):
 
         return arguments_list
 
+    def getHandleTypes(self):
+        '''Returns the handle types tracked by the handle registry.'''
+        handle_types = ['XrInstance', 'XrSession']
+        for handle in layer_apis.tracked_handles:
+            if handle not in [api_handle.name for api_handle in self.api_handles]:
+                raise Exception(f"{handle} in tracked_handles is not a handle type")
+            if handle not in handle_types:
+                handle_types.append(handle)
+        return handle_types
+
+    def getCreatedHandle(self, cmd):
+        '''Returns the (handle, parent) parameters of a command creating a handle, or None.'''
+        if not cmd.name.startswith('xrCreate') or cmd.name == 'xrCreateInstance' or len(cmd.params) < 2:
+            return None
+
+        all_handle_types = [handle.name for handle in self.api_handles]
+        parent = cmd.params[0]
+        created = cmd.params[-1]
+        if parent.type in all_handle_types and parent.pointer_count == 0 and \
+            created.type in self.getHandleTypes() and created.pointer_count == 1 and not created.is_const:
+            return (created, parent)
+
+        return None
+
+    def getDestroyedHandle(self, cmd):
+        '''Returns the parameter of a command destroying a handle, or None.'''
+        if not cmd.name.startswith('xrDestroy') or cmd.name == 'xrDestroyInstance' or not cmd.params:
+            return None
+
+        destroyed = cmd.params[0]
+        if destroyed.type in self.getHandleTypes() and destroyed.pointer_count == 0:
+            return destroyed
+
+        return None
+
+    # The commands sequencing frames, that are intercepted to maintain the frame context.
+    frame_functions = ['xrWaitFrame', 'xrBeginFrame', 'xrEndFrame']
+
+    # The commands intercepted only to maintain the session statistics.
+    statistics_functions = ['xrWaitSwapchainImage']
+
+    def getTrackedFunctions(self):
+        '''The commands intercepted to maintain the handle registry, the frame context and the session statistics.'''
+        return [cmd.name for cmd in self.core_commands + self.ext_commands
+                if self.getCreatedHandle(cmd) or self.getDestroyedHandle(cmd) or
+                cmd.name in self.frame_functions + self.statistics_functions]
+
+    def getHookedFunctions(self):
+        '''The commands wrapped by the layer, each measured by a HookScope.'''
+        hooked_functions = layer_apis.override_functions + self.getTrackedFunctions() + ['xrDestroyInstance', 'xrEnumerateInstanceExtensionProperties']
+        return [cmd.name for cmd in self.core_commands + self.ext_commands if cmd.name in hooked_functions]
+
+    def protect(self, cmd, generated):
+        if cmd.protect_value:
+            return f'''#if {cmd.protect_string}
+{generated}#endif
+'''
+        return generated
+
 class DispatchGenCppOutputGenerator(DispatchGenOutputGenerator):
     '''Generator for dispatch.gen.cpp.'''
     def beginFile(self, genOpts):
@@ -124,6 +183,7 @@ namespace openxr_api_layer
         generated_wrappers = self.genWrappers()
         generated_get_instance_proc_addr = self.genGetInstanceProcAddr()
         generated_create_instance = self.genCreateInstance()
+        generated_handle_type_names = self.genHandleTypeNames()
 
         postamble = '''	std::unique_ptr<OpenXrApi> g_instance;
 
@@ -144,30 +204,102 @@ namespace openxr_api_layer
 	// Auto-generated create instance handler.
 {generated_create_instance}
 
+	// Auto-generated handle registry helpers.
+{generated_handle_type_names}
+
 {postamble}'''
 
         write(contents, file=self.outFile)
         DispatchGenOutputGenerator.endFile(self)
 
+    def genFrameContext(self, cmd):
+        '''Returns the code adopting the frame id of a frame sequencing command, before it is traced.'''
+        if cmd.name not in self.frame_functions:
+            return ''
+
+        session = cmd.params[0].name
+        callback = cmd.name.replace('xr', 'On', 1)
+        if cmd.name == 'xrEndFrame':
+            return f'''
+		const uint64_t frameId = openxr_api_layer::frame::{callback}({session});
+		openxr_api_layer::statistics::{callback}({session}, frameId);
+'''
+        return f'''
+		const uint64_t frameId = openxr_api_layer::frame::{callback}({session});
+'''
+
+    def genTracking(self, cmd):
+        if cmd.name == 'xrWaitFrame':
+            session = cmd.params[0].name
+            frame_state = cmd.params[2].name
+            return f'''
+			openxr_api_layer::frame::OnWaitFrameCompleted({session}, frameId, result);
+			openxr_api_layer::statistics::OnWaitFrameCompleted({session}, result, {frame_state}, hookScope.getDownstreamTime());'''
+
+        if cmd.name == 'xrBeginFrame':
+            session = cmd.params[0].name
+            return f'''
+			openxr_api_layer::frame::OnBeginFrameCompleted({session}, frameId, result);
+			openxr_api_layer::statistics::OnBeginFrameCompleted({session}, frameId, result);'''
+
+        if cmd.name == 'xrWaitSwapchainImage':
+            return '''
+			openxr_api_layer::statistics::OnWaitSwapchainImageCompleted(result, hookScope.getDownstreamTime());'''
+
+        created = self.getCreatedHandle(cmd)
+        if created:
+            handle, parent = created
+            session_setup = ''
+            if handle.type == 'XrSession':
+                session_setup = f'''
+				openxr_api_layer::statistics::OnCreateSession(*{handle.name});'''
+            parent_arguments = ''
+            if parent.type in self.getHandleTypes():
+                parent_arguments = f', HandleType::{parent.type}, HandleToKey({parent.name})'
+            return f'''
+			if (XR_SUCCEEDED(result))
+			{{
+				openxr_api_layer::GetInstance()->GetHandleRegistry().add(HandleType::{handle.type}, HandleToKey(*{handle.name}){parent_arguments});{session_setup}
+			}}'''
+
+        destroyed = self.getDestroyedHandle(cmd)
+        if destroyed:
+            session_cleanup = ''
+            if destroyed.type == 'XrSession':
+                session_cleanup = f'''
+				openxr_api_layer::frame::OnDestroySession({destroyed.name});
+				openxr_api_layer::statistics::OnDestroySession({destroyed.name});'''
+            return f'''
+			if (XR_SUCCEEDED(result))
+			{{
+				openxr_api_layer::GetInstance()->GetHandleRegistry().remove(HandleType::{destroyed.type}, HandleToKey({destroyed.name}));{session_cleanup}
+			}}'''
+
+        return ''
+
     def genWrappers(self):
         generated = ''
 
+        hooked_functions = self.getHookedFunctions()
         for cur_cmd in self.core_commands + self.ext_commands:
-            if cur_cmd.name in (layer_apis.override_functions + ['xrDestroyInstance', 'xrEnumerateInstanceExtensionProperties']):
+            if cur_cmd.name in hooked_functions:
                 parameters_list = self.makeParametersList(cur_cmd)
                 arguments_list = self.makeArgumentsList(cur_cmd)
+                frame_context = self.genFrameContext(cur_cmd)
+                tracking = self.genTracking(cur_cmd)
 
                 if cur_cmd.return_type is not None:
-                    generated += f'''
+                    generated += self.protect(cur_cmd, f'''
 	XrResult XRAPI_CALL {cur_cmd.name}({parameters_list})
 	{{
+		openxr_api_layer::statistics::HookScope hookScope("{cur_cmd.name}");{frame_context}
 		TraceLocalActivity(local);
-		TraceLoggingWriteStart(local, "{cur_cmd.name}");
+		TraceLoggingWriteStart(local, "{cur_cmd.name}", TLFrameArg());
 
 		XrResult result;
 		try
 		{{
-			result = openxr_api_layer::GetInstance()->{cur_cmd.name}({arguments_list});
+			result = openxr_api_layer::GetInstance()->{cur_cmd.name}({arguments_list});{tracking}
 		}}
 		catch (std::exception& exc)
 		{{
@@ -183,13 +315,14 @@ namespace openxr_api_layer
 
 		return result;
 	}}
-'''
+''')
                 else:
-                    generated += f'''
+                    generated += self.protect(cur_cmd, f'''
 	void XRAPI_CALL {cur_cmd.name}({parameters_list})
 	{{
+		openxr_api_layer::statistics::HookScope hookScope("{cur_cmd.name}");
 		TraceLocalActivity(local);
-		TraceLoggingWriteStart(local, "{cur_cmd.name}");
+		TraceLoggingWriteStart(local, "{cur_cmd.name}", TLFrameArg());
 
 		try
 		{{
@@ -203,7 +336,7 @@ namespace openxr_api_layer
 
 		TraceLoggingWriteStop(local, "{cur_cmd.name}"));
 	}}
-'''
+''')
                 
         return generated
 
@@ -227,11 +360,42 @@ namespace openxr_api_layer
 '''
 
         generated += '''		m_applicationName = createInfo->applicationInfo.applicationName;
+		m_handleRegistry.add(HandleType::XrInstance, HandleToKey(m_instance));
 		return XR_SUCCESS;
 	}'''
 
         return generated
 
+    def genHandleTypeNames(self):
+        generated = '''	const char* GetHandleTypeName(HandleType type)
+	{
+		switch (type)
+		{
+'''
+
+        for handle in self.getHandleTypes():
+            generated += f'''		case HandleType::{handle}:
+			return "{handle}";
+'''
+
+        generated += '''		default:
+			return "<unknown>";
+		}
+	}
+
+	void OpenXrApi::ReportLeakedHandles()
+	{
+		for (const auto& [type, key] : m_handleRegistry.getLiveHandles())
+		{
+			if (type != HandleType::XrInstance)
+			{
+				Log(fmt::format("Handle was not destroyed: {} {:#x}\\n", GetHandleTypeName(type), key));
+			}
+		}
+	}'''
+
+        return generated
+
     def genGetInstanceProcAddr(self):
         generated = '''	XrResult OpenXrApi::xrGetInstanceProcAddr(XrInstance instance, const char* name, PFN_xrVoidFunction* function)
 	{
@@ -251,25 +415,36 @@ namespace openxr_api_layer
 		}
 '''
 
+        tracked_functions = self.getTrackedFunctions()
         for cur_cmd in self.core_commands:
-            if cur_cmd.name in layer_apis.override_functions + ['xrEnumerateInstanceExtensionProperties']:
-                generated += f'''		else if (apiName == "{cur_cmd.name}")
+            if cur_cmd.name in layer_apis.override_functions + tracked_functions + ['xrEnumerateInstanceExtensionProperties']:
+                generated += self.protect(cur_cmd, f'''		else if (apiName == "{cur_cmd.name}")
 		{{
 			m_{cur_cmd.name} = reinterpret_cast<PFN_{cur_cmd.name}>(*function);
 			*function = reinterpret_cast<PFN_xrVoidFunction>(openxr_api_layer::{cur_cmd.name});
 		}}
-'''
+''')
 
         # Always advertise extension functions.
         for cur_cmd in self.ext_commands:
             if cur_cmd.name in layer_apis.override_functions:
-                generated += f'''		else if (apiName == "{cur_cmd.name}")
+                generated += self.protect(cur_cmd, f'''		else if (apiName == "{cur_cmd.name}")
 		{{
 			m_{cur_cmd.name} = reinterpret_cast<PFN_{cur_cmd.name}>(*function);
 			*function = reinterpret_cast<PFN_xrVoidFunction>(openxr_api_layer::{cur_cmd.name});
 			result = XR_SUCCESS;
 		}}
-'''
+''')
+
+        # Only track the handles of extension functions that the runtime implements.
+        for cur_cmd in self.ext_commands:
+            if cur_cmd.name in tracked_functions and cur_cmd.name not in layer_apis.override_functions:
+                generated += self.protect(cur_cmd, f'''		else if (apiName == "{cur_cmd.name}" && XR_SUCCEEDED(result))
+		{{
+			m_{cur_cmd.name} = reinterpret_cast<PFN_{cur_cmd.name}>(*function);
+			*function = reinterpret_cast<PFN_xrVoidFunction>(openxr_api_layer::{cur_cmd.name});
+		}}
+''')
 
         generated += '''
 
@@ -291,12 +466,21 @@ namespace openxr_api_layer
 	void ResetInstance();
 	extern const std::vector<std::pair<std::string, uint32_t>> advertisedExtensions;
 
+	// Auto-generated handle types.
+HANDLE_TYPES_PLACEHOLDER
+	using HandleRegistry = HandleRegistryT<HandleType, static_cast<size_t>(HandleType::Count)>;
+	const char* GetHandleTypeName(HandleType type);
+
+	// Auto-generated number of wrapped functions (an upper bound when some are compiled out).
+HOOK_COUNT_PLACEHOLDER
+
 	class OpenXrApi
 	{
 	private:
 		XrInstance m_instance{ XR_NULL_HANDLE };
 		std::string m_applicationName;
 		std::vector<std::string> m_grantedExtensions;
+		std::vector<std::string> m_implementedExtensions;
 
 	protected:
 		OpenXrApi() = default;
@@ -332,6 +516,29 @@ namespace openxr_api_layer
 			m_grantedExtensions = grantedExtensions;
 		}
 
+		// The advertised extensions requested by the application that the runtime lacks, and that the layer implements.
+		const std::vector<std::string>& GetImplementedExtensions() const
+		{
+			return m_implementedExtensions;
+		}
+
+		bool IsExtensionImplemented(const std::string_view& extensionName) const
+		{
+			return std::find(m_implementedExtensions.cbegin(), m_implementedExtensions.cend(), extensionName) !=
+				m_implementedExtensions.cend();
+		}
+
+		void SetImplementedExtensions(const std::vector<std::string>& implementedExtensions)
+		{
+			m_implementedExtensions = implementedExtensions;
+		}
+
+		// The live handles of the instance, maintained by the auto-generated create and destroy wrappers.
+		HandleRegistry& GetHandleRegistry()
+		{
+			return m_handleRegistry;
+		}
+
 		// Specially-handled by the auto-generated code.
 		virtual XrResult xrGetInstanceProcAddr(XrInstance instance, const char* name, PFN_xrVoidFunction* function);
 		virtual XrResult xrCreateInstance(const XrInstanceCreateInfo* createInfo);
@@ -340,55 +547,80 @@ namespace openxr_api_layer
 		virtual XrResult xrDestroyInstance(XrInstance instance) {
 			// Invoking ResetInstance() is equivalent to `delete this;' so we must take precautions.
 			PFN_xrDestroyInstance finalDestroyInstance = m_xrDestroyInstance;
+			ReportLeakedHandles();
 			ResetInstance();
 			return finalDestroyInstance(instance);
 		}
 
 		// Make sure we enumerate the layer's extensions, specifically when another API layer may resolve our implementation
-		// of xrEnumerateInstanceExtensionProperties() instead of the loaders.
+		// of xrEnumerateInstanceExtensionProperties() instead of the loaders. The extensions already implemented further
+		// down the chain are only enumerated once.
 		virtual XrResult xrEnumerateInstanceExtensionProperties(const char* layerName,
 																uint32_t propertyCapacityInput,
 																uint32_t* propertyCountOutput,
 																XrExtensionProperties* properties) {
-			XrResult result = XR_ERROR_RUNTIME_FAILURE;
-			if (!layerName || std::string_view(layerName) != LAYER_NAME) {
-				result = m_xrEnumerateInstanceExtensionProperties(layerName, propertyCapacityInput, propertyCountOutput, properties);
+			const bool isThisLayer = layerName && std::string_view(layerName) == LAYER_NAME;
+
+			std::vector<XrExtensionProperties> nextExtensions;
+			if (!isThisLayer) {
+				uint32_t nextCount = 0;
+				XrResult result = m_xrEnumerateInstanceExtensionProperties(layerName, 0, &nextCount, nullptr);
+				if (XR_SUCCEEDED(result)) {
+					nextExtensions.resize(nextCount, {XR_TYPE_EXTENSION_PROPERTIES});
+					result = m_xrEnumerateInstanceExtensionProperties(layerName, nextCount, &nextCount, nextExtensions.data());
+				}
+				if (XR_FAILED(result)) {
+					return result;
+				}
+				nextExtensions.resize(nextCount);
 			}
 
-			if (XR_SUCCEEDED(result)) {
-				if (!layerName || std::string_view(layerName) == LAYER_NAME) {
-					const uint32_t baseOffset = *propertyCountOutput;
-					*propertyCountOutput += (uint32_t)advertisedExtensions.size();
-					if (propertyCapacityInput) {
-						if (propertyCapacityInput < *propertyCountOutput) {
-							result = XR_ERROR_SIZE_INSUFFICIENT;
-						} else {
-							result = XR_SUCCESS;
-							for (uint32_t i = baseOffset; i < *propertyCountOutput; i++) {
-								if (properties[i].type != XR_TYPE_EXTENSION_PROPERTIES) {
-									result = XR_ERROR_VALIDATION_FAILURE;
-									break;
-								}
-
-								strcpy_s(properties[i].extensionName, advertisedExtensions[i - baseOffset].first.c_str());
-								properties[i].extensionVersion = advertisedExtensions[i - baseOffset].second;
-							}
-						}
+			std::vector<std::pair<std::string, uint32_t>> extensions;
+			for (const auto& properties : nextExtensions) {
+				extensions.push_back({properties.extensionName, properties.extensionVersion});
+			}
+			if (!layerName || isThisLayer) {
+				for (const auto& extension : advertisedExtensions) {
+					const auto matchExtensionName = [&](const std::pair<std::string, uint32_t>& other) {
+						return other.first == extension.first;
+					};
+					if (std::none_of(extensions.cbegin(), extensions.cend(), matchExtensionName)) {
+						extensions.push_back(extension);
 					}
 				}
 			}
 
-			return result;
+			*propertyCountOutput = (uint32_t)extensions.size();
+			if (!propertyCapacityInput) {
+				return XR_SUCCESS;
+			}
+			if (propertyCapacityInput < *propertyCountOutput) {
+				return XR_ERROR_SIZE_INSUFFICIENT;
+			}
+			for (uint32_t i = 0; i < *propertyCountOutput; i++) {
+				if (properties[i].type != XR_TYPE_EXTENSION_PROPERTIES) {
+					return XR_ERROR_VALIDATION_FAILURE;
+				}
+
+				strcpy_s(properties[i].extensionName, extensions[i].first.c_str());
+				properties[i].extensionVersion = extensions[i].second;
+			}
+
+			return XR_SUCCESS;
 		}
 
 	private:
 		XrResult xrGetInstanceProcAddrInternal(XrInstance instance, const char* name, PFN_xrVoidFunction* function);
 		friend XrResult XRAPI_CALL xrGetInstanceProcAddr(XrInstance instance, const char* name, PFN_xrVoidFunction* function);
 
+		void ReportLeakedHandles();
+
+		HandleRegistry m_handleRegistry;
+
 		PFN_xrDestroyInstance m_xrDestroyInstance{nullptr};
 		PFN_xrEnumerateInstanceExtensionProperties m_xrEnumerateInstanceExtensionProperties{nullptr};
 '''
-        write(preamble, file=self.outFile)
+        self.preamble = preamble
 
     def endFile(self):
         generated_virtual_methods = self.genVirtualMethods()
@@ -401,6 +633,11 @@ namespace openxr_api_layer
 } // namespace openxr_api_layer
 '''
 
+        # The handle types and the wrapped functions are only known once the registry was parsed.
+        hook_count = f'\tconstexpr size_t HookCount = {len(self.getHookedFunctions())};'
+        preamble = self.preamble.replace('HANDLE_TYPES_PLACEHOLDER', self.genHandleTypes())
+        write(preamble.replace('HOOK_COUNT_PLACEHOLDER', hook_count), file=self.outFile)
+
         contents = f'''
 		// Auto-generated entries for the requested APIs.
 {generated_virtual_methods}
@@ -411,36 +648,53 @@ namespace openxr_api_layer
 
         DispatchGenOutputGenerator.endFile(self)
 
+    def genHandleTypes(self):
+        generated = '''	enum class HandleType : uint32_t
+	{
+'''
+
+        for handle in self.getHandleTypes():
+            generated += f'''		{handle},
+'''
+
+        generated += '''		Count
+	};'''
+
+        return generated
+
     def genVirtualMethods(self):
         generated = ''
 
-        commands_to_include = list(set(layer_apis.override_functions + layer_apis.requested_functions))
+        commands_to_include = list(set(layer_apis.override_functions + layer_apis.requested_functions + self.getTrackedFunctions()))
         for cur_cmd in self.core_commands + self.ext_commands:
             if cur_cmd.name in commands_to_include:
                 parameters_list = self.makeParametersList(cur_cmd)
                 arguments_list = self.makeArgumentsList(cur_cmd)
 
-                generated += '''
+                entry = '''
 	public:'''
 
                 if cur_cmd.return_type is not None:
-                    generated += f'''
+                    entry += f'''
 		virtual XrResult {cur_cmd.name}({parameters_list})
 		{{
+			openxr_api_layer::statistics::DownstreamScope downstream;
 			return m_{cur_cmd.name}({arguments_list});
 		}}
 '''
                 else:
-                    generated += f'''
+                    entry += f'''
 		virtual void {cur_cmd.name}({parameters_list})
 		{{
+			openxr_api_layer::statistics::DownstreamScope downstream;
 			m_{cur_cmd.name}({arguments_list});
 		}}
 '''
 
-                generated += f'''	private:
+                entry += f'''	private:
 		PFN_{cur_cmd.name} m_{cur_cmd.name}{{ nullptr }};
 '''
+                generated += self.protect(cur_cmd, entry)
                 
         return generated
 
@@ -0,0 +1,120 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "frame.h"
+
+namespace {
+
+    struct SessionFrames {
+        // Frames that were waited but not yet begun, in order.
+        std::deque<uint64_t> waitedFrames;
+        uint64_t inFlightFrameId{0};
+    };
+
+    std::atomic<uint64_t> g_nextFrameId{1};
+    std::atomic<uint64_t> g_lastBegunFrameId{0};
+    thread_local uint64_t t_currentFrameId{0};
+
+    std::mutex g_sessionsMutex;
+    std::unordered_map<XrSession, SessionFrames> g_sessions;
+
+} // namespace
+
+namespace openxr_api_layer::frame {
+
+    uint64_t GetCurrentFrameId() {
+        return t_currentFrameId ? t_currentFrameId : g_lastBegunFrameId.load(std::memory_order_relaxed);
+    }
+
+    ScopedFrameId::ScopedFrameId(uint64_t frameId) : m_previousFrameId(t_currentFrameId) {
+        t_currentFrameId = frameId;
+    }
+
+    ScopedFrameId::~ScopedFrameId() {
+        t_currentFrameId = m_previousFrameId;
+    }
+
+    uint64_t OnWaitFrame(XrSession session) {
+        const uint64_t frameId = g_nextFrameId++;
+        t_currentFrameId = frameId;
+        return frameId;
+    }
+
+    void OnWaitFrameCompleted(XrSession session, uint64_t frameId, XrResult result) {
+        if (XR_FAILED(result)) {
+            return;
+        }
+
+        std::unique_lock lock(g_sessionsMutex);
+
+        g_sessions[session].waitedFrames.push_back(frameId);
+    }
+
+    uint64_t OnBeginFrame(XrSession session) {
+        uint64_t frameId;
+        {
+            std::unique_lock lock(g_sessionsMutex);
+
+            // Without a waited frame, the call will fail and we attribute it to the in-flight frame.
+            const SessionFrames& frames = g_sessions[session];
+            frameId = !frames.waitedFrames.empty() ? frames.waitedFrames.front() : frames.inFlightFrameId;
+        }
+        t_currentFrameId = frameId;
+        return frameId;
+    }
+
+    void OnBeginFrameCompleted(XrSession session, uint64_t frameId, XrResult result) {
+        if (XR_FAILED(result)) {
+            return;
+        }
+
+        std::unique_lock lock(g_sessionsMutex);
+
+        SessionFrames& frames = g_sessions[session];
+        if (!frames.waitedFrames.empty() && frames.waitedFrames.front() == frameId) {
+            frames.waitedFrames.pop_front();
+        }
+        frames.inFlightFrameId = frameId;
+        g_lastBegunFrameId.store(frameId, std::memory_order_relaxed);
+    }
+
+    uint64_t OnEndFrame(XrSession session) {
+        uint64_t frameId;
+        {
+            std::unique_lock lock(g_sessionsMutex);
+
+            frameId = g_sessions[session].inFlightFrameId;
+        }
+        t_currentFrameId = frameId;
+        return frameId;
+    }
+
+    void OnDestroySession(XrSession session) {
+        std::unique_lock lock(g_sessionsMutex);
+
+        g_sessions.erase(session);
+    }
+
+} // namespace openxr_api_layer::frame
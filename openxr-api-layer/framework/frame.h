@@ -0,0 +1,61 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+namespace openxr_api_layer::frame {
+
+    // Frame ids are unique across all sessions, and increase monotonically within a session. 0 means no frame.
+
+    // The frame id of the calling thread: the frame it last waited or began, or, for a thread that never did (eg: a
+    // render thread), the frame most recently begun by any session.
+    uint64_t GetCurrentFrameId();
+
+    // Adopt a frame id on the calling thread for the lifetime of the object, eg: in a task submitted to a worker pool.
+    class ScopedFrameId {
+      public:
+        ScopedFrameId(uint64_t frameId);
+        ~ScopedFrameId();
+
+        ScopedFrameId(const ScopedFrameId&) = delete;
+        ScopedFrameId& operator=(const ScopedFrameId&) = delete;
+
+      private:
+        const uint64_t m_previousFrameId;
+    };
+
+    // Frame sequencing, driven by the generated xrWaitFrame(), xrBeginFrame() and xrEndFrame() wrappers.
+    // A frame id is assigned when xrWaitFrame() is entered. The matching xrBeginFrame() (the oldest waited frame not
+    // yet begun) makes it the in-flight frame of the session, which xrEndFrame() then submits. Frames may be waited on
+    // one thread and begun/ended on another. The calling thread adopts the frame id in each case.
+    uint64_t OnWaitFrame(XrSession session);
+    void OnWaitFrameCompleted(XrSession session, uint64_t frameId, XrResult result);
+    uint64_t OnBeginFrame(XrSession session);
+    void OnBeginFrameCompleted(XrSession session, uint64_t frameId, XrResult result);
+    uint64_t OnEndFrame(XrSession session);
+    void OnDestroySession(XrSession session);
+
+} // namespace openxr_api_layer::frame
+
+// Stamp a trace event with the frame id of the calling thread.
+#define TLFrameArg() TLArg(openxr_api_layer::frame::GetCurrentFrameId(), "FrameId")
@@ -0,0 +1,336 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+namespace openxr_api_layer {
+
+    template <typename Handle>
+    inline uint64_t HandleToKey(Handle handle) {
+        if constexpr (std::is_pointer_v<Handle>) {
+            return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+        } else {
+            return static_cast<uint64_t>(handle);
+        }
+    }
+
+    template <typename Handle>
+    inline Handle KeyToHandle(uint64_t key) {
+        if constexpr (std::is_pointer_v<Handle>) {
+            return reinterpret_cast<Handle>(static_cast<uintptr_t>(key));
+        } else {
+            return static_cast<Handle>(key);
+        }
+    }
+
+    // An open-addressing map from handles to the state objects it owns. Lookups are lock-free, while insertions and
+    // removals are serialized. The OpenXR threading rules forbid using a handle concurrently with its destruction, so
+    // the state of a handle can be freed as soon as it is erased.
+    template <typename Handle, typename Value>
+    class HandleMap {
+      public:
+        HandleMap() {
+            m_table.store(allocateTable(16), std::memory_order_release);
+        }
+
+        ~HandleMap() {
+            clear();
+        }
+
+        HandleMap(const HandleMap&) = delete;
+        HandleMap& operator=(const HandleMap&) = delete;
+
+        Value* find(Handle handle) const {
+            const uint64_t key = HandleToKey(handle);
+
+            // Prevent the table from being freed while we probe it.
+            m_readers.fetch_add(1);
+            const Table* table = m_table.load();
+            Value* value = nullptr;
+            for (size_t i = hash(key) & table->mask, probes = 0; probes <= table->mask;
+                 i = (i + 1) & table->mask, probes++) {
+                const uint64_t slotKey = table->slots[i].key.load(std::memory_order_acquire);
+                if (slotKey == key) {
+                    value = table->slots[i].value.load(std::memory_order_acquire);
+                    break;
+                }
+                if (slotKey == EmptyKey) {
+                    break;
+                }
+            }
+            m_readers.fetch_sub(1, std::memory_order_release);
+
+            return value;
+        }
+
+        // Any previous state of the handle is destroyed.
+        Value& insert(Handle handle, std::unique_ptr<Value> value) {
+            std::unique_lock lock(m_mutex);
+
+            const uint64_t key = HandleToKey(handle);
+            Table* table = m_table.load(std::memory_order_relaxed);
+            Slot* slot = findSlot(*table, key);
+            if (slot) {
+                std::unique_ptr<Value> previous(slot->value.exchange(value.get(), std::memory_order_acq_rel));
+                return *value.release();
+            }
+
+            if ((m_size + m_tombstones + 1) * 2 > table->mask + 1) {
+                table = rehash();
+            }
+
+            // Claim the first free slot on the probe sequence, which might hold a tombstone.
+            size_t i = hash(key) & table->mask;
+            while (true) {
+                const uint64_t slotKey = table->slots[i].key.load(std::memory_order_relaxed);
+                if (slotKey == EmptyKey || slotKey == TombstoneKey) {
+                    if (slotKey == TombstoneKey) {
+                        m_tombstones--;
+                    }
+                    break;
+                }
+                i = (i + 1) & table->mask;
+            }
+            table->slots[i].value.store(value.get(), std::memory_order_relaxed);
+            table->slots[i].key.store(key, std::memory_order_release);
+            m_size++;
+
+            return *value.release();
+        }
+
+        bool erase(Handle handle) {
+            std::unique_lock lock(m_mutex);
+
+            Slot* slot = findSlot(*m_table.load(std::memory_order_relaxed), HandleToKey(handle));
+            if (!slot) {
+                return false;
+            }
+
+            slot->key.store(TombstoneKey, std::memory_order_release);
+            delete slot->value.exchange(nullptr, std::memory_order_acq_rel);
+            m_size--;
+            m_tombstones++;
+
+            return true;
+        }
+
+        void clear() {
+            std::unique_lock lock(m_mutex);
+
+            Table* table = m_table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i <= table->mask; i++) {
+                const uint64_t slotKey = table->slots[i].key.load(std::memory_order_relaxed);
+                if (slotKey != EmptyKey && slotKey != TombstoneKey) {
+                    table->slots[i].key.store(TombstoneKey, std::memory_order_release);
+                    delete table->slots[i].value.exchange(nullptr, std::memory_order_acq_rel);
+                }
+            }
+            m_tombstones += m_size;
+            m_size = 0;
+        }
+
+        size_t size() const {
+            std::unique_lock lock(m_mutex);
+
+            return m_size;
+        }
+
+        // Invoke function(Handle, Value&) for each handle. The map must not be modified from the function.
+        template <typename Function>
+        void forEach(Function&& function) const {
+            std::unique_lock lock(m_mutex);
+
+            const Table* table = m_table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i <= table->mask; i++) {
+                const uint64_t slotKey = table->slots[i].key.load(std::memory_order_relaxed);
+                if (slotKey != EmptyKey && slotKey != TombstoneKey) {
+                    function(KeyToHandle<Handle>(slotKey), *table->slots[i].value.load(std::memory_order_relaxed));
+                }
+            }
+        }
+
+      private:
+        // XR_NULL_HANDLE is never a valid handle.
+        static constexpr uint64_t EmptyKey = 0;
+        static constexpr uint64_t TombstoneKey = ~0ull;
+
+        struct Slot {
+            std::atomic<uint64_t> key{EmptyKey};
+            std::atomic<Value*> value{nullptr};
+        };
+
+        struct Table {
+            size_t mask;
+            std::unique_ptr<Slot[]> slots;
+        };
+
+        static size_t hash(uint64_t key) {
+            // Handles are often sequential or aligned pointers: mix all the bits into the low bits.
+            key *= 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(key ^ (key >> 32));
+        }
+
+        Table* allocateTable(size_t capacity) {
+            auto table = std::make_unique<Table>();
+            table->mask = capacity - 1;
+            table->slots = std::make_unique<Slot[]>(capacity);
+            m_tables.push_back(std::move(table));
+            return m_tables.back().get();
+        }
+
+        Slot* findSlot(Table& table, uint64_t key) const {
+            for (size_t i = hash(key) & table.mask, probes = 0; probes <= table.mask;
+                 i = (i + 1) & table.mask, probes++) {
+                const uint64_t slotKey = table.slots[i].key.load(std::memory_order_relaxed);
+                if (slotKey == key) {
+                    return &table.slots[i];
+                }
+                if (slotKey == EmptyKey) {
+                    break;
+                }
+            }
+            return nullptr;
+        }
+
+        // Readers may still be probing the previous tables, so they are only freed once no lookup is in flight.
+        Table* rehash() {
+            const Table* table = m_table.load(std::memory_order_relaxed);
+            size_t capacity = table->mask + 1;
+            while ((m_size + 1) * 4 > capacity) {
+                capacity *= 2;
+            }
+
+            Table* newTable = allocateTable(capacity);
+            for (size_t i = 0; i <= table->mask; i++) {
+                const uint64_t slotKey = table->slots[i].key.load(std::memory_order_relaxed);
+                if (slotKey == EmptyKey || slotKey == TombstoneKey) {
+                    continue;
+                }
+
+                size_t j = hash(slotKey) & newTable->mask;
+                while (newTable->slots[j].key.load(std::memory_order_relaxed) != EmptyKey) {
+                    j = (j + 1) & newTable->mask;
+                }
+                newTable->slots[j].value.store(table->slots[i].value.load(std::memory_order_relaxed),
+                                               std::memory_order_relaxed);
+                newTable->slots[j].key.store(slotKey, std::memory_order_relaxed);
+            }
+            m_tombstones = 0;
+            m_table.store(newTable);
+
+            // Lookups starting after this point can only see the new table.
+            if (!m_readers.load()) {
+                m_tables.erase(m_tables.begin(), m_tables.end() - 1);
+            }
+
+            return newTable;
+        }
+
+        mutable std::mutex m_mutex;
+        std::atomic<Table*> m_table{nullptr};
+        std::vector<std::unique_ptr<Table>> m_tables;
+        mutable std::atomic<uint32_t> m_readers{0};
+        size_t m_size{0};
+        size_t m_tombstones{0};
+    };
+
+    // Tracks the live handles of each type and the handle they were created from, to report the handles that were not
+    // destroyed. Destroying a handle implicitly destroys its tracked children. The handle types are enumerated by the
+    // generated dispatcher (see tracked_handles in layer_apis.py), since all handles share the same C++ type on 32-bit
+    // platforms.
+    template <typename HandleType, size_t TypeCount>
+    class HandleRegistryT {
+      public:
+        void add(HandleType type, uint64_t key) {
+            addKey(static_cast<size_t>(type), key, TypeCount, 0);
+        }
+
+        void add(HandleType type, uint64_t key, HandleType parentType, uint64_t parentKey) {
+            addKey(static_cast<size_t>(type), key, static_cast<size_t>(parentType), parentKey);
+        }
+
+        void remove(HandleType type, uint64_t key) {
+            std::unique_lock lock(m_mutex);
+
+            removeKey(static_cast<size_t>(type), key);
+        }
+
+        // The handles that were not destroyed.
+        std::vector<std::pair<HandleType, uint64_t>> getLiveHandles() const {
+            std::vector<std::pair<HandleType, uint64_t>> liveHandles;
+            for (size_t type = 0; type < TypeCount; type++) {
+                m_handles[type].forEach([&](uint64_t key, const Entry&) {
+                    liveHandles.emplace_back(static_cast<HandleType>(type), key);
+                });
+            }
+            return liveHandles;
+        }
+
+      private:
+        struct Entry {
+            size_t parentType;
+            uint64_t parentKey;
+            std::vector<std::pair<size_t, uint64_t>> children;
+        };
+
+        void addKey(size_t type, uint64_t key, size_t parentType, uint64_t parentKey) {
+            std::unique_lock lock(m_mutex);
+
+            // A runtime may recycle the value of a destroyed handle that we did not see being destroyed.
+            removeKey(type, key);
+
+            Entry* parent = parentType < TypeCount ? m_handles[parentType].find(parentKey) : nullptr;
+            if (parent) {
+                parent->children.emplace_back(type, key);
+            }
+            m_handles[type].insert(key, std::make_unique<Entry>(Entry{parent ? parentType : TypeCount, parentKey}));
+        }
+
+        void removeKey(size_t type, uint64_t key) {
+            Entry* entry = m_handles[type].find(key);
+            if (!entry) {
+                return;
+            }
+
+            const auto children = std::move(entry->children);
+            for (const auto& [childType, childKey] : children) {
+                removeKey(childType, childKey);
+            }
+
+            Entry* parent =
+                entry->parentType < TypeCount ? m_handles[entry->parentType].find(entry->parentKey) : nullptr;
+            if (parent) {
+                const auto it = std::find(parent->children.begin(), parent->children.end(), std::make_pair(type, key));
+                if (it != parent->children.end()) {
+                    parent->children.erase(it);
+                }
+            }
+
+            m_handles[type].erase(key);
+        }
+
+        std::mutex m_mutex;
+        std::array<HandleMap<uint64_t, Entry>, TypeCount> m_handles;
+    };
+
+} // namespace openxr_api_layer
@@ -1,7 +1,14 @@
 # The list of OpenXR functions our layer will override.
 override_functions = [
     "xrGetSystem",
-    "xrCreateSession"
+    "xrCreateSession",
+    "xrDestroySession",
+    "xrBeginSession",
+    "xrEndFrame",
+    "xrLocateSpacesKHR",
+    "xrLocateViews",
+    "xrPollEvent",
+    "xrGetVisibilityMaskKHR"
 ]
 
 # The list of OpenXR functions our layer will use from the runtime.
@@ -12,4 +19,9 @@ requested_functions = [
 ]
 
 # The list of OpenXR extensions our layer will either override or use.
-extensions = []
+extensions = ["XR_KHR_locate_spaces", "XR_KHR_visibility_mask"]
+
+# The list of handle types whose creation and destruction are tracked by the handle registry (eg: to report the leaked
+# handles). Each adds a wrapper to the functions creating and destroying this type of handle. XrInstance is always
+# tracked, and XrSession is required by the frame context and the session statistics.
+tracked_handles = ["XrSession"]
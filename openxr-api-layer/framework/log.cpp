@@ -45,6 +45,10 @@ namespace openxr_api_layer::log {
 
             char buf[1024];
             size_t offset = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %z: ", std::localtime(&now));
+            const uint64_t frameId = frame::GetCurrentFrameId();
+            if (frameId) {
+                offset += sprintf_s(buf + offset, sizeof(buf) - offset, "[frame %llu] ", frameId);
+            }
             vsnprintf_s(buf + offset, sizeof(buf) - offset, _TRUNCATE, fmt, va);
             OutputDebugStringA(buf);
             if (logStream.is_open()) {
@@ -0,0 +1,134 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+namespace openxr_api_layer {
+
+    // A failed XrResult, along with a static string describing the failing operation. It never allocates, so that it
+    // can be returned at frame rate.
+    struct XrFailure {
+        XrResult result;
+        const char* what;
+    };
+
+    // A value or an XrFailure, for the per-frame paths where exceptions are too costly. Qualified success codes (eg:
+    // XR_SESSION_LOSS_PENDING) are carried along with the value.
+    template <typename T>
+    class XrExpected {
+      public:
+        XrExpected(T value, XrResult result = XR_SUCCESS) : m_value(std::move(value)), m_result(result) {
+        }
+        XrExpected(const XrFailure& failure) : m_result(failure.result), m_what(failure.what) {
+        }
+
+        bool has_value() const {
+            return m_value.has_value();
+        }
+        explicit operator bool() const {
+            return has_value();
+        }
+
+        T& value() {
+            return m_value.value();
+        }
+        const T& value() const {
+            return m_value.value();
+        }
+        T value_or(T defaultValue) const {
+            return m_value.value_or(std::move(defaultValue));
+        }
+        T& operator*() {
+            return *m_value;
+        }
+        const T& operator*() const {
+            return *m_value;
+        }
+
+        XrResult result() const {
+            return m_result;
+        }
+        const char* what() const {
+            return m_what;
+        }
+
+      private:
+        std::optional<T> m_value;
+        XrResult m_result;
+        const char* m_what{nullptr};
+    };
+
+    template <>
+    class XrExpected<void> {
+      public:
+        XrExpected(XrResult result = XR_SUCCESS) : m_result(result) {
+        }
+        XrExpected(const XrFailure& failure) : m_result(failure.result), m_what(failure.what) {
+        }
+
+        bool has_value() const {
+            return XR_SUCCEEDED(m_result);
+        }
+        explicit operator bool() const {
+            return has_value();
+        }
+
+        XrResult result() const {
+            return m_result;
+        }
+        const char* what() const {
+            return m_what;
+        }
+
+      private:
+        XrResult m_result;
+        const char* m_what{nullptr};
+    };
+
+} // namespace openxr_api_layer
+
+// Non-throwing counterpart to CHECK_XRCMD(), for use in functions returning an XrExpected.
+#define RETURN_IF_XR_FAILED(cmd)                                                                                       \
+    do {                                                                                                               \
+        const XrResult _result = (cmd);                                                                                \
+        if (XR_FAILED(_result)) {                                                                                      \
+            return openxr_api_layer::XrFailure{_result, #cmd};                                                         \
+        }                                                                                                              \
+    } while (false)
+
+// Return an XrFailure when a condition is met, for use in functions returning an XrExpected.
+#define RETURN_XR_FAILURE_IF(result, condition, what)                                                                  \
+    do {                                                                                                               \
+        if (condition) {                                                                                               \
+            return openxr_api_layer::XrFailure{(result), (what)};                                                      \
+        }                                                                                                              \
+    } while (false)
+
+// Bridge an XrExpected to the exception-based error handling, used outside of the per-frame paths.
+#define CHECK_XREXPECTED(expected)                                                                                     \
+    do {                                                                                                               \
+        const auto& _expected = (expected);                                                                            \
+        if (!_expected.has_value()) {                                                                                  \
+            CHECK_XRRESULT(_expected.result(), _expected.what() ? _expected.what() : #expected);                       \
+        }                                                                                                              \
+    } while (false)
@@ -0,0 +1,517 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include <layer.h>
+
+#include "log.h"
+#include "statistics.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::statistics;
+
+    int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    constexpr uint32_t SubBucketHalfCount = 1u << (HdrHistogram::SubBucketBits - 1);
+
+    size_t getBucketIndex(uint64_t value) {
+        if (value < (uint64_t{1} << HdrHistogram::SubBucketBits)) {
+            return static_cast<size_t>(value);
+        }
+
+        // _BitScanReverse64() is not available on 32-bit targets.
+        unsigned long msb;
+        if (_BitScanReverse(&msb, static_cast<unsigned long>(value >> 32))) {
+            msb += 32;
+        } else {
+            _BitScanReverse(&msb, static_cast<unsigned long>(value));
+        }
+        const uint32_t exponent = msb - (HdrHistogram::SubBucketBits - 1);
+        return static_cast<size_t>(exponent) * SubBucketHalfCount + static_cast<size_t>(value >> exponent);
+    }
+
+    uint64_t getHighestEquivalentValue(size_t index) {
+        if (index < (uint64_t{1} << HdrHistogram::SubBucketBits)) {
+            return index;
+        }
+
+        const uint32_t exponent = static_cast<uint32_t>(index / SubBucketHalfCount) - 1;
+        const uint64_t subBucket = index - static_cast<uint64_t>(exponent) * SubBucketHalfCount;
+        return ((subBucket + 1) << exponent) - 1;
+    }
+
+    // Hooks seen during a session, in order of first call. There is one slot for each function wrapped by the
+    // generated dispatcher, so that none is dropped.
+    constexpr size_t MaxHooks = openxr_api_layer::HookCount;
+
+    struct HookStatistics {
+        std::atomic<const char*> name{nullptr};
+        HdrHistogram overhead;
+    };
+
+    // Tracked devices with prediction errors, in order of first record.
+    constexpr size_t MaxDevices = 8;
+
+    struct DeviceStatistics {
+        std::atomic<const char*> name{nullptr};
+        HdrHistogram angularError;
+        HdrHistogram positionalError;
+    };
+
+    // Begin timestamps of the frames in flight, indexed by frame id.
+    constexpr size_t MaxFramesInFlight = 8;
+
+    struct BegunFrame {
+        std::atomic<uint64_t> frameId{0};
+        std::atomic<int64_t> beginTime{0};
+    };
+
+    struct SessionStatistics {
+        XrSession session{XR_NULL_HANDLE};
+        int64_t createTime{0};
+
+        HdrHistogram appCpuTime;
+        HdrHistogram waitFrameTime;
+        HdrHistogram compositionGpuTime;
+        HdrHistogram swapchainWaitTime;
+
+        std::atomic<uint64_t> missedFrames{0};
+        std::atomic<XrTime> lastPredictedDisplayTime{0};
+        std::array<BegunFrame, MaxFramesInFlight> begunFrames;
+
+        std::array<HookStatistics, MaxHooks> hooks;
+        std::array<DeviceStatistics, MaxDevices> devices;
+
+        void reset(XrSession newSession) {
+            session = newSession;
+            createTime = now();
+            appCpuTime.reset();
+            waitFrameTime.reset();
+            compositionGpuTime.reset();
+            swapchainWaitTime.reset();
+            missedFrames = 0;
+            lastPredictedDisplayTime = 0;
+            for (auto& frame : begunFrames) {
+                frame.frameId = 0;
+                frame.beginTime = 0;
+            }
+            for (auto& hook : hooks) {
+                hook.name = nullptr;
+                hook.overhead.reset();
+            }
+            for (auto& device : devices) {
+                device.name = nullptr;
+                device.angularError.reset();
+                device.positionalError.reset();
+            }
+        }
+
+        HdrHistogram* getHookOverhead(const char* name) {
+            for (auto& hook : hooks) {
+                const char* expected = hook.name.load(std::memory_order_acquire);
+                if (!expected && hook.name.compare_exchange_strong(expected, name, std::memory_order_acq_rel)) {
+                    return &hook.overhead;
+                }
+                if (expected == name) {
+                    return &hook.overhead;
+                }
+            }
+            return nullptr;
+        }
+
+        DeviceStatistics* getDevice(const char* name) {
+            for (auto& device : devices) {
+                const char* expected = device.name.load(std::memory_order_acquire);
+                if (!expected && device.name.compare_exchange_strong(expected, name, std::memory_order_acq_rel)) {
+                    return &device;
+                }
+                if (expected == name) {
+                    return &device;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    // The storage is reserved once, and reused for every session.
+    std::mutex g_statisticsMutex;
+    std::unique_ptr<SessionStatistics> g_statistics;
+    std::atomic<SessionStatistics*> g_activeStatistics{nullptr};
+
+    thread_local uint64_t t_downstreamTime{0};
+
+    SessionStatistics* getActiveStatistics(XrSession session) {
+        SessionStatistics* statistics = g_activeStatistics.load(std::memory_order_acquire);
+        return statistics && statistics->session == session ? statistics : nullptr;
+    }
+
+    struct Metric {
+        const char* name;
+        const char* description;
+        const HdrHistogram& histogram;
+    };
+
+    // How the recorded values are reported.
+    struct Unit {
+        const char* name;
+        double divisor;
+        int precision;
+    };
+
+    constexpr Unit Microseconds{"us", 1e3, 1};
+    constexpr Unit Degrees{"deg", 1e6, 3};
+    constexpr Unit Millimeters{"mm", 1e3, 2};
+
+    std::string formatValue(uint64_t value, const Unit& unit) {
+        return fmt::format("{:.{}f}", value / unit.divisor, unit.precision);
+    }
+
+    std::string formatPercentiles(const HdrHistogram& histogram, const Unit& unit = Microseconds) {
+        return fmt::format("p50 {} / p90 {} / p99 {} / max {} {} ({} samples)",
+                           formatValue(histogram.getValueAtPercentile(50), unit),
+                           formatValue(histogram.getValueAtPercentile(90), unit),
+                           formatValue(histogram.getValueAtPercentile(99), unit),
+                           formatValue(histogram.getMax(), unit),
+                           unit.name,
+                           histogram.getCount());
+    }
+
+    std::string formatJsonPercentiles(const HdrHistogram& histogram, const Unit& unit = Microseconds) {
+        return fmt::format(R"({{ "count": {}, "p50": {}, "p90": {}, "p99": {}, "max": {} }})",
+                           histogram.getCount(),
+                           formatValue(histogram.getValueAtPercentile(50), unit),
+                           formatValue(histogram.getValueAtPercentile(90), unit),
+                           formatValue(histogram.getValueAtPercentile(99), unit),
+                           formatValue(histogram.getMax(), unit));
+    }
+
+    void writeReport(const SessionStatistics& statistics) {
+        const uint64_t frames = statistics.appCpuTime.getCount();
+        const uint64_t missedFrames = statistics.missedFrames.load();
+        const double duration = (now() - statistics.createTime) / 1e9;
+        const Metric metrics[] = {
+            {"appCpuTime", "App CPU time (begin to end)", statistics.appCpuTime},
+            {"waitFrameTime", "Blocked in xrWaitFrame", statistics.waitFrameTime},
+            {"compositionGpuTime", "Composition GPU time", statistics.compositionGpuTime},
+            {"swapchainWaitTime", "Swapchain wait stalls", statistics.swapchainWaitTime},
+        };
+
+        Log(fmt::format("Session report: {} frames in {:.1f}s, {} missed\n", frames, duration, missedFrames));
+        for (const auto& metric : metrics) {
+            if (metric.histogram.getCount()) {
+                Log(fmt::format("  {}: {}\n", metric.description, formatPercentiles(metric.histogram)));
+            }
+        }
+        Log("  Layer overhead per hook:\n");
+        for (const auto& hook : statistics.hooks) {
+            const char* name = hook.name.load();
+            if (name) {
+                Log(fmt::format("    {}: {}\n", name, formatPercentiles(hook.overhead)));
+            }
+        }
+        for (const auto& device : statistics.devices) {
+            const char* name = device.name.load();
+            if (name) {
+                Log(fmt::format("  Prediction error of {}:\n", name));
+                Log(fmt::format("    Angular: {}\n", formatPercentiles(device.angularError, Degrees)));
+                Log(fmt::format("    Positional: {}\n", formatPercentiles(device.positionalError, Millimeters)));
+            }
+        }
+
+        // Write the same report as JSON, for offline analysis.
+        const std::time_t time = std::time(nullptr);
+        char timestamp[32];
+        std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&time));
+        const auto reportPath = openxr_api_layer::localAppData / fmt::format("session-{}.json", timestamp);
+
+        std::string json = "{\n";
+        std::string application;
+        for (const char c : openxr_api_layer::GetInstance()->GetApplicationName()) {
+            switch (c) {
+            case '"':
+                application += "\\\"";
+                break;
+            case '\\':
+                application += "\\\\";
+                break;
+            case '\n':
+                application += "\\n";
+                break;
+            case '\r':
+                application += "\\r";
+                break;
+            case '\t':
+                application += "\\t";
+                break;
+            default:
+                // The other control characters are not allowed in a JSON string.
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    application += fmt::format("\\u{:04x}", static_cast<unsigned char>(c));
+                } else {
+                    application += c;
+                }
+            }
+        }
+        json += fmt::format(R"(  "application": "{}",)" "\n", application);
+        json += fmt::format(R"(  "durationSeconds": {:.3f},)" "\n", duration);
+        json += fmt::format(R"(  "frames": {},)" "\n", frames);
+        json += fmt::format(R"(  "missedFrames": {},)" "\n", missedFrames);
+        json += "  \"unit\": \"us\",\n";
+        for (const auto& metric : metrics) {
+            json += fmt::format(R"(  "{}": {},)" "\n", metric.name, formatJsonPercentiles(metric.histogram));
+        }
+        json += "  \"hookOverhead\": {";
+        bool first = true;
+        for (const auto& hook : statistics.hooks) {
+            const char* name = hook.name.load();
+            if (name) {
+                json += fmt::format(R"({}
+    "{}": {})",
+                                    first ? "" : ",",
+                                    name,
+                                    formatJsonPercentiles(hook.overhead));
+                first = false;
+            }
+        }
+        json += "\n  },\n";
+        json += "  \"predictionError\": {";
+        first = true;
+        for (const auto& device : statistics.devices) {
+            const char* name = device.name.load();
+            if (name) {
+                json += fmt::format(R"({}
+    "{}": {{
+      "angularDegrees": {},
+      "positionalMillimeters": {}
+    }})",
+                                    first ? "" : ",",
+                                    name,
+                                    formatJsonPercentiles(device.angularError, Degrees),
+                                    formatJsonPercentiles(device.positionalError, Millimeters));
+                first = false;
+            }
+        }
+        json += "\n  }\n}\n";
+
+        std::ofstream reportStream(reportPath, std::ios_base::trunc);
+        if (!reportStream.is_open()) {
+            ErrorLog(fmt::format("Failed to write session report to {}\n", reportPath.string()));
+            return;
+        }
+        reportStream << json;
+        Log(fmt::format("Session report written to {}\n", reportPath.string()));
+    }
+
+} // namespace
+
+namespace openxr_api_layer::statistics {
+
+    void HdrHistogram::record(uint64_t value) {
+        value = std::min(value, (uint64_t{1} << MaxValueBits) - 1);
+        m_buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void HdrHistogram::reset() {
+        for (auto& bucket : m_buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_count = 0;
+        m_max = 0;
+    }
+
+    uint64_t HdrHistogram::getCount() const {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t HdrHistogram::getMax() const {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    uint64_t HdrHistogram::getValueAtPercentile(double percentile) const {
+        const uint64_t count = getCount();
+        if (!count) {
+            return 0;
+        }
+
+        const uint64_t target =
+            std::max(uint64_t{1}, static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100 * count)));
+        uint64_t cumulated = 0;
+        for (size_t i = 0; i < BucketCount; i++) {
+            cumulated += m_buckets[i].load(std::memory_order_relaxed);
+            if (cumulated >= target) {
+                return std::min(getHighestEquivalentValue(i), getMax());
+            }
+        }
+        return getMax();
+    }
+
+    HookScope::HookScope(const char* name) : m_name(name), m_start(now()), m_outerDownstreamTime(t_downstreamTime) {
+        t_downstreamTime = 0;
+    }
+
+    HookScope::~HookScope() {
+        const uint64_t duration = now() - m_start;
+        const uint64_t downstreamTime = std::min(t_downstreamTime, duration);
+        t_downstreamTime = m_outerDownstreamTime + downstreamTime;
+
+        SessionStatistics* statistics = g_activeStatistics.load(std::memory_order_acquire);
+        if (statistics) {
+            HdrHistogram* overhead = statistics->getHookOverhead(m_name);
+            if (overhead) {
+                overhead->record(duration - downstreamTime);
+            }
+        }
+    }
+
+    uint64_t HookScope::getDownstreamTime() const {
+        return t_downstreamTime;
+    }
+
+    DownstreamScope::DownstreamScope() : m_start(now()) {
+    }
+
+    DownstreamScope::~DownstreamScope() {
+        t_downstreamTime += now() - m_start;
+    }
+
+    void OnCreateSession(XrSession session) {
+        std::unique_lock lock(g_statisticsMutex);
+
+        if (!g_statistics) {
+            g_statistics = std::make_unique<SessionStatistics>();
+        }
+
+        // Only one session is recorded at a time: stop recording the previous one while we reset.
+        g_activeStatistics.store(nullptr, std::memory_order_release);
+        g_statistics->reset(session);
+        g_activeStatistics.store(g_statistics.get(), std::memory_order_release);
+    }
+
+    void OnWaitFrameCompleted(XrSession session,
+                              XrResult result,
+                              const XrFrameState* frameState,
+                              uint64_t blockedTime) {
+        SessionStatistics* statistics = getActiveStatistics(session);
+        if (!statistics || XR_FAILED(result)) {
+            return;
+        }
+
+        statistics->waitFrameTime.record(blockedTime);
+
+        // Any display period skipped between two consecutive frames is a missed frame.
+        const XrTime lastPredictedDisplayTime =
+            statistics->lastPredictedDisplayTime.exchange(frameState->predictedDisplayTime);
+        if (lastPredictedDisplayTime && frameState->predictedDisplayPeriod > 0 &&
+            frameState->predictedDisplayTime > lastPredictedDisplayTime) {
+            const int64_t periods =
+                std::llround(static_cast<double>(frameState->predictedDisplayTime - lastPredictedDisplayTime) /
+                             frameState->predictedDisplayPeriod);
+            if (periods > 1) {
+                statistics->missedFrames += periods - 1;
+            }
+        }
+    }
+
+    void OnBeginFrameCompleted(XrSession session, uint64_t frameId, XrResult result) {
+        SessionStatistics* statistics = getActiveStatistics(session);
+        if (!statistics || XR_FAILED(result)) {
+            return;
+        }
+
+        BegunFrame& frame = statistics->begunFrames[frameId % MaxFramesInFlight];
+        frame.beginTime.store(now(), std::memory_order_relaxed);
+        frame.frameId.store(frameId, std::memory_order_release);
+    }
+
+    void OnEndFrame(XrSession session, uint64_t frameId) {
+        SessionStatistics* statistics = getActiveStatistics(session);
+        if (!statistics) {
+            return;
+        }
+
+        const BegunFrame& frame = statistics->begunFrames[frameId % MaxFramesInFlight];
+        if (frameId && frame.frameId.load(std::memory_order_acquire) == frameId) {
+            statistics->appCpuTime.record(now() - frame.beginTime.load(std::memory_order_relaxed));
+        }
+    }
+
+    void OnWaitSwapchainImageCompleted(XrResult result, uint64_t blockedTime) {
+        SessionStatistics* statistics = g_activeStatistics.load(std::memory_order_acquire);
+        if (!statistics || XR_FAILED(result)) {
+            return;
+        }
+
+        statistics->swapchainWaitTime.record(blockedTime);
+    }
+
+    void OnDestroySession(XrSession session) {
+        std::unique_lock lock(g_statisticsMutex);
+
+        SessionStatistics* statistics = getActiveStatistics(session);
+        if (!statistics) {
+            return;
+        }
+
+        // The storage remains valid for any hook still in flight on another thread.
+        g_activeStatistics.store(nullptr, std::memory_order_release);
+        writeReport(*statistics);
+    }
+
+    void RecordCompositionGpuTime(uint64_t gpuTime) {
+        SessionStatistics* statistics = g_activeStatistics.load(std::memory_order_acquire);
+        if (statistics) {
+            statistics->compositionGpuTime.record(gpuTime);
+        }
+    }
+
+    void RecordPredictionError(const char* device, int64_t angularError, int64_t positionalError) {
+        SessionStatistics* statistics = g_activeStatistics.load(std::memory_order_acquire);
+        if (!statistics) {
+            return;
+        }
+
+        DeviceStatistics* deviceStatistics = statistics->getDevice(device);
+        if (!deviceStatistics) {
+            return;
+        }
+        if (angularError >= 0) {
+            deviceStatistics->angularError.record(angularError);
+        }
+        if (positionalError >= 0) {
+            deviceStatistics->positionalError.record(positionalError);
+        }
+    }
+
+} // namespace openxr_api_layer::statistics
@@ -0,0 +1,101 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+namespace openxr_api_layer::statistics {
+
+    // A fixed-memory histogram with High Dynamic Range (log-linear) buckets: values below 2^SubBucketBits are counted
+    // exactly, and larger values with a relative precision of 2^-(SubBucketBits-1) (under 1%). Values are clamped to
+    // 2^MaxValueBits-1 (about 18 minutes in nanoseconds). Recording is lock-free and never allocates.
+    class HdrHistogram {
+      public:
+        static constexpr uint32_t SubBucketBits = 7;
+        static constexpr uint32_t MaxValueBits = 40;
+        static constexpr size_t BucketCount = (MaxValueBits - SubBucketBits + 2) << (SubBucketBits - 1);
+
+        void record(uint64_t value);
+        void reset();
+
+        uint64_t getCount() const;
+        uint64_t getMax() const;
+
+        // The highest value equivalent to the given percentile (0-100), or 0 if no values were recorded.
+        uint64_t getValueAtPercentile(double percentile) const;
+
+      private:
+        std::array<std::atomic<uint32_t>, BucketCount> m_buckets{};
+        std::atomic<uint64_t> m_count{0};
+        std::atomic<uint64_t> m_max{0};
+    };
+
+    // Measure the layer overhead of a hook: the time spent in the hook, minus the time spent in the next layer or the
+    // runtime (see DownstreamScope).
+    class HookScope {
+      public:
+        HookScope(const char* name);
+        ~HookScope();
+
+        HookScope(const HookScope&) = delete;
+        HookScope& operator=(const HookScope&) = delete;
+
+        // The time spent downstream so far, in nanoseconds.
+        uint64_t getDownstreamTime() const;
+
+      private:
+        const char* const m_name;
+        const int64_t m_start;
+        const uint64_t m_outerDownstreamTime;
+    };
+
+    // Measure a call to the next layer or the runtime, which is excluded from the overhead of the enclosing hook.
+    class DownstreamScope {
+      public:
+        DownstreamScope();
+        ~DownstreamScope();
+
+        DownstreamScope(const DownstreamScope&) = delete;
+        DownstreamScope& operator=(const DownstreamScope&) = delete;
+
+      private:
+        const int64_t m_start;
+    };
+
+    // Session statistics, driven by the generated wrappers. The statistics of the most recently created session are
+    // recorded: all storage is reserved in OnCreateSession(), and OnDestroySession() writes the end-of-session report
+    // to the log and to a JSON file under localAppData.
+    void OnCreateSession(XrSession session);
+    void OnWaitFrameCompleted(XrSession session, XrResult result, const XrFrameState* frameState, uint64_t blockedTime);
+    void OnBeginFrameCompleted(XrSession session, uint64_t frameId, XrResult result);
+    void OnEndFrame(XrSession session, uint64_t frameId);
+    void OnWaitSwapchainImageCompleted(XrResult result, uint64_t blockedTime);
+    void OnDestroySession(XrSession session);
+
+    // The GPU time of the layer's composition for one frame, in nanoseconds.
+    void RecordCompositionGpuTime(uint64_t gpuTime);
+
+    // The error of a pose predicted by the runtime for a tracked device (eg: "view"), in micro-degrees and
+    // micrometers. A negative error is not recorded (eg: the position was not tracked).
+    void RecordPredictionError(const char* device, int64_t angularError, int64_t positionalError);
+
+} // namespace openxr_api_layer::statistics
@@ -33,13 +33,58 @@ namespace openxr_api_layer {
 
     using namespace log;
 
-    // Our API layer implement these extensions, and their specified version.
-    const std::vector<std::pair<std::string, uint32_t>> advertisedExtensions = {};
+    // Our API layer implement these extensions, and their specified version. They are only implemented by the layer
+    // (and not forwarded to the runtime) when the runtime lacks them, see GetImplementedExtensions().
+    const std::vector<std::pair<std::string, uint32_t>> advertisedExtensions = {
+        {XR_KHR_LOCATE_SPACES_EXTENSION_NAME, XR_KHR_locate_spaces_SPEC_VERSION},
+        {XR_KHR_VISIBILITY_MASK_EXTENSION_NAME, XR_KHR_visibility_mask_SPEC_VERSION}};
 
     // Initialize these vectors with arrays of extensions to block and implicitly request for the instance.
+    // Requesting XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME lets the applications in
+    // clockServiceApplications use the clock service even when they do not request the extension themselves. Any
+    // implicit extension costs every application a dummy instance at xrCreateInstance() to check its support.
     const std::vector<std::string> blockedExtensions = {};
     const std::vector<std::string> implicitExtensions = {};
 
+#ifdef XR_USE_GRAPHICS_API_D3D11
+    // Initialize this vector with the applications (by name) opting in for swapchain format demotion, and the format
+    // to demote their R16G16B16A16_FLOAT swapchains to, eg: {"hello_xr", DXGI_FORMAT_R11G11B10_FLOAT}.
+    const std::vector<std::pair<std::string, DXGI_FORMAT>> formatDemotionApplications = {};
+
+    // Initialize this vector with the applications (by name) opting in for flattening their opaque quad layers into
+    // their projection layers. This cannot be combined with swapchain format demotion.
+    const std::vector<std::string> quadFlatteningApplications = {};
+#endif
+
+    // Initialize this vector with the applications (by name) opting in for per-frame de-duplication of their
+    // xrLocateSpace() and xrLocateViews() calls.
+    const std::vector<std::string> locateCacheApplications = {};
+
+    // Initialize this vector with the applications (by name) opting in for the removal of their quad layers that cannot
+    // be visible (outside of the field of view, or hidden behind an opaque quad layer) before submission.
+    const std::vector<std::string> quadCullingApplications = {};
+
+    // Initialize this vector with the applications (by name) opting in for the clock service, which serves XrTime
+    // conversions without calling the runtime. It requires XR_KHR_win32_convert_performance_counter_time, requested by
+    // the application or via implicitExtensions.
+    const std::vector<std::string> clockServiceApplications = {};
+
+    // Initialize this vector with the applications (by name) for which to measure the prediction errors of the runtime
+    // in the session report.
+    const std::vector<std::string> predictionErrorApplications = {};
+
+    // Initialize this vector with the applications (by name) opting in for the scheduling of their frame threads, and
+    // the settings to use, eg: {"hello_xr", {true, false}} to only raise the priority of their frame threads.
+    const std::vector<std::pair<std::string, utils::general::SchedulingSettings>> schedulingApplications = {};
+
+    // Initialize this vector with the runtimes (by name prefix) whose xrLocateSpace() may be called concurrently
+    // without contention, to parallelize xrLocateSpacesKHR() across worker threads.
+    const std::vector<std::string> threadSafeLocateRuntimes = {};
+
+    // Initialize this vector with the lens outlines of the headsets (by system name prefix), eg: {"Some Headset",
+    // {{0.05f, 0.f}, {1.05f, 1.1f}, 2.2f}}. Other headsets get a visibility mask that hides nothing.
+    const std::vector<std::pair<std::string, utils::visibility::LensProfile>> lensProfiles = {};
+
     // This class implements our API layer.
     class OpenXrLayer : public openxr_api_layer::OpenXrApi {
       public:
@@ -57,6 +102,28 @@ namespace openxr_api_layer {
             XrResult result = m_bypassApiLayer ? m_xrGetInstanceProcAddr(instance, name, function)
                                                : OpenXrApi::xrGetInstanceProcAddr(instance, name, function);
 
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            // The format demotion and quad flattening hooks must wrap the composition framework hooks.
+            if (XR_SUCCEEDED(result) && m_compositionFrameworkFactory) {
+                m_compositionFrameworkFactory->xrGetInstanceProcAddr_post(instance, name, function);
+            }
+            if (XR_SUCCEEDED(result) && m_formatDemotionFactory) {
+                m_formatDemotionFactory->xrGetInstanceProcAddr_post(instance, name, function);
+            }
+            if (XR_SUCCEEDED(result) && m_quadFlatteningFactory) {
+                m_quadFlatteningFactory->xrGetInstanceProcAddr_post(instance, name, function);
+            }
+#endif
+            if (XR_SUCCEEDED(result) && m_locateCacheFactory) {
+                m_locateCacheFactory->xrGetInstanceProcAddr_post(instance, name, function);
+            }
+            if (XR_SUCCEEDED(result) && m_predictionErrorFactory) {
+                m_predictionErrorFactory->xrGetInstanceProcAddr_post(instance, name, function);
+            }
+            if (XR_SUCCEEDED(result) && m_schedulingManager) {
+                m_schedulingManager->xrGetInstanceProcAddr_post(instance, name, function);
+            }
+
             TraceLoggingWrite(g_traceProvider, "xrGetInstanceProcAddr", TLPArg(*function, "Function"));
 
             return result;
@@ -97,7 +164,17 @@ namespace openxr_api_layer {
             for (uint32_t i = 0; i < createInfo->enabledExtensionCount; i++) {
                 TraceLoggingWrite(
                     g_traceProvider, "xrCreateInstance", TLArg(createInfo->enabledExtensionNames[i], "ExtensionName"));
+
+                const std::string_view extensionName(createInfo->enabledExtensionNames[i]);
+                if (extensionName == XR_KHR_LOCATE_SPACES_EXTENSION_NAME) {
+                    m_isLocateSpacesEnabled = true;
+                }
+                if (extensionName == XR_KHR_VISIBILITY_MASK_EXTENSION_NAME) {
+                    m_isVisibilityMaskEnabled = true;
+                }
             }
+            m_isVisibilityMaskImplemented =
+                m_isVisibilityMaskEnabled && IsExtensionImplemented(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
 
             XrInstanceProperties instanceProperties = {XR_TYPE_INSTANCE_PROPERTIES};
             CHECK_XRCMD(OpenXrApi::xrGetInstanceProperties(GetXrInstance(), &instanceProperties));
@@ -109,6 +186,134 @@ namespace openxr_api_layer {
             TraceLoggingWrite(g_traceProvider, "xrCreateInstance", TLArg(runtimeName.c_str(), "RuntimeName"));
             Log(fmt::format("Using OpenXR runtime: {}\n", runtimeName));
 
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            const std::string_view applicationName(createInfo->applicationInfo.applicationName);
+            for (const auto& [name, format] : formatDemotionApplications) {
+                if (name != applicationName) {
+                    continue;
+                }
+
+                try {
+                    m_compositionFrameworkFactory = utils::graphics::createCompositionFrameworkFactory(
+                        *createInfo, GetXrInstance(), m_xrGetInstanceProcAddr, utils::graphics::CompositionApi::D3D11);
+                    m_formatDemotionFactory = utils::graphics::createFormatDemotionFactory(
+                        *createInfo, GetXrInstance(), m_xrGetInstanceProcAddr, m_compositionFrameworkFactory, format);
+                    Log("Swapchain format demotion is enabled\n");
+                } catch (std::exception& exc) {
+                    ErrorLog(fmt::format("Failed to enable swapchain format demotion: {}\n", exc.what()));
+                    m_formatDemotionFactory.reset();
+                    m_compositionFrameworkFactory.reset();
+                }
+                break;
+            }
+
+            if (std::find(quadFlatteningApplications.cbegin(), quadFlatteningApplications.cend(), applicationName) !=
+                quadFlatteningApplications.cend()) {
+                if (m_formatDemotionFactory) {
+                    ErrorLog("Quad layer flattening cannot be combined with swapchain format demotion\n");
+                } else {
+                    try {
+                        m_compositionFrameworkFactory =
+                            utils::graphics::createCompositionFrameworkFactory(*createInfo,
+                                                                               GetXrInstance(),
+                                                                               m_xrGetInstanceProcAddr,
+                                                                               utils::graphics::CompositionApi::D3D11);
+                        m_quadFlatteningFactory = utils::graphics::createQuadFlatteningFactory(
+                            *createInfo, GetXrInstance(), m_xrGetInstanceProcAddr, m_compositionFrameworkFactory);
+                        Log("Quad layer flattening is enabled\n");
+                    } catch (std::exception& exc) {
+                        ErrorLog(fmt::format("Failed to enable quad layer flattening: {}\n", exc.what()));
+                        m_quadFlatteningFactory.reset();
+                        m_compositionFrameworkFactory.reset();
+                    }
+                }
+            }
+#endif
+
+            if (IsExtensionImplemented(XR_KHR_LOCATE_SPACES_EXTENSION_NAME)) {
+                PFN_xrLocateSpace xrLocateSpace = nullptr;
+                CHECK_XRCMD(m_xrGetInstanceProcAddr(
+                    GetXrInstance(), "xrLocateSpace", reinterpret_cast<PFN_xrVoidFunction*>(&xrLocateSpace)));
+
+                const auto isThreadSafe = [&](const std::string& name) {
+                    return utils::general::startsWith(instanceProperties.runtimeName, name);
+                };
+                if (std::any_of(threadSafeLocateRuntimes.cbegin(), threadSafeLocateRuntimes.cend(), isThreadSafe)) {
+                    m_spacesLocator =
+                        utils::tracking::createSpacesLocator(xrLocateSpace, utils::general::createWorkerPool(4));
+                    Log("Spaces will be located concurrently\n");
+                } else {
+                    m_spacesLocator = utils::tracking::createSpacesLocator(xrLocateSpace);
+                }
+            }
+
+            if (std::find(locateCacheApplications.cbegin(),
+                          locateCacheApplications.cend(),
+                          createInfo->applicationInfo.applicationName) != locateCacheApplications.cend()) {
+                try {
+                    m_locateCacheFactory = utils::tracking::createLocateCacheFactory();
+                    Log("Locate cache is enabled\n");
+                } catch (std::exception& exc) {
+                    ErrorLog(fmt::format("Failed to enable locate cache: {}\n", exc.what()));
+                }
+            }
+
+            if (std::find(predictionErrorApplications.cbegin(),
+                          predictionErrorApplications.cend(),
+                          createInfo->applicationInfo.applicationName) != predictionErrorApplications.cend()) {
+                try {
+                    m_predictionErrorFactory =
+                        utils::tracking::createPredictionErrorFactory(GetXrInstance(), m_xrGetInstanceProcAddr);
+                    Log("Prediction error measurement is enabled\n");
+                } catch (std::exception& exc) {
+                    ErrorLog(fmt::format("Failed to enable prediction error measurement: {}\n", exc.what()));
+                }
+            }
+
+            if (std::find(quadCullingApplications.cbegin(),
+                          quadCullingApplications.cend(),
+                          createInfo->applicationInfo.applicationName) != quadCullingApplications.cend()) {
+                m_isQuadCullingEnabled = true;
+                Log("Quad layer culling is enabled\n");
+            }
+
+            for (const auto& [name, settings] : schedulingApplications) {
+                if (name != createInfo->applicationInfo.applicationName) {
+                    continue;
+                }
+                try {
+                    m_schedulingManager = utils::general::createSchedulingManager(settings);
+                    Log("Frame thread scheduling is enabled\n");
+                } catch (std::exception& exc) {
+                    ErrorLog(fmt::format("Failed to enable frame thread scheduling: {}\n", exc.what()));
+                }
+                break;
+            }
+
+            // Serve XrTime conversions without calling the runtime each time.
+            if (std::find(clockServiceApplications.cbegin(),
+                          clockServiceApplications.cend(),
+                          createInfo->applicationInfo.applicationName) != clockServiceApplications.cend()) {
+                const auto isClockExtension = [](const std::string_view& extensionName) {
+                    return extensionName == XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME;
+                };
+                if (std::any_of(GetGrantedExtensions().cbegin(), GetGrantedExtensions().cend(), isClockExtension) ||
+                    std::any_of(createInfo->enabledExtensionNames,
+                                createInfo->enabledExtensionNames + createInfo->enabledExtensionCount,
+                                isClockExtension)) {
+                    try {
+                        m_clockService =
+                            utils::general::createClockService(GetXrInstance(), m_xrGetInstanceProcAddr);
+                        Log("Clock service is enabled\n");
+                    } catch (std::exception& exc) {
+                        ErrorLog(fmt::format("Failed to start the clock service: {}\n", exc.what()));
+                    }
+                } else {
+                    ErrorLog(fmt::format("The clock service requires {}\n",
+                                         XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME));
+                }
+            }
+
             return XR_SUCCESS;
         }
 
@@ -130,6 +335,7 @@ namespace openxr_api_layer {
                     CHECK_XRCMD(OpenXrApi::xrGetSystemProperties(instance, *systemId, &systemProperties));
                     TraceLoggingWrite(g_traceProvider, "xrGetSystem", TLArg(systemProperties.systemName, "SystemName"));
                     Log(fmt::format("Using OpenXR system: {}\n", systemProperties.systemName));
+                    m_systemName = systemProperties.systemName;
                 }
 
                 // Remember the XrSystemId to use.
@@ -158,7 +364,18 @@ namespace openxr_api_layer {
             const XrResult result = OpenXrApi::xrCreateSession(instance, createInfo, session);
             if (XR_SUCCEEDED(result)) {
                 if (isSystemHandled(createInfo->systemId)) {
-                    // Do something useful here...
+                    Session newSession;
+                    if (m_isVisibilityMaskImplemented) {
+                        const auto matchSystemName = [&](const auto& lensProfile) {
+                            return utils::general::startsWith(m_systemName, lensProfile.first);
+                        };
+                        const auto it = std::find_if(lensProfiles.cbegin(), lensProfiles.cend(), matchSystemName);
+                        newSession.visibilityMask = utils::visibility::createVisibilityMask(
+                            it != lensProfiles.cend() ? it->second : utils::visibility::LensProfile{});
+                    }
+
+                    std::unique_lock lock(m_sessionsMutex);
+                    m_sessions.insert_or_assign(*session, std::move(newSession));
                 }
 
                 TraceLoggingWrite(g_traceProvider, "xrCreateSession", TLXArg(*session, "Session"));
@@ -167,13 +384,270 @@ namespace openxr_api_layer {
             return result;
         }
 
+        // https://www.khronos.org/registry/OpenXR/specs/1.0/html/xrspec.html#xrDestroySession
+        XrResult xrDestroySession(XrSession session) override {
+            TraceLoggingWrite(g_traceProvider, "xrDestroySession", TLXArg(session, "Session"));
+
+            {
+                std::unique_lock lock(m_sessionsMutex);
+
+                auto it = m_sessions.find(session);
+                if (it != m_sessions.end()) {
+                    if (it->second.quadLayerCuller) {
+                        const auto statistics = it->second.quadLayerCuller->getStatistics();
+                        Log(fmt::format("Quad layer culling: {} frustum culled, {} occluded, {} overlays skipped "
+                                        "over {} frames\n",
+                                        statistics.frustumCulledTotal,
+                                        statistics.occlusionCulledTotal,
+                                        statistics.skippedOverlaysTotal,
+                                        statistics.framesCount));
+                    }
+                    m_sessions.erase(it);
+                }
+
+                const auto isSessionEvent = [&](const XrEventDataVisibilityMaskChangedKHR& event) {
+                    return event.session == session;
+                };
+                m_pendingEvents.erase(std::remove_if(m_pendingEvents.begin(), m_pendingEvents.end(), isSessionEvent),
+                                      m_pendingEvents.end());
+            }
+
+            return OpenXrApi::xrDestroySession(session);
+        }
+
+        // https://www.khronos.org/registry/OpenXR/specs/1.0/html/xrspec.html#xrBeginSession
+        XrResult xrBeginSession(XrSession session, const XrSessionBeginInfo* beginInfo) override {
+            if (beginInfo->type != XR_TYPE_SESSION_BEGIN_INFO) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+
+            TraceLoggingWrite(g_traceProvider,
+                              "xrBeginSession",
+                              TLXArg(session, "Session"),
+                              TLArg(xr::ToCString(beginInfo->primaryViewConfigurationType), "ViewConfigurationType"));
+
+            const XrResult result = OpenXrApi::xrBeginSession(session, beginInfo);
+            if (XR_SUCCEEDED(result) && m_isQuadCullingEnabled) {
+                std::unique_lock lock(m_sessionsMutex);
+
+                auto it = m_sessions.find(session);
+                if (it != m_sessions.end()) {
+                    try {
+                        it->second.quadLayerCuller =
+                            utils::graphics::createQuadLayerCuller(GetXrInstance(),
+                                                                   m_xrGetInstanceProcAddr,
+                                                                   session,
+                                                                   beginInfo->primaryViewConfigurationType);
+                    } catch (std::exception& exc) {
+                        ErrorLog(fmt::format("Failed to enable quad layer culling: {}\n", exc.what()));
+                    }
+                }
+            }
+
+            return result;
+        }
+
+        // https://www.khronos.org/registry/OpenXR/specs/1.0/html/xrspec.html#xrEndFrame
+        XrResult xrEndFrame(XrSession session, const XrFrameEndInfo* frameEndInfo) override {
+            if (frameEndInfo->type != XR_TYPE_FRAME_END_INFO) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+
+            if (m_clockService) {
+                // How far ahead of its display time the frame is submitted.
+                const XrDuration displayLeadTime = frameEndInfo->displayTime - m_clockService->getCurrentTime();
+                TraceLoggingWrite(g_traceProvider,
+                                  "xrEndFrame",
+                                  TLXArg(session, "Session"),
+                                  TLArg(displayLeadTime, "DisplayLeadTime"));
+            }
+
+            if (!m_isQuadCullingEnabled) {
+                return OpenXrApi::xrEndFrame(session, frameEndInfo);
+            }
+
+            std::shared_ptr<utils::graphics::IQuadLayerCuller> quadLayerCuller;
+            {
+                std::unique_lock lock(m_sessionsMutex);
+
+                auto it = m_sessions.find(session);
+                if (it != m_sessions.end()) {
+                    quadLayerCuller = it->second.quadLayerCuller;
+                }
+            }
+            if (!quadLayerCuller) {
+                return OpenXrApi::xrEndFrame(session, frameEndInfo);
+            }
+
+            // Reuse the list from frame to frame, to not allocate memory once the frames are steady.
+            thread_local std::vector<const XrCompositionLayerBaseHeader*> layers;
+            layers.assign(frameEndInfo->layers, frameEndInfo->layers + frameEndInfo->layerCount);
+
+            // Drop the quad layers that cannot be visible, so the runtime does not spend time composing them.
+            quadLayerCuller->cullLayers(frameEndInfo->displayTime, layers);
+
+            XrFrameEndInfo chainFrameEndInfo = *frameEndInfo;
+            chainFrameEndInfo.layers = layers.data();
+            chainFrameEndInfo.layerCount = static_cast<uint32_t>(layers.size());
+
+            return OpenXrApi::xrEndFrame(session, &chainFrameEndInfo);
+        }
+
+        // https://www.khronos.org/registry/OpenXR/specs/1.0/html/xrspec.html#xrLocateSpacesKHR
+        XrResult xrLocateSpacesKHR(XrSession session,
+                                   const XrSpacesLocateInfoKHR* locateInfo,
+                                   XrSpaceLocationsKHR* spaceLocations) override {
+            if (!m_spacesLocator) {
+                // The runtime implements the extension.
+                return m_isLocateSpacesEnabled ? OpenXrApi::xrLocateSpacesKHR(session, locateInfo, spaceLocations)
+                                               : XR_ERROR_FUNCTION_UNSUPPORTED;
+            }
+
+            TraceLoggingWrite(g_traceProvider,
+                              "xrLocateSpacesKHR",
+                              TLXArg(session, "Session"),
+                              TLArg(locateInfo->spaceCount, "SpaceCount"),
+                              TLXArg(locateInfo->baseSpace, "BaseSpace"),
+                              TLArg(locateInfo->time, "Time"));
+
+            return m_spacesLocator->locateSpaces(*locateInfo, *spaceLocations);
+        }
+
+        // https://www.khronos.org/registry/OpenXR/specs/1.0/html/xrspec.html#xrLocateViews
+        XrResult xrLocateViews(XrSession session,
+                               const XrViewLocateInfo* viewLocateInfo,
+                               XrViewState* viewState,
+                               uint32_t viewCapacityInput,
+                               uint32_t* viewCountOutput,
+                               XrView* views) override {
+            const XrResult result =
+                OpenXrApi::xrLocateViews(session, viewLocateInfo, viewState, viewCapacityInput, viewCountOutput, views);
+            if (!m_isVisibilityMaskImplemented || XR_FAILED(result) || !viewCapacityInput ||
+                viewLocateInfo->type != XR_TYPE_VIEW_LOCATE_INFO) {
+                return result;
+            }
+
+            // Watch the field of view of the views, to detect changes to the visibility mask.
+            std::unique_lock lock(m_sessionsMutex);
+
+            auto it = m_sessions.find(session);
+            if (it != m_sessions.end() && it->second.visibilityMask) {
+                const auto changedViews = it->second.visibilityMask->updateViews(
+                    viewLocateInfo->viewConfigurationType, views, *viewCountOutput);
+                for (const uint32_t viewIndex : changedViews) {
+                    XrEventDataVisibilityMaskChangedKHR event{XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR};
+                    event.session = session;
+                    event.viewConfigurationType = viewLocateInfo->viewConfigurationType;
+                    event.viewIndex = viewIndex;
+                    m_pendingEvents.push_back(event);
+                }
+            }
+
+            return result;
+        }
+
+        // https://www.khronos.org/registry/OpenXR/specs/1.0/html/xrspec.html#xrPollEvent
+        XrResult xrPollEvent(XrInstance instance, XrEventDataBuffer* eventData) override {
+            if (m_isVisibilityMaskImplemented) {
+                std::unique_lock lock(m_sessionsMutex);
+
+                if (!m_pendingEvents.empty()) {
+                    if (eventData->type != XR_TYPE_EVENT_DATA_BUFFER) {
+                        return XR_ERROR_VALIDATION_FAILURE;
+                    }
+
+                    TraceLoggingWrite(g_traceProvider,
+                                      "xrPollEvent",
+                                      TLXArg(m_pendingEvents.front().session, "Session"),
+                                      TLArg(m_pendingEvents.front().viewIndex, "VisibilityMaskChangedViewIndex"));
+
+                    *reinterpret_cast<XrEventDataVisibilityMaskChangedKHR*>(eventData) = m_pendingEvents.front();
+                    m_pendingEvents.pop_front();
+                    return XR_SUCCESS;
+                }
+            }
+
+            return OpenXrApi::xrPollEvent(instance, eventData);
+        }
+
+        // https://www.khronos.org/registry/OpenXR/specs/1.0/html/xrspec.html#xrGetVisibilityMaskKHR
+        XrResult xrGetVisibilityMaskKHR(XrSession session,
+                                        XrViewConfigurationType viewConfigurationType,
+                                        uint32_t viewIndex,
+                                        XrVisibilityMaskTypeKHR visibilityMaskType,
+                                        XrVisibilityMaskKHR* visibilityMask) override {
+            if (!m_isVisibilityMaskEnabled) {
+                return XR_ERROR_FUNCTION_UNSUPPORTED;
+            }
+            if (!m_isVisibilityMaskImplemented) {
+                // The runtime implements the extension.
+                return OpenXrApi::xrGetVisibilityMaskKHR(
+                    session, viewConfigurationType, viewIndex, visibilityMaskType, visibilityMask);
+            }
+
+            TraceLoggingWrite(g_traceProvider,
+                              "xrGetVisibilityMaskKHR",
+                              TLXArg(session, "Session"),
+                              TLArg(xr::ToCString(viewConfigurationType), "ViewConfigurationType"),
+                              TLArg(viewIndex, "ViewIndex"),
+                              TLArg(xr::ToCString(visibilityMaskType), "VisibilityMaskType"));
+
+            std::shared_ptr<utils::visibility::IVisibilityMask> mask;
+            {
+                std::unique_lock lock(m_sessionsMutex);
+
+                auto it = m_sessions.find(session);
+                if (it != m_sessions.end()) {
+                    mask = it->second.visibilityMask;
+                }
+            }
+            if (!mask) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+
+            const XrResult result =
+                mask->getVisibilityMask(viewConfigurationType, viewIndex, visibilityMaskType, *visibilityMask);
+
+            TraceLoggingWrite(g_traceProvider,
+                              "xrGetVisibilityMaskKHR",
+                              TLArg(visibilityMask->vertexCountOutput, "VertexCount"),
+                              TLArg(visibilityMask->indexCountOutput, "IndexCount"));
+
+            return result;
+        }
+
       private:
+        struct Session {
+            std::shared_ptr<utils::graphics::IQuadLayerCuller> quadLayerCuller;
+            std::shared_ptr<utils::visibility::IVisibilityMask> visibilityMask;
+        };
+
         bool isSystemHandled(XrSystemId systemId) const {
             return systemId == m_systemId;
         }
 
         bool m_bypassApiLayer{false};
         XrSystemId m_systemId{XR_NULL_SYSTEM_ID};
+        std::string m_systemName;
+        bool m_isLocateSpacesEnabled{false};
+        bool m_isVisibilityMaskEnabled{false};
+        bool m_isVisibilityMaskImplemented{false};
+        bool m_isQuadCullingEnabled{false};
+
+        std::mutex m_sessionsMutex;
+        std::unordered_map<XrSession, Session> m_sessions;
+        std::deque<XrEventDataVisibilityMaskChangedKHR> m_pendingEvents;
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        std::shared_ptr<utils::graphics::ICompositionFrameworkFactory> m_compositionFrameworkFactory;
+        std::shared_ptr<utils::graphics::IFormatDemotionFactory> m_formatDemotionFactory;
+        std::shared_ptr<utils::graphics::IQuadFlatteningFactory> m_quadFlatteningFactory;
+#endif
+        std::shared_ptr<utils::tracking::ILocateCacheFactory> m_locateCacheFactory;
+        std::shared_ptr<utils::tracking::IPredictionErrorFactory> m_predictionErrorFactory;
+        std::shared_ptr<utils::general::ISchedulingManager> m_schedulingManager;
+        std::shared_ptr<utils::tracking::ISpacesLocator> m_spacesLocator;
+        std::shared_ptr<utils::general::IClockService> m_clockService;
     };
 
     // This method is required by the framework to instantiate your OpenXrApi implementation.
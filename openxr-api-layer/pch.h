@@ -32,20 +32,30 @@
 
 // Standard library.
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdarg>
 #include <ctime>
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <condition_variable>
 #include <deque>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <mutex>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <sstream>
 #include <string>
 #include <memory>
 #include <optional>
+#include <random>
+#include <thread>
+#include <unordered_map>
 
 using namespace std::chrono_literals;
 
@@ -65,6 +75,7 @@ using Microsoft::WRL::ComPtr;
 #include <dxgiformat.h>
 #ifdef XR_USE_GRAPHICS_API_D3D11
 #include <d3d11_4.h>
+#include <d3dcompiler.h>
 #endif
 #ifdef XR_USE_GRAPHICS_API_D3D12
 #include <d3d12.h>
@@ -86,13 +97,29 @@ using Microsoft::WRL::ComPtr;
 #include <XrStereoView.h>
 #include <XrToString.h>
 #include <DirectXCollision.h>
+#include <DirectXPackedVector.h>
 
 // FMT formatter.
 #include <fmt/format.h>
 
+// Lock-free handle maps and the handle registry.
+#include <handles.h>
+
+// Non-throwing error handling for the per-frame paths.
+#include <result.h>
+
+// Frame id correlation.
+#include <frame.h>
+
+// Session statistics and the end-of-session report.
+#include <statistics.h>
+
 #if defined(XR_USE_GRAPHICS_API_D3D11) || defined(XR_USE_GRAPHICS_API_D3D12)
 // Utilities framework.
 #include <utils/graphics.h>
+#include <utils/ui.h>
 #endif
 
 #include <utils/inputs.h>
+#include <utils/tracking.h>
+#include <utils/visibility.h>
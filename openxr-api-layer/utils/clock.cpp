@@ -0,0 +1,319 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+#include "general.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::general;
+
+    // A linear mapping from the performance counter to XrTime.
+    struct ClockParameters {
+        int64_t performanceCounterReference{0};
+        XrTime timeReference{0};
+        double nanosecondsPerTick{0};
+        XrDuration errorBound{0};
+
+        XrTime toXrTime(int64_t performanceCounter) const {
+            return timeReference +
+                   std::llround((performanceCounter - performanceCounterReference) * nanosecondsPerTick);
+        }
+
+        int64_t toPerformanceCounter(XrTime time) const {
+            return performanceCounterReference + std::llround((time - timeReference) / nanosecondsPerTick);
+        }
+    };
+
+    // The current parameters, published with a sequence lock: readers never block, and retry if they raced with the
+    // (single) writer.
+    class ClockModel {
+      public:
+        void publish(const ClockParameters& parameters) {
+            const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+            m_sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            m_performanceCounterReference.store(parameters.performanceCounterReference, std::memory_order_relaxed);
+            m_timeReference.store(parameters.timeReference, std::memory_order_relaxed);
+            m_nanosecondsPerTick.store(parameters.nanosecondsPerTick, std::memory_order_relaxed);
+            m_errorBound.store(parameters.errorBound, std::memory_order_relaxed);
+
+            m_sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        ClockParameters read() const {
+            ClockParameters parameters;
+            uint32_t sequence;
+            do {
+                sequence = m_sequence.load(std::memory_order_acquire);
+
+                parameters.performanceCounterReference = m_performanceCounterReference.load(std::memory_order_relaxed);
+                parameters.timeReference = m_timeReference.load(std::memory_order_relaxed);
+                parameters.nanosecondsPerTick = m_nanosecondsPerTick.load(std::memory_order_relaxed);
+                parameters.errorBound = m_errorBound.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+            } while ((sequence & 1) || sequence != m_sequence.load(std::memory_order_relaxed));
+
+            return parameters;
+        }
+
+      private:
+        std::atomic<uint32_t> m_sequence{0};
+        std::atomic<int64_t> m_performanceCounterReference{0};
+        std::atomic<XrTime> m_timeReference{0};
+        std::atomic<double> m_nanosecondsPerTick{0};
+        std::atomic<XrDuration> m_errorBound{0};
+    };
+
+    // Fits a line through the most recent samples of the runtime's mapping. The model is anchored at the newest sample,
+    // and used until the next one: the error bound covers both the residuals of the fit, and the errors of the previous
+    // models when they were extrapolated to the samples that followed.
+    class ClockCalibrator {
+      public:
+        ClockCalibrator(int64_t frequency) : m_nominalNanosecondsPerTick(1e9 / frequency) {
+        }
+
+        ClockParameters addSample(int64_t performanceCounter, XrTime time) {
+            const XrDuration extrapolationError =
+                m_samples.empty() ? 0 : std::abs(m_parameters.toXrTime(performanceCounter) - time);
+            m_samples.push_back({performanceCounter, time, extrapolationError});
+            if (m_samples.size() > WindowSize) {
+                m_samples.pop_front();
+            }
+            m_sampleCount++;
+
+            // Least squares, relative to the newest sample to keep the precision.
+            double meanX = 0, meanY = 0;
+            for (const Sample& sample : m_samples) {
+                meanX += static_cast<double>(sample.performanceCounter - performanceCounter);
+                meanY += static_cast<double>(sample.time - time);
+            }
+            meanX /= m_samples.size();
+            meanY /= m_samples.size();
+
+            double sxx = 0, sxy = 0;
+            for (const Sample& sample : m_samples) {
+                const double dx = static_cast<double>(sample.performanceCounter - performanceCounter) - meanX;
+                const double dy = static_cast<double>(sample.time - time) - meanY;
+                sxx += dx * dx;
+                sxy += dx * dy;
+            }
+            const double nanosecondsPerTick = sxx > 0 ? sxy / sxx : m_nominalNanosecondsPerTick;
+
+            m_parameters.performanceCounterReference = performanceCounter;
+            m_parameters.timeReference = time + std::llround(meanY - nanosecondsPerTick * meanX);
+            m_parameters.nanosecondsPerTick = nanosecondsPerTick;
+
+            // The runtime's conversions are assumed to be no coarser than a tick of the performance counter. Until
+            // there are two samples, the drift is unknown.
+            const XrDuration resolution = std::llround(std::ceil(m_nominalNanosecondsPerTick));
+            if (m_samples.size() < 2) {
+                const auto samplingPeriod = std::chrono::duration_cast<std::chrono::nanoseconds>(getSamplingPeriod());
+                m_parameters.errorBound =
+                    std::llround(samplingPeriod.count() * MaxDriftPpm * 1e-6) + resolution;
+            } else {
+                XrDuration maxError = 0;
+                for (const Sample& sample : m_samples) {
+                    maxError =
+                        std::max(maxError, std::abs(m_parameters.toXrTime(sample.performanceCounter) - sample.time));
+                    maxError = std::max(maxError, sample.extrapolationError);
+                }
+                m_parameters.errorBound = maxError * ErrorBoundMargin + resolution;
+            }
+
+            return m_parameters;
+        }
+
+        // Sample faster until the window is full.
+        std::chrono::milliseconds getSamplingPeriod() const {
+            return m_sampleCount < WindowSize ? 100ms : 1000ms;
+        }
+
+        double getNominalNanosecondsPerTick() const {
+            return m_nominalNanosecondsPerTick;
+        }
+
+      private:
+        static constexpr size_t WindowSize = 8;
+        static constexpr XrDuration ErrorBoundMargin = 2;
+        static constexpr double MaxDriftPpm = 1000.0;
+
+        struct Sample {
+            int64_t performanceCounter;
+            XrTime time;
+            XrDuration extrapolationError;
+        };
+
+        const double m_nominalNanosecondsPerTick;
+        std::deque<Sample> m_samples;
+        uint64_t m_sampleCount{0};
+        ClockParameters m_parameters;
+    };
+
+    int64_t getPerformanceFrequency() {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return frequency.QuadPart;
+    }
+
+    struct ClockService : IClockService {
+        ClockService(XrInstance instance, PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr)
+            : m_instance(instance), m_calibrator(getPerformanceFrequency()) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "ClockService_Create");
+
+            CHECK_XRCMD(xrGetInstanceProcAddr(
+                instance,
+                "xrConvertWin32PerformanceCounterToTimeKHR",
+                reinterpret_cast<PFN_xrVoidFunction*>(&xrConvertWin32PerformanceCounterToTimeKHR)));
+
+            // The first sample is taken right away, so the service is usable upon creation.
+            if (!sample()) {
+                throw std::runtime_error("Failed to sample the runtime clock");
+            }
+
+            m_thread = std::thread([this] {
+                SetThreadDescription(GetCurrentThread(), L"Layer Clock");
+                ScopedLayerThread layerThread;
+                samplerThread();
+            });
+
+            TraceLoggingWriteStop(local, "ClockService_Create", TLPArg(this, "ClockService"));
+        }
+
+        ~ClockService() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "ClockService_Destroy");
+
+            {
+                std::unique_lock lock(m_mutex);
+                m_exiting = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread.join();
+
+            const ClockServiceStatistics statistics = getStatistics();
+            Log(fmt::format("Clock service: {} samples ({} failed), drift {:.2f} ppm, error bound {:.2f} us\n",
+                            statistics.sampleCount,
+                            statistics.failedSampleCount,
+                            statistics.driftPpm,
+                            statistics.errorBound / 1000.0));
+
+            TraceLoggingWriteStop(local, "ClockService_Destroy");
+        }
+
+        XrTime toXrTime(int64_t performanceCounter) const override {
+            return m_model.read().toXrTime(performanceCounter);
+        }
+
+        int64_t toPerformanceCounter(XrTime time) const override {
+            return m_model.read().toPerformanceCounter(time);
+        }
+
+        XrTime getCurrentTime() const override {
+            LARGE_INTEGER counter;
+            QueryPerformanceCounter(&counter);
+            return toXrTime(counter.QuadPart);
+        }
+
+        XrDuration getErrorBound() const override {
+            return m_model.read().errorBound;
+        }
+
+        ClockServiceStatistics getStatistics() const override {
+            const ClockParameters parameters = m_model.read();
+
+            ClockServiceStatistics statistics{};
+            statistics.sampleCount = m_sampleCount.load(std::memory_order_relaxed);
+            statistics.failedSampleCount = m_failedSampleCount.load(std::memory_order_relaxed);
+            statistics.driftPpm =
+                (parameters.nanosecondsPerTick / m_calibrator.getNominalNanosecondsPerTick() - 1.0) * 1e6;
+            statistics.errorBound = parameters.errorBound;
+            return statistics;
+        }
+
+      private:
+        bool sample() {
+            LARGE_INTEGER counter;
+            QueryPerformanceCounter(&counter);
+            XrTime time;
+            const XrResult result = xrConvertWin32PerformanceCounterToTimeKHR(m_instance, &counter, &time);
+            if (XR_FAILED(result)) {
+                // Keep the current model until the next sample.
+                m_failedSampleCount++;
+                TraceLoggingWrite(g_traceProvider, "ClockService_SampleFailed", TLArg(xr::ToCString(result), "Result"));
+                return false;
+            }
+
+            const ClockParameters parameters = m_calibrator.addSample(counter.QuadPart, time);
+            m_model.publish(parameters);
+            m_sampleCount++;
+
+            TraceLoggingWrite(g_traceProvider,
+                              "ClockService_Sample",
+                              TLArg(counter.QuadPart, "PerformanceCounter"),
+                              TLArg(time, "Time"),
+                              TLArg(parameters.nanosecondsPerTick, "NanosecondsPerTick"),
+                              TLArg(parameters.errorBound, "ErrorBound"));
+
+            return true;
+        }
+
+        void samplerThread() {
+            std::unique_lock lock(m_mutex);
+            while (!m_wakeUp.wait_for(lock, m_calibrator.getSamplingPeriod(), [&] { return m_exiting; })) {
+                lock.unlock();
+                sample();
+                lock.lock();
+            }
+        }
+
+        const XrInstance m_instance;
+        PFN_xrConvertWin32PerformanceCounterToTimeKHR xrConvertWin32PerformanceCounterToTimeKHR{nullptr};
+
+        // Only used by the sampler thread (and the constructor).
+        ClockCalibrator m_calibrator;
+        ClockModel m_model;
+        std::atomic<uint64_t> m_sampleCount{0};
+        std::atomic<uint64_t> m_failedSampleCount{0};
+
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        bool m_exiting{false};
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::general {
+
+    std::shared_ptr<IClockService> createClockService(XrInstance instance,
+                                                      PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr) {
+        return std::make_shared<ClockService>(instance, xrGetInstanceProcAddr);
+    }
+
+} // namespace openxr_api_layer::utils::general
@@ -22,6 +22,7 @@
 
 #include "pch.h"
 
+#include "general.h"
 #include "graphics.h"
 #include "log.h"
 
@@ -41,6 +42,8 @@ namespace xr {
         case Api::D3D12:
             return "D3D12";
 #endif
+        case Api::CPU:
+            return "CPU";
         };
 
         return "";
@@ -62,6 +65,9 @@ namespace xr {
 namespace {
 
     using namespace openxr_api_layer::log;
+    using openxr_api_layer::HandleMap;
+    using openxr_api_layer::XrExpected;
+    using namespace openxr_api_layer::utils;
     using namespace openxr_api_layer::utils::graphics;
 
     bool isSRGBFormat(DXGI_FORMAT format) {
@@ -76,6 +82,438 @@ namespace {
                format == DXGI_FORMAT_D32_FLOAT || format == DXGI_FORMAT_D32_FLOAT_S8X24_UINT;
     }
 
+    // The resources of the swapchains and composition frameworks are retired upon destruction, and released later
+    // once the GPU work that might use them has completed. This avoids blocking the application thread in
+    // xrDestroySwapchain() and xrDestroySession() while the GPU drains. The retired resources of the composition
+    // device are queued per fence (hence per device), in increasing order of fence values, and reclaimed by a
+    // background thread. The resources of the application device must be released on the application thread, since
+    // the application device might not be thread-safe (D3D11_CREATE_DEVICE_SINGLETHREADED): they are released at the
+    // next frame boundary after their fence has completed (see releaseApplicationResources()), or when the session
+    // using the application device is destroyed (see releaseApplicationDeviceResources()).
+    class DeferredDestructionQueue {
+      public:
+        using clock = std::chrono::high_resolution_clock;
+
+        DeferredDestructionQueue() {
+            m_thread = std::thread([this] {
+                SetThreadDescription(GetCurrentThread(), L"Layer Reclaimer");
+                general::ScopedLayerThread layerThread;
+                reclaimerThread();
+            });
+        }
+
+        ~DeferredDestructionQueue() {
+            {
+                std::unique_lock lock(m_mutex);
+                m_exiting = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread.join();
+
+            releaseApplicationResources(true);
+
+            if (m_statistics.retiredCount) {
+                Log(fmt::format("Deferred destruction: {} retirements, {:.2f} ms of teardown on average (max {:.2f} "
+                                "ms), {:.2f} ms until completion on average (max {:.2f} ms)\n",
+                                m_statistics.retiredCount,
+                                m_statistics.teardownMicrosecondsTotal / 1000.0 / m_statistics.retiredCount,
+                                m_statistics.teardownMicrosecondsMax / 1000.0,
+                                m_statistics.deferredMicrosecondsTotal / 1000.0 /
+                                    std::max(m_statistics.reclaimedCount, 1u),
+                                m_statistics.deferredMicrosecondsMax / 1000.0));
+            }
+        }
+
+        // The resources are released in order once the fence reaches the value. The teardown time is measured from
+        // the start of the destruction of their owner. The applicationResources belong to the applicationDevice.
+        void retire(std::shared_ptr<IGraphicsFence> fence,
+                    uint64_t value,
+                    std::vector<std::shared_ptr<void>> compositionResources,
+                    std::vector<std::shared_ptr<void>> applicationResources,
+                    clock::time_point teardownStart,
+                    const IGraphicsDevice* applicationDevice = nullptr) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "DeferredDestructionQueue_Retire",
+                                   TLPArg(fence.get(), "Fence"),
+                                   TLArg(value, "Value"),
+                                   TLArg(compositionResources.size(), "CompositionResourcesCount"),
+                                   TLArg(applicationResources.size(), "ApplicationResourcesCount"));
+
+            const auto now = clock::now();
+            {
+                std::unique_lock lock(m_mutex);
+
+                if (!applicationResources.empty()) {
+                    m_applicationRetirements.push_back(
+                        {fence, value, std::move(applicationResources), now, applicationDevice});
+                    m_applicationPendingCount++;
+                }
+
+                IGraphicsFence* const key = fence.get();
+                m_queues[key].push_back({std::move(fence), value, std::move(compositionResources), now});
+                m_pendingCount++;
+
+                const uint64_t teardownUs =
+                    std::chrono::duration_cast<std::chrono::microseconds>(now - teardownStart).count();
+                m_statistics.retiredCount++;
+                m_statistics.teardownMicrosecondsTotal += teardownUs;
+                m_statistics.teardownMicrosecondsMax = std::max(m_statistics.teardownMicrosecondsMax, teardownUs);
+            }
+            m_wakeUp.notify_one();
+
+            TraceLoggingWriteStop(local, "DeferredDestructionQueue_Retire");
+        }
+
+        // Must be called from the application thread, at a frame boundary. Releases the resources of the application
+        // device whose fence has completed. When forced, wait (for a bounded time) for all the fences to complete.
+        void releaseApplicationResources(bool force = false) {
+            releaseApplicationRetirements(force, nullptr);
+        }
+
+        // Must be called from the application thread, once the session using the application device is destroyed.
+        // Releases all the resources of that device, waiting (for a bounded time) for their fences to complete, so that
+        // the application is free to destroy its device.
+        void releaseApplicationDeviceResources(const IGraphicsDevice* applicationDevice) {
+            releaseApplicationRetirements(false, applicationDevice);
+        }
+
+        DeferredDestructionStatistics getStatistics() const {
+            std::unique_lock lock(m_mutex);
+
+            return m_statistics;
+        }
+
+      private:
+        struct Retirement {
+            std::shared_ptr<IGraphicsFence> fence;
+            uint64_t value;
+            std::vector<std::shared_ptr<void>> resources;
+            clock::time_point retireTime;
+            const IGraphicsDevice* applicationDevice{nullptr};
+        };
+
+        // The resources of the applicationDevice (if any) are released as if forced.
+        void releaseApplicationRetirements(bool force, const IGraphicsDevice* applicationDevice) {
+            if (!m_applicationPendingCount.load(std::memory_order_relaxed)) {
+                return;
+            }
+
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "DeferredDestructionQueue_ReleaseApplicationResources",
+                                   TLArg(force, "Force"),
+                                   TLPArg(applicationDevice, "ApplicationDevice"));
+
+            const auto isForced = [&](const Retirement& retirement) {
+                return force || (applicationDevice && retirement.applicationDevice == applicationDevice);
+            };
+
+            std::vector<Retirement> completed;
+            {
+                std::unique_lock lock(m_mutex);
+
+                for (auto it = m_applicationRetirements.begin(); it != m_applicationRetirements.end();) {
+                    if (isForced(*it) || it->fence->getCompletedValue() >= it->value) {
+                        completed.push_back(std::move(*it));
+                        it = m_applicationRetirements.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+                m_applicationPendingCount -= completed.size();
+            }
+
+            // Do not hang the application if a device stopped making progress.
+            const auto deadline = clock::now() + MaxDrainDuration;
+            for (Retirement& retirement : completed) {
+                while (isForced(retirement) && retirement.fence->getCompletedValue() < retirement.value &&
+                       clock::now() < deadline) {
+                    std::this_thread::sleep_for(PollingPeriod);
+                }
+                for (std::shared_ptr<void>& resource : retirement.resources) {
+                    resource.reset();
+                }
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "DeferredDestructionQueue_ReleaseApplicationResources",
+                                  TLArg(completed.size(), "ReleasedCount"));
+        }
+
+        // Release the resources whose fence value was reached. When forced, release all the resources regardless.
+        void reclaim(bool force = false) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "DeferredDestructionQueue_Reclaim", TLArg(force, "Force"));
+
+            std::vector<Retirement> completed;
+            {
+                std::unique_lock lock(m_mutex);
+
+                const auto now = clock::now();
+                for (auto it = m_queues.begin(); it != m_queues.end();) {
+                    std::deque<Retirement>& queue = it->second;
+                    const uint64_t completedValue = queue.front().fence->getCompletedValue();
+                    while (!queue.empty() && (force || queue.front().value <= completedValue)) {
+                        const uint64_t deferredUs =
+                            std::chrono::duration_cast<std::chrono::microseconds>(now - queue.front().retireTime)
+                                .count();
+                        m_statistics.reclaimedCount++;
+                        m_statistics.deferredMicrosecondsTotal += deferredUs;
+                        m_statistics.deferredMicrosecondsMax =
+                            std::max(m_statistics.deferredMicrosecondsMax, deferredUs);
+
+                        completed.push_back(std::move(queue.front()));
+                        queue.pop_front();
+                    }
+
+                    if (queue.empty()) {
+                        it = m_queues.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+                m_pendingCount -= completed.size();
+            }
+
+            // The resources are released outside of the lock, since this might take a while.
+            for (Retirement& retirement : completed) {
+                for (std::shared_ptr<void>& resource : retirement.resources) {
+                    resource.reset();
+                }
+            }
+
+            TraceLoggingWriteStop(
+                local, "DeferredDestructionQueue_Reclaim", TLArg(completed.size(), "ReclaimedCount"));
+        }
+
+        void reclaimerThread() {
+            std::optional<clock::time_point> exitDeadline;
+            std::unique_lock lock(m_mutex);
+            while (true) {
+                if (!m_pendingCount) {
+                    // Drain all the retired resources before exiting.
+                    if (m_exiting) {
+                        return;
+                    }
+                    m_wakeUp.wait(lock, [&] { return m_exiting || m_pendingCount; });
+                    continue;
+                }
+
+                // The fences cannot signal an event without a device context, which is not thread-safe. Poll them
+                // instead.
+                m_wakeUp.wait_for(lock, PollingPeriod);
+
+                // Do not hang the destruction of the instance if a device stopped making progress.
+                bool force = false;
+                if (m_exiting) {
+                    if (!exitDeadline) {
+                        exitDeadline = clock::now() + MaxDrainDuration;
+                    }
+                    force = clock::now() >= exitDeadline.value();
+                }
+
+                lock.unlock();
+                if (force) {
+                    ErrorLog("Deferred destruction timed out, releasing all resources\n");
+                }
+                reclaim(force);
+                lock.lock();
+            }
+        }
+
+        static constexpr auto PollingPeriod = 1ms;
+        static constexpr auto MaxDrainDuration = 2s;
+
+        std::thread m_thread;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::unordered_map<IGraphicsFence*, std::deque<Retirement>> m_queues;
+        size_t m_pendingCount{0};
+        std::deque<Retirement> m_applicationRetirements;
+        std::atomic<size_t> m_applicationPendingCount{0};
+        bool m_exiting{false};
+        DeferredDestructionStatistics m_statistics;
+    };
+
+    // The device-level objects of a composition framework, which do not depend on the session. Only objects of the
+    // composition device are kept, so that the application is free to destroy its device with the session.
+    struct CompositionDevices {
+        std::shared_ptr<IGraphicsDevice> compositionDevice;
+        std::shared_ptr<IGraphicsFence> fenceOnCompositionDevice;
+
+        // The fences are reused, so their values must keep increasing.
+        uint64_t fenceValue{0};
+
+        DXGI_FORMAT preferredColorFormat{DXGI_FORMAT_UNKNOWN};
+        DXGI_FORMAT preferredSRGBColorFormat{DXGI_FORMAT_UNKNOWN};
+        DXGI_FORMAT preferredDepthFormat{DXGI_FORMAT_UNKNOWN};
+
+        std::unique_ptr<ICompositionDeviceData> deviceData;
+    };
+
+    // The composition devices can be reused with the same adapter and application device (and queue for D3D12). The
+    // application objects are only compared by address, and no reference is held on them.
+    struct CompositionDevicesKey {
+        LUID adapterLuid{};
+        Api applicationApi{};
+        void* applicationDevice{nullptr};
+        void* applicationContext{nullptr};
+
+        bool operator==(const CompositionDevicesKey& other) const {
+            return !memcmp(&adapterLuid, &other.adapterLuid, sizeof(LUID)) && applicationApi == other.applicationApi &&
+                   applicationDevice == other.applicationDevice && applicationContext == other.applicationContext;
+        }
+    };
+
+    // Many applications destroy and recreate their session (upon focus loss, or between menus and gameplay). The
+    // devices of a destroyed session are kept warm for the next session, and evicted after a timeout.
+    class CompositionDevicesCache {
+      public:
+        using clock = std::chrono::high_resolution_clock;
+
+        CompositionDevicesCache(std::shared_ptr<DeferredDestructionQueue> destructionQueue)
+            : m_destructionQueue(destructionQueue) {
+            m_thread = std::thread([this] {
+                SetThreadDescription(GetCurrentThread(), L"Layer Devices Cache");
+                general::ScopedLayerThread layerThread;
+                evictionThread();
+            });
+        }
+
+        ~CompositionDevicesCache() {
+            {
+                std::unique_lock lock(m_mutex);
+                m_exiting = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread.join();
+
+            for (Entry& entry : m_entries) {
+                evict(std::move(entry.devices));
+            }
+        }
+
+        // Returns nullptr if there are no warm devices for the key.
+        std::unique_ptr<CompositionDevices> take(const CompositionDevicesKey& key) {
+            std::unique_lock lock(m_mutex);
+
+            for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+                if (it->key == key) {
+                    std::unique_ptr<CompositionDevices> devices = std::move(it->devices);
+                    m_entries.erase(it);
+                    return devices;
+                }
+            }
+
+            return nullptr;
+        }
+
+        bool hasAdapter(const LUID& adapterLuid) {
+            std::unique_lock lock(m_mutex);
+
+            return std::any_of(m_entries.cbegin(), m_entries.cend(), [&](const Entry& entry) {
+                return !memcmp(&entry.key.adapterLuid, &adapterLuid, sizeof(LUID));
+            });
+        }
+
+        void park(const CompositionDevicesKey& key, std::unique_ptr<CompositionDevices> devices) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CompositionDevicesCache_Park", TLPArg(devices.get(), "Devices"));
+
+            // Only the most recent devices are kept for a given key.
+            std::unique_ptr<CompositionDevices> replaced = take(key);
+            {
+                std::unique_lock lock(m_mutex);
+                m_entries.push_back({key, std::move(devices), clock::now() + Timeout});
+            }
+            m_wakeUp.notify_one();
+
+            if (replaced) {
+                evict(std::move(replaced));
+            }
+
+            TraceLoggingWriteStop(local, "CompositionDevicesCache_Park");
+        }
+
+      private:
+        struct Entry {
+            CompositionDevicesKey key;
+            std::unique_ptr<CompositionDevices> devices;
+            clock::time_point expiry;
+        };
+
+        // The devices are released once the work submitted to the composition device has completed, and after the
+        // objects that depend on them.
+        void evict(std::unique_ptr<CompositionDevices> devices) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CompositionDevicesCache_Evict", TLPArg(devices.get(), "Devices"));
+
+            std::vector<std::shared_ptr<void>> resources;
+            resources.push_back(std::shared_ptr<ICompositionDeviceData>(std::move(devices->deviceData)));
+            resources.push_back(devices->fenceOnCompositionDevice);
+            resources.push_back(std::move(devices->compositionDevice));
+            m_destructionQueue->retire(
+                devices->fenceOnCompositionDevice, devices->fenceValue, std::move(resources), {}, clock::now());
+
+            TraceLoggingWriteStop(local, "CompositionDevicesCache_Evict");
+        }
+
+        void evictionThread() {
+            std::unique_lock lock(m_mutex);
+            while (!m_exiting) {
+                if (m_entries.empty()) {
+                    m_wakeUp.wait(lock);
+                    continue;
+                }
+
+                const auto nextExpiry =
+                    std::min_element(m_entries.cbegin(), m_entries.cend(), [](const Entry& a, const Entry& b) {
+                        return a.expiry < b.expiry;
+                    })->expiry;
+                m_wakeUp.wait_until(lock, nextExpiry);
+
+                const auto now = clock::now();
+                std::vector<std::unique_ptr<CompositionDevices>> expired;
+                for (auto it = m_entries.begin(); it != m_entries.end();) {
+                    if (it->expiry <= now) {
+                        expired.push_back(std::move(it->devices));
+                        it = m_entries.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+
+                lock.unlock();
+                for (std::unique_ptr<CompositionDevices>& devices : expired) {
+                    evict(std::move(devices));
+                }
+                lock.lock();
+            }
+        }
+
+        static constexpr auto Timeout = 10s;
+
+        const std::shared_ptr<DeferredDestructionQueue> m_destructionQueue;
+        std::thread m_thread;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::vector<Entry> m_entries;
+        bool m_exiting{false};
+    };
+
+    // A composition device created ahead of the session, as soon as the application queries the graphics requirements.
+    struct PrewarmedCompositionDevice {
+        LUID adapterLuid{};
+        std::shared_future<std::shared_ptr<IGraphicsDevice>> device;
+    };
+
+    // Reports the background initialization of a composition framework: whether the devices were reused, how long
+    // the initialization took, and how long the application was blocked waiting for it.
+    using InitializationCallback = std::function<void(bool isWarm, uint64_t initializationUs, uint64_t blockedUs)>;
+
     struct SwapchainImage : ISwapchainImage {
         SwapchainImage(std::shared_ptr<IGraphicsTexture> textureOnApplicationDevice,
                        std::shared_ptr<IGraphicsTexture> textureOnCompositionDevice,
@@ -114,11 +552,12 @@ namespace {
                              IGraphicsDevice* applicationDevice,
                              IGraphicsDevice* compositionDevice,
                              SwapchainMode mode,
+                             std::shared_ptr<DeferredDestructionQueue> destructionQueue,
                              std::optional<bool> overrideShareable = {},
                              bool hasOwnership = true)
             : m_swapchain(swapchain), m_infoOnCompositionDevice(infoOnApplicationDevice),
               m_formatOnApplicationDevice(infoOnApplicationDevice.format), m_applicationDevice(applicationDevice),
-              m_compositionDevice(compositionDevice),
+              m_compositionDevice(compositionDevice), m_destructionQueue(destructionQueue),
               m_accessForRead((mode & SwapchainMode::Read) == SwapchainMode::Read),
               m_accessForWrite((mode & SwapchainMode::Write) == SwapchainMode::Write) {
             TraceLocalActivity(local);
@@ -217,31 +656,55 @@ namespace {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local, "Swapchain_Destroy", TLPArg(this, "Swapchain"));
 
-            if (m_fenceOnApplicationDevice) {
-                m_fenceOnApplicationDevice->waitOnCpu(m_fenceValue);
-            }
-            if (m_fenceOnCompositionDevice) {
-                m_fenceOnCompositionDevice->waitOnCpu(m_fenceValue);
-            }
+            const auto teardownStart = DeferredDestructionQueue::clock::now();
+
+            // The runtime swapchain is destroyed right away to honor the OpenXR ordering rules (before its session).
+            // The textures opened on our devices keep the images alive until they are released.
             if (xrDestroySwapchain) {
                 xrDestroySwapchain(m_swapchain);
             }
 
+            // Serialize the outstanding work of the application device before the composition device, so that the
+            // composition device reaching the fence means that both devices are done with the images.
+            m_fenceValue++;
+            m_fenceOnApplicationDevice->signal(m_fenceValue);
+            m_fenceOnCompositionDevice->waitOnDevice(m_fenceValue);
+            m_fenceValue++;
+            m_fenceOnCompositionDevice->signal(m_fenceValue);
+
+            std::vector<std::shared_ptr<void>> compositionResources;
+            std::vector<std::shared_ptr<void>> applicationResources;
+            for (const std::unique_ptr<SwapchainImage>& image : m_images) {
+                applicationResources.push_back(image->m_textureOnApplicationDevice);
+                compositionResources.push_back(image->m_textureForRead);
+                compositionResources.push_back(image->m_textureForWrite);
+            }
+            m_images.clear();
+            applicationResources.push_back(std::move(m_bounceBufferOnApplicationDevice));
+            applicationResources.push_back(m_fenceOnApplicationDevice);
+            compositionResources.push_back(std::move(m_bounceBufferOnCompositionDevice));
+            m_destructionQueue->retire(m_fenceOnCompositionDevice,
+                                       m_fenceValue,
+                                       std::move(compositionResources),
+                                       std::move(applicationResources),
+                                       teardownStart,
+                                       m_applicationDevice);
+
             TraceLoggingWriteStop(local, "Swapchain_Destroy");
         }
 
-        ISwapchainImage* acquireImage(bool wait) override {
+        XrExpected<ISwapchainImage*> tryAcquireImage(bool wait) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "Swapchain_AcquireImage", TLPArg(this, "Swapchain"));
+            TraceLoggingWriteStart(local, "Swapchain_AcquireImage", TLPArg(this, "Swapchain"), TLFrameArg());
 
             std::unique_lock lock(m_mutex);
 
             uint32_t index;
-            CHECK_XRCMD(xrAcquireSwapchainImage(m_swapchain, nullptr, &index));
+            RETURN_IF_XR_FAILED(xrAcquireSwapchainImage(m_swapchain, nullptr, &index));
             if (wait) {
                 XrSwapchainImageWaitInfo waitInfo{XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
                 waitInfo.timeout = XR_INFINITE_DURATION;
-                CHECK_XRCMD(xrWaitSwapchainImage(m_swapchain, &waitInfo));
+                RETURN_IF_XR_FAILED(xrWaitSwapchainImage(m_swapchain, &waitInfo));
             }
 
             // Serialize the operations on the application device that might have occurred when acquiring the swapchain
@@ -260,37 +723,41 @@ namespace {
             return image;
         }
 
-        void waitImage() override {
+        XrExpected<void> tryWaitImage() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "Swapchain_WaitImage", TLPArg(this, "Swapchain"));
+            TraceLoggingWriteStart(local, "Swapchain_WaitImage", TLPArg(this, "Swapchain"), TLFrameArg());
 
-            // We don't need to check that an image was acquired since OpenXR will do it for us and throw an error
+            // We don't need to check that an image was acquired since OpenXR will do it for us and return an error
             // below.
             XrSwapchainImageWaitInfo waitInfo{XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
             waitInfo.timeout = XR_INFINITE_DURATION;
-            CHECK_XRCMD(xrWaitSwapchainImage(m_swapchain, &waitInfo));
+            RETURN_IF_XR_FAILED(xrWaitSwapchainImage(m_swapchain, &waitInfo));
 
             TraceLoggingWriteStop(local, "Swapchain_WaitImage");
+
+            return {};
         }
 
-        void releaseImage() override {
+        XrExpected<void> tryReleaseImage() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "Swapchain_ReleaseImage", TLPArg(this, "Swapchain"));
+            TraceLoggingWriteStart(local, "Swapchain_ReleaseImage", TLPArg(this, "Swapchain"), TLFrameArg());
 
             std::unique_lock lock(m_mutex);
 
             // We defer release of the OpenXR swapchain to ensure that we will have an opportunity to peek and/or poke
             // its content. If the same swapchain is released multiple times, then only defer the most recent call.
             if (!(m_accessForRead || m_accessForWrite) || m_lastReleasedImage.has_value()) {
-                CHECK_XRCMD(xrReleaseSwapchainImage(m_swapchain, nullptr));
-            } else if (m_acquiredImages.empty()) {
-                throw std::runtime_error("No image was acquired");
+                RETURN_IF_XR_FAILED(xrReleaseSwapchainImage(m_swapchain, nullptr));
+            } else {
+                RETURN_XR_FAILURE_IF(XR_ERROR_CALL_ORDER_INVALID, m_acquiredImages.empty(), "No image was acquired");
             }
 
             m_lastReleasedImage = m_acquiredImages.front();
             m_acquiredImages.pop_front();
 
             TraceLoggingWriteStop(local, "Swapchain_ReleaseImage", TLArg(m_lastReleasedImage.value(), "ReleasedIndex"));
+
+            return {};
         }
 
         ISwapchainImage* getLastReleasedImage() const override {
@@ -298,7 +765,8 @@ namespace {
             TraceLoggingWriteStart(local,
                                    "Swapchain_GetLastReleasedImage",
                                    TLPArg(this, "Swapchain"),
-                                   TLArg(m_lastReleasedImage.value_or(-1), "Index"));
+                                   TLArg(m_lastReleasedImage.value_or(-1), "Index"),
+                                   TLFrameArg());
 
             if (!m_accessForRead) {
                 throw std::runtime_error("Not a readable swapchain");
@@ -326,16 +794,15 @@ namespace {
             return image;
         }
 
-        void commitLastReleasedImage() override {
+        XrExpected<void> tryCommitLastReleasedImage() override {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local,
                                    "Swapchain_CommitLastReleasedImage",
                                    TLPArg(this, "Swapchain"),
-                                   TLArg(m_lastReleasedImage.value_or(-1), "Index"));
+                                   TLArg(m_lastReleasedImage.value_or(-1), "Index"),
+                                   TLFrameArg());
 
-            if (!m_accessForWrite) {
-                throw std::runtime_error("Not a writable swapchain");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_VALIDATION_FAILURE, !m_accessForWrite, "Not a writable swapchain");
 
             if (m_lastReleasedImage.has_value()) {
                 // Serialize the operations on the composition device before copying to the application device or
@@ -351,11 +818,13 @@ namespace {
                                                      m_images[m_lastReleasedImage.value()]->getApplicationTexture());
                 }
 
-                CHECK_XRCMD(xrReleaseSwapchainImage(m_swapchain, nullptr));
+                RETURN_IF_XR_FAILED(xrReleaseSwapchainImage(m_swapchain, nullptr));
                 m_lastReleasedImage = {};
             }
 
             TraceLoggingWriteStop(local, "Swapchain_CommitLastReleasedImage");
+
+            return {};
         }
 
         const XrSwapchainCreateInfo& getInfoOnCompositionDevice() const override {
@@ -392,6 +861,7 @@ namespace {
         const int64_t m_formatOnApplicationDevice;
         IGraphicsDevice* const m_compositionDevice;
         IGraphicsDevice* const m_applicationDevice;
+        const std::shared_ptr<DeferredDestructionQueue> m_destructionQueue;
         const bool m_accessForRead;
         const bool m_accessForWrite;
 
@@ -403,7 +873,7 @@ namespace {
 
         XrSwapchainCreateInfo m_infoOnCompositionDevice;
 
-        std::vector<std::unique_ptr<ISwapchainImage>> m_images;
+        std::vector<std::unique_ptr<SwapchainImage>> m_images;
         std::shared_ptr<IGraphicsTexture> m_bounceBufferOnApplicationDevice;
         std::shared_ptr<IGraphicsTexture> m_bounceBufferOnCompositionDevice;
         std::shared_ptr<IGraphicsFence> m_fenceOnApplicationDevice;
@@ -459,17 +929,18 @@ namespace {
             TraceLoggingWriteStop(local, "Swapchain_Destroy");
         }
 
-        ISwapchainImage* acquireImage(bool wait) override {
+        XrExpected<ISwapchainImage*> tryAcquireImage(bool wait) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "Swapchain_AcquireImage", TLPArg(this, "Swapchain"));
+            TraceLoggingWriteStart(local, "Swapchain_AcquireImage", TLPArg(this, "Swapchain"), TLFrameArg());
 
             std::unique_lock lock(m_mutex);
 
-            if (m_acquiredImages.size() == m_images.size()) {
-                throw std::runtime_error("No image available to acquire");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_CALL_ORDER_INVALID,
+                                 m_acquiredImages.size() == m_images.size(),
+                                 "No image available to acquire");
 
-            const uint32_t index = m_nextImage++;
+            const uint32_t index = m_nextImage;
+            m_nextImage = (m_nextImage + 1) % static_cast<uint32_t>(m_images.size());
             m_acquiredImages.push_back(index);
 
             ISwapchainImage* const image = m_images[index].get();
@@ -480,33 +951,33 @@ namespace {
             return image;
         }
 
-        void waitImage() override {
+        XrExpected<void> tryWaitImage() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "Swapchain_WaitImage", TLPArg(this, "Swapchain"));
+            TraceLoggingWriteStart(local, "Swapchain_WaitImage", TLPArg(this, "Swapchain"), TLFrameArg());
 
             std::unique_lock lock(m_mutex);
 
-            if (m_acquiredImages.empty()) {
-                throw std::runtime_error("No image was acquired");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_CALL_ORDER_INVALID, m_acquiredImages.empty(), "No image was acquired");
 
             TraceLoggingWriteStop(local, "Swapchain_WaitImage");
+
+            return {};
         }
 
-        void releaseImage() override {
+        XrExpected<void> tryReleaseImage() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "Swapchain_ReleaseImage", TLPArg(this, "Swapchain"));
+            TraceLoggingWriteStart(local, "Swapchain_ReleaseImage", TLPArg(this, "Swapchain"), TLFrameArg());
 
             std::unique_lock lock(m_mutex);
 
-            if (m_acquiredImages.empty()) {
-                throw std::runtime_error("No image was acquired");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_CALL_ORDER_INVALID, m_acquiredImages.empty(), "No image was acquired");
 
             m_lastReleasedImage = m_acquiredImages.front();
             m_acquiredImages.pop_front();
 
             TraceLoggingWriteStop(local, "Swapchain_ReleaseImage", TLArg(m_lastReleasedImage, "ReleasedIndex"));
+
+            return {};
         }
 
         ISwapchainImage* getLastReleasedImage() const override {
@@ -514,7 +985,8 @@ namespace {
             TraceLoggingWriteStart(local,
                                    "Swapchain_GetLastReleasedImage",
                                    TLPArg(this, "Swapchain"),
-                                   TLArg(m_lastReleasedImage, "Index"));
+                                   TLArg(m_lastReleasedImage, "Index"),
+                                   TLFrameArg());
 
             if (!m_accessForRead) {
                 throw std::runtime_error("Not a readable swapchain");
@@ -527,18 +999,19 @@ namespace {
             return image;
         }
 
-        void commitLastReleasedImage() override {
+        XrExpected<void> tryCommitLastReleasedImage() override {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local,
                                    "Swapchain_CommitLastReleasedImage",
                                    TLPArg(this, "Swapchain"),
-                                   TLArg(m_lastReleasedImage, "Index"));
+                                   TLArg(m_lastReleasedImage, "Index"),
+                                   TLFrameArg());
 
-            if (!m_accessForWrite) {
-                throw std::runtime_error("Not a writable swapchain");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_VALIDATION_FAILURE, !m_accessForWrite, "Not a writable swapchain");
 
             TraceLoggingWriteStop(local, "Swapchain_CommitLastReleasedImage");
+
+            return {};
         }
 
         const XrSwapchainCreateInfo& getInfoOnCompositionDevice() const override {
@@ -585,8 +1058,14 @@ namespace {
                              PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr_,
                              const XrSessionCreateInfo& sessionInfo,
                              XrSession session,
-                             CompositionApi compositionApi)
-            : m_instance(instance), xrGetInstanceProcAddr(xrGetInstanceProcAddr_), m_session(session) {
+                             CompositionApi compositionApi,
+                             std::shared_ptr<DeferredDestructionQueue> destructionQueue,
+                             std::shared_ptr<CompositionDevicesCache> devicesCache,
+                             general::IWorkerPool* initializationWorker,
+                             PrewarmedCompositionDevice prewarmedCompositionDevice,
+                             InitializationCallback onInitialized)
+            : m_instance(instance), xrGetInstanceProcAddr(xrGetInstanceProcAddr_), m_session(session),
+              m_destructionQueue(destructionQueue), m_devicesCache(devicesCache), m_onInitialized(onInitialized) {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local, "CompositionFramework_Create", TLXArg(session, "Session"));
 
@@ -639,19 +1118,72 @@ namespace {
                 throw std::runtime_error("Application graphics API is not supported");
             }
 
-            // Create the device for composition according to the API layer's request.
-            switch (compositionApi) {
+            m_devicesKey.adapterLuid = m_applicationDevice->getAdapterLuid();
+            m_devicesKey.applicationApi = m_applicationDevice->getApi();
+            m_devicesKey.applicationDevice = m_applicationDevice->getNativeDevicePtr();
+            m_devicesKey.applicationContext = m_applicationDevice->getNativeContextPtr();
+
+            m_refreshScheduler = createOverlayRefreshScheduler();
+
+            // The rest of the initialization does not need the application thread, and it is completed in the
+            // background while xrCreateSession() returns. The first call needing the devices waits for it.
+            auto initialized = std::make_shared<std::promise<void>>();
+            m_initialized = initialized->get_future().share();
+            m_initializationStart = std::chrono::high_resolution_clock::now();
+            initializationWorker->submit([this, initialized, compositionApi, prewarmedCompositionDevice] {
+                try {
+                    initializeDevices(compositionApi, prewarmedCompositionDevice);
+                    initialized->set_value();
+                } catch (...) {
+                    initialized->set_exception(std::current_exception());
+                }
+            });
+
+            TraceLoggingWriteStop(local, "CompositionFramework_Create", TLPArg(this, "CompositionFramework"));
+        }
+
+        // Runs on the initialization worker. Only the composition device is used, since the application device
+        // might not be thread-safe (D3D11_CREATE_DEVICE_SINGLETHREADED).
+        void initializeDevices(CompositionApi compositionApi, const PrewarmedCompositionDevice& prewarmed) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CompositionFramework_InitializeDevices", TLXArg(m_session, "Session"));
+
+            // Reuse the devices of a previous session on the same adapter and application device if possible.
+            std::unique_ptr<CompositionDevices> devices = m_devicesCache->take(m_devicesKey);
+            m_isWarm = devices != nullptr;
+            if (m_isWarm) {
+                m_compositionDevice = std::move(devices->compositionDevice);
+                m_fenceOnCompositionDevice = std::move(devices->fenceOnCompositionDevice);
+                m_fenceValue = devices->fenceValue;
+                m_preferredColorFormat = devices->preferredColorFormat;
+                m_preferredSRGBColorFormat = devices->preferredSRGBColorFormat;
+                m_preferredDepthFormat = devices->preferredDepthFormat;
+                m_deviceData = std::move(devices->deviceData);
+            } else {
+                // Create the device for composition according to the API layer's request, unless it was created ahead
+                // of the session for the same adapter.
+                if (prewarmed.device.valid() &&
+                    !memcmp(&prewarmed.adapterLuid, &m_devicesKey.adapterLuid, sizeof(LUID))) {
+                    m_compositionDevice = prewarmed.device.get();
+                } else {
+                    switch (compositionApi) {
 #ifdef XR_USE_GRAPHICS_API_D3D11
-            case CompositionApi::D3D11:
-                m_compositionDevice = internal::createD3D11CompositionDevice(m_applicationDevice->getAdapterLuid());
-                break;
+                    case CompositionApi::D3D11:
+                        m_compositionDevice = internal::createD3D11CompositionDevice(m_devicesKey.adapterLuid);
+                        break;
 #endif
-            default:
-                throw std::runtime_error("Composition graphics API is not supported");
+                    default:
+                        throw std::runtime_error("Composition graphics API is not supported");
+                    }
+                }
+
+                // The fence is opened on the application device later, from the application thread.
+                m_fenceOnCompositionDevice = m_compositionDevice->createFence();
             }
 
-            m_fenceOnCompositionDevice = m_compositionDevice->createFence();
-            m_fenceOnApplicationDevice = m_applicationDevice->openFence(m_fenceOnCompositionDevice->getFenceHandle());
+            for (FrameTimers& timers : m_frameTimers) {
+                timers.composition = m_compositionDevice->createTimer();
+            }
 
             // Check for quirks.
             PFN_xrGetInstanceProperties xrGetInstanceProperties;
@@ -659,11 +1191,11 @@ namespace {
                                               "xrGetInstanceProperties",
                                               reinterpret_cast<PFN_xrVoidFunction*>(&xrGetInstanceProperties)));
             XrInstanceProperties instanceProperties{XR_TYPE_INSTANCE_PROPERTIES};
-            CHECK_XRCMD(xrGetInstanceProperties(instance, &instanceProperties));
+            CHECK_XRCMD(xrGetInstanceProperties(m_instance, &instanceProperties));
             const std::string_view runtimeName(instanceProperties.runtimeName);
 #ifdef XR_USE_GRAPHICS_API_D3D12
             if (runtimeName.find("Windows Mixed Reality") == std::string::npos &&
-                m_applicationDevice->getApi() == Api::D3D12) {
+                m_devicesKey.applicationApi == Api::D3D12) {
                 // Quirk: only WMR seems to implement a full D3D12 compositor. Other runtimes seem to use D3D11 and
                 // despite of D3D12 textures having the shareable flag, they are not shareable with D3D11.
                 m_overrideShareable = false;
@@ -671,6 +1203,80 @@ namespace {
 #endif
 
             // Get the preferred formats for swapchains.
+            if (!m_isWarm) {
+                initializePreferredFormats();
+            }
+
+            m_initializationUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::high_resolution_clock::now() - m_initializationStart)
+                                     .count();
+
+            TraceLoggingWriteStop(local,
+                                  "CompositionFramework_InitializeDevices",
+                                  TLArg(m_isWarm, "Warm"),
+                                  TLArg(m_initializationUs, "InitializationUs"),
+                                  TLArg((int64_t)m_preferredColorFormat, "PreferredColorFormat"),
+                                  TLArg((int64_t)m_preferredSRGBColorFormat, "PreferredSRGBColorFormat"),
+                                  TLArg((int64_t)m_preferredDepthFormat, "PreferredDepthFormat"));
+        }
+
+        // Wait for the background initialization, then complete it on the calling thread. Rethrows the error of the
+        // initialization if it failed.
+        void waitForInitialization() const {
+            if (m_initialized.wait_for(0s) != std::future_status::ready) {
+                TraceLocalActivity(local);
+                TraceLoggingWriteStart(
+                    local, "CompositionFramework_WaitForInitialization", TLXArg(m_session, "Session"));
+
+                const auto start = std::chrono::high_resolution_clock::now();
+                m_initialized.wait();
+                m_blockedUs += std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::high_resolution_clock::now() - start)
+                                   .count();
+
+                TraceLoggingWriteStop(local, "CompositionFramework_WaitForInitialization");
+            }
+            m_initialized.get();
+
+            std::call_once(m_applicationDeviceInitialized, [this] {
+                const_cast<CompositionFramework*>(this)->initializeApplicationDevice();
+                if (m_onInitialized) {
+                    m_onInitialized(m_isWarm, m_initializationUs, m_blockedUs);
+                }
+            });
+        }
+
+        // Non-throwing counterpart to waitForInitialization(). A failed initialization is logged once, and the
+        // framework is unusable for the rest of the session.
+        bool tryWaitForInitialization() const {
+            if (m_initializationFailed.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            try {
+                waitForInitialization();
+                return true;
+            } catch (std::exception& exc) {
+                if (!m_initializationFailed.exchange(true, std::memory_order_acq_rel)) {
+                    TraceLoggingWrite(g_traceProvider,
+                                      "CompositionFramework_InitializationFailed",
+                                      TLXArg(m_session, "Session"),
+                                      TLArg(exc.what(), "Error"));
+                    ErrorLog(fmt::format("Composition framework failed to initialize: {}\n", exc.what()));
+                }
+                return false;
+            }
+        }
+
+        void initializeApplicationDevice() {
+            m_fenceOnApplicationDevice = m_applicationDevice->openFence(m_fenceOnCompositionDevice->getFenceHandle());
+
+            for (FrameTimers& timers : m_frameTimers) {
+                timers.application = m_applicationDevice->createTimer();
+            }
+        }
+
+        void initializePreferredFormats() {
             PFN_xrEnumerateSwapchainFormats xrEnumerateSwapchainFormats;
             CHECK_XRCMD(xrGetInstanceProcAddr(m_instance,
                                               "xrEnumerateSwapchainFormats",
@@ -695,23 +1301,58 @@ namespace {
                     m_preferredDepthFormat = format;
                 }
             }
-            TraceLoggingWriteTagged(local,
-                                    "CompositionFramework_Create",
-                                    TLArg((int64_t)m_preferredColorFormat, "PreferredColorFormat"),
-                                    TLArg((int64_t)m_preferredSRGBColorFormat, "PreferredSRGBColorFormat"),
-                                    TLArg((int64_t)m_preferredDepthFormat, "PreferredDepthFormat"));
-
-            TraceLoggingWriteStop(local, "CompositionFramework_Create", TLPArg(this, "CompositionFramework"));
         }
 
         ~CompositionFramework() {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local, "CompositionFramework_Destroy", TLXArg(m_session, "Session"));
 
-            if (m_fenceOnCompositionDevice) {
-                m_fenceOnCompositionDevice->waitOnCpu(m_fenceValue);
+            const auto teardownStart = DeferredDestructionQueue::clock::now();
+
+            // The session data might own swapchains, which must be destroyed before the session.
+            m_sessionData.reset();
+
+            // The background initialization might still be using the framework.
+            if (!tryWaitForInitialization()) {
+                TraceLoggingWriteStop(local, "CompositionFramework_Destroy");
+                return;
             }
 
+            // Serialize the outstanding work of the application device before the composition device, so that the
+            // composition device reaching the fence means that both devices are done with the timers.
+            m_fenceValue++;
+            m_fenceOnApplicationDevice->signal(m_fenceValue);
+            m_fenceOnCompositionDevice->waitOnDevice(m_fenceValue);
+            m_fenceValue++;
+            m_fenceOnCompositionDevice->signal(m_fenceValue);
+
+            std::vector<std::shared_ptr<void>> compositionResources;
+            std::vector<std::shared_ptr<void>> applicationResources;
+            for (FrameTimers& timers : m_frameTimers) {
+                applicationResources.push_back(std::move(timers.application));
+                compositionResources.push_back(std::move(timers.composition));
+            }
+            const IGraphicsDevice* const applicationDevice = m_applicationDevice.get();
+            applicationResources.push_back(std::move(m_fenceOnApplicationDevice));
+            applicationResources.push_back(std::move(m_applicationDevice));
+            m_destructionQueue->retire(m_fenceOnCompositionDevice,
+                                       m_fenceValue,
+                                       std::move(compositionResources),
+                                       std::move(applicationResources),
+                                       teardownStart,
+                                       applicationDevice);
+
+            // The composition devices are kept warm for the next session.
+            auto devices = std::make_unique<CompositionDevices>();
+            devices->compositionDevice = std::move(m_compositionDevice);
+            devices->fenceOnCompositionDevice = std::move(m_fenceOnCompositionDevice);
+            devices->fenceValue = m_fenceValue;
+            devices->preferredColorFormat = m_preferredColorFormat;
+            devices->preferredSRGBColorFormat = m_preferredSRGBColorFormat;
+            devices->preferredDepthFormat = m_preferredDepthFormat;
+            devices->deviceData = std::move(m_deviceData);
+            m_devicesCache->park(m_devicesKey, std::move(devices));
+
             TraceLoggingWriteStop(local, "CompositionFramework_Destroy");
         }
 
@@ -735,6 +1376,24 @@ namespace {
             return m_sessionData.get();
         }
 
+        void setDeviceData(std::unique_ptr<ICompositionDeviceData> deviceData) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CompositionFramework_SetDeviceData",
+                                   TLXArg(m_session, "Session"),
+                                   TLPArg(deviceData.get(), "DeviceData"));
+
+            waitForInitialization();
+            m_deviceData = std::move(deviceData);
+
+            TraceLoggingWriteStop(local, "CompositionFramework_SetDeviceData");
+        }
+
+        ICompositionDeviceData* getDeviceDataPtr() const override {
+            waitForInitialization();
+            return m_deviceData.get();
+        }
+
         std::shared_ptr<ISwapchain> createSwapchain(const XrSwapchainCreateInfo& infoOnApplicationDevice,
                                                     SwapchainMode mode) override {
             TraceLocalActivity(local);
@@ -752,6 +1411,8 @@ namespace {
                                    TLArg(infoOnApplicationDevice.usageFlags, "UsageFlags"),
                                    TLArg((int)mode, "Mode"));
 
+            waitForInitialization();
+
             std::shared_ptr<ISwapchain> result;
             if ((mode & SwapchainMode::Submit) == SwapchainMode::Submit) {
                 XrSwapchain swapchain;
@@ -765,6 +1426,7 @@ namespace {
                                                                 m_applicationDevice.get(),
                                                                 m_compositionDevice.get(),
                                                                 mode,
+                                                                m_destructionQueue,
                                                                 m_overrideShareable);
             } else {
                 result = std::make_shared<NonSubmittableSwapchain>(
@@ -778,7 +1440,12 @@ namespace {
 
         void serializePreComposition() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "CompositionFramework_SerializePreComposition", TLXArg(m_session, "Session"));
+            TraceLoggingWriteStart(local,
+                                   "CompositionFramework_SerializePreComposition",
+                                   TLXArg(m_session, "Session"),
+                                   TLFrameArg());
+
+            waitForInitialization();
 
             std::unique_lock lock(m_fenceMutex);
 
@@ -786,16 +1453,42 @@ namespace {
             m_fenceOnApplicationDevice->signal(m_fenceValue);
             m_fenceOnCompositionDevice->waitOnDevice(m_fenceValue);
 
+            {
+                std::unique_lock timingLock(m_frameTimingMutex);
+
+                if (m_isTimingFrame) {
+                    FrameTimers& timers = m_frameTimers[m_frameIndex % m_frameTimers.size()];
+                    timers.application->stop();
+                    timers.composition->start();
+                }
+            }
+
             TraceLoggingWriteStop(local, "CompositionFramework_SerializePreComposition");
         }
 
         void serializePostComposition() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(
-                local, "CompositionFramework_SerializePostComposition", TLXArg(m_session, "Session"));
+            TraceLoggingWriteStart(local,
+                                   "CompositionFramework_SerializePostComposition",
+                                   TLXArg(m_session, "Session"),
+                                   TLFrameArg());
+
+            waitForInitialization();
 
             std::unique_lock lock(m_fenceMutex);
 
+            {
+                std::unique_lock timingLock(m_frameTimingMutex);
+
+                if (m_isTimingFrame) {
+                    FrameTimers& timers = m_frameTimers[m_frameIndex % m_frameTimers.size()];
+                    timers.composition->stop();
+                    timers.hasTiming = true;
+                    m_isTimingFrame = false;
+                    m_frameIndex++;
+                }
+            }
+
             m_fenceValue++;
             m_fenceOnCompositionDevice->signal(m_fenceValue);
             m_fenceOnApplicationDevice->waitOnDevice(m_fenceValue);
@@ -804,15 +1497,19 @@ namespace {
         }
 
         IGraphicsDevice* getCompositionDevice() const override {
+            waitForInitialization();
             return m_compositionDevice.get();
         }
 
         IGraphicsDevice* getApplicationDevice() const override {
+            waitForInitialization();
             return m_applicationDevice.get();
         }
 
         int64_t getPreferredSwapchainFormatOnApplicationDevice(XrSwapchainUsageFlags usageFlags,
                                                                bool preferSRGB) const override {
+            waitForInitialization();
+
             DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
             if (usageFlags & XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT) {
                 format = preferSRGB ? m_preferredSRGBColorFormat : m_preferredColorFormat;
@@ -822,11 +1519,70 @@ namespace {
             return m_applicationDevice->translateFromGenericFormat(format);
         }
 
+        IOverlayRefreshScheduler* getOverlayRefreshScheduler() const override {
+            return m_refreshScheduler.get();
+        }
+
+        void onWaitFrame(const XrFrameState& frameState) {
+            std::unique_lock lock(m_frameTimingMutex);
+
+            m_predictedDisplayTime = frameState.predictedDisplayTime;
+            m_predictedDisplayPeriod = frameState.predictedDisplayPeriod;
+        }
+
+        void onBeginFrame() {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CompositionFramework_BeginFrame",
+                                   TLXArg(m_session, "Session"),
+                                   TLFrameArg());
+
+            waitForInitialization();
+
+            std::unique_lock lock(m_frameTimingMutex);
+
+            // The timers are reused after a few frames, by which time their results are available without stalling.
+            FrameTimers& timers = m_frameTimers[m_frameIndex % m_frameTimers.size()];
+            if (timers.hasTiming) {
+                const uint64_t compositionGpuTimeUs = timers.composition->query();
+                const uint64_t gpuTimeUs = timers.application->query() + compositionGpuTimeUs;
+                if (compositionGpuTimeUs) {
+                    openxr_api_layer::statistics::RecordCompositionGpuTime(compositionGpuTimeUs * 1000);
+                }
+                if (gpuTimeUs) {
+                    m_refreshScheduler->submitFrameTiming(gpuTimeUs, m_predictedDisplayPeriod / 1000);
+                }
+                timers.hasTiming = false;
+            }
+            timers.application->start();
+            m_isTimingFrame = true;
+
+            m_refreshScheduler->beginFrame(m_predictedDisplayTime);
+
+            TraceLoggingWriteStop(local,
+                                  "CompositionFramework_BeginFrame",
+                                  TLArg(m_predictedDisplayTime, "PredictedDisplayTime"));
+        }
+
         const XrInstance m_instance;
         const PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr;
         const XrSession m_session;
+        const std::shared_ptr<DeferredDestructionQueue> m_destructionQueue;
+        const std::shared_ptr<CompositionDevicesCache> m_devicesCache;
+        const InitializationCallback m_onInitialized;
 
         std::unique_ptr<ICompositionSessionData> m_sessionData;
+        std::unique_ptr<ICompositionDeviceData> m_deviceData;
+
+        CompositionDevicesKey m_devicesKey;
+        bool m_isWarm{false};
+
+        std::shared_future<void> m_initialized;
+        mutable std::once_flag m_applicationDeviceInitialized;
+        mutable std::atomic<bool> m_initializationFailed{false};
+        std::chrono::high_resolution_clock::time_point m_initializationStart;
+        uint64_t m_initializationUs{0};
+        mutable std::atomic<uint64_t> m_blockedUs{0};
 
         std::shared_ptr<IGraphicsDevice> m_compositionDevice;
         std::shared_ptr<IGraphicsDevice> m_applicationDevice;
@@ -839,6 +1595,20 @@ namespace {
         std::shared_ptr<IGraphicsFence> m_fenceOnCompositionDevice;
         uint64_t m_fenceValue{0};
 
+        struct FrameTimers {
+            std::shared_ptr<IGraphicsTimer> application;
+            std::shared_ptr<IGraphicsTimer> composition;
+            bool hasTiming{false};
+        };
+
+        std::shared_ptr<IOverlayRefreshScheduler> m_refreshScheduler;
+        std::mutex m_frameTimingMutex;
+        std::array<FrameTimers, 3> m_frameTimers;
+        uint64_t m_frameIndex{0};
+        bool m_isTimingFrame{false};
+        XrTime m_predictedDisplayTime{0};
+        XrDuration m_predictedDisplayPeriod{0};
+
 #ifdef XR_USE_GRAPHICS_API_D3D12
         std::optional<bool> m_overrideShareable;
 #endif
@@ -888,6 +1658,22 @@ namespace {
 
             factory = nullptr;
 
+            const SessionCreationStatistics statistics = getSessionCreationStatistics();
+            if (statistics.coldCount || statistics.warmCount) {
+                Log(fmt::format("Composition framework creation: {} cold (avg {:.2f} ms), {} warm (avg {:.2f} ms)\n",
+                                statistics.coldCount,
+                                statistics.coldCount ? statistics.coldMicrosecondsTotal / 1000.0 / statistics.coldCount
+                                                     : 0.0,
+                                statistics.warmCount,
+                                statistics.warmCount ? statistics.warmMicrosecondsTotal / 1000.0 / statistics.warmCount
+                                                     : 0.0));
+                Log(fmt::format("Composition framework initialization: {:.2f} ms hidden, {:.2f} ms blocked, {} "
+                                "device(s) prewarmed\n",
+                                statistics.hiddenMicrosecondsTotal / 1000.0,
+                                statistics.blockedMicrosecondsTotal / 1000.0,
+                                statistics.prewarmedCount));
+            }
+
             TraceLoggingWriteStop(local, "CompositionFrameworkFactory_Destroy");
         }
 
@@ -899,19 +1685,48 @@ namespace {
             } else if (functionName == "xrDestroySession") {
                 xrDestroySession = reinterpret_cast<PFN_xrDestroySession>(*function);
                 *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySession);
+            } else if (functionName == "xrWaitFrame") {
+                xrWaitFrame = reinterpret_cast<PFN_xrWaitFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookWaitFrame);
+            } else if (functionName == "xrBeginFrame") {
+                xrBeginFrame = reinterpret_cast<PFN_xrBeginFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookBeginFrame);
+            } else if (functionName == "xrEndFrame") {
+                xrEndFrame = reinterpret_cast<PFN_xrEndFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookEndFrame);
             }
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            if (functionName == "xrGetD3D11GraphicsRequirementsKHR") {
+                xrGetD3D11GraphicsRequirementsKHR = reinterpret_cast<PFN_xrGetD3D11GraphicsRequirementsKHR>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookGetD3D11GraphicsRequirementsKHR);
+            }
+#endif
+#ifdef XR_USE_GRAPHICS_API_D3D12
+            if (functionName == "xrGetD3D12GraphicsRequirementsKHR") {
+                xrGetD3D12GraphicsRequirementsKHR = reinterpret_cast<PFN_xrGetD3D12GraphicsRequirementsKHR>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookGetD3D12GraphicsRequirementsKHR);
+            }
+#endif
         }
 
+        // Lock-free, since it is invoked on every frame. Returns nullptr if the session (likely) could not be handled,
+        // including when the initialization of its framework failed.
         ICompositionFramework* getCompositionFramework(XrSession session) override {
-            std::unique_lock lock(m_sessionsMutex);
-
-            auto it = m_sessions.find(session);
-            if (it == m_sessions.end()) {
-                // The session (likely) could not be handled.
+            CompositionFramework* compositionFramework = m_sessions.find(session);
+            if (!compositionFramework || !compositionFramework->tryWaitForInitialization()) {
                 return nullptr;
             }
+            return compositionFramework;
+        }
 
-            return it->second.get();
+        DeferredDestructionStatistics getDeferredDestructionStatistics() const override {
+            return m_destructionQueue->getStatistics();
+        }
+
+        SessionCreationStatistics getSessionCreationStatistics() const override {
+            std::unique_lock lock(m_statisticsMutex);
+
+            return m_creationStatistics;
         }
 
         XrResult xrCreateSession_subst(XrInstance instance, const XrSessionCreateInfo* createInfo, XrSession* session) {
@@ -920,16 +1735,29 @@ namespace {
 
             const XrResult result = xrCreateSession(instance, createInfo, session);
             if (XR_SUCCEEDED(result)) {
-                std::unique_lock lock(m_sessionsMutex);
-
                 try {
-                    m_sessions.insert_or_assign(*session,
-                                                std::move(std::make_unique<CompositionFramework>(m_instanceInfo,
-                                                                                                 m_instance,
-                                                                                                 xrGetInstanceProcAddr,
-                                                                                                 *createInfo,
-                                                                                                 *session,
-                                                                                                 m_compositionApi)));
+                    PrewarmedCompositionDevice prewarmedCompositionDevice;
+                    {
+                        std::unique_lock lock(m_prewarmMutex);
+                        prewarmedCompositionDevice = std::move(m_prewarmedCompositionDevice);
+                        m_prewarmedCompositionDevice = {};
+                    }
+
+                    m_sessions.insert(*session,
+                                      std::make_unique<CompositionFramework>(
+                                          m_instanceInfo,
+                                          m_instance,
+                                          xrGetInstanceProcAddr,
+                                          *createInfo,
+                                          *session,
+                                          m_compositionApi,
+                                          m_destructionQueue,
+                                          m_devicesCache,
+                                          m_initializationWorker.get(),
+                                          std::move(prewarmedCompositionDevice),
+                                          [this](bool isWarm, uint64_t initializationUs, uint64_t blockedUs) {
+                                              onInitialized(isWarm, initializationUs, blockedUs);
+                                          }));
                 } catch (std::exception& exc) {
                     TraceLoggingWriteTagged(
                         local, "CompositionFrameworkFactory_CreateSession_Error", TLArg(exc.what(), "Error"));
@@ -945,26 +1773,162 @@ namespace {
             return result;
         }
 
-        XrResult xrDestroySession_subst(XrSession session) {
+        void onInitialized(bool isWarm, uint64_t initializationUs, uint64_t blockedUs) {
+            const uint64_t hiddenUs = initializationUs - std::min(initializationUs, blockedUs);
+            {
+                std::unique_lock lock(m_statisticsMutex);
+                if (isWarm) {
+                    m_creationStatistics.warmCount++;
+                    m_creationStatistics.warmMicrosecondsTotal += initializationUs;
+                } else {
+                    m_creationStatistics.coldCount++;
+                    m_creationStatistics.coldMicrosecondsTotal += initializationUs;
+                }
+                m_creationStatistics.blockedMicrosecondsTotal += blockedUs;
+                m_creationStatistics.hiddenMicrosecondsTotal += hiddenUs;
+            }
+            Log(fmt::format("Composition framework initialized in {:.2f} ms ({}), {:.2f} ms hidden from the "
+                            "application\n",
+                            initializationUs / 1000.0,
+                            isWarm ? "warm" : "cold",
+                            hiddenUs / 1000.0));
+        }
+
+        // Create the composition device as soon as the adapter is known, ahead of xrCreateSession().
+        void prewarmCompositionDevice(const LUID& adapterLuid) {
+            if (m_devicesCache->hasAdapter(adapterLuid)) {
+                return;
+            }
+
+            std::unique_lock lock(m_prewarmMutex);
+            if (m_prewarmedCompositionDevice.device.valid() &&
+                !memcmp(&m_prewarmedCompositionDevice.adapterLuid, &adapterLuid, sizeof(LUID))) {
+                return;
+            }
+
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "CompositionFrameworkFactory_DestroySession", TLXArg(session, "Session"));
+            TraceLoggingWriteStart(local,
+                                   "CompositionFrameworkFactory_PrewarmCompositionDevice",
+                                   TLArg(adapterLuid.HighPart, "AdapterLuidHigh"),
+                                   TLArg(adapterLuid.LowPart, "AdapterLuidLow"));
+
+            auto device = std::make_shared<std::promise<std::shared_ptr<IGraphicsDevice>>>();
+            m_prewarmedCompositionDevice.adapterLuid = adapterLuid;
+            m_prewarmedCompositionDevice.device = device->get_future().share();
+            m_initializationWorker->submit([device, adapterLuid, compositionApi = m_compositionApi] {
+                try {
+                    switch (compositionApi) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+                    case CompositionApi::D3D11:
+                        device->set_value(internal::createD3D11CompositionDevice(adapterLuid));
+                        break;
+#endif
+                    default:
+                        throw std::runtime_error("Composition graphics API is not supported");
+                    }
+                } catch (...) {
+                    device->set_exception(std::current_exception());
+                }
+            });
 
             {
-                std::unique_lock lock(m_sessionsMutex);
+                std::unique_lock statisticsLock(m_statisticsMutex);
+                m_creationStatistics.prewarmedCount++;
+            }
 
-                auto it = m_sessions.find(session);
-                if (it != m_sessions.end()) {
-                    m_sessions.erase(it);
-                }
+            TraceLoggingWriteStop(local, "CompositionFrameworkFactory_PrewarmCompositionDevice");
+        }
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        XrResult xrGetD3D11GraphicsRequirementsKHR_subst(XrInstance instance,
+                                                          XrSystemId systemId,
+                                                          XrGraphicsRequirementsD3D11KHR* graphicsRequirements) {
+            const XrResult result = xrGetD3D11GraphicsRequirementsKHR(instance, systemId, graphicsRequirements);
+            if (XR_SUCCEEDED(result)) {
+                prewarmCompositionDevice(graphicsRequirements->adapterLuid);
             }
+
+            return result;
+        }
+#endif
+
+#ifdef XR_USE_GRAPHICS_API_D3D12
+        XrResult xrGetD3D12GraphicsRequirementsKHR_subst(XrInstance instance,
+                                                          XrSystemId systemId,
+                                                          XrGraphicsRequirementsD3D12KHR* graphicsRequirements) {
+            const XrResult result = xrGetD3D12GraphicsRequirementsKHR(instance, systemId, graphicsRequirements);
+            if (XR_SUCCEEDED(result)) {
+                prewarmCompositionDevice(graphicsRequirements->adapterLuid);
+            }
+
+            return result;
+        }
+#endif
+
+        XrResult xrDestroySession_subst(XrSession session) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CompositionFrameworkFactory_DestroySession", TLXArg(session, "Session"));
+
+            CompositionFramework* compositionFramework = m_sessions.find(session);
+            const IGraphicsDevice* const applicationDevice =
+                compositionFramework ? compositionFramework->m_applicationDevice.get() : nullptr;
+
+            m_sessions.erase(session);
             const XrResult result = xrDestroySession(session);
 
+            // The application is free to destroy its device with the session, so the layer must not hold onto it. The
+            // resources of the composition device are still released in the background.
+            if (applicationDevice) {
+                m_destructionQueue->releaseApplicationDeviceResources(applicationDevice);
+            }
+            m_destructionQueue->releaseApplicationResources();
+
             TraceLoggingWriteStop(
                 local, "CompositionFrameworkFactory_DestroySession", TLArg(xr::ToCString(result), "Result"));
 
             return result;
         }
 
+        XrResult xrWaitFrame_subst(XrSession session, const XrFrameWaitInfo* frameWaitInfo, XrFrameState* frameState) {
+            const XrResult result = xrWaitFrame(session, frameWaitInfo, frameState);
+            if (XR_SUCCEEDED(result)) {
+                // Does not wait for the initialization, which must be completed on the thread using the application
+                // device.
+                CompositionFramework* compositionFramework = m_sessions.find(session);
+                if (compositionFramework) {
+                    compositionFramework->onWaitFrame(*frameState);
+                }
+            }
+
+            return result;
+        }
+
+        XrResult xrBeginFrame_subst(XrSession session, const XrFrameBeginInfo* frameBeginInfo) {
+            const XrResult result = xrBeginFrame(session, frameBeginInfo);
+            if (XR_SUCCEEDED(result)) {
+                CompositionFramework* compositionFramework =
+                    static_cast<CompositionFramework*>(getCompositionFramework(session));
+                if (compositionFramework) {
+                    try {
+                        compositionFramework->onBeginFrame();
+                    } catch (std::exception& exc) {
+                        ErrorLog(fmt::format("xrBeginFrame: {}\n", exc.what()));
+                    }
+                }
+            }
+
+            return result;
+        }
+
+        XrResult xrEndFrame_subst(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            const XrResult result = xrEndFrame(session, frameEndInfo);
+
+            // The application thread is the only one allowed to release the resources of the application device.
+            m_destructionQueue->releaseApplicationResources();
+
+            return result;
+        }
+
         const XrInstance m_instance;
         const PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr;
         const CompositionApi m_compositionApi;
@@ -972,11 +1936,35 @@ namespace {
         std::vector<std::string> m_instanceExtensions;
         std::vector<const char*> m_instanceExtensionsArray;
 
-        std::mutex m_sessionsMutex;
-        std::unordered_map<XrSession, std::unique_ptr<CompositionFramework>> m_sessions;
+        // Shared with the composition frameworks and their swapchains, which might outlive the factory.
+        const std::shared_ptr<DeferredDestructionQueue> m_destructionQueue{
+            std::make_shared<DeferredDestructionQueue>()};
+        const std::shared_ptr<CompositionDevicesCache> m_devicesCache{
+            std::make_shared<CompositionDevicesCache>(m_destructionQueue)};
+
+        // Runs the device creations in submission order, so that a session waiting on a prewarmed device cannot
+        // deadlock.
+        const std::shared_ptr<general::IWorkerPool> m_initializationWorker{general::createWorkerPool(1)};
+
+        std::mutex m_prewarmMutex;
+        PrewarmedCompositionDevice m_prewarmedCompositionDevice;
+
+        mutable std::mutex m_statisticsMutex;
+        SessionCreationStatistics m_creationStatistics;
+
+        HandleMap<XrSession, CompositionFramework> m_sessions;
 
         PFN_xrCreateSession xrCreateSession{nullptr};
         PFN_xrDestroySession xrDestroySession{nullptr};
+        PFN_xrWaitFrame xrWaitFrame{nullptr};
+        PFN_xrBeginFrame xrBeginFrame{nullptr};
+        PFN_xrEndFrame xrEndFrame{nullptr};
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        PFN_xrGetD3D11GraphicsRequirementsKHR xrGetD3D11GraphicsRequirementsKHR{nullptr};
+#endif
+#ifdef XR_USE_GRAPHICS_API_D3D12
+        PFN_xrGetD3D12GraphicsRequirementsKHR xrGetD3D12GraphicsRequirementsKHR{nullptr};
+#endif
 
         static inline std::mutex factoryMutex;
         static inline CompositionFrameworkFactory* factory{nullptr};
@@ -990,6 +1978,38 @@ namespace {
         static XrResult XRAPI_CALL hookDestroySession(XrSession session) {
             return factory->xrDestroySession_subst(session);
         }
+
+        static XrResult XRAPI_CALL hookWaitFrame(XrSession session,
+                                                 const XrFrameWaitInfo* frameWaitInfo,
+                                                 XrFrameState* frameState) {
+            return factory->xrWaitFrame_subst(session, frameWaitInfo, frameState);
+        }
+
+        static XrResult XRAPI_CALL hookBeginFrame(XrSession session, const XrFrameBeginInfo* frameBeginInfo) {
+            return factory->xrBeginFrame_subst(session, frameBeginInfo);
+        }
+
+        static XrResult XRAPI_CALL hookEndFrame(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            return factory->xrEndFrame_subst(session, frameEndInfo);
+        }
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        static XrResult XRAPI_CALL
+        hookGetD3D11GraphicsRequirementsKHR(XrInstance instance,
+                                            XrSystemId systemId,
+                                            XrGraphicsRequirementsD3D11KHR* graphicsRequirements) {
+            return factory->xrGetD3D11GraphicsRequirementsKHR_subst(instance, systemId, graphicsRequirements);
+        }
+#endif
+
+#ifdef XR_USE_GRAPHICS_API_D3D12
+        static XrResult XRAPI_CALL
+        hookGetD3D12GraphicsRequirementsKHR(XrInstance instance,
+                                            XrSystemId systemId,
+                                            XrGraphicsRequirementsD3D12KHR* graphicsRequirements) {
+            return factory->xrGetD3D12GraphicsRequirementsKHR_subst(instance, systemId, graphicsRequirements);
+        }
+#endif
     };
 
 } // namespace
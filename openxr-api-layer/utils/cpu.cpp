@@ -0,0 +1,871 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "general.h"
+#include "graphics.h"
+#include "image.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+    // Alignment of the texture storage, suitable for the widest SIMD loads and to avoid false sharing between tiles.
+    constexpr size_t StorageAlignment = 64;
+
+    // The memory backing a texture.
+    struct Storage {
+        Storage(const XrSwapchainCreateInfo& info, uint8_t* externalData) {
+            const uint32_t bytesPerPixel = image::getBytesPerPixel((DXGI_FORMAT)info.format);
+            if (!bytesPerPixel || !image::isFormatSupported((DXGI_FORMAT)info.format)) {
+                throw std::runtime_error("Texture format is not supported");
+            }
+            if (info.mipCount > 1 || info.sampleCount > 1 || info.faceCount > 1) {
+                throw std::runtime_error("Only single-mip, single-sample textures are supported");
+            }
+
+            format = (DXGI_FORMAT)info.format;
+            width = info.width;
+            height = info.height;
+            arraySize = std::max(1u, info.arraySize);
+            rowPitch = static_cast<size_t>(width) * bytesPerPixel;
+            slicePitch = rowPitch * height;
+
+            if (externalData) {
+                data = externalData;
+            } else {
+                data = static_cast<uint8_t*>(_aligned_malloc(slicePitch * arraySize, StorageAlignment));
+                if (!data) {
+                    throw std::bad_alloc();
+                }
+                ZeroMemory(data, slicePitch * arraySize);
+                isOwned = true;
+            }
+        }
+
+        ~Storage() {
+            if (isOwned) {
+                _aligned_free(data);
+            }
+        }
+
+        image::Image getSlice(uint32_t slice) const {
+            if (slice >= arraySize) {
+                throw std::runtime_error("Slice is out of bounds");
+            }
+            return {data + slice * slicePitch, rowPitch, width, height, format};
+        }
+
+        uint8_t* data{nullptr};
+        bool isOwned{false};
+        DXGI_FORMAT format{DXGI_FORMAT_UNKNOWN};
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t arraySize{0};
+        size_t rowPitch{0};
+        size_t slicePitch{0};
+    };
+
+    // The state of a fence, shared between all the fences opened from the same handle.
+    struct FenceState {
+        std::atomic<uint64_t> value{0};
+
+        std::mutex mutex;
+        std::condition_variable valueChanged;
+        std::multimap<uint64_t, std::function<void()>> callbacks;
+
+        void signal(uint64_t newValue) {
+            std::vector<std::function<void()>> reached;
+            {
+                std::unique_lock lock(mutex);
+                value = newValue;
+                for (auto it = callbacks.begin(); it != callbacks.end() && it->first <= newValue;) {
+                    reached.push_back(std::move(it->second));
+                    it = callbacks.erase(it);
+                }
+            }
+            valueChanged.notify_all();
+
+            for (auto& callback : reached) {
+                callback();
+            }
+        }
+
+        // Invoke the callback once the fence reaches the value. The callback might be invoked immediately.
+        void onReached(uint64_t targetValue, std::function<void()> callback) {
+            {
+                std::unique_lock lock(mutex);
+                if (value < targetValue) {
+                    callbacks.emplace(targetValue, std::move(callback));
+                    return;
+                }
+            }
+            callback();
+        }
+
+        void wait(uint64_t targetValue) {
+            std::unique_lock lock(mutex);
+            valueChanged.wait(lock, [&] { return value >= targetValue; });
+        }
+    };
+
+    // Resolve shareable handles back to the objects. Handles are the address of the shared state.
+    template <typename T>
+    struct HandleRegistry {
+        std::mutex mutex;
+        std::map<HANDLE, std::weak_ptr<T>> entries;
+
+        HANDLE add(const std::shared_ptr<T>& object) {
+            std::unique_lock lock(mutex);
+            for (auto it = entries.begin(); it != entries.end();) {
+                it = it->second.expired() ? entries.erase(it) : std::next(it);
+            }
+            const HANDLE handle = reinterpret_cast<HANDLE>(object.get());
+            entries.insert_or_assign(handle, object);
+            return handle;
+        }
+
+        std::shared_ptr<T> get(HANDLE handle) {
+            std::unique_lock lock(mutex);
+            const auto it = entries.find(handle);
+            std::shared_ptr<T> object = it != entries.cend() ? it->second.lock() : nullptr;
+            if (!object) {
+                throw std::runtime_error("Invalid handle");
+            }
+            return object;
+        }
+    };
+
+    HandleRegistry<Storage> StorageRegistry;
+    HandleRegistry<FenceState> FenceRegistry;
+
+    // A unit of work on the device, and its position in the dependency graph.
+    struct Task {
+        std::function<void()> work;
+
+        uint32_t pendingDependencies{0};
+        std::vector<std::shared_ptr<Task>> dependents;
+        bool isDone{false};
+    };
+
+    // A range of rows of a texture accessed by a task. Rows are numbered across all the array slices.
+    struct Footprint {
+        std::shared_ptr<Storage> storage;
+        uint64_t rowBegin;
+        uint64_t rowEnd;
+        bool isWrite;
+    };
+
+    // Schedule the tasks onto the worker pool, in the order allowed by their dependencies. Tasks that access
+    // overlapping rows of a texture, where at least one of them writes, are executed in submission order.
+    class TaskGraph {
+      public:
+        TaskGraph(std::shared_ptr<general::IWorkerPool> workerPool) : m_workerPool(std::move(workerPool)) {
+        }
+
+        ~TaskGraph() {
+            flush();
+        }
+
+        void submit(std::function<void()> work, const std::vector<Footprint>& footprints) {
+            std::unique_lock lock(m_mutex);
+
+            std::shared_ptr<Task> task = createTask(std::move(work));
+            for (const Footprint& footprint : footprints) {
+                auto& accesses = m_accesses[footprint.storage.get()];
+                for (const Access& access : accesses) {
+                    if ((access.isWrite || footprint.isWrite) && access.rowBegin < footprint.rowEnd &&
+                        footprint.rowBegin < access.rowEnd) {
+                        addDependency(task, access.task);
+                    }
+                }
+                accesses.push_back({task, footprint.rowBegin, footprint.rowEnd, footprint.isWrite});
+            }
+            schedule(task);
+        }
+
+        // Submit a task that executes after all the previously submitted tasks. When isBarrier is set, the tasks
+        // submitted afterwards also wait for this task.
+        std::shared_ptr<Task> submitBarrier(std::function<void()> work, bool isBarrier, bool isHeld = false) {
+            std::unique_lock lock(m_mutex);
+
+            std::shared_ptr<Task> task = createTask(std::move(work));
+            for (const auto& previous : m_inFlight) {
+                if (previous != task) {
+                    addDependency(task, previous);
+                }
+            }
+            if (isBarrier) {
+                m_barrier = task;
+            }
+
+            // A held task is not executed until release() is invoked.
+            if (isHeld) {
+                task->pendingDependencies++;
+            }
+            schedule(task);
+
+            return task;
+        }
+
+        void release(const std::shared_ptr<Task>& task) {
+            std::unique_lock lock(m_mutex);
+            if (!--task->pendingDependencies) {
+                m_workerPool->submit([this, task] { execute(task); });
+            }
+        }
+
+        void flush() {
+            std::unique_lock lock(m_mutex);
+            m_allDone.wait(lock, [&] { return !m_pendingTasks; });
+        }
+
+      private:
+        struct Access {
+            std::shared_ptr<Task> task;
+            uint64_t rowBegin;
+            uint64_t rowEnd;
+            bool isWrite;
+        };
+
+        std::shared_ptr<Task> createTask(std::function<void()> work) {
+            pruneCompletedTasks();
+
+            auto task = std::make_shared<Task>();
+            task->work = std::move(work);
+            if (m_barrier) {
+                addDependency(task, m_barrier);
+            }
+            m_inFlight.push_back(task);
+            m_pendingTasks++;
+
+            return task;
+        }
+
+        void addDependency(const std::shared_ptr<Task>& task, const std::shared_ptr<Task>& dependency) {
+            if (!dependency->isDone) {
+                dependency->dependents.push_back(task);
+                task->pendingDependencies++;
+            }
+        }
+
+        void schedule(const std::shared_ptr<Task>& task) {
+            if (!task->pendingDependencies) {
+                m_workerPool->submit([this, task] { execute(task); });
+            }
+        }
+
+        void execute(const std::shared_ptr<Task>& task) {
+            try {
+                task->work();
+            } catch (std::exception& exc) {
+                ErrorLog(fmt::format("CPU device task failed: {}\n", exc.what()));
+            }
+
+            // Release the dependents while holding the lock: once the last task completes, flush() may return and
+            // the graph may be destroyed, therefore it must not be accessed past this point.
+            std::unique_lock lock(m_mutex);
+            task->isDone = true;
+            task->work = nullptr;
+            for (const auto& dependent : task->dependents) {
+                if (!--dependent->pendingDependencies) {
+                    m_workerPool->submit([this, dependent] { execute(dependent); });
+                }
+            }
+            task->dependents.clear();
+            if (!--m_pendingTasks) {
+                m_allDone.notify_all();
+            }
+        }
+
+        void pruneCompletedTasks() {
+            const auto isDone = [](const auto& entry) { return entry->isDone; };
+            m_inFlight.erase(std::remove_if(m_inFlight.begin(), m_inFlight.end(), isDone), m_inFlight.end());
+            if (m_barrier && m_barrier->isDone) {
+                m_barrier.reset();
+            }
+            for (auto it = m_accesses.begin(); it != m_accesses.end();) {
+                auto& accesses = it->second;
+                accesses.erase(std::remove_if(accesses.begin(),
+                                              accesses.end(),
+                                              [](const Access& access) { return access.task->isDone; }),
+                               accesses.end());
+                it = accesses.empty() ? m_accesses.erase(it) : std::next(it);
+            }
+        }
+
+        const std::shared_ptr<general::IWorkerPool> m_workerPool;
+
+        std::mutex m_mutex;
+        std::condition_variable m_allDone;
+        uint32_t m_pendingTasks{0};
+        std::vector<std::shared_ptr<Task>> m_inFlight;
+        std::shared_ptr<Task> m_barrier;
+
+        // The tasks are holding a reference to the storage, so its address is not reused while it is in this map.
+        std::unordered_map<const Storage*, std::vector<Access>> m_accesses;
+    };
+
+    struct CpuTimer : IGraphicsTimer {
+        CpuTimer(std::shared_ptr<TaskGraph> graph) : m_graph(std::move(graph)), m_timer(general::createTimer()) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTimer_Create");
+            TraceLoggingWriteStop(local, "CpuTimer_Create", TLPArg(this, "Timer"));
+        }
+
+        ~CpuTimer() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTimer_Destroy", TLPArg(this, "Timer"));
+            TraceLoggingWriteStop(local, "CpuTimer_Destroy");
+        }
+
+        Api getApi() const override {
+            return Api::CPU;
+        }
+
+        void start() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTimer_Start", TLPArg(this, "Timer"), TLFrameArg());
+
+            m_frameId = openxr_api_layer::frame::GetCurrentFrameId();
+
+            m_graph->submitBarrier([timer = m_timer] { timer->start(); }, true /* isBarrier */);
+
+            TraceLoggingWriteStop(local, "CpuTimer_Start");
+        }
+
+        void stop() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTimer_Stop", TLPArg(this, "Timer"));
+
+            m_graph->submitBarrier([timer = m_timer] { timer->stop(); }, false /* isBarrier */);
+            m_valid = true;
+
+            TraceLoggingWriteStop(local, "CpuTimer_Stop");
+        }
+
+        uint64_t query() const override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuTimer_Query",
+                                   TLPArg(this, "Timer"),
+                                   TLArg(m_valid, "Valid"),
+                                   TLArg(m_frameId, "FrameId"));
+
+            uint64_t duration = 0;
+            if (m_valid) {
+                m_graph->flush();
+                duration = m_timer->query();
+                m_valid = false;
+            }
+
+            TraceLoggingWriteStop(local, "CpuTimer_Query", TLArg(duration, "Duration"));
+
+            return duration;
+        }
+
+        uint64_t getFrameId() const override {
+            return m_frameId;
+        }
+
+        const std::shared_ptr<TaskGraph> m_graph;
+        const std::shared_ptr<general::ITimer> m_timer;
+
+        // Can the timer be queried (it might still only read 0).
+        mutable bool m_valid{false};
+
+        uint64_t m_frameId{0};
+    };
+
+    struct CpuFence : IGraphicsFence {
+        CpuFence(std::shared_ptr<TaskGraph> graph, std::shared_ptr<FenceState> state, bool shareable)
+            : m_graph(std::move(graph)), m_state(std::move(state)), m_isShareable(shareable) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuFence_Create", TLArg(shareable, "Shareable"));
+            TraceLoggingWriteStop(local, "CpuFence_Create", TLPArg(this, "Fence"));
+        }
+
+        ~CpuFence() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuFence_Destroy", TLPArg(this, "Fence"));
+            TraceLoggingWriteStop(local, "CpuFence_Destroy");
+        }
+
+        Api getApi() const override {
+            return Api::CPU;
+        }
+
+        void* getNativeFencePtr() const override {
+            return &m_state->value;
+        }
+
+        ShareableHandle getFenceHandle() const override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuFence_Export", TLPArg(this, "Fence"));
+
+            if (!m_isShareable) {
+                throw std::runtime_error("Fence is not shareable");
+            }
+
+            ShareableHandle handle{};
+            handle.handle = FenceRegistry.add(m_state);
+            handle.origin = Api::CPU;
+
+            TraceLoggingWriteStop(local, "CpuFence_Export", TLPArg(handle.handle, "Handle"));
+
+            return handle;
+        }
+
+        void signal(uint64_t value) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuFence_Signal",
+                                   TLPArg(this, "Fence"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
+
+            // The fence is signaled once all the tiles of the previous commands have completed.
+            m_graph->submitBarrier([state = m_state, value] { state->signal(value); }, false /* isBarrier */);
+
+            TraceLoggingWriteStop(local, "CpuFence_Signal");
+        }
+
+        void waitOnDevice(uint64_t value) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuFence_Wait",
+                                   TLPArg(this, "Fence"),
+                                   TLArg("Device", "WaitType"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
+
+            // Hold the subsequent commands until the fence is reached, without blocking any worker thread.
+            std::shared_ptr<Task> barrier = m_graph->submitBarrier([] {}, true /* isBarrier */, true /* isHeld */);
+            m_state->onReached(value, [graph = m_graph, barrier] { graph->release(barrier); });
+
+            TraceLoggingWriteStop(local, "CpuFence_Wait");
+        }
+
+        void waitOnCpu(uint64_t value) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuFence_Wait",
+                                   TLPArg(this, "Fence"),
+                                   TLArg("Host", "WaitType"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
+
+            m_state->wait(value);
+
+            TraceLoggingWriteStop(local, "CpuFence_Wait");
+        }
+
+        uint64_t getCompletedValue() const override {
+            return m_state->value;
+        }
+
+        bool isShareable() const override {
+            return m_isShareable;
+        }
+
+        const std::shared_ptr<TaskGraph> m_graph;
+        const std::shared_ptr<FenceState> m_state;
+        const bool m_isShareable;
+    };
+
+    struct CpuTexture : IGraphicsTexture {
+        CpuTexture(std::shared_ptr<Storage> storage, const XrSwapchainCreateInfo& info, bool shareable)
+            : m_storage(std::move(storage)), m_info(info), m_isShareable(shareable) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTexture_Create", TLPArg(m_storage->data, "Data"));
+            TraceLoggingWriteTagged(local,
+                                    "CpuTexture_Create",
+                                    TLArg(info.width, "Width"),
+                                    TLArg(info.height, "Height"),
+                                    TLArg(info.arraySize, "ArraySize"),
+                                    TLArg((int)info.format, "Format"),
+                                    TLArg(m_storage->isOwned, "Owned"));
+            TraceLoggingWriteStop(
+                local, "CpuTexture_Create", TLPArg(this, "Texture"), TLArg(m_isShareable, "Shareable"));
+        }
+
+        ~CpuTexture() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTexture_Destroy", TLPArg(this, "Texture"));
+            TraceLoggingWriteStop(local, "CpuTexture_Destroy");
+        }
+
+        Api getApi() const override {
+            return Api::CPU;
+        }
+
+        void* getNativeTexturePtr() const override {
+            return m_storage->data;
+        }
+
+        ShareableHandle getTextureHandle() const override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTexture_Export", TLPArg(this, "Texture"));
+
+            if (!m_isShareable) {
+                throw std::runtime_error("Texture is not shareable");
+            }
+
+            ShareableHandle handle{};
+            handle.handle = StorageRegistry.add(m_storage);
+            handle.origin = Api::CPU;
+
+            TraceLoggingWriteStop(local, "CpuTexture_Export", TLPArg(handle.handle, "Handle"));
+
+            return handle;
+        }
+
+        const XrSwapchainCreateInfo& getInfo() const override {
+            return m_info;
+        }
+
+        bool isShareable() const override {
+            return m_isShareable;
+        }
+
+        const std::shared_ptr<Storage> m_storage;
+        const XrSwapchainCreateInfo m_info;
+        const bool m_isShareable;
+    };
+
+    struct CpuGraphicsDevice : IGraphicsDevice, ICpuCommandContext {
+        CpuGraphicsDevice(std::shared_ptr<general::IWorkerPool> workerPool, size_t tileBytes)
+            : m_graph(std::make_shared<TaskGraph>(workerPool)), m_threadCount(workerPool->getThreadCount()),
+              m_tileBytes(std::max<size_t>(tileBytes, 1)) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuGraphicsDevice_Create",
+                                   TLArg(m_threadCount, "ThreadCount"),
+                                   TLArg(m_tileBytes, "TileBytes"));
+            TraceLoggingWriteStop(local, "CpuGraphicsDevice_Create", TLPArg(this, "Device"));
+        }
+
+        ~CpuGraphicsDevice() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuGraphicsDevice_Destroy", TLPArg(this, "Device"));
+
+            m_graph->flush();
+
+            TraceLoggingWriteStop(local, "CpuGraphicsDevice_Destroy");
+        }
+
+        Api getApi() const override {
+            return Api::CPU;
+        }
+
+        void* getNativeDevicePtr() const override {
+            return static_cast<ICpuCommandContext*>(const_cast<CpuGraphicsDevice*>(this));
+        }
+
+        void* getNativeContextPtr() const override {
+            return static_cast<ICpuCommandContext*>(const_cast<CpuGraphicsDevice*>(this));
+        }
+
+        std::shared_ptr<IGraphicsTimer> createTimer() override {
+            return std::make_shared<CpuTimer>(m_graph);
+        }
+
+        std::shared_ptr<IGraphicsFence> createFence(bool shareable) override {
+            return std::make_shared<CpuFence>(m_graph, std::make_shared<FenceState>(), shareable);
+        }
+
+        std::shared_ptr<IGraphicsFence> openFence(const ShareableHandle& handle) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuFence_Import", TLPArg(handle.handle, "Handle"));
+
+            if (handle.origin != Api::CPU) {
+                throw std::runtime_error("Fence was not created on a CPU device");
+            }
+
+            std::shared_ptr<IGraphicsFence> result =
+                std::make_shared<CpuFence>(m_graph, FenceRegistry.get(handle.handle), false /* shareable */);
+
+            TraceLoggingWriteStop(local, "CpuFence_Import", TLPArg(result.get(), "Fence"));
+
+            return result;
+        }
+
+        std::shared_ptr<IGraphicsTexture> createTexture(const XrSwapchainCreateInfo& info, bool shareable) override {
+            return std::make_shared<CpuTexture>(std::make_shared<Storage>(info, nullptr), info, shareable);
+        }
+
+        std::shared_ptr<IGraphicsTexture> openTexture(const ShareableHandle& handle,
+                                                      const XrSwapchainCreateInfo& info) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTexture_Import", TLPArg(handle.handle, "Handle"));
+
+            if (handle.origin != Api::CPU) {
+                throw std::runtime_error("Texture was not created on a CPU device");
+            }
+
+            std::shared_ptr<IGraphicsTexture> result =
+                std::make_shared<CpuTexture>(StorageRegistry.get(handle.handle), info, false /* shareable */);
+
+            TraceLoggingWriteStop(local, "CpuTexture_Import", TLPArg(result.get(), "Texture"));
+
+            return result;
+        }
+
+        std::shared_ptr<IGraphicsTexture> openTexturePtr(void* nativeTexturePtr,
+                                                         const XrSwapchainCreateInfo& info) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuTexture_Import", TLPArg(nativeTexturePtr, "Data"));
+
+            // The memory must be tightly packed, and must remain valid for the lifetime of the texture.
+            std::shared_ptr<IGraphicsTexture> result = std::make_shared<CpuTexture>(
+                std::make_shared<Storage>(info, static_cast<uint8_t*>(nativeTexturePtr)), info, false /* shareable */);
+
+            TraceLoggingWriteStop(local, "CpuTexture_Import", TLPArg(result.get(), "Texture"));
+
+            return result;
+        }
+
+        void copyTexture(IGraphicsTexture* from, IGraphicsTexture* to) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuTexture_Copy",
+                                   TLPArg(from, "Source"),
+                                   TLPArg(to, "Destination"),
+                                   TLFrameArg());
+
+            const std::shared_ptr<Storage>& source = getStorage(from);
+            const std::shared_ptr<Storage>& destination = getStorage(to);
+            if (source->width != destination->width || source->height != destination->height ||
+                source->arraySize != destination->arraySize) {
+                throw std::runtime_error("Texture dimensions mismatch");
+            }
+
+            const XrRect2Di sourceRect{{0, 0}, {(int32_t)source->width, (int32_t)source->height}};
+            for (uint32_t slice = 0; slice < source->arraySize; slice++) {
+                submitBlit(source, sourceRect, destination, {0, 0}, slice);
+            }
+
+            TraceLoggingWriteStop(local, "CpuTexture_Copy");
+        }
+
+        GenericFormat translateToGenericFormat(int64_t format) const override {
+            return (DXGI_FORMAT)format;
+        }
+
+        int64_t translateFromGenericFormat(GenericFormat format) const override {
+            return (int64_t)format;
+        }
+
+        LUID getAdapterLuid() const override {
+            return {};
+        }
+
+        void blit(IGraphicsTexture* from,
+                  const XrRect2Di& sourceRect,
+                  IGraphicsTexture* to,
+                  const XrOffset2Di& destinationOffset,
+                  uint32_t slice) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuGraphicsDevice_Blit",
+                                   TLPArg(from, "Source"),
+                                   TLPArg(to, "Destination"),
+                                   TLArg(sourceRect.offset.x, "SourceX"),
+                                   TLArg(sourceRect.offset.y, "SourceY"),
+                                   TLArg(sourceRect.extent.width, "SourceWidth"),
+                                   TLArg(sourceRect.extent.height, "SourceHeight"),
+                                   TLArg(destinationOffset.x, "DestinationX"),
+                                   TLArg(destinationOffset.y, "DestinationY"),
+                                   TLArg(slice, "Slice"),
+                                   TLFrameArg());
+
+            submitBlit(getStorage(from), sourceRect, getStorage(to), destinationOffset, slice);
+
+            TraceLoggingWriteStop(local, "CpuGraphicsDevice_Blit");
+        }
+
+        void scale(IGraphicsTexture* from, IGraphicsTexture* to, image::Filter filter, uint32_t slice) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuGraphicsDevice_Scale",
+                                   TLPArg(from, "Source"),
+                                   TLPArg(to, "Destination"),
+                                   TLArg((int)filter, "Filter"),
+                                   TLArg(slice, "Slice"),
+                                   TLFrameArg());
+
+            const std::shared_ptr<Storage>& source = getStorage(from);
+            const std::shared_ptr<Storage>& destination = getStorage(to);
+            const image::Image sourceImage = source->getSlice(slice);
+            const image::Image destinationImage = destination->getSlice(slice);
+
+            const uint32_t tileRows = getTileRows(destination->width, source->format, destination->format);
+            for (uint32_t y = 0; y < destination->height; y += tileRows) {
+                const uint32_t rowCount = std::min(tileRows, destination->height - y);
+
+                // The source rows sampled by the destination rows, with one extra row on each side for filtering.
+                const uint64_t sourceBegin = (static_cast<uint64_t>(y) * source->height) / destination->height;
+                const uint64_t sourceEnd = ((static_cast<uint64_t>(y) + rowCount) * source->height +
+                                            destination->height - 1) /
+                                           destination->height;
+                m_graph->submit(
+                    [=] { image::scale(sourceImage, destinationImage, filter, y, rowCount); },
+                    {getFootprint(source, slice, sourceBegin > 0 ? sourceBegin - 1 : 0, sourceEnd + 1, false),
+                     getFootprint(destination, slice, y, y + rowCount, true)});
+            }
+
+            TraceLoggingWriteStop(local, "CpuGraphicsDevice_Scale");
+        }
+
+        void blendPremultiplied(IGraphicsTexture* from,
+                                IGraphicsTexture* to,
+                                const XrOffset2Di& destinationOffset,
+                                uint32_t slice) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "CpuGraphicsDevice_Blend",
+                                   TLPArg(from, "Source"),
+                                   TLPArg(to, "Destination"),
+                                   TLArg(destinationOffset.x, "DestinationX"),
+                                   TLArg(destinationOffset.y, "DestinationY"),
+                                   TLArg(slice, "Slice"),
+                                   TLFrameArg());
+
+            const std::shared_ptr<Storage>& source = getStorage(from);
+            const std::shared_ptr<Storage>& destination = getStorage(to);
+            const image::Image sourceImage = source->getSlice(slice);
+            const image::Image destinationImage = destination->getSlice(slice);
+
+            // The destination is read for blending, so we account twice for its size.
+            const uint32_t tileRows = getTileRows(source->width, source->format, destination->format, 2);
+            for (uint32_t y = 0; y < source->height; y += tileRows) {
+                const uint32_t rowCount = std::min(tileRows, source->height - y);
+                const int64_t destinationY = static_cast<int64_t>(destinationOffset.y) + y;
+                if (destinationY + rowCount <= 0 || destinationY >= destination->height) {
+                    continue;
+                }
+
+                // Blend a band of the source, which the kernel clips against the destination.
+                image::Image band = sourceImage;
+                band.data += y * sourceImage.rowPitch;
+                band.height = rowCount;
+                const XrOffset2Di bandOffset{destinationOffset.x, static_cast<int32_t>(destinationY)};
+                m_graph->submit([=] { image::blendPremultiplied(band, destinationImage, bandOffset); },
+                                {getFootprint(source, slice, y, y + rowCount, false),
+                                 getFootprint(destination,
+                                              slice,
+                                              std::max<int64_t>(destinationY, 0),
+                                              std::max<int64_t>(destinationY + rowCount, 0),
+                                              true)});
+            }
+
+            TraceLoggingWriteStop(local, "CpuGraphicsDevice_Blend");
+        }
+
+        void flush() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "CpuGraphicsDevice_Flush", TLPArg(this, "Device"), TLFrameArg());
+
+            m_graph->flush();
+
+            TraceLoggingWriteStop(local, "CpuGraphicsDevice_Flush");
+        }
+
+      private:
+        const std::shared_ptr<Storage>& getStorage(IGraphicsTexture* texture) const {
+            if (texture->getApi() != Api::CPU) {
+                throw std::runtime_error("Api mismatch");
+            }
+            return static_cast<CpuTexture*>(texture)->m_storage;
+        }
+
+        // The number of rows per tile, so that the memory touched by one tile stays within the tile budget.
+        uint32_t getTileRows(uint32_t width,
+                             DXGI_FORMAT sourceFormat,
+                             DXGI_FORMAT destinationFormat,
+                             uint32_t destinationAccesses = 1) const {
+            const size_t bytesPerPixel = image::getBytesPerPixel(sourceFormat) +
+                                         destinationAccesses * image::getBytesPerPixel(destinationFormat);
+            const size_t bytesPerRow = std::max<size_t>(static_cast<size_t>(width) * bytesPerPixel, 1);
+            return static_cast<uint32_t>(std::clamp<size_t>(m_tileBytes / bytesPerRow, 1, UINT32_MAX));
+        }
+
+        static Footprint getFootprint(
+            const std::shared_ptr<Storage>& storage, uint32_t slice, uint64_t rowBegin, uint64_t rowEnd, bool isWrite) {
+            const uint64_t sliceBase = static_cast<uint64_t>(slice) * storage->height;
+            return {storage,
+                    sliceBase + std::min<uint64_t>(rowBegin, storage->height),
+                    sliceBase + std::min<uint64_t>(rowEnd, storage->height),
+                    isWrite};
+        }
+
+        void submitBlit(const std::shared_ptr<Storage>& source,
+                        const XrRect2Di& sourceRect,
+                        const std::shared_ptr<Storage>& destination,
+                        const XrOffset2Di& destinationOffset,
+                        uint32_t slice) {
+            const image::Image sourceImage = source->getSlice(slice);
+            const image::Image destinationImage = destination->getSlice(slice);
+
+            // Clip the rows upfront, so that the tiles do not cover empty bands.
+            const int64_t sourceToDestination = static_cast<int64_t>(destinationOffset.y) - sourceRect.offset.y;
+            const int64_t firstRow = std::max<int64_t>({sourceRect.offset.y, 0, -sourceToDestination});
+            const int64_t lastRow =
+                std::min<int64_t>({static_cast<int64_t>(sourceRect.offset.y) + sourceRect.extent.height,
+                                   source->height,
+                                   static_cast<int64_t>(destination->height) - sourceToDestination});
+
+            const uint32_t tileRows = getTileRows(source->width, source->format, destination->format);
+            for (int64_t y = firstRow; y < lastRow; y += tileRows) {
+                const int32_t rowCount = static_cast<int32_t>(std::min<int64_t>(tileRows, lastRow - y));
+                const XrRect2Di band{{sourceRect.offset.x, static_cast<int32_t>(y)},
+                                     {sourceRect.extent.width, rowCount}};
+                const XrOffset2Di bandOffset{destinationOffset.x, static_cast<int32_t>(y + sourceToDestination)};
+                m_graph->submit([=] { image::blit(sourceImage, band, destinationImage, bandOffset); },
+                                {getFootprint(source, slice, y, y + rowCount, false),
+                                 getFootprint(destination, slice, bandOffset.y, bandOffset.y + rowCount, true)});
+            }
+        }
+
+        const std::shared_ptr<TaskGraph> m_graph;
+        const uint32_t m_threadCount;
+        const size_t m_tileBytes;
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::graphics {
+
+    std::shared_ptr<IGraphicsDevice> createCpuDevice(std::shared_ptr<general::IWorkerPool> workerPool,
+                                                     size_t tileBytes) {
+        if (!workerPool) {
+            workerPool = general::createWorkerPool();
+        }
+        return std::make_shared<CpuGraphicsDevice>(std::move(workerPool), tileBytes);
+    }
+
+} // namespace openxr_api_layer::utils::graphics
@@ -0,0 +1,356 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "general.h"
+#include "graphics.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+    // Whether a point is inside of a convex polygon, regardless of the winding of the polygon.
+    bool isInsideConvex(const std::array<XrVector2f, 4>& polygon, const XrVector2f& point) {
+        float sign = 0.f;
+        for (uint32_t i = 0; i < polygon.size(); i++) {
+            const XrVector2f& a = polygon[i];
+            const XrVector2f& b = polygon[(i + 1) % polygon.size()];
+            const float cross = (b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x);
+
+            // Points on the edges are not considered inside, to remain conservative.
+            if (cross == 0.f || cross * sign < 0.f) {
+                return false;
+            }
+            sign = cross;
+        }
+        return true;
+    }
+
+    // Views alternate between the left and right eyes, including with the quad views configuration.
+    uint32_t getEyeViewMask(XrEyeVisibility eyeVisibility, uint32_t viewCount) {
+        const uint32_t allViews = viewCount < 32 ? (1u << viewCount) - 1 : ~0u;
+        if (viewCount < 2 || eyeVisibility == XR_EYE_VISIBILITY_BOTH) {
+            return allViews;
+        }
+        return allViews & (eyeVisibility == XR_EYE_VISIBILITY_LEFT ? 0x55555555u : 0xAAAAAAAAu);
+    }
+
+    struct QuadLayerCuller : IQuadLayerCuller {
+        QuadLayerCuller(XrInstance instance,
+                        PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                        XrSession session,
+                        XrViewConfigurationType viewConfigurationType,
+                        float fovMargin)
+            : m_session(session), m_viewConfigurationType(viewConfigurationType), m_fovMargin(fovMargin) {
+            CHECK_XRCMD(xrGetInstanceProcAddr(
+                instance, "xrLocateViews", reinterpret_cast<PFN_xrVoidFunction*>(&xrLocateViews)));
+        }
+
+        bool isQuadVisible(XrTime displayTime,
+                           XrSpace space,
+                           const XrPosef& pose,
+                           const XrExtent2Df& size,
+                           XrEyeVisibility eyeVisibility) override {
+            std::unique_lock lock(m_mutex);
+
+            const std::vector<XrView>& views = locateViews(displayTime, space);
+            if (views.empty()) {
+                return true;
+            }
+
+            const uint32_t viewCount = static_cast<uint32_t>(views.size());
+            const bool isVisible = (general::getQuadViewMask(views.data(), viewCount, pose, size, m_fovMargin) &
+                                    getEyeViewMask(eyeVisibility, viewCount)) != 0;
+            if (!isVisible) {
+                m_skippedOverlays++;
+            }
+            return isVisible;
+        }
+
+        void cullLayers(XrTime displayTime, std::vector<const XrCompositionLayerBaseHeader*>& layers) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "QuadLayerCuller_CullLayers",
+                                   TLXArg(m_session, "Session"),
+                                   TLArg(displayTime, "DisplayTime"),
+                                   TLFrameArg());
+
+            std::unique_lock lock(m_mutex);
+
+            // The working storage is kept across frames, to not allocate memory once the frames are steady.
+            m_quads.clear();
+            for (const XrCompositionLayerBaseHeader* layer : layers) {
+                if (layer->type == XR_TYPE_COMPOSITION_LAYER_QUAD) {
+                    Quad quad;
+                    quad.layer = reinterpret_cast<const XrCompositionLayerQuad*>(layer);
+                    m_quads.push_back(quad);
+                }
+            }
+
+            // Frustum culling, batched per space.
+            uint32_t frustumCulled = 0;
+            for (Quad& quad : m_quads) {
+                if (quad.isTested) {
+                    continue;
+                }
+
+                m_batch.clear();
+                m_poses.clear();
+                m_sizes.clear();
+                for (Quad& other : m_quads) {
+                    if (other.layer->space == quad.layer->space) {
+                        m_batch.push_back(&other);
+                        m_poses.push_back(other.layer->pose);
+                        m_sizes.push_back(other.layer->size);
+                    }
+                }
+
+                const std::vector<XrView>& views = locateViews(displayTime, quad.layer->space);
+                const uint32_t viewCount = static_cast<uint32_t>(views.size());
+                m_viewMasks.assign(m_batch.size(), getEyeViewMask(XR_EYE_VISIBILITY_BOTH, viewCount));
+                if (viewCount) {
+                    general::getQuadViewMasks(views.data(),
+                                              viewCount,
+                                              m_poses.data(),
+                                              m_sizes.data(),
+                                              static_cast<uint32_t>(m_batch.size()),
+                                              m_viewMasks.data(),
+                                              m_fovMargin);
+                }
+
+                for (size_t i = 0; i < m_batch.size(); i++) {
+                    m_batch[i]->viewMask =
+                        m_viewMasks[i] & getEyeViewMask(m_batch[i]->layer->eyeVisibility, viewCount);
+                    m_batch[i]->isTested = true;
+                    if (!m_batch[i]->viewMask) {
+                        m_batch[i]->isCulled = true;
+                        frustumCulled++;
+                    }
+                }
+            }
+
+            // Occlusion culling, walking the quads front to back (from the last one submitted, which is composited
+            // over all the others). A quad is hidden when, in each view it is visible in, its projection is inside the
+            // projection of an opaque quad submitted after it. The projected corners of the occluders are stored
+            // contiguously, one entry per view.
+            uint32_t occlusionCulled = 0;
+            m_occluders.clear();
+            m_occluderCorners.clear();
+            for (auto it = m_quads.rbegin(); it != m_quads.rend(); ++it) {
+                if (it->isCulled) {
+                    continue;
+                }
+
+                const std::vector<XrView>& views = locateViews(displayTime, it->layer->space);
+                if (views.empty()) {
+                    continue;
+                }
+
+                // Speculatively append the corners of this quad, in case it is an occluder.
+                const size_t firstCorner = m_occluderCorners.size();
+                m_occluderCorners.resize(firstCorner + views.size());
+                bool isHidden = true;
+                for (uint32_t i = 0; i < views.size(); i++) {
+                    if (!(it->viewMask & (1u << i))) {
+                        continue;
+                    }
+
+                    std::optional<std::array<XrVector2f, 4>>& corners = m_occluderCorners[firstCorner + i];
+                    std::array<XrVector2f, 4> projected;
+                    if (general::projectQuad(views[i], it->layer->pose, it->layer->size, projected)) {
+                        corners = projected;
+                    }
+
+                    const bool isHiddenInView =
+                        corners &&
+                        std::any_of(m_occluders.cbegin(), m_occluders.cend(), [&](const Occluder& occluder) {
+                            if (!(occluder.viewMask & (1u << i)) || i >= occluder.viewCount) {
+                                return false;
+                            }
+                            const auto& occluderCorners = m_occluderCorners[occluder.firstCorner + i];
+                            return occluderCorners &&
+                                   std::all_of(projected.cbegin(), projected.cend(), [&](const XrVector2f& point) {
+                                       return isInsideConvex(*occluderCorners, point);
+                                   });
+                        });
+                    isHidden = isHidden && isHiddenInView;
+                }
+
+                const bool isOpaque = !(it->layer->layerFlags & XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT) &&
+                                      !it->layer->next;
+                if (isHidden) {
+                    it->isCulled = true;
+                    occlusionCulled++;
+                }
+                if (!isHidden && isOpaque) {
+                    m_occluders.push_back({it->viewMask, static_cast<uint32_t>(views.size()), firstCorner});
+                } else {
+                    m_occluderCorners.resize(firstCorner);
+                }
+            }
+
+            if (frustumCulled || occlusionCulled) {
+                // The quads are in the same order as in the list of layers, which is compacted in place.
+                auto quad = m_quads.cbegin();
+                auto remaining = layers.begin();
+                for (const XrCompositionLayerBaseHeader* layer : layers) {
+                    if (layer->type == XR_TYPE_COMPOSITION_LAYER_QUAD && (quad++)->isCulled) {
+                        continue;
+                    }
+                    *remaining++ = layer;
+                }
+                layers.erase(remaining, layers.end());
+            }
+
+            m_statistics.framesCount++;
+            m_statistics.quadLayersLastFrame = static_cast<uint32_t>(m_quads.size());
+            m_statistics.frustumCulledLastFrame = frustumCulled;
+            m_statistics.frustumCulledTotal += frustumCulled;
+            m_statistics.occlusionCulledLastFrame = occlusionCulled;
+            m_statistics.occlusionCulledTotal += occlusionCulled;
+            m_statistics.skippedOverlaysLastFrame = m_skippedOverlays;
+            m_statistics.skippedOverlaysTotal += m_skippedOverlays;
+            m_skippedOverlays = 0;
+
+            TraceLoggingWriteStop(local,
+                                  "QuadLayerCuller_CullLayers",
+                                  TLArg(m_statistics.quadLayersLastFrame, "QuadLayers"),
+                                  TLArg(frustumCulled, "FrustumCulled"),
+                                  TLArg(occlusionCulled, "OcclusionCulled"),
+                                  TLArg(m_statistics.skippedOverlaysLastFrame, "SkippedOverlays"));
+        }
+
+        QuadLayerCullingStatistics getStatistics() const override {
+            std::unique_lock lock(m_mutex);
+
+            return m_statistics;
+        }
+
+        // Returns an empty list if the views cannot be located, in which case nothing must be culled. The returned list
+        // remains valid until the next display time.
+        const std::vector<XrView>& locateViews(XrTime displayTime, XrSpace space) {
+            if (displayTime != m_displayTime) {
+                m_locatedSpacesCount = 0;
+                m_displayTime = displayTime;
+            }
+
+            // There are only a handful of spaces per frame. The entries (and their lists) are reused across frames,
+            // and a deque keeps the lists in place when it grows.
+            for (size_t i = 0; i < m_locatedSpacesCount; i++) {
+                if (m_locatedSpaces[i].space == space) {
+                    return m_locatedSpaces[i].views;
+                }
+            }
+            if (m_locatedSpacesCount == m_locatedSpaces.size()) {
+                m_locatedSpaces.emplace_back();
+            }
+            LocatedSpace& located = m_locatedSpaces[m_locatedSpacesCount++];
+            located.space = space;
+            std::vector<XrView>& views = located.views;
+            views.clear();
+
+            XrViewLocateInfo locateInfo{XR_TYPE_VIEW_LOCATE_INFO};
+            locateInfo.viewConfigurationType = m_viewConfigurationType;
+            locateInfo.displayTime = displayTime;
+            locateInfo.space = space;
+            XrViewState viewState{XR_TYPE_VIEW_STATE};
+            uint32_t viewCount = 0;
+            if (XR_SUCCEEDED(xrLocateViews(m_session, &locateInfo, &viewState, 0, &viewCount, nullptr)) &&
+                viewCount <= 32) {
+                views.assign(viewCount, XrView{XR_TYPE_VIEW});
+                const XrViewStateFlags valid =
+                    XR_VIEW_STATE_ORIENTATION_VALID_BIT | XR_VIEW_STATE_POSITION_VALID_BIT;
+                if (XR_FAILED(xrLocateViews(
+                        m_session, &locateInfo, &viewState, viewCount, &viewCount, views.data())) ||
+                    (viewState.viewStateFlags & valid) != valid) {
+                    views.clear();
+                }
+            }
+
+            TraceLoggingWrite(g_traceProvider,
+                              "QuadLayerCuller_LocateViews",
+                              TLXArg(space, "Space"),
+                              TLArg(displayTime, "DisplayTime"),
+                              TLArg(static_cast<uint32_t>(views.size()), "ViewCount"),
+                              TLFrameArg());
+
+            return views;
+        }
+
+        const XrSession m_session;
+        const XrViewConfigurationType m_viewConfigurationType;
+        const float m_fovMargin;
+
+        struct Quad {
+            const XrCompositionLayerQuad* layer;
+            uint32_t viewMask{0};
+            bool isTested{false};
+            bool isCulled{false};
+        };
+
+        struct Occluder {
+            uint32_t viewMask;
+            uint32_t viewCount;
+            size_t firstCorner;
+        };
+
+        struct LocatedSpace {
+            XrSpace space{XR_NULL_HANDLE};
+            std::vector<XrView> views;
+        };
+
+        mutable std::mutex m_mutex;
+        XrTime m_displayTime{0};
+        std::deque<LocatedSpace> m_locatedSpaces;
+        size_t m_locatedSpacesCount{0};
+        std::vector<Quad> m_quads;
+        std::vector<Quad*> m_batch;
+        std::vector<XrPosef> m_poses;
+        std::vector<XrExtent2Df> m_sizes;
+        std::vector<uint32_t> m_viewMasks;
+        std::vector<Occluder> m_occluders;
+        std::vector<std::optional<std::array<XrVector2f, 4>>> m_occluderCorners;
+        uint32_t m_skippedOverlays{0};
+        QuadLayerCullingStatistics m_statistics;
+
+        PFN_xrLocateViews xrLocateViews{nullptr};
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::graphics {
+
+    std::shared_ptr<IQuadLayerCuller> createQuadLayerCuller(XrInstance instance,
+                                                            PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                                            XrSession session,
+                                                            XrViewConfigurationType viewConfigurationType,
+                                                            float fovMargin) {
+        return std::make_shared<QuadLayerCuller>(
+            instance, xrGetInstanceProcAddr, session, viewConfigurationType, fovMargin);
+    }
+
+} // namespace openxr_api_layer::utils::graphics
@@ -67,7 +67,9 @@ namespace {
 
         void start() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D11Timer_Start", TLPArg(this, "Timer"));
+            TraceLoggingWriteStart(local, "D3D11Timer_Start", TLPArg(this, "Timer"), TLFrameArg());
+
+            m_frameId = openxr_api_layer::frame::GetCurrentFrameId();
 
             m_context->Begin(m_timeStampDis.Get());
             m_context->End(m_timeStampStart.Get());
@@ -88,7 +90,11 @@ namespace {
 
         uint64_t query() const override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D11Timer_Query", TLPArg(this, "Timer"), TLArg(m_valid, "Valid"));
+            TraceLoggingWriteStart(local,
+                                   "D3D11Timer_Query",
+                                   TLPArg(this, "Timer"),
+                                   TLArg(m_valid, "Valid"),
+                                   TLArg(m_frameId, "FrameId"));
 
             uint64_t duration = 0;
             if (m_valid) {
@@ -110,6 +116,10 @@ namespace {
             return duration;
         }
 
+        uint64_t getFrameId() const override {
+            return m_frameId;
+        }
+
         ComPtr<ID3D11DeviceContext> m_context;
         ComPtr<ID3D11Query> m_timeStampDis;
         ComPtr<ID3D11Query> m_timeStampStart;
@@ -117,6 +127,8 @@ namespace {
 
         // Can the timer be queried (it might still only read 0).
         mutable bool m_valid{false};
+
+        uint64_t m_frameId{0};
     };
 
     struct D3D11Fence : IGraphicsFence {
@@ -169,7 +181,11 @@ namespace {
 
         void signal(uint64_t value) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D11Fence_Signal", TLPArg(this, "Fence"), TLArg(value, "Value"));
+            TraceLoggingWriteStart(local,
+                                   "D3D11Fence_Signal",
+                                   TLPArg(this, "Fence"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
 
             CHECK_HRCMD(m_context->Signal(m_fence.Get(), value));
             m_context->Flush();
@@ -179,8 +195,12 @@ namespace {
 
         void waitOnDevice(uint64_t value) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(
-                local, "D3D11Fence_Wait", TLPArg(this, "Fence"), TLArg("Device", "WaitType"), TLArg(value, "Value"));
+            TraceLoggingWriteStart(local,
+                                   "D3D11Fence_Wait",
+                                   TLPArg(this, "Fence"),
+                                   TLArg("Device", "WaitType"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
 
             CHECK_HRCMD(m_context->Wait(m_fence.Get(), value));
 
@@ -189,8 +209,12 @@ namespace {
 
         void waitOnCpu(uint64_t value) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(
-                local, "D3D11Fence_Wait", TLPArg(this, "Fence"), TLArg("Host", "WaitType"), TLArg(value, "Value"));
+            TraceLoggingWriteStart(local,
+                                   "D3D11Fence_Wait",
+                                   TLPArg(this, "Fence"),
+                                   TLArg("Host", "WaitType"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
 
             wil::unique_handle eventHandle;
             CHECK_HRCMD(m_context->Signal(m_fence.Get(), value));
@@ -203,6 +227,10 @@ namespace {
             TraceLoggingWriteStop(local, "D3D11Fence_Wait");
         }
 
+        uint64_t getCompletedValue() const override {
+            return m_fence->GetCompletedValue();
+        }
+
         bool isShareable() const override {
             return m_isShareable;
         }
@@ -476,7 +504,11 @@ namespace {
 
         void copyTexture(IGraphicsTexture* from, IGraphicsTexture* to) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D11Texture_Copy", TLPArg(from, "Source"), TLPArg(to, "Destination"));
+            TraceLoggingWriteStart(local,
+                                   "D3D11Texture_Copy",
+                                   TLPArg(from, "Source"),
+                                   TLPArg(to, "Destination"),
+                                   TLFrameArg());
 
             m_context->CopyResource(to->getNativeTexture<D3D11>(), from->getNativeTexture<D3D11>());
 
@@ -96,7 +96,9 @@ namespace {
 
         void start() override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D12Timer_Start", TLPArg(this, "Timer"));
+            TraceLoggingWriteStart(local, "D3D12Timer_Start", TLPArg(this, "Timer"), TLFrameArg());
+
+            m_frameId = openxr_api_layer::frame::GetCurrentFrameId();
 
             CHECK_HRCMD(m_commandAllocator[0]->Reset());
             CHECK_HRCMD(m_commandList[0]->Reset(m_commandAllocator[0].Get(), nullptr));
@@ -130,7 +132,11 @@ namespace {
 
         uint64_t query() const override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D12Timer_Query", TLPArg(this, "Timer"), TLArg(m_valid, "Valid"));
+            TraceLoggingWriteStart(local,
+                                   "D3D12Timer_Query",
+                                   TLPArg(this, "Timer"),
+                                   TLArg(m_valid, "Valid"),
+                                   TLArg(m_frameId, "FrameId"));
 
             uint64_t duration = 0;
             if (m_valid) {
@@ -151,6 +157,10 @@ namespace {
             return duration;
         }
 
+        uint64_t getFrameId() const override {
+            return m_frameId;
+        }
+
         ComPtr<ID3D12CommandQueue> m_queue;
         ComPtr<ID3D12CommandAllocator> m_commandAllocator[2];
         ComPtr<ID3D12GraphicsCommandList> m_commandList[2];
@@ -161,6 +171,8 @@ namespace {
 
         // Can the timer be queried (it might still only read 0).
         mutable bool m_valid{false};
+
+        uint64_t m_frameId{0};
     };
 
     struct D3D12Fence : IGraphicsFence {
@@ -210,7 +222,11 @@ namespace {
 
         void signal(uint64_t value) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D12Fence_Signal", TLPArg(this, "Fence"), TLArg(value, "Value"));
+            TraceLoggingWriteStart(local,
+                                   "D3D12Fence_Signal",
+                                   TLPArg(this, "Fence"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
 
             CHECK_HRCMD(m_commandQueue->Signal(m_fence.Get(), value));
 
@@ -219,8 +235,12 @@ namespace {
 
         void waitOnDevice(uint64_t value) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(
-                local, "D3D12Fence_Wait", TLPArg(this, "Fence"), TLArg("Device", "WaitType"), TLArg(value, "Value"));
+            TraceLoggingWriteStart(local,
+                                   "D3D12Fence_Wait",
+                                   TLPArg(this, "Fence"),
+                                   TLArg("Device", "WaitType"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
 
             CHECK_HRCMD(m_commandQueue->Wait(m_fence.Get(), value));
 
@@ -229,8 +249,12 @@ namespace {
 
         void waitOnCpu(uint64_t value) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(
-                local, "D3D12Fence_Wait", TLPArg(this, "Fence"), TLArg("Host", "WaitType"), TLArg(value, "Value"));
+            TraceLoggingWriteStart(local,
+                                   "D3D12Fence_Wait",
+                                   TLPArg(this, "Fence"),
+                                   TLArg("Host", "WaitType"),
+                                   TLArg(value, "Value"),
+                                   TLFrameArg());
 
             wil::unique_handle eventHandle;
             CHECK_HRCMD(m_commandQueue->Signal(m_fence.Get(), value));
@@ -242,6 +266,10 @@ namespace {
             TraceLoggingWriteStop(local, "D3D12Fence_Wait");
         }
 
+        uint64_t getCompletedValue() const override {
+            return m_fence->GetCompletedValue();
+        }
+
         bool isShareable() const override {
             return m_isShareable;
         }
@@ -519,7 +547,11 @@ namespace {
 
         void copyTexture(IGraphicsTexture* from, IGraphicsTexture* to) override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "D3D12Texture_Copy", TLPArg(from, "Source"), TLPArg(to, "Destination"));
+            TraceLoggingWriteStart(local,
+                                   "D3D12Texture_Copy",
+                                   TLPArg(from, "Source"),
+                                   TLPArg(to, "Destination"),
+                                   TLFrameArg());
 
             D3D12ReusableCommandList commandList = getCommandList();
             commandList.commandList->CopyResource(to->getNativeTexture<D3D12>(), from->getNativeTexture<D3D12>());
@@ -0,0 +1,900 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "graphics.h"
+#include "image.h"
+#include "log.h"
+
+#if defined(XR_USE_GRAPHICS_API_D3D11) || defined(XR_USE_GRAPHICS_API_D3D12)
+
+#pragma comment(lib, "d3dcompiler.lib")
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+    // A full-screen triangle that copies each texel of the source into the render target. The format conversion
+    // (including sRGB encoding) is performed by the output merger when writing to the render target.
+    const std::string_view ConversionShaderSource = R"_(
+Texture2DArray<float4> source : register(t0);
+
+void vsMain(in uint id : SV_VertexID, out float4 position : SV_Position) {
+    const float2 uv = float2((id << 1) & 2, id & 2);
+    position = float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+float4 psMain(in float4 position : SV_Position) : SV_Target {
+    return source.Load(int4(position.xy, 0, 0));
+}
+)_";
+
+    struct D3D11ConversionPipeline {
+        D3D11ConversionPipeline(ID3D11Device* device) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "D3D11ConversionPipeline_Create");
+
+            const auto compile = [&](const char* entryPoint, const char* target) {
+                ComPtr<ID3DBlob> shaderBytes;
+                ComPtr<ID3DBlob> errMsgs;
+                const HRESULT hr = D3DCompile(ConversionShaderSource.data(),
+                                              ConversionShaderSource.size(),
+                                              nullptr,
+                                              nullptr,
+                                              nullptr,
+                                              entryPoint,
+                                              target,
+                                              D3DCOMPILE_OPTIMIZATION_LEVEL3,
+                                              0,
+                                              shaderBytes.ReleaseAndGetAddressOf(),
+                                              errMsgs.ReleaseAndGetAddressOf());
+                if (FAILED(hr)) {
+                    ErrorLog(fmt::format("D3DCompile failed: {}\n",
+                                         errMsgs ? static_cast<const char*>(errMsgs->GetBufferPointer()) : ""));
+                    CHECK_HRESULT(hr, "D3DCompile");
+                }
+                return shaderBytes;
+            };
+
+            const ComPtr<ID3DBlob> vsBytes = compile("vsMain", "vs_5_0");
+            CHECK_HRCMD(device->CreateVertexShader(vsBytes->GetBufferPointer(),
+                                                   vsBytes->GetBufferSize(),
+                                                   nullptr,
+                                                   m_vertexShader.ReleaseAndGetAddressOf()));
+            const ComPtr<ID3DBlob> psBytes = compile("psMain", "ps_5_0");
+            CHECK_HRCMD(device->CreatePixelShader(psBytes->GetBufferPointer(),
+                                                  psBytes->GetBufferSize(),
+                                                  nullptr,
+                                                  m_pixelShader.ReleaseAndGetAddressOf()));
+
+            TraceLoggingWriteStop(local, "D3D11ConversionPipeline_Create", TLPArg(this, "Pipeline"));
+        }
+
+        void convert(ID3D11DeviceContext* context,
+                     ID3D11ShaderResourceView* source,
+                     ID3D11RenderTargetView* destination,
+                     uint32_t width,
+                     uint32_t height) {
+            context->ClearState();
+
+            D3D11_VIEWPORT viewport{};
+            viewport.Width = static_cast<float>(width);
+            viewport.Height = static_cast<float>(height);
+            viewport.MaxDepth = 1.f;
+
+            context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+            context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+            context->PSSetShaderResources(0, 1, &source);
+            context->RSSetViewports(1, &viewport);
+            context->OMSetRenderTargets(1, &destination, nullptr);
+            context->Draw(3, 0);
+
+            // Unbind our resources to avoid D3D debug layer warnings when the textures are used next.
+            ID3D11ShaderResourceView* const nullSRV[] = {nullptr};
+            context->PSSetShaderResources(0, 1, nullSRV);
+            context->OMSetRenderTargets(0, nullptr, nullptr);
+        }
+
+        ComPtr<ID3D11VertexShader> m_vertexShader;
+        ComPtr<ID3D11PixelShader> m_pixelShader;
+    };
+#endif
+
+    struct DemotedSwapchain {
+        XrSession session{XR_NULL_HANDLE};
+        DXGI_FORMAT sourceFormat{DXGI_FORMAT_UNKNOWN};
+        DXGI_FORMAT targetFormat{DXGI_FORMAT_UNKNOWN};
+
+        // The textures the application renders to, in the format it requested.
+        std::shared_ptr<ISwapchain> privateSwapchain;
+
+        // The swapchain submitted to the runtime, in the demoted format.
+        std::shared_ptr<ISwapchain> runtimeSwapchain;
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        // Views are indexed by [imageIndex * arraySize + slice].
+        std::vector<ComPtr<ID3D11ShaderResourceView>> sourceViews;
+        std::vector<ComPtr<ID3D11RenderTargetView>> destinationViews;
+#endif
+
+        bool hasPendingImage{false};
+        bool needVerify{false};
+        uint64_t bytesSavedPerImage{0};
+    };
+
+    struct SessionState {
+        std::vector<DXGI_FORMAT> runtimeFormats;
+        FormatDemotionStatistics statistics;
+    };
+
+    // The shaders are tied to the composition device, and are reused by the next sessions on the same device.
+    struct DeviceState : ICompositionDeviceData {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        std::unique_ptr<D3D11ConversionPipeline> pipeline;
+#endif
+    };
+
+    bool isEligibleForDemotion(const XrSwapchainCreateInfo& info, DXGI_FORMAT format) {
+        return format == DXGI_FORMAT_R16G16B16A16_FLOAT && info.sampleCount == 1 && info.mipCount == 1 &&
+               info.faceCount == 1 && (info.usageFlags & XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT) &&
+               !(info.usageFlags & (XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                    XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT));
+    }
+
+    struct FormatDemotionFactory : IFormatDemotionFactory {
+        FormatDemotionFactory(const XrInstanceCreateInfo& instanceInfo,
+                              XrInstance instance,
+                              PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr_,
+                              std::shared_ptr<ICompositionFrameworkFactory> compositionFrameworkFactory,
+                              GenericFormat targetFormat)
+            : m_instance(instance), xrGetInstanceProcAddr(xrGetInstanceProcAddr_),
+              m_compositionFrameworkFactory(compositionFrameworkFactory), m_targetFormat(targetFormat) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(
+                local, "FormatDemotionFactory_Create", TLArg((int)targetFormat, "TargetFormat"));
+
+            if (!image::isConversionSupported(DXGI_FORMAT_R16G16B16A16_FLOAT, m_targetFormat)) {
+                throw std::runtime_error("Unsupported target format for demotion");
+            }
+
+            CHECK_XRCMD(xrGetInstanceProcAddr(m_instance,
+                                              "xrEnumerateSwapchainFormats",
+                                              reinterpret_cast<PFN_xrVoidFunction*>(&xrEnumerateSwapchainFormats)));
+
+            // All other function pointers are chained.
+
+            // Registered last, since the destructor (which unregisters the factory) does not run if the constructor
+            // throws.
+            {
+                std::unique_lock lock(factoryMutex);
+                if (factory) {
+                    throw std::runtime_error("There can only be one FormatDemotion factory");
+                }
+                factory = this;
+            }
+
+            TraceLoggingWriteStop(local, "FormatDemotionFactory_Create", TLPArg(this, "FormatDemotionFactory"));
+        }
+
+        ~FormatDemotionFactory() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "FormatDemotionFactory_Destroy");
+
+            std::unique_lock lock(factoryMutex);
+
+            factory = nullptr;
+
+            TraceLoggingWriteStop(local, "FormatDemotionFactory_Destroy");
+        }
+
+        void xrGetInstanceProcAddr_post(XrInstance instance, const char* name, PFN_xrVoidFunction* function) override {
+            const std::string_view functionName(name);
+            if (functionName == "xrDestroySession") {
+                xrDestroySession = reinterpret_cast<PFN_xrDestroySession>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySession);
+            } else if (functionName == "xrCreateSwapchain") {
+                xrCreateSwapchain = reinterpret_cast<PFN_xrCreateSwapchain>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookCreateSwapchain);
+            } else if (functionName == "xrDestroySwapchain") {
+                xrDestroySwapchain = reinterpret_cast<PFN_xrDestroySwapchain>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySwapchain);
+            } else if (functionName == "xrEnumerateSwapchainImages") {
+                xrEnumerateSwapchainImages = reinterpret_cast<PFN_xrEnumerateSwapchainImages>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookEnumerateSwapchainImages);
+            } else if (functionName == "xrAcquireSwapchainImage") {
+                xrAcquireSwapchainImage = reinterpret_cast<PFN_xrAcquireSwapchainImage>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookAcquireSwapchainImage);
+            } else if (functionName == "xrWaitSwapchainImage") {
+                xrWaitSwapchainImage = reinterpret_cast<PFN_xrWaitSwapchainImage>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookWaitSwapchainImage);
+            } else if (functionName == "xrReleaseSwapchainImage") {
+                xrReleaseSwapchainImage = reinterpret_cast<PFN_xrReleaseSwapchainImage>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookReleaseSwapchainImage);
+            } else if (functionName == "xrEndFrame") {
+                xrEndFrame = reinterpret_cast<PFN_xrEndFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookEndFrame);
+            }
+        }
+
+        FormatDemotionStatistics getStatistics(XrSession session) const override {
+            std::unique_lock lock(m_mutex);
+
+            auto it = m_sessions.find(session);
+            if (it == m_sessions.end()) {
+                return {};
+            }
+
+            return it->second.statistics;
+        }
+
+        XrResult xrDestroySession_subst(XrSession session) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "FormatDemotionFactory_DestroySession", TLXArg(session, "Session"));
+
+            {
+                std::unique_lock lock(m_mutex);
+
+                // Our swapchains reference the composition framework's devices, so they must be released before the
+                // composition framework is destroyed further down the chain.
+                for (auto it = m_swapchains.begin(); it != m_swapchains.end();) {
+                    if (it->second->session == session) {
+                        it = m_swapchains.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+
+                auto it = m_sessions.find(session);
+                if (it != m_sessions.end()) {
+                    const FormatDemotionStatistics& statistics = it->second.statistics;
+                    if (statistics.framesCount) {
+                        Log(fmt::format("Swapchain format demotion saved {:.2f} MB per frame on average\n",
+                                        statistics.bytesSavedTotal / (1024.0 * 1024.0) / statistics.framesCount));
+                    }
+                    m_sessions.erase(it);
+                }
+            }
+            const XrResult result = xrDestroySession(session);
+
+            TraceLoggingWriteStop(
+                local, "FormatDemotionFactory_DestroySession", TLArg(xr::ToCString(result), "Result"));
+
+            return result;
+        }
+
+        XrResult xrCreateSwapchain_subst(XrSession session,
+                                         const XrSwapchainCreateInfo* createInfo,
+                                         XrSwapchain* swapchain) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "FormatDemotionFactory_CreateSwapchain", TLXArg(session, "Session"));
+
+            ICompositionFramework* compositionFramework =
+                m_compositionFrameworkFactory->getCompositionFramework(session);
+
+            XrResult result = XR_ERROR_RUNTIME_FAILURE;
+            bool demoted = false;
+            if (compositionFramework && createInfo->type == XR_TYPE_SWAPCHAIN_CREATE_INFO) {
+                const DXGI_FORMAT sourceFormat =
+                    compositionFramework->getApplicationDevice()->translateToGenericFormat(createInfo->format);
+                // Fallback to 8-bit sRGB when the runtime does not support the requested format.
+                DXGI_FORMAT targetFormat = m_targetFormat;
+                if (!isFormatSupportedByRuntime(session, targetFormat)) {
+                    targetFormat = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+                }
+                if (isEligibleForDemotion(*createInfo, sourceFormat) &&
+                    isFormatSupportedByRuntime(session, targetFormat)) {
+                    try {
+                        auto demotedSwapchain =
+                            createDemotedSwapchain(compositionFramework, *createInfo, sourceFormat, targetFormat);
+                        *swapchain = demotedSwapchain->runtimeSwapchain->getSwapchainHandle();
+
+                        std::unique_lock lock(m_mutex);
+                        m_sessions[session].statistics.demotedSwapchains++;
+                        m_swapchains.insert_or_assign(*swapchain, std::move(demotedSwapchain));
+
+                        result = XR_SUCCESS;
+                        demoted = true;
+                    } catch (std::exception& exc) {
+                        TraceLoggingWriteTagged(
+                            local, "FormatDemotionFactory_CreateSwapchain_Error", TLArg(exc.what(), "Error"));
+                        ErrorLog(fmt::format("Failed to demote swapchain: {}\n", exc.what()));
+                    }
+                }
+            }
+
+            if (!demoted) {
+                result = xrCreateSwapchain(session, createInfo, swapchain);
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "FormatDemotionFactory_CreateSwapchain",
+                                  TLArg(xr::ToCString(result), "Result"),
+                                  TLXArg(*swapchain, "Swapchain"),
+                                  TLArg(demoted, "Demoted"));
+
+            return result;
+        }
+
+        XrResult xrDestroySwapchain_subst(XrSwapchain swapchain) {
+            {
+                std::unique_lock lock(m_mutex);
+
+                auto it = m_swapchains.find(swapchain);
+                if (it != m_swapchains.end()) {
+                    TraceLocalActivity(local);
+                    TraceLoggingWriteStart(
+                        local, "FormatDemotionFactory_DestroySwapchain", TLXArg(swapchain, "Swapchain"));
+
+                    // The runtime swapchain is destroyed along with its ISwapchain wrapper.
+                    m_swapchains.erase(it);
+
+                    TraceLoggingWriteStop(local, "FormatDemotionFactory_DestroySwapchain");
+
+                    return XR_SUCCESS;
+                }
+            }
+
+            return xrDestroySwapchain(swapchain);
+        }
+
+        XrResult xrEnumerateSwapchainImages_subst(XrSwapchain swapchain,
+                                                  uint32_t imageCapacityInput,
+                                                  uint32_t* imageCountOutput,
+                                                  XrSwapchainImageBaseHeader* images) {
+            DemotedSwapchain* demotedSwapchain = getDemotedSwapchain(swapchain);
+            if (!demotedSwapchain) {
+                return xrEnumerateSwapchainImages(swapchain, imageCapacityInput, imageCountOutput, images);
+            }
+
+            // Expose the application-format textures instead of the runtime's.
+            ISwapchain* const privateSwapchain = demotedSwapchain->privateSwapchain.get();
+            *imageCountOutput = privateSwapchain->getLength();
+            if (imageCapacityInput == 0) {
+                return XR_SUCCESS;
+            }
+            if (imageCapacityInput < *imageCountOutput) {
+                return XR_ERROR_SIZE_INSUFFICIENT;
+            }
+
+            for (uint32_t i = 0; i < *imageCountOutput; i++) {
+                IGraphicsTexture* const texture = privateSwapchain->getImage(i)->getApplicationTexture();
+                switch (texture->getApi()) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+                case Api::D3D11: {
+                    XrSwapchainImageD3D11KHR* const d3d11Images = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
+                    if (d3d11Images[i].type != XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR) {
+                        return XR_ERROR_VALIDATION_FAILURE;
+                    }
+                    d3d11Images[i].texture = texture->getNativeTexture<D3D11>();
+                } break;
+#endif
+#ifdef XR_USE_GRAPHICS_API_D3D12
+                case Api::D3D12: {
+                    XrSwapchainImageD3D12KHR* const d3d12Images = reinterpret_cast<XrSwapchainImageD3D12KHR*>(images);
+                    if (d3d12Images[i].type != XR_TYPE_SWAPCHAIN_IMAGE_D3D12_KHR) {
+                        return XR_ERROR_VALIDATION_FAILURE;
+                    }
+                    d3d12Images[i].texture = texture->getNativeTexture<D3D12>();
+                } break;
+#endif
+                default:
+                    return XR_ERROR_RUNTIME_FAILURE;
+                }
+            }
+
+            return XR_SUCCESS;
+        }
+
+        XrResult xrAcquireSwapchainImage_subst(XrSwapchain swapchain,
+                                               const XrSwapchainImageAcquireInfo* acquireInfo,
+                                               uint32_t* index) {
+            DemotedSwapchain* demotedSwapchain = getDemotedSwapchain(swapchain);
+            if (!demotedSwapchain) {
+                return xrAcquireSwapchainImage(swapchain, acquireInfo, index);
+            }
+
+            const auto image = demotedSwapchain->privateSwapchain->tryAcquireImage(false /* wait */);
+            if (!image) {
+                ErrorLog(fmt::format("xrAcquireSwapchainImage: {}\n", image.what()));
+                return image.result();
+            }
+            *index = image.value()->getIndex();
+
+            return XR_SUCCESS;
+        }
+
+        XrResult xrWaitSwapchainImage_subst(XrSwapchain swapchain, const XrSwapchainImageWaitInfo* waitInfo) {
+            DemotedSwapchain* demotedSwapchain = getDemotedSwapchain(swapchain);
+            if (!demotedSwapchain) {
+                return xrWaitSwapchainImage(swapchain, waitInfo);
+            }
+
+            const auto waited = demotedSwapchain->privateSwapchain->tryWaitImage();
+            if (!waited) {
+                ErrorLog(fmt::format("xrWaitSwapchainImage: {}\n", waited.what()));
+            }
+
+            return waited.result();
+        }
+
+        XrResult xrReleaseSwapchainImage_subst(XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* releaseInfo) {
+            DemotedSwapchain* demotedSwapchain = getDemotedSwapchain(swapchain);
+            if (!demotedSwapchain) {
+                return xrReleaseSwapchainImage(swapchain, releaseInfo);
+            }
+
+            const auto released = demotedSwapchain->privateSwapchain->tryReleaseImage();
+            if (!released) {
+                ErrorLog(fmt::format("xrReleaseSwapchainImage: {}\n", released.what()));
+                return released.result();
+            }
+            demotedSwapchain->hasPendingImage = true;
+
+            return XR_SUCCESS;
+        }
+
+        XrResult xrEndFrame_subst(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "FormatDemotionFactory_EndFrame", TLXArg(session, "Session"), TLFrameArg());
+
+            ICompositionFramework* compositionFramework =
+                m_compositionFrameworkFactory->getCompositionFramework(session);
+
+            uint64_t bytesSaved = 0;
+            if (compositionFramework) {
+                std::unique_lock lock(m_mutex);
+
+                // Every swapchain with a newly released image is converted, regardless of the type of composition
+                // layer that references it.
+                std::vector<DemotedSwapchain*> pendingSwapchains;
+                for (auto& [handle, demotedSwapchain] : m_swapchains) {
+                    if (demotedSwapchain->session == session && demotedSwapchain->hasPendingImage) {
+                        pendingSwapchains.push_back(demotedSwapchain.get());
+                    }
+                }
+
+                if (!pendingSwapchains.empty()) {
+                    SessionState& state = m_sessions[session];
+
+                    try {
+                        compositionFramework->serializePreComposition();
+                        for (DemotedSwapchain* demotedSwapchain : pendingSwapchains) {
+                            const auto converted = convert(compositionFramework, state, *demotedSwapchain);
+                            demotedSwapchain->hasPendingImage = false;
+                            if (!converted) {
+                                ErrorLog(fmt::format("Failed to convert demoted swapchain: {}\n", converted.what()));
+                                continue;
+                            }
+                            bytesSaved += demotedSwapchain->bytesSavedPerImage;
+                        }
+                        compositionFramework->serializePostComposition();
+                    } catch (std::exception& exc) {
+                        TraceLoggingWriteTagged(
+                            local, "FormatDemotionFactory_EndFrame_Error", TLArg(exc.what(), "Error"));
+                        ErrorLog(fmt::format("Failed to convert demoted swapchain: {}\n", exc.what()));
+                    }
+
+                    state.statistics.bytesSavedLastFrame = bytesSaved;
+                    state.statistics.bytesSavedTotal += bytesSaved;
+                    state.statistics.framesCount++;
+                }
+            }
+
+            const XrResult result = xrEndFrame(session, frameEndInfo);
+
+            TraceLoggingWriteStop(local,
+                                  "FormatDemotionFactory_EndFrame",
+                                  TLArg(xr::ToCString(result), "Result"),
+                                  TLArg(bytesSaved, "BytesSaved"));
+
+            return result;
+        }
+
+        std::unique_ptr<DemotedSwapchain> createDemotedSwapchain(ICompositionFramework* compositionFramework,
+                                                                 const XrSwapchainCreateInfo& createInfo,
+                                                                 DXGI_FORMAT sourceFormat,
+                                                                 DXGI_FORMAT targetFormat) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "FormatDemotionFactory_CreateDemotedSwapchain");
+
+            IGraphicsDevice* const applicationDevice = compositionFramework->getApplicationDevice();
+            IGraphicsDevice* const compositionDevice = compositionFramework->getCompositionDevice();
+
+            auto demotedSwapchain = std::make_unique<DemotedSwapchain>();
+            demotedSwapchain->session = compositionFramework->getSessionHandle();
+            demotedSwapchain->sourceFormat = sourceFormat;
+            demotedSwapchain->targetFormat = targetFormat;
+
+            // The swapchain submitted to the runtime is only ever written by our conversion pass.
+            XrSwapchainCreateInfo runtimeInfo = createInfo;
+            runtimeInfo.format = applicationDevice->translateFromGenericFormat(targetFormat);
+            runtimeInfo.usageFlags |= XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT;
+            demotedSwapchain->runtimeSwapchain =
+                compositionFramework->createSwapchain(runtimeInfo, SwapchainMode::Submit | SwapchainMode::Write);
+
+            // The private textures must be readable by our conversion pass.
+            XrSwapchainCreateInfo privateInfo = createInfo;
+            privateInfo.next = nullptr;
+            privateInfo.usageFlags |= XR_SWAPCHAIN_USAGE_SAMPLED_BIT;
+            demotedSwapchain->privateSwapchain =
+                compositionFramework->createSwapchain(privateInfo, SwapchainMode::Read);
+
+            demotedSwapchain->bytesSavedPerImage =
+                static_cast<uint64_t>(createInfo.width) * createInfo.height * createInfo.arraySize *
+                (image::getBytesPerPixel(sourceFormat) - image::getBytesPerPixel(targetFormat));
+
+#ifdef _DEBUG
+            demotedSwapchain->needVerify = true;
+#endif
+
+            switch (compositionDevice->getApi()) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            case Api::D3D11: {
+                ID3D11Device* const device = compositionDevice->getNativeDevice<D3D11>();
+                const uint32_t arraySize = createInfo.arraySize;
+
+                ISwapchain* const privateSwapchain = demotedSwapchain->privateSwapchain.get();
+                for (uint32_t i = 0; i < privateSwapchain->getLength(); i++) {
+                    for (uint32_t slice = 0; slice < arraySize; slice++) {
+                        D3D11_SHADER_RESOURCE_VIEW_DESC desc{};
+                        desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+                        desc.Format = sourceFormat;
+                        desc.Texture2DArray.MipLevels = 1;
+                        desc.Texture2DArray.FirstArraySlice = slice;
+                        desc.Texture2DArray.ArraySize = 1;
+
+                        ComPtr<ID3D11ShaderResourceView> srv;
+                        CHECK_HRCMD(device->CreateShaderResourceView(
+                            privateSwapchain->getImage(i)->getTextureForRead()->getNativeTexture<D3D11>(),
+                            &desc,
+                            srv.ReleaseAndGetAddressOf()));
+                        demotedSwapchain->sourceViews.push_back(std::move(srv));
+                    }
+                }
+
+                ISwapchain* const runtimeSwapchain = demotedSwapchain->runtimeSwapchain.get();
+                for (uint32_t i = 0; i < runtimeSwapchain->getLength(); i++) {
+                    for (uint32_t slice = 0; slice < arraySize; slice++) {
+                        // The runtime may have created typeless textures, so the view must be explicitly typed.
+                        D3D11_RENDER_TARGET_VIEW_DESC desc{};
+                        desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+                        desc.Format = targetFormat;
+                        desc.Texture2DArray.FirstArraySlice = slice;
+                        desc.Texture2DArray.ArraySize = 1;
+
+                        ComPtr<ID3D11RenderTargetView> rtv;
+                        CHECK_HRCMD(device->CreateRenderTargetView(
+                            runtimeSwapchain->getImage(i)->getTextureForWrite()->getNativeTexture<D3D11>(),
+                            &desc,
+                            rtv.ReleaseAndGetAddressOf()));
+                        demotedSwapchain->destinationViews.push_back(std::move(rtv));
+                    }
+                }
+            } break;
+#endif
+            default:
+                throw std::runtime_error("Composition graphics API is not supported");
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "FormatDemotionFactory_CreateDemotedSwapchain",
+                                  TLPArg(demotedSwapchain->runtimeSwapchain.get(), "RuntimeSwapchain"),
+                                  TLPArg(demotedSwapchain->privateSwapchain.get(), "PrivateSwapchain"),
+                                  TLArg((int)sourceFormat, "SourceFormat"),
+                                  TLArg((int)targetFormat, "TargetFormat"),
+                                  TLArg(demotedSwapchain->bytesSavedPerImage, "BytesSavedPerImage"));
+
+            return demotedSwapchain;
+        }
+
+        XrExpected<void> convert(ICompositionFramework* compositionFramework,
+                                 SessionState& state,
+                                 DemotedSwapchain& demotedSwapchain) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "FormatDemotion_Convert",
+                                   TLPArg(&demotedSwapchain, "Swapchain"),
+                                   TLFrameArg());
+
+            IGraphicsDevice* const compositionDevice = compositionFramework->getCompositionDevice();
+            ISwapchainImage* const source = demotedSwapchain.privateSwapchain->getLastReleasedImage();
+            const auto acquired = demotedSwapchain.runtimeSwapchain->tryAcquireImage();
+            if (!acquired) {
+                TraceLoggingWriteStop(local,
+                                      "FormatDemotion_Convert",
+                                      TLArg(acquired.what(), "Operation"),
+                                      TLArg(xr::ToCString(acquired.result()), "Result"));
+                return XrFailure{acquired.result(), acquired.what()};
+            }
+            ISwapchainImage* const destination = acquired.value();
+            const XrSwapchainCreateInfo& info = demotedSwapchain.runtimeSwapchain->getInfoOnCompositionDevice();
+
+            switch (compositionDevice->getApi()) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            case Api::D3D11: {
+                if (!compositionFramework->getDeviceDataPtr()) {
+                    compositionFramework->setDeviceData(std::make_unique<DeviceState>());
+                }
+                DeviceState* const deviceState = compositionFramework->getDeviceData<DeviceState>();
+                if (!deviceState->pipeline) {
+                    deviceState->pipeline =
+                        std::make_unique<D3D11ConversionPipeline>(compositionDevice->getNativeDevice<D3D11>());
+                }
+
+                ID3D11DeviceContext* const context = compositionDevice->getNativeContext<D3D11>();
+                for (uint32_t slice = 0; slice < info.arraySize; slice++) {
+                    deviceState->pipeline->convert(
+                        context,
+                        demotedSwapchain.sourceViews[source->getIndex() * info.arraySize + slice].Get(),
+                        demotedSwapchain.destinationViews[destination->getIndex() * info.arraySize + slice].Get(),
+                        info.width,
+                        info.height);
+                }
+
+                if (demotedSwapchain.needVerify) {
+                    verifyConversion(compositionDevice,
+                                     source->getTextureForRead(),
+                                     destination->getTextureForWrite(),
+                                     demotedSwapchain.sourceFormat,
+                                     demotedSwapchain.targetFormat);
+                    demotedSwapchain.needVerify = false;
+                }
+            } break;
+#endif
+            default:
+                throw std::runtime_error("Composition graphics API is not supported");
+            }
+
+            auto released = demotedSwapchain.runtimeSwapchain->tryReleaseImage();
+            if (released) {
+                released = demotedSwapchain.runtimeSwapchain->tryCommitLastReleasedImage();
+            }
+            if (!released) {
+                TraceLoggingWriteTagged(local,
+                                        "FormatDemotion_Convert_Error",
+                                        TLArg(released.what(), "Operation"),
+                                        TLArg(xr::ToCString(released.result()), "Result"));
+            }
+
+            TraceLoggingWriteStop(local, "FormatDemotion_Convert", TLArg(xr::ToCString(released.result()), "Result"));
+
+            return released;
+        }
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        // Compare the output of the conversion pass against the CPU conversion kernel. This is a blocking readback,
+        // only meant for validation in Debug builds.
+        void verifyConversion(IGraphicsDevice* compositionDevice,
+                              IGraphicsTexture* source,
+                              IGraphicsTexture* destination,
+                              DXGI_FORMAT sourceFormat,
+                              DXGI_FORMAT targetFormat) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "FormatDemotion_Verify");
+
+            ID3D11Device* const device = compositionDevice->getNativeDevice<D3D11>();
+            ID3D11DeviceContext* const context = compositionDevice->getNativeContext<D3D11>();
+
+            const auto readback = [&](IGraphicsTexture* texture, DXGI_FORMAT format) {
+                D3D11_TEXTURE2D_DESC desc{};
+                desc.Width = texture->getInfo().width;
+                desc.Height = texture->getInfo().height;
+                desc.ArraySize = desc.MipLevels = desc.SampleDesc.Count = 1;
+                desc.Format = format;
+                desc.Usage = D3D11_USAGE_STAGING;
+                desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+                ComPtr<ID3D11Texture2D> staging;
+                CHECK_HRCMD(device->CreateTexture2D(&desc, nullptr, staging.ReleaseAndGetAddressOf()));
+                context->CopySubresourceRegion(
+                    staging.Get(), 0, 0, 0, 0, texture->getNativeTexture<D3D11>(), 0, nullptr);
+                return staging;
+            };
+
+            const ComPtr<ID3D11Texture2D> sourceStaging = readback(source, sourceFormat);
+            const ComPtr<ID3D11Texture2D> destinationStaging = readback(destination, targetFormat);
+
+            D3D11_MAPPED_SUBRESOURCE sourceMapped{};
+            CHECK_HRCMD(context->Map(sourceStaging.Get(), 0, D3D11_MAP_READ, 0, &sourceMapped));
+            D3D11_MAPPED_SUBRESOURCE destinationMapped{};
+            CHECK_HRCMD(context->Map(destinationStaging.Get(), 0, D3D11_MAP_READ, 0, &destinationMapped));
+
+            const uint32_t width = destination->getInfo().width;
+            const uint32_t height = destination->getInfo().height;
+            std::vector<uint32_t> expected(width);
+            uint64_t mismatches = 0;
+            for (uint32_t y = 0; y < height; y++) {
+                image::convertPixels(sourceFormat,
+                                     static_cast<const uint8_t*>(sourceMapped.pData) + y * sourceMapped.RowPitch,
+                                     targetFormat,
+                                     expected.data(),
+                                     width);
+                const uint32_t* const actual = reinterpret_cast<const uint32_t*>(
+                    static_cast<const uint8_t*>(destinationMapped.pData) + y * destinationMapped.RowPitch);
+                for (uint32_t x = 0; x < width; x++) {
+                    if (!isWithinTolerance(targetFormat, expected[x], actual[x])) {
+                        mismatches++;
+                    }
+                }
+            }
+
+            context->Unmap(destinationStaging.Get(), 0);
+            context->Unmap(sourceStaging.Get(), 0);
+
+            TraceLoggingWriteStop(local, "FormatDemotion_Verify", TLArg(mismatches, "Mismatches"));
+            if (mismatches) {
+                ErrorLog(fmt::format("Demoted swapchain conversion mismatches the reference for {} pixels\n",
+                                     mismatches));
+            }
+        }
+
+        static bool isWithinTolerance(DXGI_FORMAT format, uint32_t expected, uint32_t actual) {
+            using namespace DirectX;
+            using namespace DirectX::PackedVector;
+
+            if (format == DXGI_FORMAT_R11G11B10_FLOAT) {
+                // The GPU may round differently than the CPU: allow for 1 ULP of the 5-bit mantissa.
+                XMFLOAT3PK expectedPacked(expected);
+                XMFLOAT3PK actualPacked(actual);
+                const XMVECTOR e = XMLoadFloat3PK(&expectedPacked);
+                const XMVECTOR a = XMLoadFloat3PK(&actualPacked);
+                const XMVECTOR tolerance =
+                    XMVectorMax(XMVectorScale(XMVectorAbs(e), 1.f / 32), XMVectorReplicate(1e-4f));
+                return XMVector3LessOrEqual(XMVectorAbs(XMVectorSubtract(e, a)), tolerance);
+            }
+
+            for (uint32_t i = 0; i < 4; i++) {
+                const int e = (expected >> (i * 8)) & 0xff;
+                const int a = (actual >> (i * 8)) & 0xff;
+                if (std::abs(e - a) > 1) {
+                    return false;
+                }
+            }
+            return true;
+        }
+#endif
+
+        bool isFormatSupportedByRuntime(XrSession session, DXGI_FORMAT format) {
+            ICompositionFramework* compositionFramework =
+                m_compositionFrameworkFactory->getCompositionFramework(session);
+
+            std::unique_lock lock(m_mutex);
+
+            SessionState& state = m_sessions[session];
+            if (state.runtimeFormats.empty()) {
+                uint32_t formatsCount = 0;
+                if (XR_FAILED(xrEnumerateSwapchainFormats(session, 0, &formatsCount, nullptr))) {
+                    return false;
+                }
+                std::vector<int64_t> formats(formatsCount);
+                if (XR_FAILED(xrEnumerateSwapchainFormats(session, formatsCount, &formatsCount, formats.data()))) {
+                    return false;
+                }
+                for (const int64_t formatOnApplicationDevice : formats) {
+                    state.runtimeFormats.push_back(
+                        compositionFramework->getApplicationDevice()->translateToGenericFormat(
+                            formatOnApplicationDevice));
+                }
+            }
+
+            return std::find(state.runtimeFormats.cbegin(), state.runtimeFormats.cend(), format) !=
+                   state.runtimeFormats.cend();
+        }
+
+        DemotedSwapchain* getDemotedSwapchain(XrSwapchain swapchain) {
+            std::unique_lock lock(m_mutex);
+
+            auto it = m_swapchains.find(swapchain);
+            if (it == m_swapchains.end()) {
+                return nullptr;
+            }
+
+            return it->second.get();
+        }
+
+        const XrInstance m_instance;
+        const PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr;
+        const std::shared_ptr<ICompositionFrameworkFactory> m_compositionFrameworkFactory;
+        const DXGI_FORMAT m_targetFormat;
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<XrSwapchain, std::unique_ptr<DemotedSwapchain>> m_swapchains;
+        std::unordered_map<XrSession, SessionState> m_sessions;
+
+        PFN_xrEnumerateSwapchainFormats xrEnumerateSwapchainFormats{nullptr};
+        PFN_xrDestroySession xrDestroySession{nullptr};
+        PFN_xrCreateSwapchain xrCreateSwapchain{nullptr};
+        PFN_xrDestroySwapchain xrDestroySwapchain{nullptr};
+        PFN_xrEnumerateSwapchainImages xrEnumerateSwapchainImages{nullptr};
+        PFN_xrAcquireSwapchainImage xrAcquireSwapchainImage{nullptr};
+        PFN_xrWaitSwapchainImage xrWaitSwapchainImage{nullptr};
+        PFN_xrReleaseSwapchainImage xrReleaseSwapchainImage{nullptr};
+        PFN_xrEndFrame xrEndFrame{nullptr};
+
+        static inline std::mutex factoryMutex;
+        static inline FormatDemotionFactory* factory{nullptr};
+
+        static XrResult XRAPI_CALL hookDestroySession(XrSession session) {
+            return factory->xrDestroySession_subst(session);
+        }
+
+        static XrResult XRAPI_CALL hookCreateSwapchain(XrSession session,
+                                                       const XrSwapchainCreateInfo* createInfo,
+                                                       XrSwapchain* swapchain) {
+            return factory->xrCreateSwapchain_subst(session, createInfo, swapchain);
+        }
+
+        static XrResult XRAPI_CALL hookDestroySwapchain(XrSwapchain swapchain) {
+            return factory->xrDestroySwapchain_subst(swapchain);
+        }
+
+        static XrResult XRAPI_CALL hookEnumerateSwapchainImages(XrSwapchain swapchain,
+                                                                uint32_t imageCapacityInput,
+                                                                uint32_t* imageCountOutput,
+                                                                XrSwapchainImageBaseHeader* images) {
+            return factory->xrEnumerateSwapchainImages_subst(swapchain, imageCapacityInput, imageCountOutput, images);
+        }
+
+        static XrResult XRAPI_CALL hookAcquireSwapchainImage(XrSwapchain swapchain,
+                                                             const XrSwapchainImageAcquireInfo* acquireInfo,
+                                                             uint32_t* index) {
+            return factory->xrAcquireSwapchainImage_subst(swapchain, acquireInfo, index);
+        }
+
+        static XrResult XRAPI_CALL hookWaitSwapchainImage(XrSwapchain swapchain,
+                                                          const XrSwapchainImageWaitInfo* waitInfo) {
+            return factory->xrWaitSwapchainImage_subst(swapchain, waitInfo);
+        }
+
+        static XrResult XRAPI_CALL hookReleaseSwapchainImage(XrSwapchain swapchain,
+                                                             const XrSwapchainImageReleaseInfo* releaseInfo) {
+            return factory->xrReleaseSwapchainImage_subst(swapchain, releaseInfo);
+        }
+
+        static XrResult XRAPI_CALL hookEndFrame(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            return factory->xrEndFrame_subst(session, frameEndInfo);
+        }
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::graphics {
+
+    std::shared_ptr<IFormatDemotionFactory>
+    createFormatDemotionFactory(const XrInstanceCreateInfo& instanceInfo,
+                                XrInstance instance,
+                                PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                std::shared_ptr<ICompositionFrameworkFactory> compositionFrameworkFactory,
+                                GenericFormat targetFormat) {
+        return std::make_shared<FormatDemotionFactory>(
+            instanceInfo, instance, xrGetInstanceProcAddr, compositionFrameworkFactory, targetFormat);
+    }
+
+} // namespace openxr_api_layer::utils::graphics
+
+#endif
@@ -0,0 +1,1287 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "graphics.h"
+#include "image.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+    // The distance to the eye below which the quads are clipped, in meters.
+    constexpr float NearPlane = 0.001f;
+
+    // Views alternate between the left and right eyes, like for quad layer culling.
+    bool isVisibleInView(XrEyeVisibility eyeVisibility, uint32_t viewIndex, uint32_t viewCount) {
+        return viewCount < 2 || eyeVisibility == XR_EYE_VISIBILITY_BOTH ||
+               ((viewIndex % 2) == 0) == (eyeVisibility == XR_EYE_VISIBILITY_LEFT);
+    }
+
+    XrVector3f rotate(const XrQuaternionf& rotation, const XrVector3f& vector) {
+        using namespace xr::math;
+
+        return Pose::Multiply(Pose::Translation(vector), Pose::MakePose(rotation, XrVector3f{})).position;
+    }
+
+    // The corners of the quad in the clip space of a view, in triangle strip order (top-left, top-right, bottom-left,
+    // bottom-right). The depth is the distance past the near plane, so that the rasterizer clips the parts of the quad
+    // behind the eye, and there is no far plane.
+    std::array<XrVector4f, 4>
+    getClipSpaceCorners(const XrPosef& quadInView, const XrExtent2Df& size, const XrFovf& fov) {
+        const XrVector3f halfRight = rotate(quadInView.orientation, {size.width / 2.f, 0, 0});
+        const XrVector3f halfUp = rotate(quadInView.orientation, {0, size.height / 2.f, 0});
+        const XrVector3f points[4] = {
+            quadInView.position - halfRight + halfUp,
+            quadInView.position + halfRight + halfUp,
+            quadInView.position - halfRight - halfUp,
+            quadInView.position + halfRight - halfUp,
+        };
+
+        const float tanLeft = std::tan(fov.angleLeft);
+        const float tanRight = std::tan(fov.angleRight);
+        const float tanUp = std::tan(fov.angleUp);
+        const float tanDown = std::tan(fov.angleDown);
+
+        std::array<XrVector4f, 4> corners;
+        for (uint32_t i = 0; i < 4; i++) {
+            const float w = -points[i].z;
+            corners[i].x = (2.f * points[i].x - w * (tanLeft + tanRight)) / (tanRight - tanLeft);
+            corners[i].y = (2.f * points[i].y - w * (tanUp + tanDown)) / (tanUp - tanDown);
+            corners[i].z = w - NearPlane;
+            corners[i].w = w;
+        }
+        return corners;
+    }
+
+    // The CPU reference of the flattening pass: cast a ray through the center of each pixel of the destination
+    // rectangle, and replace the pixels hitting the quad with a bilinear sample of the source rectangle. The alpha of
+    // the quad is ignored, like for any opaque quad layer. Returns the number of pixels written. The optional edge mask
+    // receives (for each pixel of the destination rectangle, in row-major order) whether the pixel straddles an edge of
+    // the quad, where the rasterization rules of a GPU may legitimately produce a different coverage.
+    uint64_t rasterizeQuadReference(const image::Image& source,
+                                    const XrRect2Di& sourceRect,
+                                    const XrPosef& quadInView,
+                                    const XrExtent2Df& size,
+                                    const XrFovf& fov,
+                                    const image::Image& destination,
+                                    const XrRect2Di& destinationRect,
+                                    std::vector<uint8_t>* edgeMask = nullptr) {
+        using namespace xr::math;
+
+        const auto isInside = [](const image::Image& image, const XrRect2Di& rect) {
+            return rect.offset.x >= 0 && rect.offset.y >= 0 && rect.extent.width > 0 && rect.extent.height > 0 &&
+                   static_cast<uint64_t>(rect.offset.x) + rect.extent.width <= image.width &&
+                   static_cast<uint64_t>(rect.offset.y) + rect.extent.height <= image.height;
+        };
+        if (!isInside(source, sourceRect) || !isInside(destination, destinationRect)) {
+            throw std::runtime_error("Image rectangle is out of bounds");
+        }
+
+        // The quad image in linear space.
+        const uint32_t sourceWidth = sourceRect.extent.width;
+        const uint32_t sourceHeight = sourceRect.extent.height;
+        const uint32_t sourceBytesPerPixel = image::getBytesPerPixel(source.format);
+        std::vector<XrColor4f> texels(static_cast<size_t>(sourceWidth) * sourceHeight);
+        for (uint32_t y = 0; y < sourceHeight; y++) {
+            image::convertPixels(source.format,
+                                 source.data + (sourceRect.offset.y + y) * source.rowPitch +
+                                     static_cast<size_t>(sourceRect.offset.x) * sourceBytesPerPixel,
+                                 DXGI_FORMAT_R32G32B32A32_FLOAT,
+                                 texels.data() + static_cast<size_t>(y) * sourceWidth,
+                                 sourceWidth);
+        }
+
+        const auto sample = [&](float x, float y) {
+            x = std::clamp(x, 0.f, sourceWidth - 1.f);
+            y = std::clamp(y, 0.f, sourceHeight - 1.f);
+            const uint32_t x0 = static_cast<uint32_t>(x);
+            const uint32_t y0 = static_cast<uint32_t>(y);
+            const uint32_t x1 = std::min(x0 + 1, sourceWidth - 1);
+            const uint32_t y1 = std::min(y0 + 1, sourceHeight - 1);
+            const float fx = x - x0;
+            const float fy = y - y0;
+
+            const auto texel = [&](uint32_t tx, uint32_t ty) -> const XrColor4f& {
+                return texels[static_cast<size_t>(ty) * sourceWidth + tx];
+            };
+            const auto lerp = [](const XrColor4f& a, const XrColor4f& b, float t) {
+                return XrColor4f{a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t, 1.f};
+            };
+            return lerp(lerp(texel(x0, y0), texel(x1, y0), fx), lerp(texel(x0, y1), texel(x1, y1), fx), fy);
+        };
+
+        // The rays are cast in the space of the quad, where the quad is the [-width/2, width/2] x [-height/2, height/2]
+        // rectangle of the z = 0 plane.
+        const XrPosef viewInQuad = Pose::Invert(quadInView);
+        const XrVector3f origin = viewInQuad.position;
+        const XrVector3f right = rotate(viewInQuad.orientation, {1, 0, 0});
+        const XrVector3f up = rotate(viewInQuad.orientation, {0, 1, 0});
+        const XrVector3f forward = rotate(viewInQuad.orientation, {0, 0, -1});
+
+        const float tanLeft = std::tan(fov.angleLeft);
+        const float tanRight = std::tan(fov.angleRight);
+        const float tanUp = std::tan(fov.angleUp);
+        const float tanDown = std::tan(fov.angleDown);
+
+        // Cast the ray through a point of the destination image, and return the hit in texels of the source rectangle.
+        const auto castRay = [&](float x, float y, XrVector2f& hit) {
+            const float u = (x - destinationRect.offset.x) / destinationRect.extent.width;
+            const float v = (y - destinationRect.offset.y) / destinationRect.extent.height;
+            const XrVector3f direction =
+                (tanLeft + u * (tanRight - tanLeft)) * right + (tanUp - v * (tanUp - tanDown)) * up + forward;
+            if (direction.z == 0.f) {
+                return false;
+            }
+
+            // The direction has a unit length along the forward axis of the view, so this is also the depth of the hit.
+            const float depth = -origin.z / direction.z;
+            if (depth < NearPlane) {
+                return false;
+            }
+
+            const float hitX = origin.x + depth * direction.x;
+            const float hitY = origin.y + depth * direction.y;
+            if (std::abs(hitX) > size.width / 2.f || std::abs(hitY) > size.height / 2.f) {
+                return false;
+            }
+
+            hit.x = (hitX / size.width + 0.5f) * sourceWidth - 0.5f;
+            hit.y = (0.5f - hitY / size.height) * sourceHeight - 0.5f;
+            return true;
+        };
+
+        const uint32_t width = destinationRect.extent.width;
+        const uint32_t height = destinationRect.extent.height;
+        const uint32_t destinationBytesPerPixel = image::getBytesPerPixel(destination.format);
+        if (edgeMask) {
+            edgeMask->assign(static_cast<size_t>(width) * height, 0);
+        }
+
+        uint64_t pixelsWritten = 0;
+        std::vector<XrColor4f> row(width);
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t* const rowData = destination.data + (destinationRect.offset.y + y) * destination.rowPitch +
+                                     static_cast<size_t>(destinationRect.offset.x) * destinationBytesPerPixel;
+            image::convertPixels(destination.format, rowData, DXGI_FORMAT_R32G32B32A32_FLOAT, row.data(), width);
+
+            bool isRowWritten = false;
+            for (uint32_t x = 0; x < width; x++) {
+                const float centerX = destinationRect.offset.x + x + 0.5f;
+                const float centerY = destinationRect.offset.y + y + 0.5f;
+
+                XrVector2f hit;
+                const bool isCovered = castRay(centerX, centerY, hit);
+                if (edgeMask) {
+                    XrVector2f unused;
+                    for (uint32_t corner = 0; corner < 4; corner++) {
+                        const float cornerX = centerX + (corner & 1 ? 0.5f : -0.5f);
+                        const float cornerY = centerY + (corner & 2 ? 0.5f : -0.5f);
+                        if (castRay(cornerX, cornerY, unused) != isCovered) {
+                            (*edgeMask)[static_cast<size_t>(y) * width + x] = 1;
+                            break;
+                        }
+                    }
+                }
+                if (!isCovered) {
+                    continue;
+                }
+
+                row[x] = sample(hit.x, hit.y);
+                isRowWritten = true;
+                pixelsWritten++;
+            }
+
+            if (isRowWritten) {
+                image::convertPixels(DXGI_FORMAT_R32G32B32A32_FLOAT, row.data(), destination.format, rowData, width);
+            }
+        }
+
+        return pixelsWritten;
+    }
+
+} // namespace
+
+#if defined(XR_USE_GRAPHICS_API_D3D11) || defined(XR_USE_GRAPHICS_API_D3D12)
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+    // The vertices of a quad, as consumed by the flattening pass.
+    struct QuadConstants {
+        std::array<XrVector4f, 4> corners;
+
+        // Only the first two components are used.
+        std::array<XrVector4f, 4> texCoords;
+    };
+    static_assert(sizeof(QuadConstants) % 16 == 0, "Constant buffers must be a multiple of 16 bytes");
+
+    QuadConstants getQuadConstants(const XrPosef& quadInView,
+                                   const XrExtent2Df& size,
+                                   const XrFovf& fov,
+                                   const XrRect2Di& sourceRect,
+                                   const XrSwapchainCreateInfo& sourceInfo) {
+        QuadConstants constants{};
+        constants.corners = getClipSpaceCorners(quadInView, size, fov);
+
+        const float left = static_cast<float>(sourceRect.offset.x) / sourceInfo.width;
+        const float top = static_cast<float>(sourceRect.offset.y) / sourceInfo.height;
+        const float right = static_cast<float>(sourceRect.offset.x + sourceRect.extent.width) / sourceInfo.width;
+        const float bottom = static_cast<float>(sourceRect.offset.y + sourceRect.extent.height) / sourceInfo.height;
+        constants.texCoords = {{{left, top, 0, 0}, {right, top, 0, 0}, {left, bottom, 0, 0}, {right, bottom, 0, 0}}};
+
+        return constants;
+    }
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+    // The quad is drawn with a triangle strip, and sampled with perspective-correct texture coordinates. The quad is
+    // opaque: its alpha channel is ignored, like the runtime would do.
+    const std::string_view FlatteningShaderSource = R"_(
+cbuffer Quad : register(b0) {
+    float4 corners[4];
+    float4 texCoords[4];
+};
+Texture2DArray<float4> source : register(t0);
+SamplerState sourceSampler : register(s0);
+
+void vsMain(in uint id : SV_VertexID, out float4 position : SV_Position, out float2 texCoord : TEXCOORD0) {
+    position = corners[id];
+    texCoord = texCoords[id].xy;
+}
+
+float4 psMain(in float4 position : SV_Position, in float2 texCoord : TEXCOORD0) : SV_Target {
+    return float4(source.Sample(sourceSampler, float3(texCoord, 0)).rgb, 1);
+}
+)_";
+
+    struct D3D11FlatteningPipeline {
+        D3D11FlatteningPipeline(ID3D11Device* device) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "D3D11FlatteningPipeline_Create");
+
+            const auto compile = [&](const char* entryPoint, const char* target) {
+                ComPtr<ID3DBlob> shaderBytes;
+                ComPtr<ID3DBlob> errMsgs;
+                const HRESULT hr = D3DCompile(FlatteningShaderSource.data(),
+                                              FlatteningShaderSource.size(),
+                                              nullptr,
+                                              nullptr,
+                                              nullptr,
+                                              entryPoint,
+                                              target,
+                                              D3DCOMPILE_OPTIMIZATION_LEVEL3,
+                                              0,
+                                              shaderBytes.ReleaseAndGetAddressOf(),
+                                              errMsgs.ReleaseAndGetAddressOf());
+                if (FAILED(hr)) {
+                    ErrorLog(fmt::format("D3DCompile failed: {}\n",
+                                         errMsgs ? static_cast<const char*>(errMsgs->GetBufferPointer()) : ""));
+                    CHECK_HRESULT(hr, "D3DCompile");
+                }
+                return shaderBytes;
+            };
+
+            const ComPtr<ID3DBlob> vsBytes = compile("vsMain", "vs_5_0");
+            CHECK_HRCMD(device->CreateVertexShader(vsBytes->GetBufferPointer(),
+                                                   vsBytes->GetBufferSize(),
+                                                   nullptr,
+                                                   m_vertexShader.ReleaseAndGetAddressOf()));
+            const ComPtr<ID3DBlob> psBytes = compile("psMain", "ps_5_0");
+            CHECK_HRCMD(device->CreatePixelShader(psBytes->GetBufferPointer(),
+                                                  psBytes->GetBufferSize(),
+                                                  nullptr,
+                                                  m_pixelShader.ReleaseAndGetAddressOf()));
+
+            D3D11_BUFFER_DESC bufferDesc{};
+            bufferDesc.ByteWidth = sizeof(QuadConstants);
+            bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+            bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+            bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+            CHECK_HRCMD(device->CreateBuffer(&bufferDesc, nullptr, m_constantBuffer.ReleaseAndGetAddressOf()));
+
+            D3D11_SAMPLER_DESC samplerDesc{};
+            samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+            samplerDesc.AddressU = samplerDesc.AddressV = samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+            samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+            samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+            CHECK_HRCMD(device->CreateSamplerState(&samplerDesc, m_sampler.ReleaseAndGetAddressOf()));
+
+            // The quad may be seen from behind. The depth clipping removes the parts of the quad behind the eye.
+            D3D11_RASTERIZER_DESC rasterizerDesc{};
+            rasterizerDesc.FillMode = D3D11_FILL_SOLID;
+            rasterizerDesc.CullMode = D3D11_CULL_NONE;
+            rasterizerDesc.DepthClipEnable = TRUE;
+            CHECK_HRCMD(device->CreateRasterizerState(&rasterizerDesc, m_rasterizerState.ReleaseAndGetAddressOf()));
+
+            TraceLoggingWriteStop(local, "D3D11FlatteningPipeline_Create", TLPArg(this, "Pipeline"));
+        }
+
+        void draw(ID3D11DeviceContext* context,
+                  ID3D11ShaderResourceView* source,
+                  ID3D11RenderTargetView* destination,
+                  const XrRect2Di& destinationRect,
+                  const QuadConstants& constants) {
+            D3D11_MAPPED_SUBRESOURCE mapped{};
+            CHECK_HRCMD(context->Map(m_constantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+            memcpy(mapped.pData, &constants, sizeof(constants));
+            context->Unmap(m_constantBuffer.Get(), 0);
+
+            context->ClearState();
+
+            D3D11_VIEWPORT viewport{};
+            viewport.TopLeftX = static_cast<float>(destinationRect.offset.x);
+            viewport.TopLeftY = static_cast<float>(destinationRect.offset.y);
+            viewport.Width = static_cast<float>(destinationRect.extent.width);
+            viewport.Height = static_cast<float>(destinationRect.extent.height);
+            viewport.MaxDepth = 1.f;
+
+            ID3D11Buffer* const constantBuffers[] = {m_constantBuffer.Get()};
+            ID3D11SamplerState* const samplers[] = {m_sampler.Get()};
+            context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+            context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+            context->VSSetConstantBuffers(0, 1, constantBuffers);
+            context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+            context->PSSetShaderResources(0, 1, &source);
+            context->PSSetSamplers(0, 1, samplers);
+            context->RSSetState(m_rasterizerState.Get());
+            context->RSSetViewports(1, &viewport);
+            context->OMSetRenderTargets(1, &destination, nullptr);
+            context->Draw(4, 0);
+
+            // Unbind our resources to avoid D3D debug layer warnings when the textures are used next.
+            ID3D11ShaderResourceView* const nullSRV[] = {nullptr};
+            context->PSSetShaderResources(0, 1, nullSRV);
+            context->OMSetRenderTargets(0, nullptr, nullptr);
+        }
+
+        ComPtr<ID3D11VertexShader> m_vertexShader;
+        ComPtr<ID3D11PixelShader> m_pixelShader;
+        ComPtr<ID3D11Buffer> m_constantBuffer;
+        ComPtr<ID3D11SamplerState> m_sampler;
+        ComPtr<ID3D11RasterizerState> m_rasterizerState;
+    };
+#endif
+
+    struct InterceptedSwapchain {
+        XrSession session{XR_NULL_HANDLE};
+
+        // Created on the composition framework, with the textures exposed to the application.
+        std::shared_ptr<ISwapchain> swapchain;
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        // Views are created upon first use (since the swapchain might be used as a source and/or a destination), and
+        // are indexed by [imageIndex * arraySize + slice].
+        std::vector<ComPtr<ID3D11ShaderResourceView>> shaderResourceViews;
+        std::vector<ComPtr<ID3D11RenderTargetView>> renderTargetViews;
+#endif
+
+        bool hasPendingImage{false};
+    };
+
+    struct FlattenedQuad {
+        const XrCompositionLayerQuad* layer;
+        InterceptedSwapchain* swapchain;
+
+        // The pose of the quad in the space of the projection layer.
+        XrPosef pose;
+    };
+
+    struct FlatteningTarget {
+        const XrCompositionLayerProjection* layer;
+        std::vector<InterceptedSwapchain*> viewSwapchains;
+        std::vector<FlattenedQuad> quads;
+    };
+
+    struct SessionState {
+        bool needVerify{false};
+        QuadFlatteningStatistics statistics;
+    };
+
+    // The shaders are tied to the composition device, and are reused by the next sessions on the same device.
+    struct DeviceState : ICompositionDeviceData {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        std::unique_ptr<D3D11FlatteningPipeline> pipeline;
+#endif
+    };
+
+    bool isEligibleForFlattening(const XrSwapchainCreateInfo& info) {
+        // Static and protected swapchains cannot be written during composition.
+        return !info.createFlags && info.sampleCount == 1 && info.mipCount == 1 && info.faceCount == 1 &&
+               (info.usageFlags & XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT) &&
+               !(info.usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    }
+
+    struct QuadFlatteningFactory : IQuadFlatteningFactory {
+        QuadFlatteningFactory(const XrInstanceCreateInfo& instanceInfo,
+                              XrInstance instance,
+                              PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr_,
+                              std::shared_ptr<ICompositionFrameworkFactory> compositionFrameworkFactory)
+            : m_instance(instance), xrGetInstanceProcAddr(xrGetInstanceProcAddr_),
+              m_compositionFrameworkFactory(compositionFrameworkFactory) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "QuadFlatteningFactory_Create");
+
+            CHECK_XRCMD(xrGetInstanceProcAddr(
+                m_instance, "xrLocateSpace", reinterpret_cast<PFN_xrVoidFunction*>(&xrLocateSpace)));
+
+            // All other function pointers are chained.
+
+            // Only register the factory once nothing else can fail, so that a failed creation leaves no dangling
+            // pointer behind.
+            {
+                std::unique_lock lock(factoryMutex);
+                if (factory) {
+                    throw std::runtime_error("There can only be one QuadFlattening factory");
+                }
+                factory = this;
+            }
+
+            TraceLoggingWriteStop(local, "QuadFlatteningFactory_Create", TLPArg(this, "QuadFlatteningFactory"));
+        }
+
+        ~QuadFlatteningFactory() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "QuadFlatteningFactory_Destroy");
+
+            std::unique_lock lock(factoryMutex);
+
+            factory = nullptr;
+
+            TraceLoggingWriteStop(local, "QuadFlatteningFactory_Destroy");
+        }
+
+        void xrGetInstanceProcAddr_post(XrInstance instance, const char* name, PFN_xrVoidFunction* function) override {
+            const std::string_view functionName(name);
+            if (functionName == "xrDestroySession") {
+                xrDestroySession = reinterpret_cast<PFN_xrDestroySession>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySession);
+            } else if (functionName == "xrCreateSwapchain") {
+                xrCreateSwapchain = reinterpret_cast<PFN_xrCreateSwapchain>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookCreateSwapchain);
+            } else if (functionName == "xrDestroySwapchain") {
+                xrDestroySwapchain = reinterpret_cast<PFN_xrDestroySwapchain>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySwapchain);
+            } else if (functionName == "xrEnumerateSwapchainImages") {
+                xrEnumerateSwapchainImages = reinterpret_cast<PFN_xrEnumerateSwapchainImages>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookEnumerateSwapchainImages);
+            } else if (functionName == "xrAcquireSwapchainImage") {
+                xrAcquireSwapchainImage = reinterpret_cast<PFN_xrAcquireSwapchainImage>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookAcquireSwapchainImage);
+            } else if (functionName == "xrWaitSwapchainImage") {
+                xrWaitSwapchainImage = reinterpret_cast<PFN_xrWaitSwapchainImage>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookWaitSwapchainImage);
+            } else if (functionName == "xrReleaseSwapchainImage") {
+                xrReleaseSwapchainImage = reinterpret_cast<PFN_xrReleaseSwapchainImage>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookReleaseSwapchainImage);
+            } else if (functionName == "xrEndFrame") {
+                xrEndFrame = reinterpret_cast<PFN_xrEndFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookEndFrame);
+            }
+        }
+
+        QuadFlatteningStatistics getStatistics(XrSession session) const override {
+            std::unique_lock lock(m_mutex);
+
+            auto it = m_sessions.find(session);
+            if (it == m_sessions.end()) {
+                return {};
+            }
+
+            return it->second.statistics;
+        }
+
+        XrResult xrDestroySession_subst(XrSession session) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "QuadFlatteningFactory_DestroySession", TLXArg(session, "Session"));
+
+            {
+                std::unique_lock lock(m_mutex);
+
+                // Our swapchains reference the composition framework's devices, so they must be released before the
+                // composition framework is destroyed further down the chain.
+                for (auto it = m_swapchains.begin(); it != m_swapchains.end();) {
+                    if (it->second->session == session) {
+                        it = m_swapchains.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+
+                auto it = m_sessions.find(session);
+                if (it != m_sessions.end()) {
+                    const QuadFlatteningStatistics& statistics = it->second.statistics;
+                    if (statistics.framesCount) {
+                        Log(fmt::format("Quad flattening removed {:.2f} quad layers and {:.2f} MB of composition "
+                                        "reads per frame on average\n",
+                                        static_cast<double>(statistics.flattenedQuadsTotal) / statistics.framesCount,
+                                        statistics.bytesSavedTotal / (1024.0 * 1024.0) / statistics.framesCount));
+                    }
+                    m_sessions.erase(it);
+                }
+            }
+            const XrResult result = xrDestroySession(session);
+
+            TraceLoggingWriteStop(
+                local, "QuadFlatteningFactory_DestroySession", TLArg(xr::ToCString(result), "Result"));
+
+            return result;
+        }
+
+        XrResult xrCreateSwapchain_subst(XrSession session,
+                                         const XrSwapchainCreateInfo* createInfo,
+                                         XrSwapchain* swapchain) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "QuadFlatteningFactory_CreateSwapchain", TLXArg(session, "Session"));
+
+            ICompositionFramework* compositionFramework =
+                m_compositionFrameworkFactory->getCompositionFramework(session);
+
+            XrResult result = XR_ERROR_RUNTIME_FAILURE;
+            bool intercepted = false;
+            if (compositionFramework && createInfo->type == XR_TYPE_SWAPCHAIN_CREATE_INFO &&
+                isEligibleForFlattening(*createInfo)) {
+                try {
+                    auto interceptedSwapchain = std::make_unique<InterceptedSwapchain>();
+                    interceptedSwapchain->session = session;
+
+                    // We do not know yet whether the swapchain will be used for a projection layer (that we draw
+                    // into) or for a quad layer (that we sample from). Reading is needed in both cases to access
+                    // the image last released by the application.
+                    XrSwapchainCreateInfo info = *createInfo;
+                    info.usageFlags |= XR_SWAPCHAIN_USAGE_SAMPLED_BIT;
+                    interceptedSwapchain->swapchain = compositionFramework->createSwapchain(
+                        info, SwapchainMode::Submit | SwapchainMode::Read | SwapchainMode::Write);
+#ifdef XR_USE_GRAPHICS_API_D3D11
+                    const size_t viewsCount =
+                        static_cast<size_t>(interceptedSwapchain->swapchain->getLength()) * info.arraySize;
+                    interceptedSwapchain->shaderResourceViews.resize(viewsCount);
+                    interceptedSwapchain->renderTargetViews.resize(viewsCount);
+#endif
+                    *swapchain = interceptedSwapchain->swapchain->getSwapchainHandle();
+
+                    std::unique_lock lock(m_mutex);
+                    SessionState& state = m_sessions[session];
+                    state.statistics.interceptedSwapchains++;
+#ifdef _DEBUG
+                    state.needVerify = true;
+#endif
+                    m_swapchains.insert_or_assign(*swapchain, std::move(interceptedSwapchain));
+
+                    result = XR_SUCCESS;
+                    intercepted = true;
+                } catch (std::exception& exc) {
+                    TraceLoggingWriteTagged(
+                        local, "QuadFlatteningFactory_CreateSwapchain_Error", TLArg(exc.what(), "Error"));
+                    ErrorLog(fmt::format("Failed to intercept swapchain: {}\n", exc.what()));
+                }
+            }
+
+            if (!intercepted) {
+                result = xrCreateSwapchain(session, createInfo, swapchain);
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "QuadFlatteningFactory_CreateSwapchain",
+                                  TLArg(xr::ToCString(result), "Result"),
+                                  TLXArg(*swapchain, "Swapchain"),
+                                  TLArg(intercepted, "Intercepted"));
+
+            return result;
+        }
+
+        XrResult xrDestroySwapchain_subst(XrSwapchain swapchain) {
+            {
+                std::unique_lock lock(m_mutex);
+
+                auto it = m_swapchains.find(swapchain);
+                if (it != m_swapchains.end()) {
+                    TraceLocalActivity(local);
+                    TraceLoggingWriteStart(
+                        local, "QuadFlatteningFactory_DestroySwapchain", TLXArg(swapchain, "Swapchain"));
+
+                    // The runtime swapchain is destroyed along with its ISwapchain wrapper.
+                    m_swapchains.erase(it);
+
+                    TraceLoggingWriteStop(local, "QuadFlatteningFactory_DestroySwapchain");
+
+                    return XR_SUCCESS;
+                }
+            }
+
+            return xrDestroySwapchain(swapchain);
+        }
+
+        XrResult xrEnumerateSwapchainImages_subst(XrSwapchain swapchain,
+                                                  uint32_t imageCapacityInput,
+                                                  uint32_t* imageCountOutput,
+                                                  XrSwapchainImageBaseHeader* images) {
+            InterceptedSwapchain* interceptedSwapchain = getInterceptedSwapchain(swapchain);
+            if (!interceptedSwapchain) {
+                return xrEnumerateSwapchainImages(swapchain, imageCapacityInput, imageCountOutput, images);
+            }
+
+            // Expose the textures of the runtime swapchain as opened on the application device.
+            ISwapchain* const wrappedSwapchain = interceptedSwapchain->swapchain.get();
+            *imageCountOutput = wrappedSwapchain->getLength();
+            if (imageCapacityInput == 0) {
+                return XR_SUCCESS;
+            }
+            if (imageCapacityInput < *imageCountOutput) {
+                return XR_ERROR_SIZE_INSUFFICIENT;
+            }
+
+            for (uint32_t i = 0; i < *imageCountOutput; i++) {
+                IGraphicsTexture* const texture = wrappedSwapchain->getImage(i)->getApplicationTexture();
+                switch (texture->getApi()) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+                case Api::D3D11: {
+                    XrSwapchainImageD3D11KHR* const d3d11Images = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
+                    if (d3d11Images[i].type != XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR) {
+                        return XR_ERROR_VALIDATION_FAILURE;
+                    }
+                    d3d11Images[i].texture = texture->getNativeTexture<D3D11>();
+                } break;
+#endif
+#ifdef XR_USE_GRAPHICS_API_D3D12
+                case Api::D3D12: {
+                    XrSwapchainImageD3D12KHR* const d3d12Images = reinterpret_cast<XrSwapchainImageD3D12KHR*>(images);
+                    if (d3d12Images[i].type != XR_TYPE_SWAPCHAIN_IMAGE_D3D12_KHR) {
+                        return XR_ERROR_VALIDATION_FAILURE;
+                    }
+                    d3d12Images[i].texture = texture->getNativeTexture<D3D12>();
+                } break;
+#endif
+                default:
+                    return XR_ERROR_RUNTIME_FAILURE;
+                }
+            }
+
+            return XR_SUCCESS;
+        }
+
+        XrResult xrAcquireSwapchainImage_subst(XrSwapchain swapchain,
+                                               const XrSwapchainImageAcquireInfo* acquireInfo,
+                                               uint32_t* index) {
+            InterceptedSwapchain* interceptedSwapchain = getInterceptedSwapchain(swapchain);
+            if (!interceptedSwapchain) {
+                return xrAcquireSwapchainImage(swapchain, acquireInfo, index);
+            }
+
+            const auto image = interceptedSwapchain->swapchain->tryAcquireImage(false /* wait */);
+            if (!image) {
+                ErrorLog(fmt::format("xrAcquireSwapchainImage: {}\n", image.what()));
+                return image.result();
+            }
+            *index = image.value()->getIndex();
+
+            return XR_SUCCESS;
+        }
+
+        XrResult xrWaitSwapchainImage_subst(XrSwapchain swapchain, const XrSwapchainImageWaitInfo* waitInfo) {
+            InterceptedSwapchain* interceptedSwapchain = getInterceptedSwapchain(swapchain);
+            if (!interceptedSwapchain) {
+                return xrWaitSwapchainImage(swapchain, waitInfo);
+            }
+
+            const auto waited = interceptedSwapchain->swapchain->tryWaitImage();
+            if (!waited) {
+                ErrorLog(fmt::format("xrWaitSwapchainImage: {}\n", waited.what()));
+            }
+
+            return waited.result();
+        }
+
+        XrResult xrReleaseSwapchainImage_subst(XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* releaseInfo) {
+            InterceptedSwapchain* interceptedSwapchain = getInterceptedSwapchain(swapchain);
+            if (!interceptedSwapchain) {
+                return xrReleaseSwapchainImage(swapchain, releaseInfo);
+            }
+
+            // The release to the runtime is deferred until xrEndFrame().
+            const auto released = interceptedSwapchain->swapchain->tryReleaseImage();
+            if (!released) {
+                ErrorLog(fmt::format("xrReleaseSwapchainImage: {}\n", released.what()));
+                return released.result();
+            }
+            interceptedSwapchain->hasPendingImage = true;
+
+            return XR_SUCCESS;
+        }
+
+        XrResult xrEndFrame_subst(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "QuadFlatteningFactory_EndFrame", TLXArg(session, "Session"), TLFrameArg());
+
+            ICompositionFramework* compositionFramework =
+                m_compositionFrameworkFactory->getCompositionFramework(session);
+
+            std::vector<const XrCompositionLayerBaseHeader*> layers;
+            if (frameEndInfo->type == XR_TYPE_FRAME_END_INFO) {
+                layers.assign(frameEndInfo->layers, frameEndInfo->layers + frameEndInfo->layerCount);
+            }
+
+            uint32_t flattenedQuads = 0;
+            uint64_t bytesSaved = 0;
+            if (compositionFramework && frameEndInfo->type == XR_TYPE_FRAME_END_INFO) {
+                std::unique_lock lock(m_mutex);
+
+                std::vector<InterceptedSwapchain*> pendingSwapchains;
+                for (auto& [handle, interceptedSwapchain] : m_swapchains) {
+                    if (interceptedSwapchain->session == session && interceptedSwapchain->hasPendingImage) {
+                        pendingSwapchains.push_back(interceptedSwapchain.get());
+                    }
+                }
+
+                if (!pendingSwapchains.empty()) {
+                    SessionState& state = m_sessions[session];
+
+                    try {
+                        flattenedQuads =
+                            flattenLayers(compositionFramework, state, frameEndInfo->displayTime, layers, bytesSaved);
+                    } catch (std::exception& exc) {
+                        TraceLoggingWriteTagged(
+                            local, "QuadFlatteningFactory_EndFrame_Error", TLArg(exc.what(), "Error"));
+                        ErrorLog(fmt::format("Failed to flatten quad layers: {}\n", exc.what()));
+
+                        // Submit all the layers. Quads that were already drawn are covered by their own layer.
+                        layers.assign(frameEndInfo->layers, frameEndInfo->layers + frameEndInfo->layerCount);
+                        flattenedQuads = 0;
+                        bytesSaved = 0;
+                    }
+
+                    // Every swapchain with a newly released image must be released to the runtime before submission,
+                    // regardless of the type of composition layer that references it.
+                    for (InterceptedSwapchain* interceptedSwapchain : pendingSwapchains) {
+                        const auto committed = interceptedSwapchain->swapchain->tryCommitLastReleasedImage();
+                        if (!committed) {
+                            ErrorLog(fmt::format("xrReleaseSwapchainImage: {}\n", committed.what()));
+                        }
+                        interceptedSwapchain->hasPendingImage = false;
+                    }
+
+                    state.statistics.flattenedQuadsLastFrame = flattenedQuads;
+                    state.statistics.flattenedQuadsTotal += flattenedQuads;
+                    state.statistics.bytesSavedLastFrame = bytesSaved;
+                    state.statistics.bytesSavedTotal += bytesSaved;
+                    state.statistics.framesCount++;
+                }
+            }
+
+            XrFrameEndInfo chainFrameEndInfo = *frameEndInfo;
+            if (flattenedQuads) {
+                chainFrameEndInfo.layers = layers.data();
+                chainFrameEndInfo.layerCount = static_cast<uint32_t>(layers.size());
+            }
+            const XrResult result = xrEndFrame(session, &chainFrameEndInfo);
+
+            TraceLoggingWriteStop(local,
+                                  "QuadFlatteningFactory_EndFrame",
+                                  TLArg(xr::ToCString(result), "Result"),
+                                  TLArg(flattenedQuads, "FlattenedQuads"),
+                                  TLArg(bytesSaved, "BytesSaved"));
+
+            return result;
+        }
+
+        // Draw the quads that can be flattened into the projection layers beneath them, and remove them from the list
+        // of layers. Returns the number of quads flattened.
+        uint32_t flattenLayers(ICompositionFramework* compositionFramework,
+                               SessionState& state,
+                               XrTime displayTime,
+                               std::vector<const XrCompositionLayerBaseHeader*>& layers,
+                               uint64_t& bytesSaved) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "QuadFlattening_FlattenLayers", TLArg(displayTime, "DisplayTime"));
+
+            // Only the quads submitted right after a projection layer can be flattened into it, since any other layer
+            // in between would be composited over them.
+            std::vector<FlatteningTarget> targets;
+            std::vector<const XrCompositionLayerBaseHeader*> remainingLayers;
+            bool canFlatten = false;
+            uint32_t flattenedQuads = 0;
+            for (const XrCompositionLayerBaseHeader* layer : layers) {
+                if (layer->type == XR_TYPE_COMPOSITION_LAYER_PROJECTION) {
+                    FlatteningTarget target{reinterpret_cast<const XrCompositionLayerProjection*>(layer)};
+                    canFlatten = getTargetSwapchains(target);
+                    if (canFlatten) {
+                        targets.push_back(std::move(target));
+                    }
+                } else if (canFlatten && layer->type == XR_TYPE_COMPOSITION_LAYER_QUAD) {
+                    FlattenedQuad quad{reinterpret_cast<const XrCompositionLayerQuad*>(layer)};
+                    canFlatten = isFlattenable(targets.back(), displayTime, quad);
+                    if (canFlatten) {
+                        targets.back().quads.push_back(quad);
+                        flattenedQuads++;
+                        continue;
+                    }
+                } else {
+                    canFlatten = false;
+                }
+                remainingLayers.push_back(layer);
+            }
+
+            if (flattenedQuads) {
+                compositionFramework->serializePreComposition();
+
+                // The last released image of each swapchain must only be retrieved once per frame.
+                std::unordered_map<InterceptedSwapchain*, ISwapchainImage*> images;
+                const auto getImage = [&](InterceptedSwapchain* interceptedSwapchain) {
+                    auto it = images.find(interceptedSwapchain);
+                    if (it == images.end()) {
+                        it = images
+                                 .insert_or_assign(interceptedSwapchain,
+                                                   interceptedSwapchain->swapchain->getLastReleasedImage())
+                                 .first;
+                    }
+                    return it->second;
+                };
+
+                for (const FlatteningTarget& target : targets) {
+                    const uint32_t viewCount = target.layer->viewCount;
+                    for (uint32_t i = 0; i < viewCount; i++) {
+                        const XrCompositionLayerProjectionView& view = target.layer->views[i];
+                        InterceptedSwapchain* const destination = target.viewSwapchains[i];
+                        const XrPosef viewInverse = xr::math::Pose::Invert(view.pose);
+
+                        for (const FlattenedQuad& quad : target.quads) {
+                            if (!isVisibleInView(quad.layer->eyeVisibility, i, viewCount)) {
+                                continue;
+                            }
+
+                            drawQuad(compositionFramework,
+                                     state,
+                                     *quad.swapchain,
+                                     getImage(quad.swapchain),
+                                     quad.layer->subImage,
+                                     *destination,
+                                     getImage(destination),
+                                     view.subImage,
+                                     xr::math::Pose::Multiply(quad.pose, viewInverse),
+                                     quad.layer->size,
+                                     view.fov);
+
+                            const XrExtent2Di& extent = quad.layer->subImage.imageRect.extent;
+                            bytesSaved += static_cast<uint64_t>(extent.width) * extent.height *
+                                          image::getBytesPerPixel(static_cast<DXGI_FORMAT>(
+                                              quad.swapchain->swapchain->getInfoOnCompositionDevice().format));
+                        }
+                    }
+                }
+
+                compositionFramework->serializePostComposition();
+
+                layers = std::move(remainingLayers);
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "QuadFlattening_FlattenLayers",
+                                  TLArg(static_cast<uint32_t>(targets.size()), "Targets"),
+                                  TLArg(flattenedQuads, "FlattenedQuads"));
+
+            return flattenedQuads;
+        }
+
+        // A projection layer can be drawn into when all its views use an image that was released during this frame.
+        bool getTargetSwapchains(FlatteningTarget& target) {
+            for (uint32_t i = 0; i < target.layer->viewCount; i++) {
+                const XrSwapchainSubImage& subImage = target.layer->views[i].subImage;
+                auto it = m_swapchains.find(subImage.swapchain);
+                if (it == m_swapchains.end() || !it->second->hasPendingImage ||
+                    subImage.imageArrayIndex >= it->second->swapchain->getInfoOnCompositionDevice().arraySize) {
+                    return false;
+                }
+                target.viewSwapchains.push_back(it->second.get());
+            }
+            return target.layer->viewCount > 0;
+        }
+
+        bool isFlattenable(const FlatteningTarget& target, XrTime displayTime, FlattenedQuad& quad) {
+            const XrCompositionLayerQuad* const layer = quad.layer;
+            const bool isOpaque = !(layer->layerFlags & XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT) &&
+                                  !layer->next;
+            if (!isOpaque) {
+                return false;
+            }
+
+            auto it = m_swapchains.find(layer->subImage.swapchain);
+            if (it == m_swapchains.end() || !it->second->hasPendingImage ||
+                layer->subImage.imageArrayIndex >= it->second->swapchain->getInfoOnCompositionDevice().arraySize ||
+                std::find(target.viewSwapchains.cbegin(), target.viewSwapchains.cend(), it->second.get()) !=
+                    target.viewSwapchains.cend()) {
+                return false;
+            }
+            quad.swapchain = it->second.get();
+
+            quad.pose = layer->pose;
+            if (layer->space != target.layer->space) {
+                XrSpaceLocation location{XR_TYPE_SPACE_LOCATION};
+                const XrSpaceLocationFlags valid =
+                    XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_POSITION_VALID_BIT;
+                if (XR_FAILED(xrLocateSpace(layer->space, target.layer->space, displayTime, &location)) ||
+                    (location.locationFlags & valid) != valid) {
+                    return false;
+                }
+                quad.pose = xr::math::Pose::Multiply(layer->pose, location.pose);
+            }
+
+            return true;
+        }
+
+        void drawQuad(ICompositionFramework* compositionFramework,
+                      SessionState& state,
+                      InterceptedSwapchain& source,
+                      ISwapchainImage* sourceImage,
+                      const XrSwapchainSubImage& sourceSubImage,
+                      InterceptedSwapchain& destination,
+                      ISwapchainImage* destinationImage,
+                      const XrSwapchainSubImage& destinationSubImage,
+                      const XrPosef& quadInView,
+                      const XrExtent2Df& size,
+                      const XrFovf& fov) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "QuadFlattening_DrawQuad",
+                                   TLPArg(sourceImage, "Source"),
+                                   TLPArg(destinationImage, "Destination"),
+                                   TLFrameArg());
+
+            const QuadConstants constants = getQuadConstants(quadInView,
+                                                             size,
+                                                             fov,
+                                                             sourceSubImage.imageRect,
+                                                             source.swapchain->getInfoOnCompositionDevice());
+
+            IGraphicsDevice* const compositionDevice = compositionFramework->getCompositionDevice();
+            switch (compositionDevice->getApi()) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            case Api::D3D11: {
+                ID3D11Device* const device = compositionDevice->getNativeDevice<D3D11>();
+                if (!compositionFramework->getDeviceDataPtr()) {
+                    compositionFramework->setDeviceData(std::make_unique<DeviceState>());
+                }
+                DeviceState* const deviceState = compositionFramework->getDeviceData<DeviceState>();
+                if (!deviceState->pipeline) {
+                    deviceState->pipeline = std::make_unique<D3D11FlatteningPipeline>(device);
+                }
+
+                ID3D11ShaderResourceView* const shaderResourceView =
+                    getShaderResourceView(device, source, sourceImage->getIndex(), sourceSubImage.imageArrayIndex);
+                ID3D11RenderTargetView* const renderTargetView = getRenderTargetView(
+                    device, destination, destinationImage->getIndex(), destinationSubImage.imageArrayIndex);
+                const auto draw = [&] {
+                    deviceState->pipeline->draw(compositionDevice->getNativeContext<D3D11>(),
+                                                shaderResourceView,
+                                                renderTargetView,
+                                                destinationSubImage.imageRect,
+                                                constants);
+                };
+
+                if (state.needVerify) {
+                    verifyDraw(compositionDevice,
+                               draw,
+                               sourceImage->getTextureForRead(),
+                               sourceSubImage,
+                               destinationImage->getTextureForWrite(),
+                               destinationSubImage,
+                               quadInView,
+                               size,
+                               fov);
+                    state.needVerify = false;
+                } else {
+                    draw();
+                }
+            } break;
+#endif
+            default:
+                throw std::runtime_error("Composition graphics API is not supported");
+            }
+
+            TraceLoggingWriteStop(local, "QuadFlattening_DrawQuad");
+        }
+
+#ifdef XR_USE_GRAPHICS_API_D3D11
+        ID3D11ShaderResourceView* getShaderResourceView(ID3D11Device* device,
+                                                        InterceptedSwapchain& interceptedSwapchain,
+                                                        uint32_t imageIndex,
+                                                        uint32_t slice) {
+            const XrSwapchainCreateInfo& info = interceptedSwapchain.swapchain->getInfoOnCompositionDevice();
+            ComPtr<ID3D11ShaderResourceView>& view =
+                interceptedSwapchain.shaderResourceViews[imageIndex * info.arraySize + slice];
+            if (!view) {
+                // The runtime may have created typeless textures, so the view must be explicitly typed.
+                D3D11_SHADER_RESOURCE_VIEW_DESC desc{};
+                desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+                desc.Format = static_cast<DXGI_FORMAT>(info.format);
+                desc.Texture2DArray.MipLevels = 1;
+                desc.Texture2DArray.FirstArraySlice = slice;
+                desc.Texture2DArray.ArraySize = 1;
+                CHECK_HRCMD(device->CreateShaderResourceView(interceptedSwapchain.swapchain->getImage(imageIndex)
+                                                                 ->getTextureForRead()
+                                                                 ->getNativeTexture<D3D11>(),
+                                                             &desc,
+                                                             view.ReleaseAndGetAddressOf()));
+            }
+            return view.Get();
+        }
+
+        ID3D11RenderTargetView* getRenderTargetView(ID3D11Device* device,
+                                                    InterceptedSwapchain& interceptedSwapchain,
+                                                    uint32_t imageIndex,
+                                                    uint32_t slice) {
+            const XrSwapchainCreateInfo& info = interceptedSwapchain.swapchain->getInfoOnCompositionDevice();
+            ComPtr<ID3D11RenderTargetView>& view =
+                interceptedSwapchain.renderTargetViews[imageIndex * info.arraySize + slice];
+            if (!view) {
+                D3D11_RENDER_TARGET_VIEW_DESC desc{};
+                desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+                desc.Format = static_cast<DXGI_FORMAT>(info.format);
+                desc.Texture2DArray.FirstArraySlice = slice;
+                desc.Texture2DArray.ArraySize = 1;
+                CHECK_HRCMD(device->CreateRenderTargetView(interceptedSwapchain.swapchain->getImage(imageIndex)
+                                                               ->getTextureForWrite()
+                                                               ->getNativeTexture<D3D11>(),
+                                                           &desc,
+                                                           view.ReleaseAndGetAddressOf()));
+            }
+            return view.Get();
+        }
+
+        // Compare the output of the flattening pass against the CPU reference rasterization. This is a blocking
+        // readback, only meant for validation in Debug builds.
+        void verifyDraw(IGraphicsDevice* compositionDevice,
+                        const std::function<void()>& draw,
+                        IGraphicsTexture* source,
+                        const XrSwapchainSubImage& sourceSubImage,
+                        IGraphicsTexture* destination,
+                        const XrSwapchainSubImage& destinationSubImage,
+                        const XrPosef& quadInView,
+                        const XrExtent2Df& size,
+                        const XrFovf& fov) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "QuadFlattening_Verify");
+
+            const DXGI_FORMAT sourceFormat = static_cast<DXGI_FORMAT>(source->getInfo().format);
+            const DXGI_FORMAT destinationFormat = static_cast<DXGI_FORMAT>(destination->getInfo().format);
+            if (!image::isFormatSupported(sourceFormat) || !image::isFormatSupported(destinationFormat)) {
+                draw();
+                TraceLoggingWriteStop(local, "QuadFlattening_Verify", TLArg(false, "Supported"));
+                return;
+            }
+
+            ID3D11Device* const device = compositionDevice->getNativeDevice<D3D11>();
+            ID3D11DeviceContext* const context = compositionDevice->getNativeContext<D3D11>();
+
+            const auto readback = [&](IGraphicsTexture* texture, uint32_t slice) {
+                D3D11_TEXTURE2D_DESC desc{};
+                desc.Width = texture->getInfo().width;
+                desc.Height = texture->getInfo().height;
+                desc.ArraySize = desc.MipLevels = desc.SampleDesc.Count = 1;
+                desc.Format = static_cast<DXGI_FORMAT>(texture->getInfo().format);
+                desc.Usage = D3D11_USAGE_STAGING;
+                desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ | D3D11_CPU_ACCESS_WRITE;
+
+                ComPtr<ID3D11Texture2D> staging;
+                CHECK_HRCMD(device->CreateTexture2D(&desc, nullptr, staging.ReleaseAndGetAddressOf()));
+                context->CopySubresourceRegion(
+                    staging.Get(), 0, 0, 0, 0, texture->getNativeTexture<D3D11>(), slice, nullptr);
+                return staging;
+            };
+
+            // The reference is drawn over a copy of the destination taken before the flattening pass.
+            const ComPtr<ID3D11Texture2D> expectedStaging = readback(destination, destinationSubImage.imageArrayIndex);
+            draw();
+            const ComPtr<ID3D11Texture2D> actualStaging = readback(destination, destinationSubImage.imageArrayIndex);
+            const ComPtr<ID3D11Texture2D> sourceStaging = readback(source, sourceSubImage.imageArrayIndex);
+
+            D3D11_MAPPED_SUBRESOURCE expectedMapped{};
+            CHECK_HRCMD(context->Map(expectedStaging.Get(), 0, D3D11_MAP_READ_WRITE, 0, &expectedMapped));
+            D3D11_MAPPED_SUBRESOURCE actualMapped{};
+            CHECK_HRCMD(context->Map(actualStaging.Get(), 0, D3D11_MAP_READ, 0, &actualMapped));
+            D3D11_MAPPED_SUBRESOURCE sourceMapped{};
+            CHECK_HRCMD(context->Map(sourceStaging.Get(), 0, D3D11_MAP_READ, 0, &sourceMapped));
+
+            const image::Image sourceImage{static_cast<uint8_t*>(sourceMapped.pData),
+                                           sourceMapped.RowPitch,
+                                           source->getInfo().width,
+                                           source->getInfo().height,
+                                           sourceFormat};
+            const image::Image expectedImage{static_cast<uint8_t*>(expectedMapped.pData),
+                                             expectedMapped.RowPitch,
+                                             destination->getInfo().width,
+                                             destination->getInfo().height,
+                                             destinationFormat};
+            std::vector<uint8_t> edgeMask;
+            rasterizeQuadReference(sourceImage,
+                                   sourceSubImage.imageRect,
+                                   quadInView,
+                                   size,
+                                   fov,
+                                   expectedImage,
+                                   destinationSubImage.imageRect,
+                                   &edgeMask);
+
+            // The GPU filters with a reduced precision, and may round differently than the CPU.
+            const XrRect2Di& rect = destinationSubImage.imageRect;
+            const uint32_t bytesPerPixel = image::getBytesPerPixel(destinationFormat);
+            std::vector<XrColor4f> expected(rect.extent.width);
+            std::vector<XrColor4f> actual(rect.extent.width);
+            uint64_t mismatches = 0;
+            for (int32_t y = 0; y < rect.extent.height; y++) {
+                const size_t offset = static_cast<size_t>(rect.offset.x) * bytesPerPixel;
+                image::convertPixels(destinationFormat,
+                                     static_cast<const uint8_t*>(expectedMapped.pData) +
+                                         (rect.offset.y + y) * expectedMapped.RowPitch + offset,
+                                     DXGI_FORMAT_R32G32B32A32_FLOAT,
+                                     expected.data(),
+                                     rect.extent.width);
+                image::convertPixels(destinationFormat,
+                                     static_cast<const uint8_t*>(actualMapped.pData) +
+                                         (rect.offset.y + y) * actualMapped.RowPitch + offset,
+                                     DXGI_FORMAT_R32G32B32A32_FLOAT,
+                                     actual.data(),
+                                     rect.extent.width);
+                for (int32_t x = 0; x < rect.extent.width; x++) {
+                    if (edgeMask[static_cast<size_t>(y) * rect.extent.width + x]) {
+                        continue;
+                    }
+                    const auto isClose = [](float e, float a) {
+                        return std::abs(e - a) <= 0.02f + 0.02f * std::abs(e);
+                    };
+                    if (!isClose(expected[x].r, actual[x].r) || !isClose(expected[x].g, actual[x].g) ||
+                        !isClose(expected[x].b, actual[x].b)) {
+                        mismatches++;
+                    }
+                }
+            }
+
+            context->Unmap(sourceStaging.Get(), 0);
+            context->Unmap(actualStaging.Get(), 0);
+            context->Unmap(expectedStaging.Get(), 0);
+
+            TraceLoggingWriteStop(local, "QuadFlattening_Verify", TLArg(mismatches, "Mismatches"));
+            if (mismatches) {
+                ErrorLog(fmt::format("Flattened quad mismatches the reference rasterization for {} pixels\n",
+                                     mismatches));
+            }
+        }
+#endif
+
+        InterceptedSwapchain* getInterceptedSwapchain(XrSwapchain swapchain) {
+            std::unique_lock lock(m_mutex);
+
+            auto it = m_swapchains.find(swapchain);
+            if (it == m_swapchains.end()) {
+                return nullptr;
+            }
+
+            return it->second.get();
+        }
+
+        const XrInstance m_instance;
+        const PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr;
+        const std::shared_ptr<ICompositionFrameworkFactory> m_compositionFrameworkFactory;
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<XrSwapchain, std::unique_ptr<InterceptedSwapchain>> m_swapchains;
+        std::unordered_map<XrSession, SessionState> m_sessions;
+
+        PFN_xrLocateSpace xrLocateSpace{nullptr};
+        PFN_xrDestroySession xrDestroySession{nullptr};
+        PFN_xrCreateSwapchain xrCreateSwapchain{nullptr};
+        PFN_xrDestroySwapchain xrDestroySwapchain{nullptr};
+        PFN_xrEnumerateSwapchainImages xrEnumerateSwapchainImages{nullptr};
+        PFN_xrAcquireSwapchainImage xrAcquireSwapchainImage{nullptr};
+        PFN_xrWaitSwapchainImage xrWaitSwapchainImage{nullptr};
+        PFN_xrReleaseSwapchainImage xrReleaseSwapchainImage{nullptr};
+        PFN_xrEndFrame xrEndFrame{nullptr};
+
+        static inline std::mutex factoryMutex;
+        static inline QuadFlatteningFactory* factory{nullptr};
+
+        static XrResult XRAPI_CALL hookDestroySession(XrSession session) {
+            return factory->xrDestroySession_subst(session);
+        }
+
+        static XrResult XRAPI_CALL hookCreateSwapchain(XrSession session,
+                                                       const XrSwapchainCreateInfo* createInfo,
+                                                       XrSwapchain* swapchain) {
+            return factory->xrCreateSwapchain_subst(session, createInfo, swapchain);
+        }
+
+        static XrResult XRAPI_CALL hookDestroySwapchain(XrSwapchain swapchain) {
+            return factory->xrDestroySwapchain_subst(swapchain);
+        }
+
+        static XrResult XRAPI_CALL hookEnumerateSwapchainImages(XrSwapchain swapchain,
+                                                                uint32_t imageCapacityInput,
+                                                                uint32_t* imageCountOutput,
+                                                                XrSwapchainImageBaseHeader* images) {
+            return factory->xrEnumerateSwapchainImages_subst(swapchain, imageCapacityInput, imageCountOutput, images);
+        }
+
+        static XrResult XRAPI_CALL hookAcquireSwapchainImage(XrSwapchain swapchain,
+                                                             const XrSwapchainImageAcquireInfo* acquireInfo,
+                                                             uint32_t* index) {
+            return factory->xrAcquireSwapchainImage_subst(swapchain, acquireInfo, index);
+        }
+
+        static XrResult XRAPI_CALL hookWaitSwapchainImage(XrSwapchain swapchain,
+                                                          const XrSwapchainImageWaitInfo* waitInfo) {
+            return factory->xrWaitSwapchainImage_subst(swapchain, waitInfo);
+        }
+
+        static XrResult XRAPI_CALL hookReleaseSwapchainImage(XrSwapchain swapchain,
+                                                             const XrSwapchainImageReleaseInfo* releaseInfo) {
+            return factory->xrReleaseSwapchainImage_subst(swapchain, releaseInfo);
+        }
+
+        static XrResult XRAPI_CALL hookEndFrame(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            return factory->xrEndFrame_subst(session, frameEndInfo);
+        }
+    };
+
+} // namespace
+
+#endif
+
+namespace openxr_api_layer::utils::graphics {
+
+#if defined(XR_USE_GRAPHICS_API_D3D11) || defined(XR_USE_GRAPHICS_API_D3D12)
+    std::shared_ptr<IQuadFlatteningFactory>
+    createQuadFlatteningFactory(const XrInstanceCreateInfo& instanceInfo,
+                                XrInstance instance,
+                                PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                std::shared_ptr<ICompositionFrameworkFactory> compositionFrameworkFactory) {
+        return std::make_shared<QuadFlatteningFactory>(
+            instanceInfo, instance, xrGetInstanceProcAddr, compositionFrameworkFactory);
+    }
+#endif
+
+} // namespace openxr_api_layer::utils::graphics
@@ -26,6 +26,7 @@
 
 namespace {
 
+    using namespace openxr_api_layer::log;
     using namespace openxr_api_layer::utils;
     using namespace DirectX;
 
@@ -35,6 +36,7 @@ namespace {
       public:
         void start() override {
             m_timeStart = clock::now();
+            m_frameId = openxr_api_layer::frame::GetCurrentFrameId();
         }
 
         void stop() override {
@@ -47,9 +49,83 @@ namespace {
             return duration.count();
         }
 
+        uint64_t getFrameId() const override {
+            return m_frameId;
+        }
+
       private:
         clock::time_point m_timeStart;
         mutable clock::duration m_duration{0};
+        uint64_t m_frameId{0};
+    };
+
+    class WorkerPool : public general::IWorkerPool {
+      public:
+        WorkerPool(uint32_t threadCount) {
+            for (uint32_t i = 0; i < threadCount; i++) {
+                m_threads.emplace_back([this, i] {
+                    SetThreadDescription(GetCurrentThread(), fmt::format(L"Layer Worker {}", i).c_str());
+                    general::ScopedLayerThread layerThread;
+                    workerThread();
+                });
+            }
+        }
+
+        ~WorkerPool() override {
+            {
+                std::unique_lock lock(m_mutex);
+                m_exiting = true;
+            }
+            m_wakeUp.notify_all();
+            for (auto& thread : m_threads) {
+                thread.join();
+            }
+        }
+
+        void submit(std::function<void()> task) override {
+            {
+                std::unique_lock lock(m_mutex);
+                // Tasks run on behalf of the frame of the submitting thread.
+                m_tasks.push_back({std::move(task), openxr_api_layer::frame::GetCurrentFrameId()});
+            }
+            m_wakeUp.notify_one();
+        }
+
+        uint32_t getThreadCount() const override {
+            return static_cast<uint32_t>(m_threads.size());
+        }
+
+      private:
+        struct Task {
+            std::function<void()> run;
+            uint64_t frameId;
+        };
+
+        void workerThread() {
+            while (true) {
+                Task task;
+                {
+                    std::unique_lock lock(m_mutex);
+                    m_wakeUp.wait(lock, [&] { return m_exiting || !m_tasks.empty(); });
+
+                    // Drain all the tasks before exiting.
+                    if (m_tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                }
+                openxr_api_layer::frame::ScopedFrameId frame(task.frameId);
+                task.run();
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::deque<Task> m_tasks;
+        bool m_exiting{false};
     };
 
     // Taken from
@@ -84,6 +160,91 @@ namespace {
         return hit;
     }
 
+    // The corners of a quad, in clockwise order.
+    void getQuadVertices(const XrPosef& quadCenter, const XrExtent2Df& quadSize, DirectX::XMVECTOR (&vertices)[4]) {
+        using namespace DirectX;
+
+        const float halfWidth = quadSize.width / 2.0f;
+        const float halfHeight = quadSize.height / 2.0f;
+        const auto matrix = xr::math::LoadXrPose(quadCenter);
+        vertices[0] = XMVector4Transform(XMVectorSet(-halfWidth, -halfHeight, 0, 1), matrix);
+        vertices[1] = XMVector4Transform(XMVectorSet(-halfWidth, halfHeight, 0, 1), matrix);
+        vertices[2] = XMVector4Transform(XMVectorSet(halfWidth, halfHeight, 0, 1), matrix);
+        vertices[3] = XMVector4Transform(XMVectorSet(halfWidth, -halfHeight, 0, 1), matrix);
+    }
+
+    // Rotate a vector by a unit quaternion: v' = v + w * t + q.xyz x t, with t = 2 * q.xyz x v.
+    XrVector3f rotate(const XrQuaternionf& rotation, const XrVector3f& vector) {
+        const XrVector3f axis{rotation.x, rotation.y, rotation.z};
+        const XrVector3f t = 2.f * xr::math::Cross(axis, vector);
+        return vector + rotation.w * t + xr::math::Cross(axis, t);
+    }
+
+    // The 4 sides and the near plane of a view frustum, located in the base space of the view. A point p is on the
+    // inside of a plane when Dot(normal, p) + distance >= 0.
+    struct Frustum {
+        XrVector3f normals[5];
+        float distances[5];
+    };
+
+    Frustum getFrustum(const XrView& view, float fovMargin) {
+        const float angles[4] = {view.fov.angleLeft - fovMargin,
+                                 view.fov.angleRight + fovMargin,
+                                 view.fov.angleDown - fovMargin,
+                                 view.fov.angleUp + fovMargin};
+
+        // The normals in view space (looking down -Z) point towards the inside of the frustum. The near plane goes
+        // through the eye, to only reject what is behind the user.
+        XrVector3f normals[5] = {
+            {1, 0, std::tan(angles[0])},
+            {-1, 0, -std::tan(angles[1])},
+            {0, 1, std::tan(angles[2])},
+            {0, -1, -std::tan(angles[3])},
+            {0, 0, -1},
+        };
+
+        // A side at (or close to) 90 degrees does not bound the view, and its tangent is not usable. Its plane is given
+        // a null normal, which every point is on the inside of, so that the test remains conservative.
+        for (uint32_t i = 0; i < 4; i++) {
+            if (std::abs(angles[i]) >= 1.55f) {
+                normals[i] = {};
+            }
+        }
+
+        Frustum frustum;
+        for (uint32_t i = 0; i < 5; i++) {
+            frustum.normals[i] = rotate(view.pose.orientation, normals[i]);
+            frustum.distances[i] = -xr::math::Dot(frustum.normals[i], view.pose.position);
+        }
+        return frustum;
+    }
+
+    uint32_t getQuadViewMask(const Frustum* frustums,
+                             uint32_t viewCount,
+                             const XrPosef& quadCenter,
+                             const XrExtent2Df& quadSize) {
+        using namespace xr::math;
+
+        const XrVector3f halfRight = rotate(quadCenter.orientation, {quadSize.width / 2.f, 0, 0});
+        const XrVector3f halfUp = rotate(quadCenter.orientation, {0, quadSize.height / 2.f, 0});
+
+        uint32_t viewMask = 0;
+        for (uint32_t i = 0; i < viewCount; i++) {
+            bool isInside = true;
+            for (uint32_t j = 0; j < 5 && isInside; j++) {
+                // The quad is outside if its farthest corner along the normal is still outside of the plane.
+                const XrVector3f& normal = frustums[i].normals[j];
+                const float distance = Dot(normal, quadCenter.position) + frustums[i].distances[j] +
+                                       std::abs(Dot(normal, halfRight)) + std::abs(Dot(normal, halfUp));
+                isInside = distance >= 0.f;
+            }
+            if (isInside) {
+                viewMask |= 1u << i;
+            }
+        }
+        return viewMask;
+    }
+
 } // namespace
 
 namespace openxr_api_layer::utils::general {
@@ -92,24 +253,21 @@ namespace openxr_api_layer::utils::general {
         return std::make_shared<CpuTimer>();
     }
 
+    std::shared_ptr<IWorkerPool> createWorkerPool(uint32_t threadCount) {
+        if (!threadCount) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return std::make_shared<WorkerPool>(threadCount);
+    }
+
     bool hitTest(const XrPosef& ray, const XrPosef& quadCenter, const XrExtent2Df& quadSize, XrPosef& hitPose) {
         using namespace DirectX;
 
         // Taken from
         // https://github.com/microsoft/OpenXR-MixedReality/blob/main/samples/SceneUnderstandingUwp/Scene_Placement.cpp
 
-        // Clockwise order
-        const float halfWidth = quadSize.width / 2.0f;
-        const float halfHeight = quadSize.height / 2.0f;
-        auto v0 = XMVectorSet(-halfWidth, -halfHeight, 0, 1);
-        auto v1 = XMVectorSet(-halfWidth, halfHeight, 0, 1);
-        auto v2 = XMVectorSet(halfWidth, halfHeight, 0, 1);
-        auto v3 = XMVectorSet(halfWidth, -halfHeight, 0, 1);
-        const auto matrix = xr::math::LoadXrPose(quadCenter);
-        v0 = XMVector4Transform(v0, matrix);
-        v1 = XMVector4Transform(v1, matrix);
-        v2 = XMVector4Transform(v2, matrix);
-        v3 = XMVector4Transform(v3, matrix);
+        XMVECTOR v[4];
+        getQuadVertices(quadCenter, quadSize, v);
 
         XMVECTOR rayPosition = xr::math::LoadXrVector3(ray.position);
 
@@ -118,7 +276,42 @@ namespace openxr_api_layer::utils::general {
         XMVECTOR rayDirection = XMVector3Rotate(forward, rotation);
 
         float distance = 0.0f;
-        return rayIntersectQuad(rayPosition, rayDirection, v0, v1, v2, v3, &hitPose, distance);
+        return rayIntersectQuad(rayPosition, rayDirection, v[0], v[1], v[2], v[3], &hitPose, distance);
+    }
+
+    int32_t hitTestQuads(const XrPosef& ray,
+                         const XrPosef* quadCenters,
+                         const XrExtent2Df* quadSizes,
+                         uint32_t quadCount,
+                         XrPosef& hitPose) {
+        using namespace DirectX;
+
+        // The ray is transformed once, and the hit pose is only computed for the nearest quad.
+        const XMVECTOR rayPosition = xr::math::LoadXrVector3(ray.position);
+        const XMVECTOR rayDirection =
+            XMVector3Rotate(XMVectorSet(0, 0, -1, 0), xr::math::LoadXrQuaternion(ray.orientation));
+
+        int32_t nearestQuad = -1;
+        float nearestDistance = std::numeric_limits<float>::infinity();
+        for (uint32_t i = 0; i < quadCount; i++) {
+            XMVECTOR v[4];
+            getQuadVertices(quadCenters[i], quadSizes[i], v);
+
+            float distance = 0.0f;
+            if (rayIntersectQuad(rayPosition, rayDirection, v[0], v[1], v[2], v[3], nullptr, distance) &&
+                distance < nearestDistance) {
+                nearestQuad = static_cast<int32_t>(i);
+                nearestDistance = distance;
+            }
+        }
+
+        if (nearestQuad >= 0) {
+            XMVECTOR v[4];
+            getQuadVertices(quadCenters[nearestQuad], quadSizes[nearestQuad], v);
+            rayIntersectQuad(rayPosition, rayDirection, v[0], v[1], v[2], v[3], &hitPose, nearestDistance);
+        }
+
+        return nearestQuad;
     }
 
     // https://gamedev.stackexchange.com/questions/136652/uv-world-mapping-in-shader-with-unity/136720#136720
@@ -142,4 +335,132 @@ namespace openxr_api_layer::utils::general {
         };
     }
 
+    uint32_t getQuadViewMask(const XrView* views,
+                             uint32_t viewCount,
+                             const XrPosef& quadCenter,
+                             const XrExtent2Df& quadSize,
+                             float fovMargin) {
+        Frustum frustums[32];
+        for (uint32_t i = 0; i < viewCount; i++) {
+            frustums[i] = getFrustum(views[i], fovMargin);
+        }
+        return ::getQuadViewMask(frustums, viewCount, quadCenter, quadSize);
+    }
+
+    void getQuadViewMasks(const XrView* views,
+                          uint32_t viewCount,
+                          const XrPosef* quadCenters,
+                          const XrExtent2Df* quadSizes,
+                          uint32_t quadCount,
+                          uint32_t* viewMasks,
+                          float fovMargin) {
+        Frustum frustums[32];
+        for (uint32_t i = 0; i < viewCount; i++) {
+            frustums[i] = getFrustum(views[i], fovMargin);
+        }
+
+        uint32_t i = 0;
+        for (; i + 4 <= quadCount; i += 4) {
+            const XrPosef* const p = quadCenters + i;
+            const XrExtent2Df* const s = quadSizes + i;
+
+            // Transpose the 4 quads, one per lane.
+            const auto transpose = [](const auto& get) { return XMVectorSet(get(0), get(1), get(2), get(3)); };
+            const XMVECTOR qx = transpose([&](uint32_t j) { return p[j].orientation.x; });
+            const XMVECTOR qy = transpose([&](uint32_t j) { return p[j].orientation.y; });
+            const XMVECTOR qz = transpose([&](uint32_t j) { return p[j].orientation.z; });
+            const XMVECTOR qw = transpose([&](uint32_t j) { return p[j].orientation.w; });
+            const XMVECTOR cx = transpose([&](uint32_t j) { return p[j].position.x; });
+            const XMVECTOR cy = transpose([&](uint32_t j) { return p[j].position.y; });
+            const XMVECTOR cz = transpose([&](uint32_t j) { return p[j].position.z; });
+            const XMVECTOR halfWidth = transpose([&](uint32_t j) { return s[j].width / 2.f; });
+            const XMVECTOR halfHeight = transpose([&](uint32_t j) { return s[j].height / 2.f; });
+
+            // The first two columns of the rotation matrices, scaled to the half-extents of the quads.
+            const XMVECTOR one = XMVectorSplatOne();
+            const XMVECTOR two = XMVectorAdd(one, one);
+            const XMVECTOR xx = XMVectorMultiply(qx, qx);
+            const XMVECTOR yy = XMVectorMultiply(qy, qy);
+            const XMVECTOR zz = XMVectorMultiply(qz, qz);
+            const XMVECTOR xy = XMVectorMultiply(qx, qy);
+            const XMVECTOR xz = XMVectorMultiply(qx, qz);
+            const XMVECTOR yz = XMVectorMultiply(qy, qz);
+            const XMVECTOR wx = XMVectorMultiply(qw, qx);
+            const XMVECTOR wy = XMVectorMultiply(qw, qy);
+            const XMVECTOR wz = XMVectorMultiply(qw, qz);
+            const XMVECTOR rightX =
+                XMVectorMultiply(halfWidth, XMVectorNegativeMultiplySubtract(two, XMVectorAdd(yy, zz), one));
+            const XMVECTOR rightY = XMVectorMultiply(halfWidth, XMVectorMultiply(two, XMVectorAdd(xy, wz)));
+            const XMVECTOR rightZ = XMVectorMultiply(halfWidth, XMVectorMultiply(two, XMVectorSubtract(xz, wy)));
+            const XMVECTOR upX = XMVectorMultiply(halfHeight, XMVectorMultiply(two, XMVectorSubtract(xy, wz)));
+            const XMVECTOR upY =
+                XMVectorMultiply(halfHeight, XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, zz), one));
+            const XMVECTOR upZ = XMVectorMultiply(halfHeight, XMVectorMultiply(two, XMVectorAdd(yz, wx)));
+
+            uint32_t masks[4] = {};
+            for (uint32_t j = 0; j < viewCount; j++) {
+                XMVECTOR isOutside = XMVectorFalseInt();
+                for (uint32_t k = 0; k < 5; k++) {
+                    const XrVector3f& normal = frustums[j].normals[k];
+                    const XMVECTOR nx = XMVectorReplicate(normal.x);
+                    const XMVECTOR ny = XMVectorReplicate(normal.y);
+                    const XMVECTOR nz = XMVectorReplicate(normal.z);
+
+                    XMVECTOR distance = XMVectorReplicate(frustums[j].distances[k]);
+                    distance = XMVectorMultiplyAdd(nx, cx, distance);
+                    distance = XMVectorMultiplyAdd(ny, cy, distance);
+                    distance = XMVectorMultiplyAdd(nz, cz, distance);
+                    const XMVECTOR alongRight =
+                        XMVectorMultiplyAdd(nz, rightZ, XMVectorMultiplyAdd(ny, rightY, XMVectorMultiply(nx, rightX)));
+                    const XMVECTOR alongUp =
+                        XMVectorMultiplyAdd(nz, upZ, XMVectorMultiplyAdd(ny, upY, XMVectorMultiply(nx, upX)));
+                    distance = XMVectorAdd(distance, XMVectorAdd(XMVectorAbs(alongRight), XMVectorAbs(alongUp)));
+
+                    isOutside = XMVectorOrInt(isOutside, XMVectorLess(distance, XMVectorZero()));
+                }
+
+                uint32_t outside[4];
+                XMStoreInt4(outside, isOutside);
+                for (uint32_t lane = 0; lane < 4; lane++) {
+                    if (!outside[lane]) {
+                        masks[lane] |= 1u << j;
+                    }
+                }
+            }
+            std::copy_n(masks, 4, viewMasks + i);
+        }
+
+        // Remainder.
+        for (; i < quadCount; i++) {
+            viewMasks[i] = ::getQuadViewMask(frustums, viewCount, quadCenters[i], quadSizes[i]);
+        }
+    }
+
+    bool projectQuad(const XrView& view,
+                     const XrPosef& quadCenter,
+                     const XrExtent2Df& quadSize,
+                     std::array<XrVector2f, 4>& corners) {
+        using namespace xr::math;
+
+        const XrPosef quadInView = Pose::Multiply(quadCenter, Pose::Invert(view.pose));
+        const XrVector3f halfRight = rotate(quadInView.orientation, {quadSize.width / 2.f, 0, 0});
+        const XrVector3f halfUp = rotate(quadInView.orientation, {0, quadSize.height / 2.f, 0});
+
+        // Clockwise order, as seen from the front of the quad.
+        const XrVector3f points[4] = {
+            quadInView.position - halfRight - halfUp,
+            quadInView.position - halfRight + halfUp,
+            quadInView.position + halfRight + halfUp,
+            quadInView.position + halfRight - halfUp,
+        };
+        for (uint32_t i = 0; i < 4; i++) {
+            // Keep a small distance to the eye to avoid the projection blowing up.
+            if (points[i].z > -0.001f) {
+                return false;
+            }
+            corners[i] = {points[i].x / -points[i].z, points[i].y / -points[i].z};
+        }
+        return true;
+    }
+
 } // namespace openxr_api_layer::utils::general
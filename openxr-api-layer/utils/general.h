@@ -43,10 +43,25 @@ namespace openxr_api_layer::utils::general {
         virtual void stop() = 0;
 
         virtual uint64_t query() const = 0;
+
+        // The frame during which the last measurement was started.
+        virtual uint64_t getFrameId() const = 0;
     };
 
     std::shared_ptr<ITimer> createTimer();
 
+    // A pool of worker threads, executing tasks in submission order.
+    struct IWorkerPool {
+        virtual ~IWorkerPool() = default;
+
+        virtual void submit(std::function<void()> task) = 0;
+
+        virtual uint32_t getThreadCount() const = 0;
+    };
+
+    // A threadCount of 0 uses one thread per logical processor.
+    std::shared_ptr<IWorkerPool> createWorkerPool(uint32_t threadCount = 0);
+
     static inline bool startsWith(const std::string& str, const std::string& substr) {
         return str.find(substr) == 0;
     }
@@ -59,6 +74,13 @@ namespace openxr_api_layer::utils::general {
     // Both ray and quadCenter poses must be located using the same base space.
     bool hitTest(const XrPosef& ray, const XrPosef& quadCenter, const XrExtent2Df& quadSize, XrPosef& hitPose);
 
+    // Batch version of hitTest(). Returns the index of the nearest quad hit by the ray (with its hitPose), or -1.
+    int32_t hitTestQuads(const XrPosef& ray,
+                         const XrPosef* quadCenters,
+                         const XrExtent2Df* quadSizes,
+                         uint32_t quadCount,
+                         XrPosef& hitPose);
+
     // Get UV coordinates for a point on quad.
     XrVector2f getUVCoordinates(const XrVector3f& point, const XrPosef& quadCenter, const XrExtent2Df& quadSize);
     static inline POINT getUVCoordinates(const XrVector3f& point,
@@ -69,4 +91,140 @@ namespace openxr_api_layer::utils::general {
         return {static_cast<LONG>(uv.x * quadPixelSize.width), static_cast<LONG>(uv.y * quadPixelSize.height)};
     }
 
+    // Get the mask of the views (bit i for views[i]) in which a quad may be visible. The test is conservative, and each
+    // field of view is widened by fovMargin (in radians) on all sides. The views and quadCenter poses must be located
+    // using the same base space. viewCount must not exceed 32.
+    uint32_t getQuadViewMask(const XrView* views,
+                             uint32_t viewCount,
+                             const XrPosef& quadCenter,
+                             const XrExtent2Df& quadSize,
+                             float fovMargin = 0.f);
+
+    // Batch version of getQuadViewMask(), testing 4 quads at a time with SIMD.
+    void getQuadViewMasks(const XrView* views,
+                          uint32_t viewCount,
+                          const XrPosef* quadCenters,
+                          const XrExtent2Df* quadSizes,
+                          uint32_t quadCount,
+                          uint32_t* viewMasks,
+                          float fovMargin = 0.f);
+
+    // Project the corners of a quad onto the plane at distance 1 in front of the view, where the tangents of the field
+    // of view angles are measured. Returns false if any corner is not in front of the view.
+    bool projectQuad(const XrView& view,
+                     const XrPosef& quadCenter,
+                     const XrExtent2Df& quadSize,
+                     std::array<XrVector2f, 4>& corners);
+
+    struct ClockServiceStatistics {
+        uint64_t sampleCount;
+        uint64_t failedSampleCount;
+        // The rate of the runtime clock relative to the performance counter, in parts per million.
+        double driftPpm;
+        XrDuration errorBound;
+    };
+
+    // Converts between XrTime and the performance counter (QPC) without calling the runtime. The runtime's mapping is
+    // sampled periodically on a background thread, and fitted with a linear model (offset and drift). The conversions
+    // are lock-free.
+    struct IClockService {
+        virtual ~IClockService() = default;
+
+        virtual XrTime toXrTime(int64_t performanceCounter) const = 0;
+        virtual int64_t toPerformanceCounter(XrTime time) const = 0;
+        virtual XrTime getCurrentTime() const = 0;
+
+        // The conversions are expected to be within this many nanoseconds of the runtime's.
+        virtual XrDuration getErrorBound() const = 0;
+
+        virtual ClockServiceStatistics getStatistics() const = 0;
+    };
+
+    // Requires XR_KHR_win32_convert_performance_counter_time on the instance (requested by the application, or via
+    // implicitExtensions).
+    std::shared_ptr<IClockService> createClockService(XrInstance instance,
+                                                      PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr);
+
+    // The threads of the layer register themselves for their lifetime, so that they can be kept away from the cores
+    // running the application's frame threads (see createSchedulingManager()).
+    struct ScopedLayerThread {
+        ScopedLayerThread();
+        ~ScopedLayerThread();
+
+        ScopedLayerThread(const ScopedLayerThread&) = delete;
+        ScopedLayerThread& operator=(const ScopedLayerThread&) = delete;
+    };
+
+    // The platform services used to place and prioritize threads. Only the first 64 logical processors (the first
+    // processor group on Windows) are managed.
+    struct IThreadScheduler {
+        static constexpr uint32_t NoCore = ~0u;
+
+        virtual ~IThreadScheduler() = default;
+
+        virtual uint32_t getCurrentThreadId() const = 0;
+        virtual uint32_t getCurrentProcessor() const = 0;
+
+        // The physical core of each logical processor (SMT siblings share a core), or NoCore for the logical
+        // processors that are unavailable to the process.
+        virtual std::vector<uint32_t> getProcessorCores() const = 0;
+
+        // These only affect the calling thread.
+        virtual bool raiseCurrentThreadPriority() = 0;
+        virtual void restoreCurrentThreadPriority() = 0;
+        virtual void setCurrentThreadIdealProcessor(uint32_t processor) = 0;
+
+        virtual bool setThreadAffinity(uint32_t threadId, uint64_t processorMask) = 0;
+
+        // The number of times each thread was switched in, or 0 if the thread could not be found.
+        virtual std::vector<uint64_t> getContextSwitchCounts(const std::vector<uint32_t>& threadIds) = 0;
+    };
+
+    // Uses MMCSS for the priority of the threads.
+    std::shared_ptr<IThreadScheduler> createThreadScheduler();
+
+    struct SchedulingSettings {
+        // Register the frame threads with the MMCSS "Games" task.
+        bool raiseFrameThreadPriority{true};
+
+        // Keep the layer threads off the physical cores where the frame threads were detected.
+        bool isolateFrameThreadCores{true};
+    };
+
+    struct SchedulingStatistics {
+        // The threads calling xrWaitFrame() and xrEndFrame(), or 0 until they are detected.
+        uint32_t waitFrameThreadId;
+        uint32_t endFrameThreadId;
+        bool isPriorityRaised;
+
+        // The logical processors that the layer threads are restricted to, or 0 when they are not restricted.
+        uint64_t layerThreadsAffinityMask;
+
+        // The frames submitted by the detected frame thread, and the frames during which a frame thread ran on a
+        // different logical processor than during the previous frame.
+        uint64_t frameCount;
+        uint64_t migrations;
+
+        // The context switches of the frame threads. They include the voluntary waits (eg: in xrWaitFrame()), and are
+        // an upper bound of the preemptions.
+        uint64_t contextSwitches;
+    };
+
+    // A factory to manage the scheduling of the application's frame threads: the threads calling xrWaitFrame() and
+    // xrEndFrame() are detected after a number of consecutive frames, their priority is raised and the layer threads
+    // are kept off their cores. Their migrations and context switches are reported.
+    struct ISchedulingManager {
+        virtual ~ISchedulingManager() = default;
+
+        virtual void xrGetInstanceProcAddr_post(XrInstance instance,
+                                                const char* name,
+                                                PFN_xrVoidFunction* function) = 0;
+
+        virtual SchedulingStatistics getStatistics() const = 0;
+    };
+
+    // A null scheduler uses createThreadScheduler().
+    std::shared_ptr<ISchedulingManager> createSchedulingManager(const SchedulingSettings& settings = {},
+                                                                std::shared_ptr<IThreadScheduler> scheduler = nullptr);
+
 } // namespace openxr_api_layer::utils::general
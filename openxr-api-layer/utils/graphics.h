@@ -23,6 +23,7 @@
 #pragma once
 
 #include "general.h"
+#include "image.h"
 
 namespace openxr_api_layer::utils::graphics {
 
@@ -33,6 +34,7 @@ namespace openxr_api_layer::utils::graphics {
 #ifdef XR_USE_GRAPHICS_API_D3D12
         D3D12,
 #endif
+        CPU,
     };
     enum class CompositionApi {
 #ifdef XR_USE_GRAPHICS_API_D3D11
@@ -64,6 +66,17 @@ namespace openxr_api_layer::utils::graphics {
     };
 #endif
 
+    struct ICpuCommandContext;
+
+    struct CPU {
+        static constexpr Api Api = Api::CPU;
+
+        using Device = ICpuCommandContext*;
+        using Context = ICpuCommandContext*;
+        using Texture = uint8_t*;
+        using Fence = const std::atomic<uint64_t>*;
+    };
+
     // We (arbitrarily) use DXGI as a common conversion point for all graphics APIs.
     using GenericFormat = DXGI_FORMAT;
 
@@ -93,6 +106,9 @@ namespace openxr_api_layer::utils::graphics {
         virtual void waitOnDevice(uint64_t value) = 0;
         virtual void waitOnCpu(uint64_t value) = 0;
 
+        // Non-blocking, and may be called from any thread.
+        virtual uint64_t getCompletedValue() const = 0;
+
         virtual bool isShareable() const = 0;
 
         template <typename ApiTraits>
@@ -175,6 +191,36 @@ namespace openxr_api_layer::utils::graphics {
         }
     };
 
+    // The commands of the CPU device. Each command is split into bands of rows (tiles) that are executed concurrently
+    // on the worker pool of the device. Tiles only wait for the completion of previous tiles touching the same rows of
+    // the same textures, and fences are only signaled once all the tiles submitted before them have completed.
+    struct ICpuCommandContext {
+        virtual ~ICpuCommandContext() = default;
+
+        virtual void blit(IGraphicsTexture* from,
+                          const XrRect2Di& sourceRect,
+                          IGraphicsTexture* to,
+                          const XrOffset2Di& destinationOffset = {},
+                          uint32_t slice = 0) = 0;
+        virtual void scale(IGraphicsTexture* from,
+                           IGraphicsTexture* to,
+                           image::Filter filter = image::Filter::Bilinear,
+                           uint32_t slice = 0) = 0;
+        virtual void blendPremultiplied(IGraphicsTexture* from,
+                                        IGraphicsTexture* to,
+                                        const XrOffset2Di& destinationOffset = {},
+                                        uint32_t slice = 0) = 0;
+
+        // Wait for all the commands submitted so far to complete.
+        virtual void flush() = 0;
+    };
+
+    // Create a device executing on the CPU. Textures are stored in system memory, and must use one of the formats
+    // supported by the image kernels. A null workerPool creates a pool with one thread per logical processor.
+    // Shareable handles are only valid within the process.
+    std::shared_ptr<IGraphicsDevice> createCpuDevice(std::shared_ptr<general::IWorkerPool> workerPool = nullptr,
+                                                     size_t tileBytes = 256 * 1024);
+
     // Modes of use of wrapped swapchains.
     enum class SwapchainMode {
         // The swapchain must be submittable to the upstream xrEndFrame() implementation.
@@ -198,12 +244,29 @@ namespace openxr_api_layer::utils::graphics {
         virtual ~ISwapchain() = default;
 
         // Only for manipulating swapchains created through createSwapchain().
-        virtual ISwapchainImage* acquireImage(bool wait = true) = 0;
-        virtual void waitImage() = 0;
-        virtual void releaseImage() = 0;
+        // The try*() methods do not throw, and should be preferred in the per-frame paths.
+        virtual XrExpected<ISwapchainImage*> tryAcquireImage(bool wait = true) = 0;
+        virtual XrExpected<void> tryWaitImage() = 0;
+        virtual XrExpected<void> tryReleaseImage() = 0;
+
+        ISwapchainImage* acquireImage(bool wait = true) {
+            auto image = tryAcquireImage(wait);
+            CHECK_XREXPECTED(image);
+            return image.value();
+        }
+        void waitImage() {
+            CHECK_XREXPECTED(tryWaitImage());
+        }
+        void releaseImage() {
+            CHECK_XREXPECTED(tryReleaseImage());
+        }
 
         virtual ISwapchainImage* getLastReleasedImage() const = 0;
-        virtual void commitLastReleasedImage() = 0;
+        virtual XrExpected<void> tryCommitLastReleasedImage() = 0;
+
+        void commitLastReleasedImage() {
+            CHECK_XREXPECTED(tryCommitLastReleasedImage());
+        }
 
         virtual const XrSwapchainCreateInfo& getInfoOnCompositionDevice() const = 0;
         virtual int64_t getFormatOnApplicationDevice() const = 0;
@@ -226,6 +289,121 @@ namespace openxr_api_layer::utils::graphics {
         virtual uint32_t getIndex() const = 0;
     };
 
+    // The priority of an overlay when the refresh rate must be reduced.
+    enum class OverlayPriority {
+        // Throttled first, down to a quarter of the target rate.
+        Low = 0,
+
+        // Throttled once all the low-priority overlays are at a quarter of their target rate.
+        Normal,
+
+        // Never throttled.
+        High,
+    };
+
+    struct OverlayRefreshStatistics {
+        std::string name;
+        OverlayPriority priority;
+        float targetRate;
+
+        // Measured over the recent refreshes.
+        float effectiveRate;
+
+        // The overlay refreshes at its target rate divided by this value.
+        uint32_t rateDivider;
+
+        uint64_t refreshCount;
+        uint64_t resubmitCount;
+    };
+
+    // Schedule the refresh of overlays at their target rate, and reduce the rate of the lower priority overlays when
+    // the GPU time approaches the frame budget. The scheduler does not access the graphics device, and can be driven
+    // with synthetic timings.
+    struct IOverlayRefreshScheduler {
+        virtual ~IOverlayRefreshScheduler() = default;
+
+        // The target rate is in Hz.
+        virtual uint32_t registerOverlay(const std::string& name, float targetRate, OverlayPriority priority) = 0;
+        virtual void unregisterOverlay(uint32_t overlay) = 0;
+
+        // Report the GPU time of a past frame and the frame budget (eg: the predicted display period), in
+        // microseconds.
+        virtual void submitFrameTiming(uint64_t gpuTimeUs, uint64_t budgetUs) = 0;
+
+        // Start scheduling the frame with the given display time.
+        virtual void beginFrame(XrTime displayTime) = 0;
+
+        // Whether the overlay must be rendered for the current frame. Otherwise, the last committed image of the
+        // overlay must be submitted again. An overlay that is not registered is always rendered.
+        virtual bool shouldRefresh(uint32_t overlay) const = 0;
+
+        virtual std::vector<OverlayRefreshStatistics> getStatistics() const = 0;
+    };
+
+    struct OverlayRefreshSchedulerOptions {
+        // The ratio of GPU time to frame budget above which overlays are throttled further.
+        float highLoad{0.9f};
+
+        // The ratio of GPU time to frame budget below which overlays are restored.
+        float lowLoad{0.75f};
+
+        // The number of consecutive frames that the load must stay above or below the thresholds before changing the
+        // rates, to avoid oscillating.
+        uint32_t hysteresisFrames{30};
+
+        // The weight of a new GPU time sample in the smoothed load.
+        float smoothing{0.1f};
+    };
+
+    std::shared_ptr<IOverlayRefreshScheduler>
+    createOverlayRefreshScheduler(const OverlayRefreshSchedulerOptions& options = {});
+
+    struct QuadLayerCullingStatistics {
+        uint64_t framesCount{0};
+        uint32_t quadLayersLastFrame{0};
+
+        // Quad layers outside of the field of view of all the views they are visible in.
+        uint32_t frustumCulledLastFrame{0};
+        uint64_t frustumCulledTotal{0};
+
+        // Quad layers hidden behind opaque quad layers submitted after them.
+        uint32_t occlusionCulledLastFrame{0};
+        uint64_t occlusionCulledTotal{0};
+
+        // Overlays whose rendering was skipped following IQuadLayerCuller::isQuadVisible().
+        uint32_t skippedOverlaysLastFrame{0};
+        uint64_t skippedOverlaysTotal{0};
+    };
+
+    // Remove the quad layers that cannot be visible from a frame submission. The views are located for the display
+    // time of the frame, in the space of each quad. Only quad layers are culled, and only opaque quad layers (without
+    // XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT nor extension structures) occlude other quad layers.
+    struct IQuadLayerCuller {
+        virtual ~IQuadLayerCuller() = default;
+
+        // Whether a quad may be visible at the given display time. Meant to skip the rendering of an overlay before
+        // submitting its quad layer.
+        virtual bool isQuadVisible(XrTime displayTime,
+                                   XrSpace space,
+                                   const XrPosef& pose,
+                                   const XrExtent2Df& size,
+                                   XrEyeVisibility eyeVisibility = XR_EYE_VISIBILITY_BOTH) = 0;
+
+        // Must be called in the layer's xrEndFrame() implementation, with the layers about to be submitted. Culled
+        // layers are removed from the list.
+        virtual void cullLayers(XrTime displayTime, std::vector<const XrCompositionLayerBaseHeader*>& layers) = 0;
+
+        virtual QuadLayerCullingStatistics getStatistics() const = 0;
+    };
+
+    // The fovMargin (in radians) widens each field of view on all sides, to keep the quads that may become visible
+    // through reprojection of the frame.
+    std::shared_ptr<IQuadLayerCuller> createQuadLayerCuller(XrInstance instance,
+                                                            PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                                            XrSession session,
+                                                            XrViewConfigurationType viewConfigurationType,
+                                                            float fovMargin = 0.1f);
+
     // A container for user session data.
     // This class is meant to be extended by a caller before use with ICompositionFramework::setSessionData() and
     // ICompositionFramework::getSessionData().
@@ -233,6 +411,15 @@ namespace openxr_api_layer::utils::graphics {
         virtual ~ICompositionSessionData() = default;
     };
 
+    // A container for user data tied to the composition device, such as shader pipelines. The device (with its data) is
+    // kept warm for a while after the session is destroyed, and reused by the next session on the same adapter and
+    // application device.
+    // This class is meant to be extended by a caller before use with ICompositionFramework::setDeviceData() and
+    // ICompositionFramework::getDeviceData().
+    struct ICompositionDeviceData {
+        virtual ~ICompositionDeviceData() = default;
+    };
+
     // A collection of hooks and utilities to perform composition in the layer.
     struct ICompositionFramework {
         virtual ~ICompositionFramework() = default;
@@ -242,6 +429,9 @@ namespace openxr_api_layer::utils::graphics {
         virtual void setSessionData(std::unique_ptr<ICompositionSessionData> sessionData) = 0;
         virtual ICompositionSessionData* getSessionDataPtr() const = 0;
 
+        virtual void setDeviceData(std::unique_ptr<ICompositionDeviceData> deviceData) = 0;
+        virtual ICompositionDeviceData* getDeviceDataPtr() const = 0;
+
         // Create a swapchain without an XrSwapchain handle.
         virtual std::shared_ptr<ISwapchain> createSwapchain(const XrSwapchainCreateInfo& infoOnApplicationDevice,
                                                             SwapchainMode mode) = 0;
@@ -259,10 +449,49 @@ namespace openxr_api_layer::utils::graphics {
         virtual int64_t getPreferredSwapchainFormatOnApplicationDevice(XrSwapchainUsageFlags usageFlags,
                                                                        bool preferSRGB = true) const = 0;
 
+        // The scheduler is advanced in xrBeginFrame(), and receives the GPU time of the application and of the
+        // composition (measured between serializePreComposition() and serializePostComposition()).
+        virtual IOverlayRefreshScheduler* getOverlayRefreshScheduler() const = 0;
+
         template <typename SessionData>
         typename SessionData* getSessionData() const {
             return reinterpret_cast<SessionData*>(getSessionDataPtr());
         }
+
+        template <typename DeviceData>
+        typename DeviceData* getDeviceData() const {
+            return reinterpret_cast<DeviceData*>(getDeviceDataPtr());
+        }
+    };
+
+    // Statistics for the deferred destruction of the swapchains and composition frameworks. Their resources are retired
+    // upon destruction, and only released once the GPU work using them has completed.
+    struct DeferredDestructionStatistics {
+        uint32_t retiredCount{0};
+        uint32_t reclaimedCount{0};
+
+        // The time spent tearing down on the application thread.
+        uint64_t teardownMicrosecondsTotal{0};
+        uint64_t teardownMicrosecondsMax{0};
+
+        // The time until the resources could be released, which the application thread used to wait for.
+        uint64_t deferredMicrosecondsTotal{0};
+        uint64_t deferredMicrosecondsMax{0};
+    };
+
+    // Statistics for the creation of the composition frameworks. A warm creation reuses the devices of a previous
+    // session, while a cold creation creates them. The devices are initialized in the background after
+    // xrCreateSession() returns: the blocked time is how long the application waited for them, and the hidden time is
+    // the rest of the initialization. The composition device might also be created ahead of the session (prewarmed),
+    // as soon as the application queries the graphics requirements.
+    struct SessionCreationStatistics {
+        uint32_t coldCount{0};
+        uint32_t warmCount{0};
+        uint64_t coldMicrosecondsTotal{0};
+        uint64_t warmMicrosecondsTotal{0};
+        uint64_t blockedMicrosecondsTotal{0};
+        uint64_t hiddenMicrosecondsTotal{0};
+        uint32_t prewarmedCount{0};
     };
 
     // A factory to create composition frameworks for each session.
@@ -274,7 +503,12 @@ namespace openxr_api_layer::utils::graphics {
                                                 const char* name,
                                                 PFN_xrVoidFunction* function) = 0;
 
+        // Returns nullptr if the session is not handled, or if the initialization of its framework failed. Waits for
+        // that initialization to complete on first use.
         virtual ICompositionFramework* getCompositionFramework(XrSession session) = 0;
+
+        virtual DeferredDestructionStatistics getDeferredDestructionStatistics() const = 0;
+        virtual SessionCreationStatistics getSessionCreationStatistics() const = 0;
     };
 
     std::shared_ptr<ICompositionFrameworkFactory>
@@ -283,6 +517,129 @@ namespace openxr_api_layer::utils::graphics {
                                       PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
                                       CompositionApi compositionApi);
 
+    struct QuadLodOptions {
+        // The number of resolution tiers, each tier halving the resolution of the previous one.
+        uint32_t tierCount{3};
+
+        // The ratio of swapchain pixels to display pixels to target.
+        float oversampling{1.f};
+
+        // A lower tier is selected only when the required resolution is below this ratio of its resolution.
+        float downscaleMargin{0.8f};
+
+        // The number of consecutive frames that a lower tier must be sufficient before selecting it, to avoid
+        // oscillating. Higher tiers are selected immediately.
+        uint32_t hysteresisFrames{30};
+    };
+
+    struct QuadLodStatistics {
+        std::string name;
+        uint32_t tier;
+        XrExtent2Di resolution;
+
+        // The resolution matching the pixel density of the display, during the last tier selection.
+        XrExtent2Di requiredResolution;
+
+        uint64_t tierChanges;
+    };
+
+    // Select the resolution of the quad layers of overlays based on their size on the display. Each overlay has
+    // pre-allocated swapchains for all its resolution tiers, so that rendering and composition costs follow the
+    // on-screen size.
+    struct IQuadLodManager {
+        virtual ~IQuadLodManager() = default;
+
+        // The create info describes the full resolution (tier 0) swapchain.
+        virtual uint32_t registerOverlay(const std::string& name,
+                                         const XrSwapchainCreateInfo& infoOnApplicationDevice,
+                                         SwapchainMode mode) = 0;
+        virtual void unregisterOverlay(uint32_t overlay) = 0;
+
+        // Select the swapchain for the overlay's quad in the current frame. The views and the pose of the quad must be
+        // located using the same base space. When the swapchain differs from the previous frame, the overlay must be
+        // rendered again.
+        virtual ISwapchain* selectTier(uint32_t overlay,
+                                       const XrView* views,
+                                       uint32_t viewCount,
+                                       const XrPosef& pose,
+                                       const XrExtent2Df& size) = 0;
+
+        virtual std::vector<QuadLodStatistics> getStatistics() const = 0;
+    };
+
+    // The recommended image size is the one returned by xrEnumerateViewConfigurationViews() for the views.
+    std::shared_ptr<IQuadLodManager> createQuadLodManager(ICompositionFramework* compositionFramework,
+                                                          const XrExtent2Di& recommendedImageSize,
+                                                          const QuadLodOptions& options = {});
+
+    // Statistics for the swapchain format demotion of a session.
+    struct FormatDemotionStatistics {
+        uint32_t demotedSwapchains{0};
+        uint64_t framesCount{0};
+        uint64_t bytesSavedLastFrame{0};
+        uint64_t bytesSavedTotal{0};
+    };
+
+    // A factory to demote the application's R16G16B16A16_FLOAT swapchains to a cheaper format for submission.
+    // The application renders into private textures in its requested format, and the content is converted into a
+    // runtime swapchain with the demoted format during xrEndFrame().
+    struct IFormatDemotionFactory {
+        virtual ~IFormatDemotionFactory() = default;
+
+        // Must be called after chaining to the upstream xrGetInstanceProcAddr() implementation, and after
+        // ICompositionFrameworkFactory::xrGetInstanceProcAddr_post().
+        virtual void xrGetInstanceProcAddr_post(XrInstance instance,
+                                                const char* name,
+                                                PFN_xrVoidFunction* function) = 0;
+
+        virtual FormatDemotionStatistics getStatistics(XrSession session) const = 0;
+    };
+
+    // Supported target formats are DXGI_FORMAT_R11G11B10_FLOAT and DXGI_FORMAT_R8G8B8A8_UNORM_SRGB.
+    std::shared_ptr<IFormatDemotionFactory>
+    createFormatDemotionFactory(const XrInstanceCreateInfo& info,
+                                XrInstance instance,
+                                PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                std::shared_ptr<ICompositionFrameworkFactory> compositionFrameworkFactory,
+                                GenericFormat targetFormat);
+
+    // Statistics for the quad layer flattening of a session.
+    struct QuadFlatteningStatistics {
+        uint32_t interceptedSwapchains{0};
+        uint64_t framesCount{0};
+        uint32_t flattenedQuadsLastFrame{0};
+        uint64_t flattenedQuadsTotal{0};
+
+        // The bytes of quad images that the runtime compositor no longer reads, summed over the views.
+        uint64_t bytesSavedLastFrame{0};
+        uint64_t bytesSavedTotal{0};
+    };
+
+    // A factory to draw the application's opaque quad layers directly into the images of the projection layer beneath
+    // them, and remove them from the frame submission. The application's color swapchains are created with
+    // SwapchainMode::Write through the composition framework, so their last released images can be modified during
+    // xrEndFrame(). Only opaque quad layers (without XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT nor extension
+    // structures) submitted right after a projection layer are flattened, which preserves the composition order.
+    // There is no depth test, so this is only suitable for world-locked overlays that are always in front of the
+    // application's content.
+    struct IQuadFlatteningFactory {
+        virtual ~IQuadFlatteningFactory() = default;
+
+        // Must be called after chaining to the upstream xrGetInstanceProcAddr() implementation, and after
+        // ICompositionFrameworkFactory::xrGetInstanceProcAddr_post().
+        virtual void xrGetInstanceProcAddr_post(XrInstance instance,
+                                                const char* name,
+                                                PFN_xrVoidFunction* function) = 0;
+
+        virtual QuadFlatteningStatistics getStatistics(XrSession session) const = 0;
+    };
+
+    std::shared_ptr<IQuadFlatteningFactory>
+    createQuadFlatteningFactory(const XrInstanceCreateInfo& info,
+                                XrInstance instance,
+                                PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                std::shared_ptr<ICompositionFrameworkFactory> compositionFrameworkFactory);
+
     namespace internal {
 
 #ifdef XR_USE_GRAPHICS_API_D3D11
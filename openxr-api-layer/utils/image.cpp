@@ -0,0 +1,1268 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "general.h"
+#include "image.h"
+#include "log.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define IMAGE_KERNELS_X86
+#include <intrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define IMAGE_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace xr {
+
+    using namespace openxr_api_layer::utils::image;
+
+    static inline std::string ToString(Isa isa) {
+        switch (isa) {
+        case Isa::Scalar:
+            return "Scalar";
+        case Isa::SSE4:
+            return "SSE4";
+        case Isa::AVX2:
+            return "AVX2";
+        case Isa::NEON:
+            return "NEON";
+        };
+
+        return "";
+    }
+
+} // namespace xr
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::image;
+    using namespace DirectX;
+    using namespace DirectX::PackedVector;
+
+    // The formats handled by the kernels. The order must match the kernel tables below.
+    enum Format : int {
+        RGBA8 = 0,
+        RGBA8_SRGB,
+        BGRA8,
+        BGRA8_SRGB,
+        RGBA16F,
+        R11G11B10F,
+        RGBA32F,
+        FormatCount,
+    };
+
+    const DXGI_FORMAT DxgiFormats[FormatCount] = {
+        DXGI_FORMAT_R8G8B8A8_UNORM,
+        DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+        DXGI_FORMAT_B8G8R8A8_UNORM,
+        DXGI_FORMAT_B8G8R8A8_UNORM_SRGB,
+        DXGI_FORMAT_R16G16B16A16_FLOAT,
+        DXGI_FORMAT_R11G11B10_FLOAT,
+        DXGI_FORMAT_R32G32B32A32_FLOAT,
+    };
+    const uint32_t FormatSizes[FormatCount] = {4, 4, 4, 4, 8, 4, 16};
+    const char* const FormatNames[FormatCount] = {
+        "RGBA8", "RGBA8_SRGB", "BGRA8", "BGRA8_SRGB", "RGBA16F", "R11G11B10F", "RGBA32F"};
+
+    int getFormatIndex(DXGI_FORMAT format) {
+        for (int i = 0; i < FormatCount; i++) {
+            if (DxgiFormats[i] == format) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Decode pixels into linear RGBA floats, or encode linear RGBA floats into pixels.
+    using DecodeKernel = void (*)(const uint8_t* source, float* destination, size_t count);
+    using EncodeKernel = void (*)(const float* source, uint8_t* destination, size_t count);
+
+    // Premultiplied-alpha "over" operator, either on linear RGBA floats or on 8-bit UNORM pixels.
+    using BlendKernel = void (*)(const float* source, float* destination, size_t count);
+    using BlendUnorm8Kernel = void (*)(const uint8_t* source, uint8_t* destination, size_t count);
+
+    struct Kernels {
+        DecodeKernel decode[FormatCount];
+        EncodeKernel encode[FormatCount];
+        BlendKernel blend;
+        BlendUnorm8Kernel blendUnorm8;
+    };
+
+    // Number of pixels converted at once when pivoting through linear RGBA floats. The intermediate buffer fits in L1.
+    constexpr size_t ChunkSize = 256;
+
+    inline float decodeSrgb(float value) {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    inline float encodeSrgb(float value) {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    }
+
+    struct LookupTables {
+        LookupTables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                srgbToLinear[i] = decodeSrgb(i / 255.f);
+            }
+            for (uint32_t i = 0; i < 4096; i++) {
+                linearToSrgb[i] = static_cast<uint32_t>(encodeSrgb(i / 4095.f) * 255.f + 0.5f);
+            }
+        }
+
+        alignas(64) float srgbToLinear[256];
+
+        // Indexed by the linear value quantized to 12 bits, which is within 1 LSB of the exact 8-bit encoding. Stored
+        // as 32-bit values to allow gathers.
+        alignas(64) uint32_t linearToSrgb[4096];
+    };
+
+    const LookupTables Tables;
+
+    inline uint32_t load32(const uint8_t* source) {
+        uint32_t value;
+        std::memcpy(&value, source, sizeof(value));
+        return value;
+    }
+
+    inline void store32(uint8_t* destination, uint32_t value) {
+        std::memcpy(destination, &value, sizeof(value));
+    }
+
+    // Rounded division by 255, exact for the product of two 8-bit values.
+    inline uint32_t div255(uint32_t value) {
+        const uint32_t t = value + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    // The reference implementation.
+    namespace scalar {
+
+        // Also maps NaN to 0.
+        inline float saturate(float value) {
+            return value > 0.f ? (value < 1.f ? value : 1.f) : 0.f;
+        }
+
+        inline uint8_t toUnorm8(float value) {
+            return static_cast<uint8_t>(saturate(value) * 255.f + 0.5f);
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void decodeRGBA8(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                for (uint32_t c = 0; c < 3; c++) {
+                    const uint8_t value = source[IsBGRA ? 2 - c : c];
+                    destination[c] = IsSRGB ? Tables.srgbToLinear[value] : value / 255.f;
+                }
+                destination[3] = source[3] / 255.f;
+            }
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void encodeRGBA8(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                for (uint32_t c = 0; c < 3; c++) {
+                    const float value = IsSRGB ? encodeSrgb(saturate(source[c])) : source[c];
+                    destination[IsBGRA ? 2 - c : c] = toUnorm8(value);
+                }
+                destination[3] = toUnorm8(source[3]);
+            }
+        }
+
+        void decodeRGBA16F(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count * 4; i++, source += 2) {
+                HALF value;
+                std::memcpy(&value, source, sizeof(value));
+                destination[i] = XMConvertHalfToFloat(value);
+            }
+        }
+
+        void encodeRGBA16F(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count * 4; i++, destination += 2) {
+                const HALF value = XMConvertFloatToHalf(source[i]);
+                std::memcpy(destination, &value, sizeof(value));
+            }
+        }
+
+        void decodeR11G11B10F(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                const XMFLOAT3PK packed(load32(source));
+                XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(destination), XMLoadFloat3PK(&packed));
+                destination[3] = 1.f;
+            }
+        }
+
+        void encodeR11G11B10F(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                XMFLOAT3PK packed;
+                XMStoreFloat3PK(&packed, XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(source)));
+                store32(destination, packed.v);
+            }
+        }
+
+        void decodeRGBA32F(const uint8_t* source, float* destination, size_t count) {
+            std::memcpy(destination, source, count * 16);
+        }
+
+        void encodeRGBA32F(const float* source, uint8_t* destination, size_t count) {
+            std::memcpy(destination, source, count * 16);
+        }
+
+        void blend(const float* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                const float inverseAlpha = 1.f - source[3];
+                for (uint32_t c = 0; c < 4; c++) {
+                    destination[c] = source[c] + destination[c] * inverseAlpha;
+                }
+            }
+        }
+
+        void blendUnorm8(const uint8_t* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                const uint32_t inverseAlpha = 255 - source[3];
+                for (uint32_t c = 0; c < 4; c++) {
+                    destination[c] =
+                        static_cast<uint8_t>(std::min(255u, source[c] + div255(destination[c] * inverseAlpha)));
+                }
+            }
+        }
+
+        const Kernels Table = {
+            {decodeRGBA8<false, false>,
+             decodeRGBA8<false, true>,
+             decodeRGBA8<true, false>,
+             decodeRGBA8<true, true>,
+             decodeRGBA16F,
+             decodeR11G11B10F,
+             decodeRGBA32F},
+            {encodeRGBA8<false, false>,
+             encodeRGBA8<false, true>,
+             encodeRGBA8<true, false>,
+             encodeRGBA8<true, true>,
+             encodeRGBA16F,
+             encodeR11G11B10F,
+             encodeRGBA32F},
+            blend,
+            blendUnorm8,
+        };
+
+    } // namespace scalar
+
+#ifdef IMAGE_KERNELS_X86
+    // One pixel per vector.
+    namespace sse4 {
+
+        // _mm_max_ps() returns the second operand when the first one is NaN, which maps NaN to 0.
+        inline __m128 saturate(__m128 value) {
+            return _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.f));
+        }
+
+        inline __m128 swapRB(__m128 value) {
+            return _mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 0, 1, 2));
+        }
+
+        // Round to nearest even while dropping the lower bits.
+        template <int Shift>
+        inline __m128i roundShiftRight(__m128i bits) {
+            const __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, Shift), _mm_set1_epi32(1));
+            return _mm_srli_epi32(_mm_add_epi32(bits, _mm_add_epi32(_mm_set1_epi32((1 << (Shift - 1)) - 1), odd)),
+                                  Shift);
+        }
+
+        // Multiplying by these constants moves the exponent between the float bias (127) and the bias of the 16-bit
+        // and 11-bit/10-bit floats (15), including for denormals.
+        inline __m128 exponentToFloat() {
+            return _mm_castsi128_ps(_mm_set1_epi32((127 + 112) << 23));
+        }
+        inline __m128 exponentFromFloat() {
+            return _mm_castsi128_ps(_mm_set1_epi32((127 - 112) << 23));
+        }
+
+        inline __m128 loadUnorm8(const uint8_t* source) {
+            const __m128i value = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load32(source)));
+            return _mm_mul_ps(_mm_cvtepi32_ps(value), _mm_set1_ps(1.f / 255));
+        }
+
+        inline void storeUnorm8(__m128 value, uint8_t* destination) {
+            __m128i packed = _mm_cvtps_epi32(_mm_mul_ps(saturate(value), _mm_set1_ps(255.f)));
+            packed = _mm_packus_epi32(packed, packed);
+            packed = _mm_packus_epi16(packed, packed);
+            store32(destination, _mm_cvtsi128_si32(packed));
+        }
+
+        inline __m128 loadSrgb8(const uint8_t* source) {
+            return _mm_setr_ps(Tables.srgbToLinear[source[0]],
+                               Tables.srgbToLinear[source[1]],
+                               Tables.srgbToLinear[source[2]],
+                               source[3] / 255.f);
+        }
+
+        inline void storeSrgb8(__m128 value, uint8_t* destination) {
+            value = saturate(value);
+            const __m128i index = _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(4095.f)));
+            const __m128i alpha = _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(255.f)));
+            store32(destination,
+                    Tables.linearToSrgb[_mm_extract_epi32(index, 0)] |
+                        Tables.linearToSrgb[_mm_extract_epi32(index, 1)] << 8 |
+                        Tables.linearToSrgb[_mm_extract_epi32(index, 2)] << 16 |
+                        static_cast<uint32_t>(_mm_extract_epi32(alpha, 3)) << 24);
+        }
+
+        // Exact, including denormals, Inf and NaN.
+        inline __m128 loadHalf4(const uint8_t* source) {
+            const __m128i half = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)));
+            const __m128i exponentAndMantissa = _mm_and_si128(half, _mm_set1_epi32(0x7fff));
+            const __m128i sign = _mm_slli_epi32(_mm_xor_si128(half, exponentAndMantissa), 16);
+            const __m128 scaled =
+                _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentAndMantissa, 13)), exponentToFloat());
+            const __m128i isInfOrNaN = _mm_cmpgt_epi32(exponentAndMantissa, _mm_set1_epi32(0x7bff));
+            const __m128i infOrNaNExponent = _mm_and_si128(isInfOrNaN, _mm_set1_epi32(255 << 23));
+            return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infOrNaNExponent)));
+        }
+
+        inline void storeHalf4(__m128 value, uint8_t* destination) {
+            const __m128 sign = _mm_and_ps(value, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+
+            // _mm_min_ps() returns the second operand when the first one is NaN.
+            const __m128 magnitude = _mm_min_ps(_mm_xor_ps(value, sign), _mm_set1_ps(65504.f));
+            const __m128i bits = roundShiftRight<13>(_mm_castps_si128(_mm_mul_ps(magnitude, exponentFromFloat())));
+            const __m128i half = _mm_or_si128(bits, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(destination), _mm_packus_epi32(half, half));
+        }
+
+        // Exact, including denormals, Inf and NaN.
+        inline __m128 loadR11G11B10(const uint8_t* source) {
+            const uint32_t packed = load32(source);
+
+            // Align each channel so that its mantissa ends on the same bit as the float mantissa.
+            const __m128i bits = _mm_setr_epi32(
+                (packed & 0x7ff) << 17, ((packed >> 11) & 0x7ff) << 17, static_cast<int>((packed >> 22) << 18), 0);
+            const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(bits), exponentToFloat());
+            const __m128i isInfOrNaN = _mm_cmpgt_epi32(bits, _mm_setr_epi32(0x7bf << 17, 0x7bf << 17, 0x3df << 18, 0));
+            const __m128i infOrNaNExponent = _mm_and_si128(isInfOrNaN, _mm_set1_epi32(255 << 23));
+            return _mm_blend_ps(_mm_or_ps(scaled, _mm_castsi128_ps(infOrNaNExponent)), _mm_set1_ps(1.f), 0b1000);
+        }
+
+        inline void storeR11G11B10(__m128 value, uint8_t* destination) {
+            // The format has no sign bit.
+            const __m128 clamped = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(65024.f));
+            const __m128i bits = _mm_castps_si128(_mm_mul_ps(clamped, exponentFromFloat()));
+            __m128i rounded = _mm_blend_epi16(roundShiftRight<17>(bits), roundShiftRight<18>(bits), 0b00110000);
+
+            // Blue has one less bit of mantissa and its largest value is below 65024.
+            rounded = _mm_min_epi32(rounded, _mm_setr_epi32(0x7bf, 0x7bf, 0x3df, 0));
+            store32(destination,
+                    static_cast<uint32_t>(_mm_extract_epi32(rounded, 0)) |
+                        static_cast<uint32_t>(_mm_extract_epi32(rounded, 1)) << 11 |
+                        static_cast<uint32_t>(_mm_extract_epi32(rounded, 2)) << 22);
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void decodeRGBA8(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                __m128 value;
+                if constexpr (IsSRGB) {
+                    value = loadSrgb8(source);
+                } else {
+                    value = loadUnorm8(source);
+                }
+                if constexpr (IsBGRA) {
+                    value = swapRB(value);
+                }
+                _mm_storeu_ps(destination, value);
+            }
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void encodeRGBA8(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                __m128 value = _mm_loadu_ps(source);
+                if constexpr (IsBGRA) {
+                    value = swapRB(value);
+                }
+                if constexpr (IsSRGB) {
+                    storeSrgb8(value, destination);
+                } else {
+                    storeUnorm8(value, destination);
+                }
+            }
+        }
+
+        void decodeRGBA16F(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 8, destination += 4) {
+                _mm_storeu_ps(destination, loadHalf4(source));
+            }
+        }
+
+        void encodeRGBA16F(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 8) {
+                storeHalf4(_mm_loadu_ps(source), destination);
+            }
+        }
+
+        void decodeR11G11B10F(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                _mm_storeu_ps(destination, loadR11G11B10(source));
+            }
+        }
+
+        void encodeR11G11B10F(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                storeR11G11B10(_mm_loadu_ps(source), destination);
+            }
+        }
+
+        void blend(const float* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                const __m128 s = _mm_loadu_ps(source);
+                const __m128 inverseAlpha = _mm_sub_ps(_mm_set1_ps(1.f), _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3)));
+                _mm_storeu_ps(destination, _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(destination), inverseAlpha)));
+            }
+        }
+
+        // Same as div255() on 16-bit lanes.
+        inline __m128i div255(__m128i value) {
+            const __m128i t = _mm_add_epi16(value, _mm_set1_epi16(128));
+            return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+
+        // Four pixels at a time.
+        inline __m128i blendUnorm8x4(__m128i source, __m128i destination) {
+            const __m128i alphaShuffle = _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+            const __m128i inverseAlpha = _mm_xor_si128(_mm_shuffle_epi8(source, alphaShuffle), _mm_set1_epi8(-1));
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i low = div255(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(destination, zero), _mm_unpacklo_epi8(inverseAlpha, zero)));
+            const __m128i high = div255(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(destination, zero), _mm_unpackhi_epi8(inverseAlpha, zero)));
+            return _mm_adds_epu8(source, _mm_packus_epi16(low, high));
+        }
+
+        void blendUnorm8(const uint8_t* source, uint8_t* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4, source += 16, destination += 16) {
+                const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+                const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), blendUnorm8x4(s, d));
+            }
+            scalar::blendUnorm8(source, destination, count - i);
+        }
+
+        const Kernels Table = {
+            {decodeRGBA8<false, false>,
+             decodeRGBA8<false, true>,
+             decodeRGBA8<true, false>,
+             decodeRGBA8<true, true>,
+             decodeRGBA16F,
+             decodeR11G11B10F,
+             scalar::decodeRGBA32F},
+            {encodeRGBA8<false, false>,
+             encodeRGBA8<false, true>,
+             encodeRGBA8<true, false>,
+             encodeRGBA8<true, true>,
+             encodeRGBA16F,
+             encodeR11G11B10F,
+             scalar::encodeRGBA32F},
+            blend,
+            blendUnorm8,
+        };
+
+    } // namespace sse4
+
+    // Two pixels per vector, with the SSE4 kernels handling the remainder. Requires F16C, which all AVX2 CPUs have.
+    namespace avx2 {
+
+        inline __m256 saturate(__m256 value) {
+            return _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+        }
+
+        inline __m256 swapRB(__m256 value) {
+            return _mm256_shuffle_ps(value, value, _MM_SHUFFLE(3, 0, 1, 2));
+        }
+
+        inline __m256i load2x32(const uint8_t* source) {
+            return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)));
+        }
+
+        inline void store2x32(__m256i value, uint8_t* destination) {
+            store32(destination, _mm256_extract_epi32(value, 0));
+            store32(destination + 4, _mm256_extract_epi32(value, 4));
+        }
+
+        inline __m256i packUnorm8(__m256i value) {
+            value = _mm256_packus_epi32(value, value);
+            return _mm256_packus_epi16(value, value);
+        }
+
+        inline __m256 loadUnorm8(const uint8_t* source) {
+            return _mm256_mul_ps(_mm256_cvtepi32_ps(load2x32(source)), _mm256_set1_ps(1.f / 255));
+        }
+
+        inline void storeUnorm8(__m256 value, uint8_t* destination) {
+            store2x32(packUnorm8(_mm256_cvtps_epi32(_mm256_mul_ps(saturate(value), _mm256_set1_ps(255.f)))),
+                      destination);
+        }
+
+        inline __m256 loadSrgb8(const uint8_t* source) {
+            const __m256i index = load2x32(source);
+            const __m256 color = _mm256_i32gather_ps(Tables.srgbToLinear, index, 4);
+            const __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(index), _mm256_set1_ps(1.f / 255));
+            return _mm256_blend_ps(color, alpha, 0b10001000);
+        }
+
+        inline void storeSrgb8(__m256 value, uint8_t* destination) {
+            value = saturate(value);
+            const __m256i index = _mm256_cvtps_epi32(_mm256_mul_ps(value, _mm256_set1_ps(4095.f)));
+            const __m256i color =
+                _mm256_i32gather_epi32(reinterpret_cast<const int*>(Tables.linearToSrgb), index, 4);
+            const __m256i alpha = _mm256_cvtps_epi32(_mm256_mul_ps(value, _mm256_set1_ps(255.f)));
+            store2x32(packUnorm8(_mm256_blend_epi32(color, alpha, 0b10001000)), destination);
+        }
+
+        inline __m256 loadHalf(const uint8_t* source) {
+            return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
+        }
+
+        inline void storeHalf(__m256 value, uint8_t* destination) {
+            // Saturate like the SSE4 kernel. _mm256_min_ps() returns the second operand when the first one is NaN.
+            value = _mm256_max_ps(_mm256_min_ps(value, _mm256_set1_ps(65504.f)), _mm256_set1_ps(-65504.f));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination),
+                             _mm256_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+        }
+
+        inline __m256 loadR11G11B10(const uint8_t* source) {
+            // Broadcast each packed pixel to its 128-bit lane, then align each channel like the SSE4 kernel does.
+            const __m256i packed = _mm256_permutevar8x32_epi32(
+                _mm256_castsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source))),
+                _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1));
+            const __m256i channels =
+                _mm256_and_si256(_mm256_srlv_epi32(packed, _mm256_setr_epi32(0, 11, 22, 0, 0, 11, 22, 0)),
+                                 _mm256_setr_epi32(0x7ff, 0x7ff, 0x3ff, 0, 0x7ff, 0x7ff, 0x3ff, 0));
+            const __m256i bits = _mm256_sllv_epi32(channels, _mm256_setr_epi32(17, 17, 18, 0, 17, 17, 18, 0));
+            const __m256 scaled =
+                _mm256_mul_ps(_mm256_castsi256_ps(bits), _mm256_castsi256_ps(_mm256_set1_epi32((127 + 112) << 23)));
+            const __m256i largestFinite =
+                _mm256_setr_epi32(0x7bf << 17, 0x7bf << 17, 0x3df << 18, 0, 0x7bf << 17, 0x7bf << 17, 0x3df << 18, 0);
+            const __m256i isInfOrNaN = _mm256_cmpgt_epi32(bits, largestFinite);
+            const __m256 value = _mm256_or_ps(
+                scaled, _mm256_castsi256_ps(_mm256_and_si256(isInfOrNaN, _mm256_set1_epi32(255 << 23))));
+            return _mm256_blend_ps(value, _mm256_set1_ps(1.f), 0b10001000);
+        }
+
+        inline void storeR11G11B10(__m256 value, uint8_t* destination) {
+            const __m256 clamped = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(65024.f));
+            const __m256i bits =
+                _mm256_castps_si256(_mm256_mul_ps(clamped, _mm256_castsi256_ps(_mm256_set1_epi32((127 - 112) << 23))));
+
+            // Round to nearest even while dropping 17 bits (red, green) or 18 bits (blue). Alpha is dropped entirely.
+            const __m256i one = _mm256_set1_epi32(1);
+            const __m256i shift = _mm256_setr_epi32(17, 17, 18, 31, 17, 17, 18, 31);
+            const __m256i bias = _mm256_sub_epi32(_mm256_sllv_epi32(one, _mm256_sub_epi32(shift, one)), one);
+            const __m256i odd = _mm256_and_si256(_mm256_srlv_epi32(bits, shift), one);
+            __m256i rounded = _mm256_srlv_epi32(_mm256_add_epi32(bits, _mm256_add_epi32(bias, odd)), shift);
+            rounded = _mm256_min_epi32(rounded, _mm256_setr_epi32(0x7bf, 0x7bf, 0x3df, 0, 0x7bf, 0x7bf, 0x3df, 0));
+
+            // Combine the channels of each pixel into the first element of its lane.
+            rounded = _mm256_sllv_epi32(rounded, _mm256_setr_epi32(0, 11, 22, 0, 0, 11, 22, 0));
+            rounded = _mm256_or_si256(rounded, _mm256_shuffle_epi32(rounded, _MM_SHUFFLE(3, 2, 3, 2)));
+            rounded = _mm256_or_si256(rounded, _mm256_shuffle_epi32(rounded, _MM_SHUFFLE(3, 2, 0, 1)));
+            store2x32(rounded, destination);
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void decodeRGBA8(const uint8_t* source, float* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2, source += 8, destination += 8) {
+                __m256 value;
+                if constexpr (IsSRGB) {
+                    value = loadSrgb8(source);
+                } else {
+                    value = loadUnorm8(source);
+                }
+                if constexpr (IsBGRA) {
+                    value = swapRB(value);
+                }
+                _mm256_storeu_ps(destination, value);
+            }
+            sse4::decodeRGBA8<IsBGRA, IsSRGB>(source, destination, count - i);
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void encodeRGBA8(const float* source, uint8_t* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2, source += 8, destination += 8) {
+                __m256 value = _mm256_loadu_ps(source);
+                if constexpr (IsBGRA) {
+                    value = swapRB(value);
+                }
+                if constexpr (IsSRGB) {
+                    storeSrgb8(value, destination);
+                } else {
+                    storeUnorm8(value, destination);
+                }
+            }
+            sse4::encodeRGBA8<IsBGRA, IsSRGB>(source, destination, count - i);
+        }
+
+        void decodeRGBA16F(const uint8_t* source, float* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2, source += 16, destination += 8) {
+                _mm256_storeu_ps(destination, loadHalf(source));
+            }
+            sse4::decodeRGBA16F(source, destination, count - i);
+        }
+
+        void encodeRGBA16F(const float* source, uint8_t* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2, source += 8, destination += 16) {
+                storeHalf(_mm256_loadu_ps(source), destination);
+            }
+            sse4::encodeRGBA16F(source, destination, count - i);
+        }
+
+        void decodeR11G11B10F(const uint8_t* source, float* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2, source += 8, destination += 8) {
+                _mm256_storeu_ps(destination, loadR11G11B10(source));
+            }
+            sse4::decodeR11G11B10F(source, destination, count - i);
+        }
+
+        void encodeR11G11B10F(const float* source, uint8_t* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2, source += 8, destination += 8) {
+                storeR11G11B10(_mm256_loadu_ps(source), destination);
+            }
+            sse4::encodeR11G11B10F(source, destination, count - i);
+        }
+
+        void blend(const float* source, float* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2, source += 8, destination += 8) {
+                const __m256 s = _mm256_loadu_ps(source);
+                const __m256 inverseAlpha =
+                    _mm256_sub_ps(_mm256_set1_ps(1.f), _mm256_permute_ps(s, _MM_SHUFFLE(3, 3, 3, 3)));
+                _mm256_storeu_ps(destination,
+                                 _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(destination), inverseAlpha)));
+            }
+            sse4::blend(source, destination, count - i);
+        }
+
+        inline __m256i div255(__m256i value) {
+            const __m256i t = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+            return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+        }
+
+        // Eight pixels at a time. The unpack and pack instructions operate within 128-bit lanes, so the pixel order is
+        // preserved.
+        void blendUnorm8(const uint8_t* source, uint8_t* destination, size_t count) {
+            const __m256i alphaShuffle = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+                                                          3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+            const __m256i zero = _mm256_setzero_si256();
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, source += 32, destination += 32) {
+                const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+                const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(destination));
+                const __m256i inverseAlpha =
+                    _mm256_xor_si256(_mm256_shuffle_epi8(s, alphaShuffle), _mm256_set1_epi8(-1));
+                const __m256i low = div255(
+                    _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(inverseAlpha, zero)));
+                const __m256i high = div255(
+                    _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(inverseAlpha, zero)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination),
+                                    _mm256_adds_epu8(s, _mm256_packus_epi16(low, high)));
+            }
+            sse4::blendUnorm8(source, destination, count - i);
+        }
+
+        const Kernels Table = {
+            {decodeRGBA8<false, false>,
+             decodeRGBA8<false, true>,
+             decodeRGBA8<true, false>,
+             decodeRGBA8<true, true>,
+             decodeRGBA16F,
+             decodeR11G11B10F,
+             scalar::decodeRGBA32F},
+            {encodeRGBA8<false, false>,
+             encodeRGBA8<false, true>,
+             encodeRGBA8<true, false>,
+             encodeRGBA8<true, true>,
+             encodeRGBA16F,
+             encodeR11G11B10F,
+             scalar::encodeRGBA32F},
+            blend,
+            blendUnorm8,
+        };
+
+    } // namespace avx2
+#endif
+
+#ifdef IMAGE_KERNELS_NEON
+    // One pixel per vector, except for the 8-bit blending which uses de-interleaved loads of eight pixels.
+    namespace neon {
+
+        // vmaxnmq_f32() returns the number when one operand is NaN, which maps NaN to 0.
+        inline float32x4_t saturate(float32x4_t value) {
+            return vminq_f32(vmaxnmq_f32(value, vdupq_n_f32(0.f)), vdupq_n_f32(1.f));
+        }
+
+        inline uint32_t swapRB(uint32_t packed) {
+            return (packed & 0xff00ff00) | ((packed >> 16) & 0xff) | ((packed & 0xff) << 16);
+        }
+
+        // Variable right shift with rounding to nearest even.
+        inline uint32x4_t roundShiftRight(uint32x4_t bits, int32x4_t shift) {
+            const uint32x4_t one = vdupq_n_u32(1);
+            const int32x4_t negativeShift = vnegq_s32(shift);
+            const uint32x4_t bias = vsubq_u32(vshlq_u32(one, vsubq_s32(shift, vdupq_n_s32(1))), one);
+            const uint32x4_t odd = vandq_u32(vshlq_u32(bits, negativeShift), one);
+            return vshlq_u32(vaddq_u32(bits, vaddq_u32(bias, odd)), negativeShift);
+        }
+
+        inline float32x4_t loadUnorm8(uint32_t packed) {
+            const uint16x8_t value = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(packed)));
+            return vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(value))), 1.f / 255);
+        }
+
+        inline uint32_t storeUnorm8(float32x4_t value) {
+            const uint16x4_t value16 = vmovn_u32(vcvtnq_u32_f32(vmulq_n_f32(saturate(value), 255.f)));
+            return vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(value16, value16))), 0);
+        }
+
+        inline float32x4_t loadSrgb8(uint32_t packed) {
+            const float value[4] = {Tables.srgbToLinear[packed & 0xff],
+                                    Tables.srgbToLinear[(packed >> 8) & 0xff],
+                                    Tables.srgbToLinear[(packed >> 16) & 0xff],
+                                    (packed >> 24) / 255.f};
+            return vld1q_f32(value);
+        }
+
+        inline uint32_t storeSrgb8(float32x4_t value) {
+            value = saturate(value);
+            const uint32x4_t index = vcvtnq_u32_f32(vmulq_n_f32(value, 4095.f));
+            const uint32x4_t alpha = vcvtnq_u32_f32(vmulq_n_f32(value, 255.f));
+            return Tables.linearToSrgb[vgetq_lane_u32(index, 0)] | Tables.linearToSrgb[vgetq_lane_u32(index, 1)] << 8 |
+                   Tables.linearToSrgb[vgetq_lane_u32(index, 2)] << 16 | vgetq_lane_u32(alpha, 3) << 24;
+        }
+
+        // Exact, including denormals, Inf and NaN.
+        inline float32x4_t loadR11G11B10(uint32_t packed) {
+            const uint32_t bits[4] = {(packed & 0x7ff) << 17, ((packed >> 11) & 0x7ff) << 17, (packed >> 22) << 18, 0};
+            const uint32_t largestFinite[4] = {0x7bf << 17, 0x7bf << 17, 0x3df << 18, 0};
+            const uint32x4_t bitsVector = vld1q_u32(bits);
+            const float32x4_t scaled = vmulq_f32(vreinterpretq_f32_u32(bitsVector),
+                                                 vreinterpretq_f32_u32(vdupq_n_u32((127 + 112) << 23)));
+            const uint32x4_t infOrNaNExponent =
+                vandq_u32(vcgtq_u32(bitsVector, vld1q_u32(largestFinite)), vdupq_n_u32(255 << 23));
+            const float32x4_t value =
+                vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(scaled), infOrNaNExponent));
+            return vsetq_lane_f32(1.f, value, 3);
+        }
+
+        inline uint32_t storeR11G11B10(float32x4_t value) {
+            const float32x4_t clamped = vminq_f32(vmaxnmq_f32(value, vdupq_n_f32(0.f)), vdupq_n_f32(65024.f));
+            const uint32x4_t bits = vreinterpretq_u32_f32(
+                vmulq_f32(clamped, vreinterpretq_f32_u32(vdupq_n_u32((127 - 112) << 23))));
+            const int32_t shift[4] = {17, 17, 18, 31};
+            const uint32_t maximum[4] = {0x7bf, 0x7bf, 0x3df, 0};
+            const uint32x4_t rounded = vminq_u32(roundShiftRight(bits, vld1q_s32(shift)), vld1q_u32(maximum));
+            return vgetq_lane_u32(rounded, 0) | vgetq_lane_u32(rounded, 1) << 11 | vgetq_lane_u32(rounded, 2) << 22;
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void decodeRGBA8(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                uint32_t packed = load32(source);
+                if constexpr (IsBGRA) {
+                    packed = swapRB(packed);
+                }
+                vst1q_f32(destination, IsSRGB ? loadSrgb8(packed) : loadUnorm8(packed));
+            }
+        }
+
+        template <bool IsBGRA, bool IsSRGB>
+        void encodeRGBA8(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                const float32x4_t value = vld1q_f32(source);
+                const uint32_t packed = IsSRGB ? storeSrgb8(value) : storeUnorm8(value);
+                store32(destination, IsBGRA ? swapRB(packed) : packed);
+            }
+        }
+
+        void decodeRGBA16F(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 8, destination += 4) {
+                vst1q_f32(destination,
+                          vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(reinterpret_cast<const uint16_t*>(source)))));
+            }
+        }
+
+        void encodeRGBA16F(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 8) {
+                // Saturate like the x86 kernels.
+                const float32x4_t value =
+                    vmaxq_f32(vminq_f32(vld1q_f32(source), vdupq_n_f32(65504.f)), vdupq_n_f32(-65504.f));
+                vst1_u16(reinterpret_cast<uint16_t*>(destination), vreinterpret_u16_f16(vcvt_f16_f32(value)));
+            }
+        }
+
+        void decodeR11G11B10F(const uint8_t* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                vst1q_f32(destination, loadR11G11B10(load32(source)));
+            }
+        }
+
+        void encodeR11G11B10F(const float* source, uint8_t* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                store32(destination, storeR11G11B10(vld1q_f32(source)));
+            }
+        }
+
+        void blend(const float* source, float* destination, size_t count) {
+            for (size_t i = 0; i < count; i++, source += 4, destination += 4) {
+                const float32x4_t s = vld1q_f32(source);
+                const float32x4_t inverseAlpha = vsubq_f32(vdupq_n_f32(1.f), vdupq_laneq_f32(s, 3));
+                vst1q_f32(destination, vfmaq_f32(s, vld1q_f32(destination), inverseAlpha));
+            }
+        }
+
+        void blendUnorm8(const uint8_t* source, uint8_t* destination, size_t count) {
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, source += 32, destination += 32) {
+                const uint8x8x4_t s = vld4_u8(source);
+                uint8x8x4_t d = vld4_u8(destination);
+                const uint8x8_t inverseAlpha = vmvn_u8(s.val[3]);
+                for (uint32_t c = 0; c < 4; c++) {
+                    const uint16x8_t t = vaddq_u16(vmull_u8(d.val[c], inverseAlpha), vdupq_n_u16(128));
+                    d.val[c] = vqadd_u8(s.val[c], vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8));
+                }
+                vst4_u8(destination, d);
+            }
+            scalar::blendUnorm8(source, destination, count - i);
+        }
+
+        const Kernels Table = {
+            {decodeRGBA8<false, false>,
+             decodeRGBA8<false, true>,
+             decodeRGBA8<true, false>,
+             decodeRGBA8<true, true>,
+             decodeRGBA16F,
+             decodeR11G11B10F,
+             scalar::decodeRGBA32F},
+            {encodeRGBA8<false, false>,
+             encodeRGBA8<false, true>,
+             encodeRGBA8<true, false>,
+             encodeRGBA8<true, true>,
+             encodeRGBA16F,
+             encodeR11G11B10F,
+             scalar::encodeRGBA32F},
+            blend,
+            blendUnorm8,
+        };
+
+    } // namespace neon
+#endif
+
+    Isa detectIsa() {
+#if defined(IMAGE_KERNELS_X86)
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        const bool hasSse41 = info[2] & (1 << 19);
+        const bool hasSsse3 = info[2] & (1 << 9);
+        const bool hasOsxsave = info[2] & (1 << 27);
+        const bool hasAvx = info[2] & (1 << 28);
+        const bool hasF16C = info[2] & (1 << 29);
+
+        // The OS must also save the AVX state.
+        const bool hasAvxState = hasOsxsave && (_xgetbv(0) & 0x6) == 0x6;
+
+        bool hasAvx2 = false;
+        if (maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            hasAvx2 = info[1] & (1 << 5);
+        }
+
+        if (hasAvx && hasAvx2 && hasF16C && hasAvxState) {
+            return Isa::AVX2;
+        }
+        if (hasSse41 && hasSsse3) {
+            return Isa::SSE4;
+        }
+        return Isa::Scalar;
+#elif defined(IMAGE_KERNELS_NEON)
+        // NEON is mandatory on AArch64.
+        return Isa::NEON;
+#else
+        return Isa::Scalar;
+#endif
+    }
+
+    const Isa SupportedIsa = detectIsa();
+    std::atomic<Isa> CurrentIsa = SupportedIsa;
+
+    bool isIsaSupported(Isa isa) {
+        switch (isa) {
+        case Isa::Scalar:
+            return true;
+        case Isa::SSE4:
+            return SupportedIsa == Isa::SSE4 || SupportedIsa == Isa::AVX2;
+        case Isa::AVX2:
+        case Isa::NEON:
+            return SupportedIsa == isa;
+        }
+        return false;
+    }
+
+    const Kernels& getKernels() {
+        switch (CurrentIsa.load()) {
+#ifdef IMAGE_KERNELS_X86
+        case Isa::SSE4:
+            return sse4::Table;
+        case Isa::AVX2:
+            return avx2::Table;
+#endif
+#ifdef IMAGE_KERNELS_NEON
+        case Isa::NEON:
+            return neon::Table;
+#endif
+        default:
+            return scalar::Table;
+        }
+    }
+
+    int getFormatIndexOrThrow(DXGI_FORMAT format) {
+        const int index = getFormatIndex(format);
+        if (index < 0) {
+            throw std::runtime_error(fmt::format("Unsupported image format: {}", (int)format));
+        }
+        return index;
+    }
+
+    inline uint8_t* getPixel(const Image& image, int format, int32_t x, int32_t y) {
+        return image.data + y * image.rowPitch + static_cast<size_t>(x) * FormatSizes[format];
+    }
+
+    void convertRun(const Kernels& kernels,
+                    int sourceFormat,
+                    const uint8_t* source,
+                    int destinationFormat,
+                    uint8_t* destination,
+                    size_t count) {
+        if (sourceFormat == destinationFormat) {
+            std::memcpy(destination, source, count * FormatSizes[sourceFormat]);
+            return;
+        }
+
+        alignas(32) float pixels[ChunkSize * 4];
+        while (count) {
+            const size_t chunk = std::min(count, ChunkSize);
+            kernels.decode[sourceFormat](source, pixels, chunk);
+            kernels.encode[destinationFormat](pixels, destination, chunk);
+            source += chunk * FormatSizes[sourceFormat];
+            destination += chunk * FormatSizes[destinationFormat];
+            count -= chunk;
+        }
+    }
+
+    // Clip the source region and its destination against the bounds of both images. Returns false if nothing is left.
+    bool clipRegion(const Image& source,
+                    const XrRect2Di& sourceRect,
+                    const Image& destination,
+                    const XrOffset2Di& destinationOffset,
+                    XrRect2Di& clippedRect,
+                    XrOffset2Di& clippedOffset) {
+        int32_t x = sourceRect.offset.x;
+        int32_t y = sourceRect.offset.y;
+        int32_t width = sourceRect.extent.width;
+        int32_t height = sourceRect.extent.height;
+        int32_t destinationX = destinationOffset.x;
+        int32_t destinationY = destinationOffset.y;
+
+        if (x < 0) {
+            width += x;
+            destinationX -= x;
+            x = 0;
+        }
+        if (y < 0) {
+            height += y;
+            destinationY -= y;
+            y = 0;
+        }
+        if (destinationX < 0) {
+            width += destinationX;
+            x -= destinationX;
+            destinationX = 0;
+        }
+        if (destinationY < 0) {
+            height += destinationY;
+            y -= destinationY;
+            destinationY = 0;
+        }
+        width = std::min({width,
+                          static_cast<int32_t>(source.width) - x,
+                          static_cast<int32_t>(destination.width) - destinationX});
+        height = std::min({height,
+                           static_cast<int32_t>(source.height) - y,
+                           static_cast<int32_t>(destination.height) - destinationY});
+
+        clippedRect = {{x, y}, {width, height}};
+        clippedOffset = {destinationX, destinationY};
+        return width > 0 && height > 0;
+    }
+
+} // namespace
+
+namespace openxr_api_layer::utils::image {
+
+    Isa getSupportedIsa() {
+        return SupportedIsa;
+    }
+
+    void setIsa(Isa isa) {
+        if (!isIsaSupported(isa)) {
+            throw std::runtime_error(fmt::format("Unsupported instruction set: {}", xr::ToString(isa)));
+        }
+        CurrentIsa = isa;
+    }
+
+    Isa getIsa() {
+        return CurrentIsa;
+    }
+
+    void convertPixels(DXGI_FORMAT sourceFormat,
+                       const void* source,
+                       DXGI_FORMAT destinationFormat,
+                       void* destination,
+                       size_t pixelCount) {
+        if (!isConversionSupported(sourceFormat, destinationFormat)) {
+            throw std::runtime_error(
+                fmt::format("Unsupported conversion: {} to {}", (int)sourceFormat, (int)destinationFormat));
+        }
+
+        convertRun(getKernels(),
+                   getFormatIndex(sourceFormat),
+                   static_cast<const uint8_t*>(source),
+                   getFormatIndex(destinationFormat),
+                   static_cast<uint8_t*>(destination),
+                   pixelCount);
+    }
+
+    bool isFormatSupported(DXGI_FORMAT format) {
+        return getFormatIndex(format) >= 0;
+    }
+
+    bool isConversionSupported(DXGI_FORMAT sourceFormat, DXGI_FORMAT destinationFormat) {
+        return isFormatSupported(sourceFormat) && isFormatSupported(destinationFormat);
+    }
+
+    uint32_t getBytesPerPixel(DXGI_FORMAT format) {
+        switch (format) {
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+            return 16;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+            return 8;
+        case DXGI_FORMAT_R11G11B10_FLOAT:
+        case DXGI_FORMAT_R10G10B10A2_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8X8_UNORM:
+        case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        case DXGI_FORMAT_D32_FLOAT:
+        case DXGI_FORMAT_D24_UNORM_S8_UINT:
+            return 4;
+        case DXGI_FORMAT_D16_UNORM:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    void blit(const Image& source,
+              const XrRect2Di& sourceRect,
+              const Image& destination,
+              const XrOffset2Di& destinationOffset) {
+        const int sourceFormat = getFormatIndexOrThrow(source.format);
+        const int destinationFormat = getFormatIndexOrThrow(destination.format);
+
+        XrRect2Di rect;
+        XrOffset2Di offset;
+        if (!clipRegion(source, sourceRect, destination, destinationOffset, rect, offset)) {
+            return;
+        }
+
+        const Kernels& kernels = getKernels();
+        for (int32_t row = 0; row < rect.extent.height; row++) {
+            convertRun(kernels,
+                       sourceFormat,
+                       getPixel(source, sourceFormat, rect.offset.x, rect.offset.y + row),
+                       destinationFormat,
+                       getPixel(destination, destinationFormat, offset.x, offset.y + row),
+                       rect.extent.width);
+        }
+    }
+
+    void scale(const Image& source, const Image& destination, Filter filter, uint32_t firstRow, uint32_t rowCount) {
+        const int sourceFormat = getFormatIndexOrThrow(source.format);
+        const int destinationFormat = getFormatIndexOrThrow(destination.format);
+
+        if (!source.width || !source.height || !destination.width || !destination.height) {
+            return;
+        }
+        const uint32_t lastRow =
+            static_cast<uint32_t>(std::min<uint64_t>(destination.height, static_cast<uint64_t>(firstRow) + rowCount));
+        if (firstRow >= lastRow) {
+            return;
+        }
+        if (source.width == destination.width && source.height == destination.height) {
+            const XrRect2Di rows{{0, static_cast<int32_t>(firstRow)},
+                                 {static_cast<int32_t>(source.width), static_cast<int32_t>(lastRow - firstRow)}};
+            blit(source, rows, destination, rows.offset);
+            return;
+        }
+
+        const Kernels& kernels = getKernels();
+        const bool isBilinear = filter == Filter::Bilinear;
+        const float scaleX = static_cast<float>(source.width) / destination.width;
+        const float scaleY = static_cast<float>(source.height) / destination.height;
+
+        // Sample at pixel centers: compute the two source taps and the weight of the second tap.
+        const auto getTaps = [&](uint32_t position, float scale, uint32_t size, uint32_t& tap0, uint32_t& tap1) {
+            if (!isBilinear) {
+                tap0 = tap1 = std::min(size - 1, static_cast<uint32_t>((position + 0.5f) * scale));
+                return 0.f;
+            }
+            const float center = std::max(0.f, (position + 0.5f) * scale - 0.5f);
+            tap0 = std::min(size - 1, static_cast<uint32_t>(center));
+            tap1 = std::min(size - 1, tap0 + 1);
+            return std::min(1.f, center - tap0);
+        };
+
+        std::vector<uint32_t> tapsX0(destination.width);
+        std::vector<uint32_t> tapsX1(destination.width);
+        std::vector<float> weightsX(destination.width);
+        for (uint32_t x = 0; x < destination.width; x++) {
+            weightsX[x] = getTaps(x, scaleX, source.width, tapsX0[x], tapsX1[x]);
+        }
+
+        // The two decoded source rows for the current destination row, kept across rows when possible.
+        std::vector<XMFLOAT4> rows[2] = {std::vector<XMFLOAT4>(source.width), std::vector<XMFLOAT4>(source.width)};
+        int64_t cachedRows[2] = {-1, -1};
+        std::vector<XMFLOAT4> blendedRow(source.width);
+        std::vector<XMFLOAT4> outputRow(destination.width);
+
+        const auto decodeRow = [&](uint32_t slot, uint32_t y) {
+            kernels.decode[sourceFormat](
+                getPixel(source, sourceFormat, 0, y), reinterpret_cast<float*>(rows[slot].data()), source.width);
+            cachedRows[slot] = y;
+        };
+
+        for (uint32_t y = firstRow; y < lastRow; y++) {
+            uint32_t y0, y1;
+            const float weightY = getTaps(y, scaleY, source.height, y0, y1);
+
+            if (cachedRows[0] != y0) {
+                if (cachedRows[1] == y0) {
+                    std::swap(rows[0], rows[1]);
+                    std::swap(cachedRows[0], cachedRows[1]);
+                } else {
+                    decodeRow(0, y0);
+                }
+            }
+
+            const XMFLOAT4* row = rows[0].data();
+            if (weightY > 0.f) {
+                if (cachedRows[1] != y1) {
+                    decodeRow(1, y1);
+                }
+                for (uint32_t x = 0; x < source.width; x++) {
+                    XMStoreFloat4(&blendedRow[x],
+                                  XMVectorLerp(XMLoadFloat4(&rows[0][x]), XMLoadFloat4(&rows[1][x]), weightY));
+                }
+                row = blendedRow.data();
+            }
+
+            for (uint32_t x = 0; x < destination.width; x++) {
+                XMStoreFloat4(&outputRow[x],
+                              XMVectorLerp(XMLoadFloat4(&row[tapsX0[x]]), XMLoadFloat4(&row[tapsX1[x]]), weightsX[x]));
+            }
+
+            kernels.encode[destinationFormat](reinterpret_cast<const float*>(outputRow.data()),
+                                              getPixel(destination, destinationFormat, 0, y),
+                                              destination.width);
+        }
+    }
+
+    void blendPremultiplied(const Image& source, const Image& destination, const XrOffset2Di& destinationOffset) {
+        const int sourceFormat = getFormatIndexOrThrow(source.format);
+        const int destinationFormat = getFormatIndexOrThrow(destination.format);
+
+        XrRect2Di rect;
+        XrOffset2Di offset;
+        if (!clipRegion(source,
+                        {{0, 0}, {static_cast<int32_t>(source.width), static_cast<int32_t>(source.height)}},
+                        destination,
+                        destinationOffset,
+                        rect,
+                        offset)) {
+            return;
+        }
+
+        const Kernels& kernels = getKernels();
+
+        // 8-bit UNORM images with the same channel order are blended without conversion.
+        const bool isUnorm8 = sourceFormat == destinationFormat && (sourceFormat == RGBA8 || sourceFormat == BGRA8);
+
+        alignas(32) float sourcePixels[ChunkSize * 4];
+        alignas(32) float destinationPixels[ChunkSize * 4];
+        for (int32_t row = 0; row < rect.extent.height; row++) {
+            const uint8_t* sourceRow = getPixel(source, sourceFormat, rect.offset.x, rect.offset.y + row);
+            uint8_t* destinationRow = getPixel(destination, destinationFormat, offset.x, offset.y + row);
+
+            if (isUnorm8) {
+                kernels.blendUnorm8(sourceRow, destinationRow, rect.extent.width);
+                continue;
+            }
+
+            for (size_t i = 0; i < static_cast<size_t>(rect.extent.width); i += ChunkSize) {
+                const size_t chunk = std::min(ChunkSize, rect.extent.width - i);
+                kernels.decode[sourceFormat](sourceRow + i * FormatSizes[sourceFormat], sourcePixels, chunk);
+                kernels.decode[destinationFormat](
+                    destinationRow + i * FormatSizes[destinationFormat], destinationPixels, chunk);
+                kernels.blend(sourcePixels, destinationPixels, chunk);
+                kernels.encode[destinationFormat](
+                    destinationPixels, destinationRow + i * FormatSizes[destinationFormat], chunk);
+            }
+        }
+    }
+
+} // namespace openxr_api_layer::utils::image
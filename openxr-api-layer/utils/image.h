@@ -0,0 +1,104 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+namespace openxr_api_layer::utils::image {
+
+    // The instruction sets that the kernels are implemented for.
+    enum class Isa {
+        Scalar = 0,
+        SSE4,
+        AVX2,
+        NEON,
+    };
+
+    // The best instruction set supported by the CPU. This is the one used by default.
+    Isa getSupportedIsa();
+
+    // Select the instruction set used by the kernels, eg: to compare the results against the scalar reference. Throws
+    // if the instruction set is not supported by the CPU.
+    void setIsa(Isa isa);
+    Isa getIsa();
+
+    // A CPU-accessible image. The kernels operate on the following formats:
+    // - DXGI_FORMAT_R8G8B8A8_UNORM and DXGI_FORMAT_R8G8B8A8_UNORM_SRGB.
+    // - DXGI_FORMAT_B8G8R8A8_UNORM and DXGI_FORMAT_B8G8R8A8_UNORM_SRGB.
+    // - DXGI_FORMAT_R16G16B16A16_FLOAT.
+    // - DXGI_FORMAT_R11G11B10_FLOAT (alpha is discarded on write, and read as 1).
+    // - DXGI_FORMAT_R32G32B32A32_FLOAT.
+    // All conversions between these formats are supported, and are done in linear space (sRGB formats are decoded
+    // upon read and encoded upon write). The SIMD implementations saturate values that are out of the range of the
+    // destination format instead of producing Inf, and may differ from the scalar reference by 1 ULP.
+    struct Image {
+        uint8_t* data{nullptr};
+        size_t rowPitch{0};
+        uint32_t width{0};
+        uint32_t height{0};
+        DXGI_FORMAT format{DXGI_FORMAT_UNKNOWN};
+    };
+
+    enum class Filter {
+        Point = 0,
+        Bilinear,
+    };
+
+    // Convert a run of pixels between two formats. Throws if the conversion is not supported.
+    void convertPixels(DXGI_FORMAT sourceFormat,
+                       const void* source,
+                       DXGI_FORMAT destinationFormat,
+                       void* destination,
+                       size_t pixelCount);
+
+    bool isFormatSupported(DXGI_FORMAT format);
+    bool isConversionSupported(DXGI_FORMAT sourceFormat, DXGI_FORMAT destinationFormat);
+
+    // The size of one pixel in bytes, or 0 for unsupported (eg: block-compressed) formats.
+    uint32_t getBytesPerPixel(DXGI_FORMAT format);
+
+    // Copy a region of the source image into the destination image, converting the format if needed. The region is
+    // clipped to the bounds of both images.
+    void blit(const Image& source,
+              const XrRect2Di& sourceRect,
+              const Image& destination,
+              const XrOffset2Di& destinationOffset = {});
+    static inline void blit(const Image& source, const Image& destination, const XrOffset2Di& destinationOffset = {}) {
+        blit(source,
+             {{0, 0}, {static_cast<int32_t>(source.width), static_cast<int32_t>(source.height)}},
+             destination,
+             destinationOffset);
+    }
+
+    // Resample the entire source image into the entire destination image, converting the format if needed. Only the
+    // destination rows in [firstRow, firstRow + rowCount) are written, which allows splitting the work.
+    void scale(const Image& source,
+               const Image& destination,
+               Filter filter = Filter::Bilinear,
+               uint32_t firstRow = 0,
+               uint32_t rowCount = UINT32_MAX);
+
+    // Composite the premultiplied-alpha source image over the destination image (Porter-Duff "over"). The region is
+    // clipped to the bounds of the destination image.
+    void blendPremultiplied(const Image& source, const Image& destination, const XrOffset2Di& destinationOffset = {});
+
+} // namespace openxr_api_layer::utils::image
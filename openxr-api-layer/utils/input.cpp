@@ -49,11 +49,15 @@ namespace xr {
 namespace {
 
     using namespace openxr_api_layer::log;
+    using openxr_api_layer::HandleMap;
+    using openxr_api_layer::XrExpected;
+    using openxr_api_layer::XrFailure;
     using namespace openxr_api_layer::utils::general;
     using namespace openxr_api_layer::utils::inputs;
     using namespace xr::math;
 
     constexpr float ThumbstickDeadzone = 0.2f;
+    constexpr float RadiansToDegrees = static_cast<float>(180.0 / M_PI);
 
     struct FrameworkActions {
         XrActionSet actionSet{XR_NULL_HANDLE};
@@ -64,6 +68,7 @@ namespace {
         XrAction thumbstickClickAction{XR_NULL_HANDLE};
         XrAction thumbstickPositionAction{XR_NULL_HANDLE};
         XrAction hapticAction{XR_NULL_HANDLE};
+        XrAction eyeGazeAction{XR_NULL_HANDLE};
         bool isOpenComposite{false};
     };
 
@@ -72,6 +77,527 @@ namespace {
         PFN_xrBeginFrame xrBeginFrame{nullptr};
         PFN_xrAttachSessionActionSets xrAttachSessionActionSets{nullptr};
         PFN_xrSyncActions xrSyncActions{nullptr};
+        PFN_xrGetActionStateBoolean xrGetActionStateBoolean{nullptr};
+        PFN_xrGetActionStateFloat xrGetActionStateFloat{nullptr};
+        PFN_xrGetActionStateVector2f xrGetActionStateVector2f{nullptr};
+        PFN_xrGetActionStatePose xrGetActionStatePose{nullptr};
+        PFN_xrEnumerateBoundSourcesForAction xrEnumerateBoundSourcesForAction{nullptr};
+        PFN_xrGetInputSourceLocalizedName xrGetInputSourceLocalizedName{nullptr};
+    };
+
+    // A flat open-addressing table of the application's action states, valid until the next xrSyncActions(). The
+    // runtime only updates action states (including changedSinceLastSync and lastChangeTime) in xrSyncActions(), so
+    // replaying the first state returned after a sync is indistinguishable from querying the runtime again.
+    class ActionStateCache {
+      public:
+        ActionStateCache() : m_slots(InitialCapacity) {
+        }
+
+        // The query is invoked on a cache miss to get the state from the runtime.
+        template <typename State, typename Query>
+        XrResult getActionState(const XrActionStateGetInfo& getInfo, State& state, const Query& query) {
+            // Do not cache states with extension structures.
+            if (getInfo.next || state.next) {
+                return query(state);
+            }
+
+            uint64_t generation;
+            {
+                std::unique_lock lock(m_mutex);
+
+                const Slot* const slot = find(getInfo.action, getInfo.subactionPath, state.type);
+                if (slot) {
+                    m_statistics.hitCount++;
+                    std::memcpy(&state, slot->state, sizeof(State));
+                    return XR_SUCCESS;
+                }
+                m_statistics.missCount++;
+                generation = m_generation;
+            }
+
+            const XrResult result = query(state);
+            if (result == XR_SUCCESS) {
+                std::unique_lock lock(m_mutex);
+
+                // Discard the state if a sync happened during the query.
+                if (generation == m_generation) {
+                    Slot& slot = claim(getInfo.action, getInfo.subactionPath, state.type);
+                    std::memcpy(slot.state, &state, sizeof(State));
+                }
+            }
+            return result;
+        }
+
+        // Must be called after each xrSyncActions().
+        void invalidate() {
+            std::unique_lock lock(m_mutex);
+
+            // Slots from previous generations are free.
+            m_generation++;
+            m_size = 0;
+            m_statistics.syncCount++;
+        }
+
+        ActionStateCacheStatistics getStatistics() const {
+            std::unique_lock lock(m_mutex);
+
+            return m_statistics;
+        }
+
+      private:
+        static constexpr size_t InitialCapacity = 64;
+        static constexpr size_t MaxStateSize = std::max({sizeof(XrActionStateBoolean),
+                                                         sizeof(XrActionStateFloat),
+                                                         sizeof(XrActionStateVector2f),
+                                                         sizeof(XrActionStatePose)});
+
+        struct Slot {
+            uint64_t generation{0};
+            XrAction action{XR_NULL_HANDLE};
+            XrPath subactionPath{XR_NULL_PATH};
+            XrStructureType type{XR_TYPE_UNKNOWN};
+            alignas(XrActionStateVector2f) uint8_t state[MaxStateSize];
+        };
+
+        static size_t hash(XrAction action, XrPath subactionPath, XrStructureType type) {
+            uint64_t value = (uint64_t)action ^ (subactionPath * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)type << 32);
+
+            // Finalizer from splitmix64.
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+            return static_cast<size_t>(value ^ (value >> 31));
+        }
+
+        // Linear probing stops at the first free slot, since the table is never more than half full.
+        const Slot* find(XrAction action, XrPath subactionPath, XrStructureType type) const {
+            const size_t mask = m_slots.size() - 1;
+            for (size_t i = hash(action, subactionPath, type) & mask;; i = (i + 1) & mask) {
+                const Slot& slot = m_slots[i];
+                if (slot.generation != m_generation) {
+                    return nullptr;
+                }
+                if (slot.action == action && slot.subactionPath == subactionPath && slot.type == type) {
+                    return &slot;
+                }
+            }
+        }
+
+        Slot& claim(XrAction action, XrPath subactionPath, XrStructureType type) {
+            if ((m_size + 1) * 2 > m_slots.size()) {
+                std::vector<Slot> slots(m_slots.size() * 2);
+                std::swap(slots, m_slots);
+                m_size = 0;
+                for (const Slot& slot : slots) {
+                    if (slot.generation == m_generation) {
+                        claim(slot.action, slot.subactionPath, slot.type) = slot;
+                    }
+                }
+            }
+
+            const size_t mask = m_slots.size() - 1;
+            for (size_t i = hash(action, subactionPath, type) & mask;; i = (i + 1) & mask) {
+                Slot& slot = m_slots[i];
+                if (slot.generation != m_generation) {
+                    slot.generation = m_generation;
+                    slot.action = action;
+                    slot.subactionPath = subactionPath;
+                    slot.type = type;
+                    m_size++;
+                    return slot;
+                }
+
+                // Another thread might have queried the same state concurrently.
+                if (slot.action == action && slot.subactionPath == subactionPath && slot.type == type) {
+                    return slot;
+                }
+            }
+        }
+
+        mutable std::mutex m_mutex;
+        std::vector<Slot> m_slots;
+        size_t m_size{0};
+        uint64_t m_generation{1};
+        ActionStateCacheStatistics m_statistics;
+    };
+
+    // The application's bound sources and localized input source names, valid until the interaction profiles change.
+    // The runtime results are copied into arenas that are rewound (but not freed) upon invalidation, so that cache hits
+    // never allocate.
+    class InputSourceCache {
+      public:
+        // The query is invoked on a cache miss to enumerate the bound sources from the runtime (two-call idiom).
+        template <typename Query>
+        XrResult enumerateBoundSources(
+            XrAction action, uint32_t capacityInput, uint32_t* countOutput, XrPath* sources, const Query& query) {
+            uint64_t generation;
+            {
+                std::unique_lock lock(m_mutex);
+
+                const auto it = m_boundSources.find(action);
+                if (it != m_boundSources.cend() && it->second.generation == m_generation) {
+                    m_statistics.hitCount++;
+                    return copyOut(
+                        m_pathArena.data() + it->second.offset, it->second.count, capacityInput, countOutput, sources);
+                }
+                m_statistics.missCount++;
+                generation = m_generation;
+            }
+
+            std::vector<XrPath> runtimeSources;
+            const XrResult result = queryAll(runtimeSources, query);
+            if (result != XR_SUCCESS) {
+                return result;
+            }
+
+            {
+                std::unique_lock lock(m_mutex);
+
+                // Discard the results if the interaction profiles changed during the query.
+                if (generation == m_generation) {
+                    m_boundSources[action] = {generation, m_pathArena.size(), runtimeSources.size()};
+                    m_pathArena.insert(m_pathArena.end(), runtimeSources.cbegin(), runtimeSources.cend());
+                }
+            }
+            return copyOut(runtimeSources.data(), runtimeSources.size(), capacityInput, countOutput, sources);
+        }
+
+        // The query is invoked on a cache miss to get the localized name from the runtime (two-call idiom).
+        template <typename Query>
+        XrResult getLocalizedName(XrPath sourcePath,
+                                  XrInputSourceLocalizedNameFlags whichComponents,
+                                  uint32_t capacityInput,
+                                  uint32_t* countOutput,
+                                  char* buffer,
+                                  const Query& query) {
+            const LocalizedNameKey key{sourcePath, whichComponents};
+            uint64_t generation;
+            {
+                std::unique_lock lock(m_mutex);
+
+                const auto it = m_localizedNames.find(key);
+                if (it != m_localizedNames.cend() && it->second.generation == m_generation) {
+                    m_statistics.hitCount++;
+                    return copyOut(
+                        m_stringArena.data() + it->second.offset, it->second.count, capacityInput, countOutput, buffer);
+                }
+                m_statistics.missCount++;
+                generation = m_generation;
+            }
+
+            std::vector<char> runtimeName;
+            const XrResult result = queryAll(runtimeName, query);
+            if (result != XR_SUCCESS) {
+                return result;
+            }
+
+            {
+                std::unique_lock lock(m_mutex);
+
+                if (generation == m_generation) {
+                    m_localizedNames[key] = {generation, m_stringArena.size(), runtimeName.size()};
+                    m_stringArena.insert(m_stringArena.end(), runtimeName.cbegin(), runtimeName.cend());
+                }
+            }
+            return copyOut(runtimeName.data(), runtimeName.size(), capacityInput, countOutput, buffer);
+        }
+
+        // Must be called when the interaction profiles change, or when an action might be replaced.
+        void invalidate() {
+            std::unique_lock lock(m_mutex);
+
+            // Entries from previous generations are stale.
+            m_generation++;
+            m_pathArena.clear();
+            m_stringArena.clear();
+            m_statistics.invalidationCount++;
+        }
+
+        InputSourceCacheStatistics getStatistics() const {
+            std::unique_lock lock(m_mutex);
+
+            return m_statistics;
+        }
+
+      private:
+        struct Entry {
+            uint64_t generation;
+            size_t offset;
+            size_t count;
+        };
+
+        struct LocalizedNameKey {
+            XrPath sourcePath;
+            XrInputSourceLocalizedNameFlags whichComponents;
+
+            bool operator==(const LocalizedNameKey& other) const {
+                return sourcePath == other.sourcePath && whichComponents == other.whichComponents;
+            }
+        };
+
+        struct LocalizedNameKeyHash {
+            size_t operator()(const LocalizedNameKey& key) const {
+                return std::hash<uint64_t>()(key.sourcePath ^ (key.whichComponents * 0x9e3779b97f4a7c15ull));
+            }
+        };
+
+        template <typename T, typename Query>
+        static XrResult queryAll(std::vector<T>& values, const Query& query) {
+            uint32_t count = 0;
+            XrResult result = query(0, &count, nullptr);
+            if (result == XR_SUCCESS && count) {
+                values.resize(count);
+                result = query(count, &count, values.data());
+                values.resize(count);
+            }
+            return result;
+        }
+
+        template <typename T>
+        static XrResult
+        copyOut(const T* values, size_t count, uint32_t capacityInput, uint32_t* countOutput, T* output) {
+            *countOutput = static_cast<uint32_t>(count);
+            if (capacityInput == 0) {
+                return XR_SUCCESS;
+            }
+            if (capacityInput < count) {
+                return XR_ERROR_SIZE_INSUFFICIENT;
+            }
+            std::copy_n(values, count, output);
+            return XR_SUCCESS;
+        }
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<XrAction, Entry> m_boundSources;
+        std::unordered_map<LocalizedNameKey, Entry, LocalizedNameKeyHash> m_localizedNames;
+        std::vector<XrPath> m_pathArena;
+        std::vector<char> m_stringArena;
+        uint64_t m_generation{1};
+        InputSourceCacheStatistics m_statistics;
+    };
+
+    // The current interaction profile of each hand. The runtime reports changes with an
+    // XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED event, so the profiles only need to be queried again after one.
+    class InteractionProfileTracker {
+      public:
+        // Must be called upon an interaction profile changed event or an action set attachment, from any thread.
+        void invalidate() {
+            m_isStale.store(true, std::memory_order_release);
+        }
+
+        // Query the profiles of both hands if they are stale, or if forced. Returns whether any profile changed.
+        template <typename Query>
+        XrExpected<bool> update(bool force, const Query& query) {
+            if (!m_isStale.exchange(false, std::memory_order_acq_rel) && !force) {
+                return false;
+            }
+
+            XrPath profiles[Hands::Count];
+            for (uint32_t side = 0; side < Hands::Count; side++) {
+                XrInteractionProfileState state{XR_TYPE_INTERACTION_PROFILE_STATE};
+                const XrResult result = query(side, state);
+                if (XR_FAILED(result)) {
+                    // Try again on the next update.
+                    invalidate();
+                    return XrFailure{result, "xrGetCurrentInteractionProfile"};
+                }
+                profiles[side] = state.interactionProfile;
+            }
+            m_queryCount++;
+
+            bool changed = false;
+            for (uint32_t side = 0; side < Hands::Count; side++) {
+                changed = changed || profiles[side] != m_profiles[side];
+                m_profiles[side] = profiles[side];
+            }
+            return changed;
+        }
+
+        XrPath getInteractionProfile(uint32_t side) const {
+            return m_profiles[side];
+        }
+
+        bool isValid() const {
+            return m_profiles[Hands::Left] != XR_NULL_PATH || m_profiles[Hands::Right] != XR_NULL_PATH;
+        }
+
+        // The number of times the runtime was queried for both hands.
+        uint64_t getQueryCount() const {
+            return m_queryCount;
+        }
+
+      private:
+        // The profiles are unknown until the first update.
+        std::atomic<bool> m_isStale{true};
+        XrPath m_profiles[Hands::Count]{XR_NULL_PATH, XR_NULL_PATH};
+        uint64_t m_queryCount{0};
+    };
+
+    // An eye movement classifier, combining a velocity threshold (I-VT) to detect saccades with a dispersion threshold
+    // (I-DT) over a sliding window to detect fixations. All the state lives in fixed-size storage, so that samples can
+    // be classified every frame without allocating.
+    class EyeGazeClassifier {
+      public:
+        EyeGazeClassifier() {
+            setSettings({});
+        }
+
+        void setSettings(const EyeGazeFilterSettings& settings) {
+            m_settings = settings;
+            m_cosHalfDispersion = std::cos(settings.fixationDispersionDegrees / (2 * RadiansToDegrees));
+            reset();
+        }
+
+        void reset() {
+            m_windowStart = m_windowSize = 0;
+            m_previousTime = 0;
+            m_movement = EyeMovement::Undetermined;
+            m_velocity = 0.f;
+            m_fixationStart = 0;
+        }
+
+        // Add the location of the eye gaze action space. Returns whether it holds a gaze sample.
+        bool addLocation(const XrSpaceLocation& location, XrTime sampleTime) {
+            const XrSpaceLocationFlags requiredFlags =
+                XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT;
+            if ((location.locationFlags & requiredFlags) != requiredFlags) {
+                // The eyes were lost, the next fixation will have to be established again.
+                reset();
+                return false;
+            }
+
+            m_origin = location.pose.position;
+            addSample(sampleTime, getForward(location.pose.orientation));
+            return true;
+        }
+
+        void addSample(XrTime time, const XrVector3f& direction) {
+            // The runtime may report the same sample for several frames.
+            if (m_previousTime && time <= m_previousTime) {
+                return;
+            }
+
+            const XrDuration elapsed = m_previousTime ? time - m_previousTime : 0;
+            m_velocity = 0.f;
+            if (elapsed) {
+                const float angle = std::acos(std::clamp(Dot(m_previousDirection, direction), -1.f, 1.f));
+                m_velocity = angle * RadiansToDegrees / (elapsed / 1e9f);
+            }
+            m_previousTime = time;
+            m_previousDirection = direction;
+
+            if (m_velocity > m_settings.saccadeVelocityDegreesPerSecond) {
+                // The next fixation starts after the saccade, and the filter snaps to the new gaze.
+                m_movement = EyeMovement::Saccade;
+                m_windowStart = m_windowSize = 0;
+                m_fixationStart = 0;
+                m_filteredDirection = direction;
+                return;
+            }
+
+            if (m_windowSize == Capacity) {
+                popOldest();
+            }
+            const uint32_t newest = (m_windowStart + m_windowSize++) % Capacity;
+            m_windowTime[newest] = time;
+            m_windowDirection[newest] = direction;
+
+            // Drop the oldest samples until the window fits in the dispersion cone.
+            XrVector3f mean = getWindowMean();
+            while (m_windowSize > 1 && !isWindowWithin(mean)) {
+                popOldest();
+                mean = getWindowMean();
+            }
+
+            if (time - m_windowTime[m_windowStart] >= m_settings.minFixationDuration) {
+                if (m_movement != EyeMovement::Fixation) {
+                    m_movement = EyeMovement::Fixation;
+                    m_fixationStart = m_windowTime[m_windowStart];
+                }
+                m_filteredDirection = mean;
+            } else {
+                m_movement = EyeMovement::Undetermined;
+                m_fixationStart = 0;
+                const float alpha =
+                    elapsed && m_settings.smoothingTimeConstant > 0
+                        ? 1.f - std::exp(-static_cast<float>(elapsed) / m_settings.smoothingTimeConstant)
+                        : 1.f;
+                m_filteredDirection = Normalize(m_filteredDirection + alpha * (direction - m_filteredDirection));
+            }
+        }
+
+        void getState(EyeGazeState& state) const {
+            state.ray.position = m_origin;
+            state.ray.orientation = getOrientation(m_filteredDirection);
+            state.movement = m_movement;
+            state.angularVelocityDegreesPerSecond = m_velocity;
+            state.fixationDuration = m_movement == EyeMovement::Fixation ? m_previousTime - m_fixationStart : 0;
+            state.sampleTime = m_previousTime;
+        }
+
+        XrVector3f getFilteredDirection() const {
+            return m_filteredDirection;
+        }
+
+        EyeMovement getMovement() const {
+            return m_movement;
+        }
+
+        // The -Z axis of a rotation.
+        static XrVector3f getForward(const XrQuaternionf& q) {
+            return {-2 * (q.x * q.z + q.w * q.y), -2 * (q.y * q.z - q.w * q.x), -1 + 2 * (q.x * q.x + q.y * q.y)};
+        }
+
+        // The shortest rotation of the -Z axis onto a unit direction.
+        static XrQuaternionf getOrientation(const XrVector3f& direction) {
+            const float w = 1.f - direction.z;
+            if (w < 1e-6f) {
+                return {0, 1, 0, 0};
+            }
+            const float norm = std::sqrt(direction.x * direction.x + direction.y * direction.y + w * w);
+            return {direction.y / norm, -direction.x / norm, 0, w / norm};
+        }
+
+      private:
+        // 128 ms at 1 kHz, beyond which the oldest samples are dropped.
+        static constexpr uint32_t Capacity = 128;
+
+        void popOldest() {
+            m_windowStart = (m_windowStart + 1) % Capacity;
+            m_windowSize--;
+        }
+
+        XrVector3f getWindowMean() const {
+            XrVector3f sum{0, 0, 0};
+            for (uint32_t i = 0; i < m_windowSize; i++) {
+                sum = sum + m_windowDirection[(m_windowStart + i) % Capacity];
+            }
+            return Normalize(sum);
+        }
+
+        bool isWindowWithin(const XrVector3f& mean) const {
+            for (uint32_t i = 0; i < m_windowSize; i++) {
+                if (Dot(mean, m_windowDirection[(m_windowStart + i) % Capacity]) < m_cosHalfDispersion) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        EyeGazeFilterSettings m_settings;
+        float m_cosHalfDispersion{1.f};
+
+        XrTime m_windowTime[Capacity];
+        XrVector3f m_windowDirection[Capacity];
+        uint32_t m_windowStart{0};
+        uint32_t m_windowSize{0};
+
+        XrTime m_previousTime{0};
+        XrVector3f m_previousDirection{0, 0, -1};
+        XrVector3f m_origin{0, 0, 0};
+        XrVector3f m_filteredDirection{0, 0, -1};
+        EyeMovement m_movement{EyeMovement::Undetermined};
+        float m_velocity{0.f};
+        XrTime m_fixationStart{0};
     };
 
     struct InputFramework : IInputFramework {
@@ -82,12 +608,13 @@ namespace {
                        XrSession session,
                        const FrameworkActions& frameworkActions,
                        PFN_xrSuggestInteractionProfileBindings xrSuggestInteractionProfileBindings_,
+                       const std::atomic<bool>& wasEyeGazeProfileSuggested,
                        const ForwardDispatch& forwardDispatch,
                        InputMethod methods)
             : m_instance(instance), xrGetInstanceProcAddr(xrGetInstanceProcAddr_), m_session(session),
               m_frameworkActions(frameworkActions),
               xrSuggestInteractionProfileBindings(xrSuggestInteractionProfileBindings_),
-              m_forwardDispatch(forwardDispatch) {
+              m_wasEyeGazeProfileSuggested(wasEyeGazeProfileSuggested), m_forwardDispatch(forwardDispatch) {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(
                 local, "InputFramework_Create", TLXArg(session, "Session"), TLArg((int)methods, "InputMethods"));
@@ -129,6 +656,45 @@ namespace {
                 CHECK_XRCMD(xrCreateActionSpace(m_session, &actionSpaceInfo, &m_aimActionSpace[Hands::Right]));
             }
 
+            // Create the eye gaze action space, along with the space where the eye gaze is filtered.
+            if (m_frameworkActions.eyeGazeAction != XR_NULL_HANDLE) {
+                PFN_xrGetSystemProperties xrGetSystemProperties;
+                CHECK_XRCMD(xrGetInstanceProcAddr(
+                    instance, "xrGetSystemProperties", reinterpret_cast<PFN_xrVoidFunction*>(&xrGetSystemProperties)));
+
+                XrSystemEyeGazeInteractionPropertiesEXT eyeGazeProperties{
+                    XR_TYPE_SYSTEM_EYE_GAZE_INTERACTION_PROPERTIES_EXT};
+                XrSystemProperties systemProperties{XR_TYPE_SYSTEM_PROPERTIES, &eyeGazeProperties};
+                CHECK_XRCMD(xrGetSystemProperties(instance, sessionInfo.systemId, &systemProperties));
+
+                TraceLoggingWriteTagged(local,
+                                        "InputFramework_Create_EyeGaze",
+                                        TLArg(!!eyeGazeProperties.supportsEyeGazeInteraction, "Supported"));
+                if (eyeGazeProperties.supportsEyeGazeInteraction) {
+                    PFN_xrCreateActionSpace xrCreateActionSpace;
+                    CHECK_XRCMD(xrGetInstanceProcAddr(
+                        instance, "xrCreateActionSpace", reinterpret_cast<PFN_xrVoidFunction*>(&xrCreateActionSpace)));
+                    PFN_xrCreateReferenceSpace xrCreateReferenceSpace;
+                    CHECK_XRCMD(xrGetInstanceProcAddr(instance,
+                                                      "xrCreateReferenceSpace",
+                                                      reinterpret_cast<PFN_xrVoidFunction*>(&xrCreateReferenceSpace)));
+
+                    XrActionSpaceCreateInfo actionSpaceInfo{XR_TYPE_ACTION_SPACE_CREATE_INFO};
+                    actionSpaceInfo.action = m_frameworkActions.eyeGazeAction;
+                    actionSpaceInfo.poseInActionSpace = Pose::Identity();
+                    CHECK_XRCMD(xrCreateActionSpace(m_session, &actionSpaceInfo, &m_eyeGazeActionSpace));
+
+                    // Fixations are world-locked, so the gaze is filtered in the LOCAL space rather than relative to
+                    // the head.
+                    XrReferenceSpaceCreateInfo referenceSpaceInfo{XR_TYPE_REFERENCE_SPACE_CREATE_INFO};
+                    referenceSpaceInfo.referenceSpaceType = XR_REFERENCE_SPACE_TYPE_LOCAL;
+                    referenceSpaceInfo.poseInReferenceSpace = Pose::Identity();
+                    CHECK_XRCMD(xrCreateReferenceSpace(m_session, &referenceSpaceInfo, &m_eyeGazeReferenceSpace));
+                } else {
+                    Log("Eye gaze interaction is not supported by the system\n");
+                }
+            }
+
             TraceLoggingWriteStop(local, "InputFramework_Create", TLPArg(this, "InputFramework"));
         }
 
@@ -144,6 +710,12 @@ namespace {
                         xrDestroySpace(m_aimActionSpace[side]);
                     }
                 }
+                if (m_eyeGazeActionSpace != XR_NULL_HANDLE) {
+                    xrDestroySpace(m_eyeGazeActionSpace);
+                }
+                if (m_eyeGazeReferenceSpace != XR_NULL_HANDLE) {
+                    xrDestroySpace(m_eyeGazeReferenceSpace);
+                }
             }
 
             TraceLoggingWriteStop(local, "InputFramework_Destroy");
@@ -179,29 +751,30 @@ namespace {
             TraceLoggingWriteStop(local, "InputFramework_BlockApplicationInput");
         }
 
-        XrSpaceLocationFlags locateMotionController(uint32_t side, XrSpace baseSpace, XrPosef& pose) const {
+        XrExpected<XrSpaceLocationFlags>
+        tryLocateMotionController(uint32_t side, XrSpace baseSpace, XrPosef& pose) const override {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(
-                local, "InputFramework_LocateMotionController", TLXArg(m_session, "Session"), TLArg(side, "Side"));
-
-            if (side >= Hands::Count) {
-                throw std::runtime_error("Invalid hand");
-            }
+            TraceLoggingWriteStart(local,
+                                   "InputFramework_LocateMotionController",
+                                   TLXArg(m_session, "Session"),
+                                   TLArg(side, "Side"),
+                                   TLFrameArg());
 
-            if (m_aimActionSpace[side] == XR_NULL_HANDLE) {
-                throw std::runtime_error(
-                    "Motion controller tracking is not available (did you specify MotionControllerSpatial methods?)");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_VALIDATION_FAILURE, side >= Hands::Count, "Invalid hand");
+            RETURN_XR_FAILURE_IF(
+                XR_ERROR_FUNCTION_UNSUPPORTED,
+                m_aimActionSpace[side] == XR_NULL_HANDLE,
+                "Motion controller tracking is not available (did you specify MotionControllerSpatial methods?)");
 
             if (!m_wasActionSetsAttached) {
-                return 0;
+                return XrSpaceLocationFlags{0};
             }
 
             // Prevent error before the first frame.
             XrSpaceLocationFlags locationFlags = 0;
             if (m_currentFrameTime) {
                 XrSpaceLocation location{XR_TYPE_SPACE_LOCATION};
-                CHECK_XRCMD(xrLocateSpace(m_aimActionSpace[side], baseSpace, m_currentFrameTime, &location));
+                RETURN_IF_XR_FAILED(xrLocateSpace(m_aimActionSpace[side], baseSpace, m_currentFrameTime, &location));
                 if (Pose::IsPoseValid(location.locationFlags)) {
                     pose = location.pose;
                 } else {
@@ -225,17 +798,17 @@ namespace {
             return m_aimActionSpace[side];
         }
 
-        bool getMotionControllerButtonState(uint32_t side, MotionControllerButton button) const {
+        XrExpected<bool> tryGetMotionControllerButtonState(uint32_t side,
+                                                           MotionControllerButton button) const override {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local,
                                    "InputFramework_GetMotionControllerButtonState",
                                    TLXArg(m_session, "Session"),
                                    TLArg(side, "Side"),
-                                   TLArg(xr::ToString(button).c_str(), "Button"));
+                                   TLArg(xr::ToString(button).c_str(), "Button"),
+                                   TLFrameArg());
 
-            if (side >= Hands::Count) {
-                throw std::runtime_error("Invalid hand");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_VALIDATION_FAILURE, side >= Hands::Count, "Invalid hand");
 
             XrAction action;
             switch (button) {
@@ -252,13 +825,13 @@ namespace {
                 action = m_frameworkActions.thumbstickClickAction;
                 break;
             default:
-                throw std::runtime_error("Invalid button");
+                return XrFailure{XR_ERROR_VALIDATION_FAILURE, "Invalid button"};
             }
 
-            if (action == XR_NULL_HANDLE) {
-                throw std::runtime_error("Motion controller buttons are not available (did you specify the "
-                                         "MotionControllerButtons input method?)");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_FUNCTION_UNSUPPORTED,
+                                 action == XR_NULL_HANDLE,
+                                 "Motion controller buttons are not available (did you specify the "
+                                 "MotionControllerButtons input method?)");
 
             if (!m_wasActionSetsAttached) {
                 return false;
@@ -269,7 +842,7 @@ namespace {
             actionInfo.subactionPath = m_sidePath[side];
 
             XrActionStateBoolean state{XR_TYPE_ACTION_STATE_BOOLEAN};
-            CHECK_XRCMD(xrGetActionStateBoolean(m_session, &actionInfo, &state));
+            RETURN_IF_XR_FAILED(xrGetActionStateBoolean(m_session, &actionInfo, &state));
 
             TraceLoggingWriteStop(local,
                                   "InputFramework_GetMotionControllerButtonState",
@@ -279,24 +852,22 @@ namespace {
             return state.isActive && state.currentState;
         }
 
-        XrVector2f getMotionControllerThumbstickState(uint32_t side) const {
+        XrExpected<XrVector2f> tryGetMotionControllerThumbstickState(uint32_t side) const override {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local,
                                    "InputFramework_GetMotionControllerThumbstickState",
                                    TLXArg(m_session, "Session"),
-                                   TLArg(side, "Side"));
-
-            if (side >= Hands::Count) {
-                throw std::runtime_error("Invalid hand");
-            }
+                                   TLArg(side, "Side"),
+                                   TLFrameArg());
 
-            if (m_frameworkActions.thumbstickPositionAction == XR_NULL_HANDLE) {
-                throw std::runtime_error("Motion controller buttons are not available (did you specify the "
-                                         "MotionControllerButtons input method?)");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_VALIDATION_FAILURE, side >= Hands::Count, "Invalid hand");
+            RETURN_XR_FAILURE_IF(XR_ERROR_FUNCTION_UNSUPPORTED,
+                                 m_frameworkActions.thumbstickPositionAction == XR_NULL_HANDLE,
+                                 "Motion controller buttons are not available (did you specify the "
+                                 "MotionControllerButtons input method?)");
 
             if (!m_wasActionSetsAttached) {
-                return {0, 0};
+                return XrVector2f{0, 0};
             }
 
             XrActionStateGetInfo actionInfo{XR_TYPE_ACTION_STATE_GET_INFO};
@@ -304,7 +875,7 @@ namespace {
             actionInfo.subactionPath = m_sidePath[side];
 
             XrActionStateVector2f state{XR_TYPE_ACTION_STATE_VECTOR2F};
-            CHECK_XRCMD(xrGetActionStateVector2f(m_session, &actionInfo, &state));
+            RETURN_IF_XR_FAILED(xrGetActionStateVector2f(m_session, &actionInfo, &state));
 
             TraceLoggingWriteStop(
                 local,
@@ -318,31 +889,29 @@ namespace {
                 if (length >= ThumbstickDeadzone) {
                     XrVector2f normalizedInput{state.currentState.x / length, state.currentState.y / length};
                     const float scaling = (length - ThumbstickDeadzone) / (1 - ThumbstickDeadzone);
-                    return {normalizedInput.x * scaling, normalizedInput.y * scaling};
+                    return XrVector2f{normalizedInput.x * scaling, normalizedInput.y * scaling};
                 }
             }
-            return {0, 0};
+            return XrVector2f{0, 0};
         }
 
-        void pulseMotionControllerHaptics(uint32_t side, float strength) const {
+        XrExpected<void> tryPulseMotionControllerHaptics(uint32_t side, float strength) const override {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local,
                                    "InputFramework_PulseMotionControllerHaptics",
                                    TLXArg(m_session, "Session"),
                                    TLArg(side, "Side"),
-                                   TLArg(strength, "Strength"));
+                                   TLArg(strength, "Strength"),
+                                   TLFrameArg());
 
-            if (side >= Hands::Count) {
-                throw std::runtime_error("Invalid hand");
-            }
-
-            if (m_frameworkActions.hapticAction == XR_NULL_HANDLE) {
-                throw std::runtime_error("Motion controller haptics is not available (did you specify the "
-                                         "MotionControllerHaptics input method?)");
-            }
+            RETURN_XR_FAILURE_IF(XR_ERROR_VALIDATION_FAILURE, side >= Hands::Count, "Invalid hand");
+            RETURN_XR_FAILURE_IF(XR_ERROR_FUNCTION_UNSUPPORTED,
+                                 m_frameworkActions.hapticAction == XR_NULL_HANDLE,
+                                 "Motion controller haptics is not available (did you specify the "
+                                 "MotionControllerHaptics input method?)");
 
             if (!m_wasActionSetsAttached) {
-                return;
+                return {};
             }
 
             XrHapticActionInfo hapticInfo{XR_TYPE_HAPTIC_ACTION_INFO};
@@ -356,10 +925,80 @@ namespace {
             hapticVibration.duration = XR_MIN_HAPTIC_DURATION;
             hapticVibration.frequency = XR_FREQUENCY_UNSPECIFIED;
 
-            CHECK_XRCMD(
+            RETURN_IF_XR_FAILED(
                 xrApplyHapticFeedback(m_session, &hapticInfo, reinterpret_cast<XrHapticBaseHeader*>(&hapticVibration)));
 
             TraceLoggingWriteStop(local, "InputFramework_PulseMotionControllerHaptics");
+
+            return {};
+        }
+
+        XrExpected<bool> tryGetEyeGaze(XrSpace baseSpace, EyeGazeState& state) const override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "InputFramework_GetEyeGaze", TLXArg(m_session, "Session"), TLFrameArg());
+
+            RETURN_XR_FAILURE_IF(XR_ERROR_FUNCTION_UNSUPPORTED,
+                                 m_frameworkActions.eyeGazeAction == XR_NULL_HANDLE,
+                                 "Eye gaze is not available (did you specify the EyeGaze method?)");
+            RETURN_XR_FAILURE_IF(XR_ERROR_FUNCTION_UNSUPPORTED,
+                                 m_eyeGazeActionSpace == XR_NULL_HANDLE,
+                                 "Eye gaze interaction is not supported by the system");
+
+            {
+                std::unique_lock lock(m_eyeGazeMutex);
+
+                if (!m_isEyeGazeValid) {
+                    TraceLoggingWriteStop(local, "InputFramework_GetEyeGaze", TLArg(false, "Valid"));
+                    return false;
+                }
+                m_eyeGazeClassifier.getState(state);
+            }
+
+            // The gaze is filtered in the LOCAL space, which must be located in the requested space.
+            XrSpaceLocation location{XR_TYPE_SPACE_LOCATION};
+            RETURN_IF_XR_FAILED(xrLocateSpace(m_eyeGazeReferenceSpace, baseSpace, m_currentFrameTime, &location));
+            if (!Pose::IsPoseValid(location.locationFlags)) {
+                TraceLoggingWriteStop(local, "InputFramework_GetEyeGaze", TLArg(false, "Valid"));
+                return false;
+            }
+            state.ray = Pose::Multiply(state.ray, location.pose);
+
+            TraceLoggingWriteStop(local,
+                                  "InputFramework_GetEyeGaze",
+                                  TLArg(true, "Valid"),
+                                  TLArg(xr::ToString(state.ray).c_str(), "Ray"),
+                                  TLArg((int)state.movement, "Movement"),
+                                  TLArg(state.fixationDuration, "FixationDuration"));
+
+            return true;
+        }
+
+        void setEyeGazeFilterSettings(const EyeGazeFilterSettings& settings) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "InputFramework_SetEyeGazeFilterSettings",
+                                   TLXArg(m_session, "Session"),
+                                   TLArg(settings.saccadeVelocityDegreesPerSecond, "SaccadeVelocityDegreesPerSecond"),
+                                   TLArg(settings.fixationDispersionDegrees, "FixationDispersionDegrees"),
+                                   TLArg(settings.minFixationDuration, "MinFixationDuration"),
+                                   TLArg(settings.smoothingTimeConstant, "SmoothingTimeConstant"));
+
+            {
+                std::unique_lock lock(m_eyeGazeMutex);
+
+                m_eyeGazeClassifier.setSettings(settings);
+                m_isEyeGazeValid = false;
+            }
+
+            TraceLoggingWriteStop(local, "InputFramework_SetEyeGazeFilterSettings");
+        }
+
+        ActionStateCacheStatistics getActionStateCacheStatistics() const override {
+            return m_actionStateCache.getStatistics();
+        }
+
+        InputSourceCacheStatistics getInputSourceCacheStatistics() const override {
+            return m_inputSourceCache.getStatistics();
         }
 
         void updateNeedPollEvent(bool needPollEvent) {
@@ -368,7 +1007,7 @@ namespace {
 
         XrResult xrWaitFrame_subst(XrSession session, const XrFrameWaitInfo* frameWaitInfo, XrFrameState* frameState) {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "InputFramework_WaitFrame", TLXArg(session, "Session"));
+            TraceLoggingWriteStart(local, "InputFramework_WaitFrame", TLXArg(session, "Session"), TLFrameArg());
 
             const XrResult result = m_forwardDispatch.xrWaitFrame(session, frameWaitInfo, frameState);
             if (XR_SUCCEEDED(result)) {
@@ -387,7 +1026,7 @@ namespace {
 
         XrResult xrBeginFrame_subst(XrSession session, const XrFrameBeginInfo* frameBeginInfo) {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "InputFramework_BeginFrame", TLXArg(session, "Session"));
+            TraceLoggingWriteStart(local, "InputFramework_BeginFrame", TLXArg(session, "Session"), TLFrameArg());
 
             const XrResult result = m_forwardDispatch.xrBeginFrame(session, frameBeginInfo);
             if (XR_SUCCEEDED(result)) {
@@ -399,7 +1038,7 @@ namespace {
                                             TLArg(m_wasActionSetsAttached, "WasActionSetsAttached"),
                                             TLArg(m_needPollEvent, "NeedPollEvent"),
                                             TLArg(m_frameworkActions.isOpenComposite, "IsOpenComposite"),
-                                            TLArg(m_isInteractionProfileValid, "IsInteractionProfileValid"));
+                                            TLArg(m_interactionProfiles.isValid(), "IsInteractionProfileValid"));
 
                     // If the application doesn't use motion controller at all, we need to attach our actionset
                     // ourselves...
@@ -407,7 +1046,7 @@ namespace {
                     // Quirk: OpenComposite waits for an interaction profile to be reported before finishing
                     // initialization of its action system.
                     if (!m_wasActionSetsAttached &&
-                        (!m_frameworkActions.isOpenComposite || m_isInteractionProfileValid)) {
+                        (!m_frameworkActions.isOpenComposite || m_interactionProfiles.isValid())) {
                         TraceLoggingWriteTagged(local, "InputFramework_BeginFrame_SetupFrameworkActionSet");
 
                         // Make sure our bindings are complete. We only submit suggestions for the interaction profiles
@@ -456,6 +1095,7 @@ namespace {
                                 if (xrPollEvent(m_instance, &buf) != XR_SUCCESS) {
                                     break;
                                 }
+                                onEvent(buf);
                             }
                         }
 
@@ -464,27 +1104,31 @@ namespace {
                         XrActiveActionSet frameworkActionSet{m_frameworkActions.actionSet, XR_NULL_PATH};
                         syncInfo.activeActionSets = &frameworkActionSet;
                         syncInfo.countActiveActionSets = 1;
-                        CHECK_XRCMD(m_forwardDispatch.xrSyncActions(session, &syncInfo));
-
-                        // Dump the interaction profiles for tracing.
-                        XrInteractionProfileState leftState{XR_TYPE_INTERACTION_PROFILE_STATE};
-                        CHECK_XRCMD(xrGetCurrentInteractionProfile(m_session, m_sidePath[xr::Side::Left], &leftState));
-                        XrInteractionProfileState rightState{XR_TYPE_INTERACTION_PROFILE_STATE};
-                        CHECK_XRCMD(
-                            xrGetCurrentInteractionProfile(m_session, m_sidePath[xr::Side::Right], &rightState));
-                        TraceLoggingWriteTagged(local,
-                                                "InputFramework_BeginFrame_CurrentInteractionProfiles",
-                                                TLArg(getXrPath(leftState.interactionProfile).c_str(), "Left"),
-                                                TLArg(getXrPath(rightState.interactionProfile).c_str(), "Right"));
-
-                        m_isInteractionProfileValid = leftState.interactionProfile != XR_NULL_PATH ||
-                                                      rightState.interactionProfile != XR_NULL_PATH;
+                        const auto synced = syncFrameworkActions(session, syncInfo);
+                        if (!synced) {
+                            // Not fatal: the session might be getting lost, and the application will be notified of
+                            // it through the result of its own calls.
+                            TraceLoggingWriteTagged(local,
+                                                    "InputFramework_BeginFrame_SyncFrameworkActions_Error",
+                                                    TLArg(synced.what(), "Operation"),
+                                                    TLArg(xr::ToCString(synced.result()), "Result"));
+                        }
                     }
                 }
 
                 // We keep track of the current frame time in order to query the tracking information for that frame.
                 m_currentFrameTime = m_waitedFrameTime.front();
                 m_waitedFrameTime.pop_front();
+
+                if (m_eyeGazeActionSpace != XR_NULL_HANDLE && m_wasActionSetsAttached) {
+                    const auto sampled = sampleEyeGaze();
+                    if (!sampled) {
+                        TraceLoggingWriteTagged(local,
+                                                "InputFramework_BeginFrame_SampleEyeGaze_Error",
+                                                TLArg(sampled.what(), "Operation"),
+                                                TLArg(xr::ToCString(sampled.result()), "Result"));
+                    }
+                }
             }
 
             TraceLoggingWriteStop(local, "InputFramework_BeginFrame", TLArg(xr::ToCString(result), "Result"));
@@ -492,6 +1136,60 @@ namespace {
             return result;
         }
 
+        // Must be called with m_frameMutex held.
+        XrExpected<void> syncFrameworkActions(XrSession session, const XrActionsSyncInfo& syncInfo) {
+            RETURN_IF_XR_FAILED(m_forwardDispatch.xrSyncActions(session, &syncInfo));
+            m_actionStateCache.invalidate();
+
+            // The interaction profiles are only queried after a change was reported.
+            // Quirk: OpenComposite waits for an interaction profile to be reported before finishing initialization of
+            // its action system, so we keep querying until we get one.
+            const bool force = m_frameworkActions.isOpenComposite && !m_interactionProfiles.isValid();
+            const auto changed =
+                m_interactionProfiles.update(force, [&](uint32_t side, XrInteractionProfileState& state) {
+                    return xrGetCurrentInteractionProfile(m_session, m_sidePath[side], &state);
+                });
+            if (!changed) {
+                return XrFailure{changed.result(), changed.what()};
+            }
+            if (*changed) {
+                TraceLoggingWrite(
+                    g_traceProvider,
+                    "InputFramework_CurrentInteractionProfiles",
+                    TLArg(getXrPath(m_interactionProfiles.getInteractionProfile(Hands::Left)).c_str(), "Left"),
+                    TLArg(getXrPath(m_interactionProfiles.getInteractionProfile(Hands::Right)).c_str(), "Right"),
+                    TLArg(m_interactionProfiles.getQueryCount(), "QueryCount"),
+                    TLFrameArg());
+            }
+
+            return {};
+        }
+
+        // Locate the eye gaze once for the frame being rendered, and feed it to the classifier. Must be called with
+        // m_frameMutex held, after the framework actions were synchronized.
+        XrExpected<void> sampleEyeGaze() {
+            XrEyeGazeSampleTimeEXT sampleTime{XR_TYPE_EYE_GAZE_SAMPLE_TIME_EXT};
+            XrSpaceLocation location{XR_TYPE_SPACE_LOCATION, &sampleTime};
+            RETURN_IF_XR_FAILED(
+                xrLocateSpace(m_eyeGazeActionSpace, m_eyeGazeReferenceSpace, m_currentFrameTime, &location));
+
+            std::unique_lock lock(m_eyeGazeMutex);
+
+            m_isEyeGazeValid =
+                m_eyeGazeClassifier.addLocation(location, sampleTime.time ? sampleTime.time : m_currentFrameTime);
+
+            return {};
+        }
+
+        // Observe the events polled by the application or by the framework.
+        void onEvent(const XrEventDataBuffer& event) {
+            if (event.type == XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED &&
+                reinterpret_cast<const XrEventDataInteractionProfileChanged&>(event).session == m_session) {
+                m_interactionProfiles.invalidate();
+                m_inputSourceCache.invalidate();
+            }
+        }
+
         XrResult xrAttachSessionActionSets_subst(XrSession session, const XrSessionActionSetsAttachInfo* attachInfo) {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local, "InputFramework_AttachSessionActionSets", TLXArg(session, "Session"));
@@ -500,6 +1198,21 @@ namespace {
                 return XR_ERROR_VALIDATION_FAILURE;
             }
 
+            // The eye gaze action needs a binding in its own interaction profile, which the application might not use.
+            if (m_eyeGazeActionSpace != XR_NULL_HANDLE && !m_wasEyeGazeProfileSuggested) {
+                XrInteractionProfileSuggestedBinding bindings{XR_TYPE_INTERACTION_PROFILE_SUGGESTED_BINDING};
+                CHECK_XRCMD(xrStringToPath(
+                    m_instance, "/interaction_profiles/ext/eye_gaze_interaction", &bindings.interactionProfile));
+                const XrResult suggestResult = xrSuggestInteractionProfileBindings(m_instance, &bindings);
+                if (XR_FAILED(suggestResult)) {
+                    TraceLoggingWriteTagged(local,
+                                            "InputFramework_AttachSessionActionSets_SuggestEyeGazeBindings_Error",
+                                            TLArg(xr::ToCString(suggestResult), "Result"));
+                    ErrorLog(fmt::format("Could not suggest framework's eye gaze bindings: {}\n",
+                                         xr::ToCString(suggestResult)));
+                }
+            }
+
             XrSessionActionSetsAttachInfo chainAttachInfo = *attachInfo;
 
             // Inject our actionset.
@@ -519,6 +1232,8 @@ namespace {
             const XrResult result = m_forwardDispatch.xrAttachSessionActionSets(session, &chainAttachInfo);
             if (XR_SUCCEEDED(result)) {
                 m_wasActionSetsAttached = true;
+                m_interactionProfiles.invalidate();
+                m_inputSourceCache.invalidate();
             }
 
             TraceLoggingWriteStop(
@@ -529,7 +1244,7 @@ namespace {
 
         XrResult xrSyncActions_subst(XrSession session, const XrActionsSyncInfo* syncInfo) {
             TraceLocalActivity(local);
-            TraceLoggingWriteStart(local, "InputFramework_SyncActions", TLXArg(session, "Session"));
+            TraceLoggingWriteStart(local, "InputFramework_SyncActions", TLXArg(session, "Session"), TLFrameArg());
 
             if (syncInfo->type != XR_TYPE_ACTIONS_SYNC_INFO) {
                 return XR_ERROR_VALIDATION_FAILURE;
@@ -541,12 +1256,80 @@ namespace {
             } else {
                 TraceLoggingWriteTagged(local, "InputFramework_SyncActions_Block");
             }
+            m_actionStateCache.invalidate();
 
             TraceLoggingWriteStop(local, "InputFramework_SyncActions", TLArg(xr::ToCString(result), "Result"));
 
             return result;
         }
 
+        template <typename State, typename GetActionState>
+        XrResult getActionState_subst(GetActionState getActionState,
+                                      XrStructureType stateType,
+                                      XrSession session,
+                                      const XrActionStateGetInfo* getInfo,
+                                      State* state) {
+            // Let the runtime report invalid parameters.
+            if (getInfo->type != XR_TYPE_ACTION_STATE_GET_INFO || state->type != stateType) {
+                return getActionState(session, getInfo, state);
+            }
+
+            return m_actionStateCache.getActionState(
+                *getInfo, *state, [&](State& runtimeState) { return getActionState(session, getInfo, &runtimeState); });
+        }
+
+        void invalidateActionStateCache() {
+            m_actionStateCache.invalidate();
+        }
+
+        XrResult xrEnumerateBoundSourcesForAction_subst(XrSession session,
+                                                        const XrBoundSourcesForActionEnumerateInfo* enumerateInfo,
+                                                        uint32_t sourceCapacityInput,
+                                                        uint32_t* sourceCountOutput,
+                                                        XrPath* sources) {
+            const auto enumerateBoundSources = [&](uint32_t capacityInput, uint32_t* countOutput, XrPath* output) {
+                return m_forwardDispatch.xrEnumerateBoundSourcesForAction(
+                    session, enumerateInfo, capacityInput, countOutput, output);
+            };
+
+            // Let the runtime report invalid parameters.
+            if (enumerateInfo->type != XR_TYPE_BOUND_SOURCES_FOR_ACTION_ENUMERATE_INFO || enumerateInfo->next ||
+                !sourceCountOutput || (sourceCapacityInput && !sources)) {
+                return enumerateBoundSources(sourceCapacityInput, sourceCountOutput, sources);
+            }
+
+            return m_inputSourceCache.enumerateBoundSources(
+                enumerateInfo->action, sourceCapacityInput, sourceCountOutput, sources, enumerateBoundSources);
+        }
+
+        XrResult xrGetInputSourceLocalizedName_subst(XrSession session,
+                                                     const XrInputSourceLocalizedNameGetInfo* getInfo,
+                                                     uint32_t bufferCapacityInput,
+                                                     uint32_t* bufferCountOutput,
+                                                     char* buffer) {
+            const auto getLocalizedName = [&](uint32_t capacityInput, uint32_t* countOutput, char* output) {
+                return m_forwardDispatch.xrGetInputSourceLocalizedName(
+                    session, getInfo, capacityInput, countOutput, output);
+            };
+
+            // Let the runtime report invalid parameters.
+            if (getInfo->type != XR_TYPE_INPUT_SOURCE_LOCALIZED_NAME_GET_INFO || getInfo->next || !bufferCountOutput ||
+                (bufferCapacityInput && !buffer)) {
+                return getLocalizedName(bufferCapacityInput, bufferCountOutput, buffer);
+            }
+
+            return m_inputSourceCache.getLocalizedName(getInfo->sourcePath,
+                                                       getInfo->whichComponents,
+                                                       bufferCapacityInput,
+                                                       bufferCountOutput,
+                                                       buffer,
+                                                       getLocalizedName);
+        }
+
+        void invalidateInputSourceCache() {
+            m_inputSourceCache.invalidate();
+        }
+
         const std::string getXrPath(XrPath path) {
             if (path == XR_NULL_PATH) {
                 return "<null>";
@@ -565,16 +1348,25 @@ namespace {
         const XrSession m_session;
         const FrameworkActions m_frameworkActions;
         const PFN_xrSuggestInteractionProfileBindings xrSuggestInteractionProfileBindings;
+        const std::atomic<bool>& m_wasEyeGazeProfileSuggested;
         const ForwardDispatch& m_forwardDispatch;
 
         std::unique_ptr<IInputSessionData> m_sessionData;
 
         bool m_blockApplicationInputs{false};
+        ActionStateCache m_actionStateCache;
+        InputSourceCache m_inputSourceCache;
         XrPath m_sidePath[Hands::Count]{{XR_NULL_PATH}, {XR_NULL_PATH}};
         XrSpace m_aimActionSpace[Hands::Count]{{XR_NULL_HANDLE}, {XR_NULL_HANDLE}};
         bool m_wasActionSetsAttached{false};
         bool m_needPollEvent{false};
-        bool m_isInteractionProfileValid{false};
+        InteractionProfileTracker m_interactionProfiles;
+
+        XrSpace m_eyeGazeActionSpace{XR_NULL_HANDLE};
+        XrSpace m_eyeGazeReferenceSpace{XR_NULL_HANDLE};
+        mutable std::mutex m_eyeGazeMutex;
+        EyeGazeClassifier m_eyeGazeClassifier;
+        bool m_isEyeGazeValid{false};
 
         std::mutex m_frameMutex;
         std::deque<XrTime> m_waitedFrameTime;
@@ -625,10 +1417,11 @@ namespace {
             CHECK_XRCMD(xrGetInstanceProcAddr(
                 instance, "xrPathToString", reinterpret_cast<PFN_xrVoidFunction*>(&xrPathToString)));
 
-            // When using motion controllers, create the necessary actions tied to the instance.
+            // When using motion controllers or eye gaze, create the necessary actions tied to the instance.
             if ((methods & InputMethod::MotionControllerSpatial) == InputMethod::MotionControllerSpatial ||
                 (methods & InputMethod::MotionControllerButtons) == InputMethod::MotionControllerButtons ||
-                (methods & InputMethod::MotionControllerHaptics) == InputMethod::MotionControllerHaptics) {
+                (methods & InputMethod::MotionControllerHaptics) == InputMethod::MotionControllerHaptics ||
+                (methods & InputMethod::EyeGaze) == InputMethod::EyeGaze) {
                 PFN_xrCreateActionSet xrCreateActionSet;
                 CHECK_XRCMD(xrGetInstanceProcAddr(
                     instance, "xrCreateActionSet", reinterpret_cast<PFN_xrVoidFunction*>(&xrCreateActionSet)));
@@ -721,6 +1514,15 @@ namespace {
                     CHECK_XRCMD(
                         xrCreateAction(m_frameworkActions.actionSet, &actionInfo, &m_frameworkActions.hapticAction));
                 }
+
+                if ((methods & InputMethod::EyeGaze) == InputMethod::EyeGaze) {
+                    XrActionCreateInfo actionInfo{XR_TYPE_ACTION_CREATE_INFO};
+                    strcpy(actionInfo.actionName, "eye_gaze");
+                    actionInfo.actionType = XR_ACTION_TYPE_POSE_INPUT;
+                    strcpy(actionInfo.localizedActionName, "Eye Gaze");
+                    CHECK_XRCMD(
+                        xrCreateAction(m_frameworkActions.actionSet, &actionInfo, &m_frameworkActions.eyeGazeAction));
+                }
             }
 
             // xrCreateSession(), xrDestroySession() and xrSuggestInteractionProfileBindings() function pointers are
@@ -757,6 +1559,9 @@ namespace {
                 if (m_frameworkActions.hapticAction != XR_NULL_HANDLE) {
                     xrDestroyAction(m_frameworkActions.hapticAction);
                 }
+                if (m_frameworkActions.eyeGazeAction != XR_NULL_HANDLE) {
+                    xrDestroyAction(m_frameworkActions.eyeGazeAction);
+                }
             }
 
             if (m_frameworkActions.actionSet != XR_NULL_HANDLE) {
@@ -806,6 +1611,48 @@ namespace {
                 m_forwardDispatch.xrSyncActions = reinterpret_cast<PFN_xrSyncActions>(*function);
                 *function = reinterpret_cast<PFN_xrVoidFunction>(hookSyncActions);
             }
+
+            if ((m_methods & InputMethod::ApplicationActionStateCache) == InputMethod::ApplicationActionStateCache) {
+                if (functionName == "xrGetActionStateBoolean") {
+                    m_forwardDispatch.xrGetActionStateBoolean =
+                        reinterpret_cast<PFN_xrGetActionStateBoolean>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookGetActionStateBoolean);
+                } else if (functionName == "xrGetActionStateFloat") {
+                    m_forwardDispatch.xrGetActionStateFloat = reinterpret_cast<PFN_xrGetActionStateFloat>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookGetActionStateFloat);
+                } else if (functionName == "xrGetActionStateVector2f") {
+                    m_forwardDispatch.xrGetActionStateVector2f =
+                        reinterpret_cast<PFN_xrGetActionStateVector2f>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookGetActionStateVector2f);
+                } else if (functionName == "xrGetActionStatePose") {
+                    m_forwardDispatch.xrGetActionStatePose = reinterpret_cast<PFN_xrGetActionStatePose>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookGetActionStatePose);
+                }
+            }
+
+            if ((m_methods & InputMethod::ApplicationInputSourceCache) == InputMethod::ApplicationInputSourceCache) {
+                if (functionName == "xrEnumerateBoundSourcesForAction") {
+                    m_forwardDispatch.xrEnumerateBoundSourcesForAction =
+                        reinterpret_cast<PFN_xrEnumerateBoundSourcesForAction>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookEnumerateBoundSourcesForAction);
+                } else if (functionName == "xrGetInputSourceLocalizedName") {
+                    m_forwardDispatch.xrGetInputSourceLocalizedName =
+                        reinterpret_cast<PFN_xrGetInputSourceLocalizedName>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookGetInputSourceLocalizedName);
+                }
+            }
+
+            // Both caches are keyed by action handles, which might be reused after destruction.
+            if ((m_methods & InputMethod::ApplicationActionStateCache) == InputMethod::ApplicationActionStateCache ||
+                (m_methods & InputMethod::ApplicationInputSourceCache) == InputMethod::ApplicationInputSourceCache) {
+                if (functionName == "xrDestroyAction") {
+                    xrDestroyAction = reinterpret_cast<PFN_xrDestroyAction>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroyAction);
+                } else if (functionName == "xrDestroyActionSet") {
+                    xrDestroyActionSet = reinterpret_cast<PFN_xrDestroyActionSet>(*function);
+                    *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroyActionSet);
+                }
+            }
         }
 
         XrResult xrPollEvent_subst(XrInstance instance, XrEventDataBuffer* eventData) {
@@ -816,6 +1663,11 @@ namespace {
             if (XR_SUCCEEDED(result)) {
                 m_needPollEvent = false;
             }
+            if (result == XR_SUCCESS) {
+                m_sessions.forEach([&](XrSession session, InputFramework& inputFramework) {
+                    inputFramework.onEvent(*eventData);
+                });
+            }
 
             TraceLoggingWriteStop(local, "InputFrameworkFactory_xrPollEvent", TLArg(xr::ToCString(result), "Result"));
 
@@ -823,14 +1675,12 @@ namespace {
         }
 
         IInputFramework* getInputFramework(XrSession session) override {
-            std::unique_lock lock(m_sessionsMutex);
-
-            auto it = m_sessions.find(session);
-            if (it == m_sessions.end()) {
+            InputFramework* inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
                 throw std::runtime_error("No session found");
             }
 
-            return it->second.get();
+            return inputFramework;
         }
 
         XrResult xrCreateSession_subst(XrInstance instance, const XrSessionCreateInfo* createInfo, XrSession* session) {
@@ -839,19 +1689,17 @@ namespace {
 
             const XrResult result = xrCreateSession(instance, createInfo, session);
             if (XR_SUCCEEDED(result)) {
-                std::unique_lock lock(m_sessionsMutex);
-
-                m_sessions.insert_or_assign(
-                    *session,
-                    std::move(std::make_unique<InputFramework>(m_instanceInfo,
-                                                               m_instance,
-                                                               xrGetInstanceProcAddr,
-                                                               *createInfo,
-                                                               *session,
-                                                               m_frameworkActions,
-                                                               hookSuggestInteractionProfileBindings,
-                                                               m_forwardDispatch,
-                                                               m_methods)));
+                m_sessions.insert(*session,
+                                  std::make_unique<InputFramework>(m_instanceInfo,
+                                                                   m_instance,
+                                                                   xrGetInstanceProcAddr,
+                                                                   *createInfo,
+                                                                   *session,
+                                                                   m_frameworkActions,
+                                                                   hookSuggestInteractionProfileBindings,
+                                                                   m_wasEyeGazeProfileSuggested,
+                                                                   m_forwardDispatch,
+                                                                   m_methods));
             }
 
             TraceLoggingWriteStop(local,
@@ -866,14 +1714,7 @@ namespace {
             TraceLocalActivity(local);
             TraceLoggingWriteStart(local, "InputFrameworkFactory_DestroySession", TLXArg(session, "Session"));
 
-            {
-                std::unique_lock lock(m_sessionsMutex);
-
-                auto it = m_sessions.find(session);
-                if (it != m_sessions.end()) {
-                    m_sessions.erase(it);
-                }
-            }
+            m_sessions.erase(session);
             const XrResult result = xrDestroySession(session);
 
             TraceLoggingWriteStop(
@@ -991,10 +1832,24 @@ namespace {
                 injectLeftRightBinding(m_frameworkActions.hapticAction, "/output/haptic");
             }
 
+            const bool isEyeGazeProfile = interationProfile == "/interaction_profiles/ext/eye_gaze_interaction";
+            if (isEyeGazeProfile && m_frameworkActions.eyeGazeAction != XR_NULL_HANDLE) {
+                XrPath eyeGazePath = XR_NULL_PATH;
+                CHECK_XRCMD(xrStringToPath(m_instance, "/user/eyes_ext/input/gaze_ext/pose", &eyeGazePath));
+                TraceLoggingWriteTagged(local,
+                                        "InputFrameworkFactory_SuggestInteractionProfileBindings_Inject",
+                                        TLArg("Eyes", "Side"),
+                                        TLArg("/input/gaze_ext/pose", "ActionPath"));
+                updatedBindings.push_back({m_frameworkActions.eyeGazeAction, eyeGazePath});
+            }
+
             chainSuggestedBindings.suggestedBindings = updatedBindings.data();
             chainSuggestedBindings.countSuggestedBindings = static_cast<uint32_t>(updatedBindings.size());
 
             const XrResult result = xrSuggestInteractionProfileBindings(instance, &chainSuggestedBindings);
+            if (XR_SUCCEEDED(result) && isEyeGazeProfile) {
+                m_wasEyeGazeProfileSuggested = true;
+            }
 
             TraceLoggingWriteStop(local,
                                   "InputFrameworkFactory_SuggestInteractionProfileBindings",
@@ -1004,23 +1859,130 @@ namespace {
         }
 
         XrResult xrWaitFrame_subst(XrSession session, const XrFrameWaitInfo* frameWaitInfo, XrFrameState* frameState) {
-            InputFramework* inputFramework = static_cast<InputFramework*>(getInputFramework(session));
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
             inputFramework->updateNeedPollEvent(m_needPollEvent);
             return inputFramework->xrWaitFrame_subst(session, frameWaitInfo, frameState);
         }
 
         XrResult xrBeginFrame_subst(XrSession session, const XrFrameBeginInfo* frameBeginInfo) {
-            return static_cast<InputFramework*>(getInputFramework(session))
-                ->xrBeginFrame_subst(session, frameBeginInfo);
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->xrBeginFrame_subst(session, frameBeginInfo);
         }
 
         XrResult xrAttachSessionActionSets_subst(XrSession session, const XrSessionActionSetsAttachInfo* attachInfo) {
-            return static_cast<InputFramework*>(getInputFramework(session))
-                ->xrAttachSessionActionSets_subst(session, attachInfo);
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->xrAttachSessionActionSets_subst(session, attachInfo);
         }
 
         XrResult xrSyncActions_subst(XrSession session, const XrActionsSyncInfo* syncInfo) {
-            return static_cast<InputFramework*>(getInputFramework(session))->xrSyncActions_subst(session, syncInfo);
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->xrSyncActions_subst(session, syncInfo);
+        }
+
+        XrResult xrGetActionStateBoolean_subst(XrSession session,
+                                               const XrActionStateGetInfo* getInfo,
+                                               XrActionStateBoolean* state) {
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->getActionState_subst(
+                m_forwardDispatch.xrGetActionStateBoolean, XR_TYPE_ACTION_STATE_BOOLEAN, session, getInfo, state);
+        }
+
+        XrResult xrGetActionStateFloat_subst(XrSession session,
+                                             const XrActionStateGetInfo* getInfo,
+                                             XrActionStateFloat* state) {
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->getActionState_subst(
+                m_forwardDispatch.xrGetActionStateFloat, XR_TYPE_ACTION_STATE_FLOAT, session, getInfo, state);
+        }
+
+        XrResult xrGetActionStateVector2f_subst(XrSession session,
+                                                const XrActionStateGetInfo* getInfo,
+                                                XrActionStateVector2f* state) {
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->getActionState_subst(
+                m_forwardDispatch.xrGetActionStateVector2f, XR_TYPE_ACTION_STATE_VECTOR2F, session, getInfo, state);
+        }
+
+        XrResult xrGetActionStatePose_subst(XrSession session,
+                                            const XrActionStateGetInfo* getInfo,
+                                            XrActionStatePose* state) {
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->getActionState_subst(
+                m_forwardDispatch.xrGetActionStatePose, XR_TYPE_ACTION_STATE_POSE, session, getInfo, state);
+        }
+
+        XrResult xrEnumerateBoundSourcesForAction_subst(XrSession session,
+                                                        const XrBoundSourcesForActionEnumerateInfo* enumerateInfo,
+                                                        uint32_t sourceCapacityInput,
+                                                        uint32_t* sourceCountOutput,
+                                                        XrPath* sources) {
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->xrEnumerateBoundSourcesForAction_subst(
+                session, enumerateInfo, sourceCapacityInput, sourceCountOutput, sources);
+        }
+
+        XrResult xrGetInputSourceLocalizedName_subst(XrSession session,
+                                                     const XrInputSourceLocalizedNameGetInfo* getInfo,
+                                                     uint32_t bufferCapacityInput,
+                                                     uint32_t* bufferCountOutput,
+                                                     char* buffer) {
+            InputFramework* const inputFramework = m_sessions.find(session);
+            if (!inputFramework) {
+                return XR_ERROR_HANDLE_INVALID;
+            }
+            return inputFramework->xrGetInputSourceLocalizedName_subst(
+                session, getInfo, bufferCapacityInput, bufferCountOutput, buffer);
+        }
+
+        // A new action might reuse the handle of a destroyed one before the next sync.
+        XrResult xrDestroyAction_subst(XrAction action) {
+            const XrResult result = xrDestroyAction(action);
+            if (XR_SUCCEEDED(result)) {
+                invalidateActionCaches();
+            }
+            return result;
+        }
+
+        XrResult xrDestroyActionSet_subst(XrActionSet actionSet) {
+            const XrResult result = xrDestroyActionSet(actionSet);
+            if (XR_SUCCEEDED(result)) {
+                invalidateActionCaches();
+            }
+            return result;
+        }
+
+        void invalidateActionCaches() {
+            m_sessions.forEach([](XrSession session, InputFramework& inputFramework) {
+                inputFramework.invalidateActionStateCache();
+                inputFramework.invalidateInputSourceCache();
+            });
         }
 
         const std::string getXrPath(XrPath path) {
@@ -1043,8 +2005,7 @@ namespace {
         std::vector<std::string> m_instanceExtensions;
         std::vector<const char*> m_instanceExtensionsArray;
 
-        std::mutex m_sessionsMutex;
-        std::unordered_map<XrSession, std::unique_ptr<InputFramework>> m_sessions;
+        HandleMap<XrSession, InputFramework> m_sessions;
 
         FrameworkActions m_frameworkActions;
 
@@ -1054,8 +2015,11 @@ namespace {
         PFN_xrSuggestInteractionProfileBindings xrSuggestInteractionProfileBindings{nullptr};
         PFN_xrStringToPath xrStringToPath{nullptr};
         PFN_xrPathToString xrPathToString{nullptr};
+        PFN_xrDestroyAction xrDestroyAction{nullptr};
+        PFN_xrDestroyActionSet xrDestroyActionSet{nullptr};
         ForwardDispatch m_forwardDispatch;
         bool m_needPollEvent{true};
+        std::atomic<bool> m_wasEyeGazeProfileSuggested{false};
 
         static inline std::mutex factoryMutex;
         static inline InputFrameworkFactory* factory{nullptr};
@@ -1097,6 +2061,57 @@ namespace {
         static XrResult XRAPI_CALL hookSyncActions(XrSession session, const XrActionsSyncInfo* syncInfo) {
             return factory->xrSyncActions_subst(session, syncInfo);
         }
+
+        static XrResult XRAPI_CALL hookGetActionStateBoolean(XrSession session,
+                                                             const XrActionStateGetInfo* getInfo,
+                                                             XrActionStateBoolean* state) {
+            return factory->xrGetActionStateBoolean_subst(session, getInfo, state);
+        }
+
+        static XrResult XRAPI_CALL hookGetActionStateFloat(XrSession session,
+                                                           const XrActionStateGetInfo* getInfo,
+                                                           XrActionStateFloat* state) {
+            return factory->xrGetActionStateFloat_subst(session, getInfo, state);
+        }
+
+        static XrResult XRAPI_CALL hookGetActionStateVector2f(XrSession session,
+                                                              const XrActionStateGetInfo* getInfo,
+                                                              XrActionStateVector2f* state) {
+            return factory->xrGetActionStateVector2f_subst(session, getInfo, state);
+        }
+
+        static XrResult XRAPI_CALL hookGetActionStatePose(XrSession session,
+                                                          const XrActionStateGetInfo* getInfo,
+                                                          XrActionStatePose* state) {
+            return factory->xrGetActionStatePose_subst(session, getInfo, state);
+        }
+
+        static XrResult XRAPI_CALL
+        hookEnumerateBoundSourcesForAction(XrSession session,
+                                           const XrBoundSourcesForActionEnumerateInfo* enumerateInfo,
+                                           uint32_t sourceCapacityInput,
+                                           uint32_t* sourceCountOutput,
+                                           XrPath* sources) {
+            return factory->xrEnumerateBoundSourcesForAction_subst(
+                session, enumerateInfo, sourceCapacityInput, sourceCountOutput, sources);
+        }
+
+        static XrResult XRAPI_CALL hookGetInputSourceLocalizedName(XrSession session,
+                                                                   const XrInputSourceLocalizedNameGetInfo* getInfo,
+                                                                   uint32_t bufferCapacityInput,
+                                                                   uint32_t* bufferCountOutput,
+                                                                   char* buffer) {
+            return factory->xrGetInputSourceLocalizedName_subst(
+                session, getInfo, bufferCapacityInput, bufferCountOutput, buffer);
+        }
+
+        static XrResult XRAPI_CALL hookDestroyAction(XrAction action) {
+            return factory->xrDestroyAction_subst(action);
+        }
+
+        static XrResult XRAPI_CALL hookDestroyActionSet(XrActionSet actionSet) {
+            return factory->xrDestroyActionSet_subst(actionSet);
+        }
     };
 
 } // namespace
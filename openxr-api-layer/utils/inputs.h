@@ -42,6 +42,16 @@ namespace openxr_api_layer::utils::inputs {
 
         // Use the motion controller haptics.
         MotionControllerHaptics = (1 << 2),
+
+        // Serve the application's repeated xrGetActionState*() queries from a cache until its next xrSyncActions().
+        ApplicationActionStateCache = (1 << 3),
+
+        // Serve the application's xrEnumerateBoundSourcesForAction() and xrGetInputSourceLocalizedName() queries from a
+        // cache until the interaction profiles change.
+        ApplicationInputSourceCache = (1 << 4),
+
+        // Use the eye gaze, with fixation filtering. Requires XR_EXT_eye_gaze_interaction (eg: via implicitExtensions).
+        EyeGaze = (1 << 5),
     };
     DEFINE_ENUM_FLAG_OPERATORS(InputMethod);
 
@@ -53,6 +63,56 @@ namespace openxr_api_layer::utils::inputs {
         ThumbstickClick,
     };
 
+    // The eye movement classification of the latest eye gaze sample.
+    enum class EyeMovement {
+        // Not enough samples yet, or a slow movement that is not a fixation (eg: smooth pursuit).
+        Undetermined = 0,
+        Fixation,
+        Saccade,
+    };
+
+    // The thresholds of the eye movement classifier, which combines a velocity criterion (I-VT) and a dispersion
+    // criterion (I-DT).
+    struct EyeGazeFilterSettings {
+        // A sample moving faster than this is part of a saccade.
+        float saccadeVelocityDegreesPerSecond{70.f};
+
+        // A fixation is at least minFixationDuration of samples whose directions fit in a cone of this aperture around
+        // their mean direction.
+        float fixationDispersionDegrees{1.5f};
+        XrDuration minFixationDuration{100'000'000};
+
+        // The time constant of the smoothing applied outside of fixations. Fixations report their mean direction.
+        XrDuration smoothingTimeConstant{20'000'000};
+    };
+
+    struct EyeGazeState {
+        // The filtered gaze ray. The -Z axis of the pose points to where the user looks.
+        XrPosef ray;
+        EyeMovement movement;
+        float angularVelocityDegreesPerSecond;
+
+        // The time since the current fixation started, or 0.
+        XrDuration fixationDuration;
+        XrTime sampleTime;
+    };
+
+    struct ActionStateCacheStatistics {
+        uint64_t syncCount{0};
+
+        // Queries served from the cache, and queries forwarded to the runtime.
+        uint64_t hitCount{0};
+        uint64_t missCount{0};
+    };
+
+    struct InputSourceCacheStatistics {
+        uint64_t invalidationCount{0};
+
+        // Queries served from the cache, and queries forwarded to the runtime.
+        uint64_t hitCount{0};
+        uint64_t missCount{0};
+    };
+
     // A container for user session data.
     // This class is meant to be extended by a caller before use with IInputFramework::setSessionData() and
     // IInputFramework::getSessionData().
@@ -71,16 +131,71 @@ namespace openxr_api_layer::utils::inputs {
 
         virtual void blockApplicationInput(bool blocked) = 0;
 
+        // The try*() methods do not throw, and should be preferred in the per-frame paths. Calling a method for an
+        // input method that was not requested fails with XR_ERROR_FUNCTION_UNSUPPORTED.
+
         // Can only be called if the MotionControllerSpatial input method was requested.
-        virtual XrSpaceLocationFlags locateMotionController(uint32_t side, XrSpace baseSpace, XrPosef& pose) const = 0;
+        virtual XrExpected<XrSpaceLocationFlags>
+        tryLocateMotionController(uint32_t side, XrSpace baseSpace, XrPosef& pose) const = 0;
         virtual XrSpace getMotionControllerSpace(uint32_t side) const = 0;
 
         // Can only be called if the MotionControllerButtons input method was requested.
-        virtual bool getMotionControllerButtonState(uint32_t side, MotionControllerButton button) const = 0;
-        virtual XrVector2f getMotionControllerThumbstickState(uint32_t side) const = 0;
+        virtual XrExpected<bool> tryGetMotionControllerButtonState(uint32_t side,
+                                                                   MotionControllerButton button) const = 0;
+        virtual XrExpected<XrVector2f> tryGetMotionControllerThumbstickState(uint32_t side) const = 0;
 
         // Can only be called if the MotionControllerHaptics input method was requested.
-        virtual void pulseMotionControllerHaptics(uint32_t side, float strength) const = 0;
+        virtual XrExpected<void> tryPulseMotionControllerHaptics(uint32_t side, float strength) const = 0;
+
+        // Can only be called if the EyeGaze input method was requested. Fails with XR_ERROR_FUNCTION_UNSUPPORTED if the
+        // system does not support eye gaze interaction. The eye gaze is sampled and filtered once per frame, for the
+        // frame being rendered. Returns false if no valid sample is available (eg: the eye tracker lost the eyes).
+        virtual XrExpected<bool> tryGetEyeGaze(XrSpace baseSpace, EyeGazeState& state) const = 0;
+        virtual void setEyeGazeFilterSettings(const EyeGazeFilterSettings& settings) = 0;
+
+        XrSpaceLocationFlags locateMotionController(uint32_t side, XrSpace baseSpace, XrPosef& pose) const {
+            auto locationFlags = tryLocateMotionController(side, baseSpace, pose);
+            CHECK_XREXPECTED(locationFlags);
+            return locationFlags.value();
+        }
+        bool getMotionControllerButtonState(uint32_t side, MotionControllerButton button) const {
+            auto state = tryGetMotionControllerButtonState(side, button);
+            CHECK_XREXPECTED(state);
+            return state.value();
+        }
+
+        XrVector2f getMotionControllerThumbstickState(uint32_t side) const {
+            auto state = tryGetMotionControllerThumbstickState(side);
+            CHECK_XREXPECTED(state);
+            return state.value();
+        }
+        void pulseMotionControllerHaptics(uint32_t side, float strength) const {
+            CHECK_XREXPECTED(tryPulseMotionControllerHaptics(side, strength));
+        }
+
+        // Hit test the eye gaze against quads located in baseSpace. Returns the index of the nearest quad being looked
+        // at (with its hitPose), or -1.
+        XrExpected<int32_t> tryGetEyeGazeHit(XrSpace baseSpace,
+                                             const XrPosef* quadCenters,
+                                             const XrExtent2Df* quadSizes,
+                                             uint32_t quadCount,
+                                             XrPosef& hitPose) const {
+            EyeGazeState state;
+            const auto isValid = tryGetEyeGaze(baseSpace, state);
+            if (!isValid) {
+                return XrFailure{isValid.result(), isValid.what()};
+            }
+            if (!*isValid) {
+                return -1;
+            }
+            return general::hitTestQuads(state.ray, quadCenters, quadSizes, quadCount, hitPose);
+        }
+
+        // Only meaningful if the ApplicationActionStateCache input method was requested.
+        virtual ActionStateCacheStatistics getActionStateCacheStatistics() const = 0;
+
+        // Only meaningful if the ApplicationInputSourceCache input method was requested.
+        virtual InputSourceCacheStatistics getInputSourceCacheStatistics() const = 0;
 
         template <typename SessionData>
         typename SessionData* getSessionData() const {
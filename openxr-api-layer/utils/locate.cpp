@@ -0,0 +1,387 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "tracking.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::tracking;
+
+    // The cache only needs to hold what an application locates within one frame.
+    constexpr size_t MaxEntries = 64;
+
+    using Clock = std::chrono::steady_clock;
+
+    class LocateCache {
+      public:
+        // The query is invoked on a cache miss to locate the space with the runtime.
+        template <typename Query>
+        XrResult locateSpace(
+            XrSpace space, XrSpace baseSpace, XrTime time, XrSpaceLocation& location, const Query& query) {
+            // Extension structures (eg: XrSpaceVelocity) are not cached.
+            if (location.next) {
+                std::unique_lock lock(m_mutex);
+                m_statistics.bypassCount++;
+                lock.unlock();
+
+                return query(location);
+            }
+
+            uint64_t generation;
+            {
+                std::unique_lock lock(m_mutex);
+
+                for (const SpaceEntry& entry : m_spaces) {
+                    if (entry.space == space && entry.baseSpace == baseSpace && entry.time == time) {
+                        location.locationFlags = entry.locationFlags;
+                        location.pose = entry.pose;
+                        m_statistics.hitCount++;
+                        return XR_SUCCESS;
+                    }
+                }
+                m_statistics.missCount++;
+                generation = m_generation;
+            }
+
+            const auto start = Clock::now();
+            const XrResult result = query(location);
+            const auto duration = Clock::now() - start;
+
+            std::unique_lock lock(m_mutex);
+
+            m_forwardedDuration += duration;
+            m_forwardedCount++;
+
+            // Discard the location if the cache was cleared during the query.
+            if (result == XR_SUCCESS && generation == m_generation && m_spaces.size() < MaxEntries) {
+                m_spaces.push_back({space, baseSpace, time, location.locationFlags, location.pose});
+            }
+
+            return result;
+        }
+
+        // The query is invoked on a cache miss to locate the views with the runtime.
+        template <typename Query>
+        XrResult locateViews(const XrViewLocateInfo& viewLocateInfo,
+                             XrViewState& viewState,
+                             uint32_t viewCapacityInput,
+                             uint32_t* viewCountOutput,
+                             XrView* views,
+                             const Query& query) {
+            bool hasExtensions = viewLocateInfo.next || viewState.next;
+            for (uint32_t i = 0; i < viewCapacityInput && views; i++) {
+                hasExtensions = hasExtensions || views[i].next;
+            }
+
+            uint64_t generation;
+            {
+                std::unique_lock lock(m_mutex);
+
+                if (hasExtensions) {
+                    m_statistics.bypassCount++;
+                    lock.unlock();
+
+                    return query();
+                }
+
+                for (const ViewsEntry& entry : m_views) {
+                    if (entry.viewConfigurationType != viewLocateInfo.viewConfigurationType ||
+                        entry.displayTime != viewLocateInfo.displayTime || entry.space != viewLocateInfo.space) {
+                        continue;
+                    }
+
+                    // Let the runtime report an insufficient capacity.
+                    const uint32_t viewCount = static_cast<uint32_t>(entry.views.size());
+                    if (viewCapacityInput && viewCapacityInput < viewCount) {
+                        break;
+                    }
+
+                    viewState.viewStateFlags = entry.viewStateFlags;
+                    *viewCountOutput = viewCount;
+                    for (uint32_t i = 0; i < viewCapacityInput && i < viewCount; i++) {
+                        views[i].pose = entry.views[i].pose;
+                        views[i].fov = entry.views[i].fov;
+                    }
+                    m_statistics.hitCount++;
+                    return XR_SUCCESS;
+                }
+
+                // Sizing calls do not return views to cache.
+                if (!viewCapacityInput) {
+                    m_statistics.bypassCount++;
+                    lock.unlock();
+
+                    return query();
+                }
+
+                m_statistics.missCount++;
+                generation = m_generation;
+            }
+
+            const auto start = Clock::now();
+            const XrResult result = query();
+            const auto duration = Clock::now() - start;
+
+            std::unique_lock lock(m_mutex);
+
+            m_forwardedDuration += duration;
+            m_forwardedCount++;
+
+            if (result == XR_SUCCESS && generation == m_generation && m_views.size() < MaxEntries) {
+                ViewsEntry entry;
+                entry.viewConfigurationType = viewLocateInfo.viewConfigurationType;
+                entry.displayTime = viewLocateInfo.displayTime;
+                entry.space = viewLocateInfo.space;
+                entry.viewStateFlags = viewState.viewStateFlags;
+                for (uint32_t i = 0; i < *viewCountOutput; i++) {
+                    entry.views.push_back({views[i].pose, views[i].fov});
+                }
+                m_views.push_back(std::move(entry));
+            }
+
+            return result;
+        }
+
+        void clear() {
+            std::unique_lock lock(m_mutex);
+
+            m_spaces.clear();
+            m_views.clear();
+            m_generation++;
+        }
+
+        LocateCacheStatistics getStatistics() const {
+            std::unique_lock lock(m_mutex);
+
+            LocateCacheStatistics statistics = m_statistics;
+            if (m_forwardedCount) {
+                const double averageUs =
+                    std::chrono::duration<double, std::micro>(m_forwardedDuration).count() / m_forwardedCount;
+                statistics.timeSavedUs = averageUs * statistics.hitCount;
+            }
+            return statistics;
+        }
+
+      private:
+        struct SpaceEntry {
+            XrSpace space;
+            XrSpace baseSpace;
+            XrTime time;
+            XrSpaceLocationFlags locationFlags;
+            XrPosef pose;
+        };
+
+        struct ViewsEntry {
+            XrViewConfigurationType viewConfigurationType;
+            XrTime displayTime;
+            XrSpace space;
+            XrViewStateFlags viewStateFlags;
+
+            struct View {
+                XrPosef pose;
+                XrFovf fov;
+            };
+            std::vector<View> views;
+        };
+
+        mutable std::mutex m_mutex;
+        std::vector<SpaceEntry> m_spaces;
+        std::vector<ViewsEntry> m_views;
+        uint64_t m_generation{0};
+
+        LocateCacheStatistics m_statistics;
+        Clock::duration m_forwardedDuration{0};
+        uint64_t m_forwardedCount{0};
+    };
+
+    struct LocateCacheFactory : ILocateCacheFactory {
+        LocateCacheFactory() {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "LocateCacheFactory_Create");
+
+            {
+                std::unique_lock lock(factoryMutex);
+                if (factory) {
+                    throw std::runtime_error("There can only be one LocateCache factory");
+                }
+                factory = this;
+            }
+
+            TraceLoggingWriteStop(local, "LocateCacheFactory_Create", TLPArg(this, "LocateCacheFactory"));
+        }
+
+        ~LocateCacheFactory() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "LocateCacheFactory_Destroy");
+
+            const LocateCacheStatistics statistics = m_cache.getStatistics();
+            const uint64_t lookups = statistics.hitCount + statistics.missCount;
+            if (lookups) {
+                Log(fmt::format("Locate cache: {:.1f}% hit rate over {} lookups, {:.1f} ms saved\n",
+                                100.0 * statistics.hitCount / lookups,
+                                lookups,
+                                statistics.timeSavedUs / 1000));
+            }
+
+            {
+                std::unique_lock lock(factoryMutex);
+
+                factory = nullptr;
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "LocateCacheFactory_Destroy",
+                                  TLArg(statistics.hitCount, "HitCount"),
+                                  TLArg(statistics.missCount, "MissCount"),
+                                  TLArg(statistics.bypassCount, "BypassCount"));
+        }
+
+        void xrGetInstanceProcAddr_post(XrInstance instance, const char* name, PFN_xrVoidFunction* function) override {
+            const std::string_view functionName(name);
+            if (functionName == "xrLocateSpace") {
+                xrLocateSpace = reinterpret_cast<PFN_xrLocateSpace>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookLocateSpace);
+            } else if (functionName == "xrLocateViews") {
+                xrLocateViews = reinterpret_cast<PFN_xrLocateViews>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookLocateViews);
+            } else if (functionName == "xrWaitFrame") {
+                xrWaitFrame = reinterpret_cast<PFN_xrWaitFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookWaitFrame);
+            } else if (functionName == "xrSyncActions") {
+                xrSyncActions = reinterpret_cast<PFN_xrSyncActions>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookSyncActions);
+            } else if (functionName == "xrDestroySpace") {
+                xrDestroySpace = reinterpret_cast<PFN_xrDestroySpace>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySpace);
+            }
+        }
+
+        LocateCacheStatistics getStatistics() const override {
+            return m_cache.getStatistics();
+        }
+
+        XrResult xrLocateSpace_subst(XrSpace space, XrSpace baseSpace, XrTime time, XrSpaceLocation* location) {
+            if (location->type != XR_TYPE_SPACE_LOCATION) {
+                return xrLocateSpace(space, baseSpace, time, location);
+            }
+
+            return m_cache.locateSpace(space, baseSpace, time, *location, [&](XrSpaceLocation& runtimeLocation) {
+                return xrLocateSpace(space, baseSpace, time, &runtimeLocation);
+            });
+        }
+
+        XrResult xrLocateViews_subst(XrSession session,
+                                     const XrViewLocateInfo* viewLocateInfo,
+                                     XrViewState* viewState,
+                                     uint32_t viewCapacityInput,
+                                     uint32_t* viewCountOutput,
+                                     XrView* views) {
+            if (viewLocateInfo->type != XR_TYPE_VIEW_LOCATE_INFO || viewState->type != XR_TYPE_VIEW_STATE ||
+                (viewCapacityInput && !views)) {
+                return xrLocateViews(session, viewLocateInfo, viewState, viewCapacityInput, viewCountOutput, views);
+            }
+
+            return m_cache.locateViews(*viewLocateInfo, *viewState, viewCapacityInput, viewCountOutput, views, [&]() {
+                return xrLocateViews(session, viewLocateInfo, viewState, viewCapacityInput, viewCountOutput, views);
+            });
+        }
+
+        XrResult xrWaitFrame_subst(XrSession session, const XrFrameWaitInfo* frameWaitInfo, XrFrameState* frameState) {
+            const XrResult result = xrWaitFrame(session, frameWaitInfo, frameState);
+            m_cache.clear();
+
+            return result;
+        }
+
+        // Action spaces may be bound to different inputs after a sync.
+        XrResult xrSyncActions_subst(XrSession session, const XrActionsSyncInfo* syncInfo) {
+            const XrResult result = xrSyncActions(session, syncInfo);
+            m_cache.clear();
+
+            return result;
+        }
+
+        // A new space might reuse the handle of a destroyed one.
+        XrResult xrDestroySpace_subst(XrSpace space) {
+            const XrResult result = xrDestroySpace(space);
+            m_cache.clear();
+
+            return result;
+        }
+
+        LocateCache m_cache;
+
+        PFN_xrLocateSpace xrLocateSpace{nullptr};
+        PFN_xrLocateViews xrLocateViews{nullptr};
+        PFN_xrWaitFrame xrWaitFrame{nullptr};
+        PFN_xrSyncActions xrSyncActions{nullptr};
+        PFN_xrDestroySpace xrDestroySpace{nullptr};
+
+        static inline std::mutex factoryMutex;
+        static inline LocateCacheFactory* factory{nullptr};
+
+        static XrResult XRAPI_CALL hookLocateSpace(XrSpace space,
+                                                   XrSpace baseSpace,
+                                                   XrTime time,
+                                                   XrSpaceLocation* location) {
+            return factory->xrLocateSpace_subst(space, baseSpace, time, location);
+        }
+
+        static XrResult XRAPI_CALL hookLocateViews(XrSession session,
+                                                   const XrViewLocateInfo* viewLocateInfo,
+                                                   XrViewState* viewState,
+                                                   uint32_t viewCapacityInput,
+                                                   uint32_t* viewCountOutput,
+                                                   XrView* views) {
+            return factory->xrLocateViews_subst(
+                session, viewLocateInfo, viewState, viewCapacityInput, viewCountOutput, views);
+        }
+
+        static XrResult XRAPI_CALL hookWaitFrame(XrSession session,
+                                                 const XrFrameWaitInfo* frameWaitInfo,
+                                                 XrFrameState* frameState) {
+            return factory->xrWaitFrame_subst(session, frameWaitInfo, frameState);
+        }
+
+        static XrResult XRAPI_CALL hookSyncActions(XrSession session, const XrActionsSyncInfo* syncInfo) {
+            return factory->xrSyncActions_subst(session, syncInfo);
+        }
+
+        static XrResult XRAPI_CALL hookDestroySpace(XrSpace space) {
+            return factory->xrDestroySpace_subst(space);
+        }
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::tracking {
+
+    std::shared_ptr<ILocateCacheFactory> createLocateCacheFactory() {
+        return std::make_shared<LocateCacheFactory>();
+    }
+
+} // namespace openxr_api_layer::utils::tracking
@@ -0,0 +1,278 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "general.h"
+#include "graphics.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+
+    // The smallest dimension of a tier.
+    constexpr uint32_t MinTierSize = 16;
+
+    float getLength(const XrVector2f& a, const XrVector2f& b, float pixelsPerTangentX, float pixelsPerTangentY) {
+        const float dx = (b.x - a.x) * pixelsPerTangentX;
+        const float dy = (b.y - a.y) * pixelsPerTangentY;
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    struct Overlay {
+        std::string name;
+        std::vector<std::shared_ptr<ISwapchain>> tiers;
+
+        uint32_t tier{0};
+        uint32_t framesBelowTier{0};
+        XrExtent2Di requiredResolution{};
+        uint64_t tierChanges{0};
+    };
+
+    struct QuadLodManager : IQuadLodManager {
+        QuadLodManager(ICompositionFramework* compositionFramework,
+                       const XrExtent2Di& recommendedImageSize,
+                       const QuadLodOptions& options)
+            : m_compositionFramework(compositionFramework), m_recommendedImageSize(recommendedImageSize),
+              m_options(options) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "QuadLodManager_Create",
+                                   TLArg(recommendedImageSize.width, "RecommendedWidth"),
+                                   TLArg(recommendedImageSize.height, "RecommendedHeight"),
+                                   TLArg(options.tierCount, "TierCount"),
+                                   TLArg(options.oversampling, "Oversampling"),
+                                   TLArg(options.downscaleMargin, "DownscaleMargin"),
+                                   TLArg(options.hysteresisFrames, "HysteresisFrames"));
+
+            if (!m_options.tierCount) {
+                throw std::runtime_error("At least one tier is required");
+            }
+            if (!(m_options.downscaleMargin > 0.f && m_options.downscaleMargin <= 1.f)) {
+                throw std::runtime_error("Downscale margin must be within (0, 1]");
+            }
+
+            TraceLoggingWriteStop(local, "QuadLodManager_Create", TLPArg(this, "LodManager"));
+        }
+
+        uint32_t registerOverlay(const std::string& name,
+                                 const XrSwapchainCreateInfo& infoOnApplicationDevice,
+                                 SwapchainMode mode) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "QuadLodManager_RegisterOverlay",
+                                   TLPArg(this, "LodManager"),
+                                   TLArg(name.c_str(), "Name"),
+                                   TLArg(infoOnApplicationDevice.width, "Width"),
+                                   TLArg(infoOnApplicationDevice.height, "Height"));
+
+            // Allocate all the tiers upfront, to switch between them without stalling.
+            Overlay entry;
+            entry.name = name;
+            XrSwapchainCreateInfo tierInfo = infoOnApplicationDevice;
+            for (uint32_t i = 0; i < m_options.tierCount; i++) {
+                if (i && (tierInfo.width / 2 < MinTierSize || tierInfo.height / 2 < MinTierSize)) {
+                    break;
+                }
+                if (i) {
+                    tierInfo.width /= 2;
+                    tierInfo.height /= 2;
+                }
+                entry.tiers.push_back(m_compositionFramework->createSwapchain(tierInfo, mode));
+
+                TraceLoggingWriteTagged(local,
+                                        "QuadLodManager_RegisterOverlay",
+                                        TLArg(i, "Tier"),
+                                        TLArg(tierInfo.width, "Width"),
+                                        TLArg(tierInfo.height, "Height"));
+            }
+
+            std::unique_lock lock(m_mutex);
+
+            const uint32_t overlay = m_nextOverlay++;
+            m_overlays.insert_or_assign(overlay, std::move(entry));
+
+            TraceLoggingWriteStop(local, "QuadLodManager_RegisterOverlay", TLArg(overlay, "Overlay"));
+
+            return overlay;
+        }
+
+        void unregisterOverlay(uint32_t overlay) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(
+                local, "QuadLodManager_UnregisterOverlay", TLPArg(this, "LodManager"), TLArg(overlay, "Overlay"));
+
+            std::unique_lock lock(m_mutex);
+
+            m_overlays.erase(overlay);
+
+            TraceLoggingWriteStop(local, "QuadLodManager_UnregisterOverlay");
+        }
+
+        ISwapchain* selectTier(uint32_t overlay,
+                               const XrView* views,
+                               uint32_t viewCount,
+                               const XrPosef& pose,
+                               const XrExtent2Df& size) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "QuadLodManager_SelectTier",
+                                   TLPArg(this, "LodManager"),
+                                   TLArg(overlay, "Overlay"),
+                                   TLFrameArg());
+
+            std::unique_lock lock(m_mutex);
+
+            auto it = m_overlays.find(overlay);
+            if (it == m_overlays.end()) {
+                throw std::runtime_error("Overlay is not registered");
+            }
+            Overlay& entry = it->second;
+
+            // A quad that cannot be projected (eg: partially behind the user) keeps the full resolution.
+            const std::optional<XrExtent2Df> required = getRequiredResolution(views, viewCount, pose, size);
+            entry.requiredResolution = required ? XrExtent2Di{static_cast<int32_t>(std::ceil(required->width)),
+                                                              static_cast<int32_t>(std::ceil(required->height))}
+                                                : XrExtent2Di{};
+
+            const uint32_t tier = required ? getLowestSufficientTier(entry, *required, 1.f) : 0;
+            if (tier < entry.tier) {
+                setTier(entry, tier);
+            } else if (tier > entry.tier) {
+                // Only move down to a tier that has enough margin for the quad to get slightly closer.
+                const uint32_t lowerTier = getLowestSufficientTier(entry, *required, m_options.downscaleMargin);
+                if (lowerTier > entry.tier && ++entry.framesBelowTier >= m_options.hysteresisFrames) {
+                    setTier(entry, lowerTier);
+                } else if (lowerTier <= entry.tier) {
+                    entry.framesBelowTier = 0;
+                }
+            } else {
+                entry.framesBelowTier = 0;
+            }
+
+            ISwapchain* const swapchain = entry.tiers[entry.tier].get();
+
+            TraceLoggingWriteStop(local,
+                                  "QuadLodManager_SelectTier",
+                                  TLArg(entry.requiredResolution.width, "RequiredWidth"),
+                                  TLArg(entry.requiredResolution.height, "RequiredHeight"),
+                                  TLArg(entry.tier, "Tier"));
+
+            return swapchain;
+        }
+
+        std::vector<QuadLodStatistics> getStatistics() const override {
+            std::unique_lock lock(m_mutex);
+
+            std::vector<QuadLodStatistics> statistics;
+            for (const auto& [overlay, entry] : m_overlays) {
+                const XrSwapchainCreateInfo& info = entry.tiers[entry.tier]->getInfoOnCompositionDevice();
+                statistics.push_back({entry.name,
+                                      entry.tier,
+                                      {static_cast<int32_t>(info.width), static_cast<int32_t>(info.height)},
+                                      entry.requiredResolution,
+                                      entry.tierChanges});
+            }
+            return statistics;
+        }
+
+        // The resolution of the quad on the display, in the view where it appears the largest.
+        std::optional<XrExtent2Df> getRequiredResolution(const XrView* views,
+                                                         uint32_t viewCount,
+                                                         const XrPosef& pose,
+                                                         const XrExtent2Df& size) const {
+            XrExtent2Df required{0, 0};
+            for (uint32_t i = 0; i < viewCount; i++) {
+                std::array<XrVector2f, 4> corners;
+                if (!general::projectQuad(views[i], pose, size, corners)) {
+                    return {};
+                }
+
+                // The recommended image size spans the tangents of the field of view.
+                const XrFovf& fov = views[i].fov;
+                const float pixelsPerTangentX =
+                    m_recommendedImageSize.width / (std::tan(fov.angleRight) - std::tan(fov.angleLeft));
+                const float pixelsPerTangentY =
+                    m_recommendedImageSize.height / (std::tan(fov.angleUp) - std::tan(fov.angleDown));
+
+                // Corners are in clockwise order starting from the bottom-left corner.
+                required.width = std::max({required.width,
+                                           getLength(corners[0], corners[3], pixelsPerTangentX, pixelsPerTangentY),
+                                           getLength(corners[1], corners[2], pixelsPerTangentX, pixelsPerTangentY)});
+                required.height = std::max({required.height,
+                                            getLength(corners[0], corners[1], pixelsPerTangentX, pixelsPerTangentY),
+                                            getLength(corners[3], corners[2], pixelsPerTangentX, pixelsPerTangentY)});
+            }
+            required.width *= m_options.oversampling;
+            required.height *= m_options.oversampling;
+            return required;
+        }
+
+        uint32_t getLowestSufficientTier(const Overlay& entry, const XrExtent2Df& required, float margin) const {
+            uint32_t tier = 0;
+            for (uint32_t i = 1; i < entry.tiers.size(); i++) {
+                const XrSwapchainCreateInfo& info = entry.tiers[i]->getInfoOnCompositionDevice();
+                if (info.width * margin < required.width || info.height * margin < required.height) {
+                    break;
+                }
+                tier = i;
+            }
+            return tier;
+        }
+
+        void setTier(Overlay& entry, uint32_t tier) {
+            TraceLoggingWrite(g_traceProvider,
+                              "QuadLodManager_TierChange",
+                              TLArg(entry.name.c_str(), "Name"),
+                              TLArg(entry.tier, "From"),
+                              TLArg(tier, "To"),
+                              TLFrameArg());
+
+            entry.tier = tier;
+            entry.framesBelowTier = 0;
+            entry.tierChanges++;
+        }
+
+        ICompositionFramework* const m_compositionFramework;
+        const XrExtent2Di m_recommendedImageSize;
+        const QuadLodOptions m_options;
+
+        mutable std::mutex m_mutex;
+        std::map<uint32_t, Overlay> m_overlays;
+        uint32_t m_nextOverlay{0};
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::graphics {
+
+    std::shared_ptr<IQuadLodManager> createQuadLodManager(ICompositionFramework* compositionFramework,
+                                                          const XrExtent2Di& recommendedImageSize,
+                                                          const QuadLodOptions& options) {
+        return std::make_shared<QuadLodManager>(compositionFramework, recommendedImageSize, options);
+    }
+
+} // namespace openxr_api_layer::utils::graphics
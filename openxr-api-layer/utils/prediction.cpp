@@ -0,0 +1,391 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "tracking.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::tracking;
+    using namespace xr::math;
+
+    enum Device : uint32_t { View = 0, LeftHand, RightHand, DeviceCount };
+
+    // The statistics are keyed by these pointers.
+    const char* const DeviceNames[DeviceCount] = {"view", "left", "right"};
+
+    constexpr float RadiansToDegrees = static_cast<float>(180.0 / M_PI);
+
+    // The angle between two orientations, in micro-degrees, or -1 if either is unknown.
+    int64_t getAngularError(const XrSpaceLocation& predicted, const XrSpaceLocation& actual) {
+        if (!(predicted.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) ||
+            !(actual.locationFlags & XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT)) {
+            return -1;
+        }
+
+        // The rotation from a to b is conjugate(a) * b. Unlike the arc-cosine of its real part, the arc-tangent remains
+        // accurate for the small angles we measure.
+        const XrQuaternionf& a = predicted.pose.orientation;
+        const XrQuaternionf& b = actual.pose.orientation;
+        const double x = a.w * b.x - b.w * a.x - (a.y * b.z - a.z * b.y);
+        const double y = a.w * b.y - b.w * a.y - (a.z * b.x - a.x * b.z);
+        const double z = a.w * b.z - b.w * a.z - (a.x * b.y - a.y * b.x);
+        const double w = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+        return std::llround(2 * std::atan2(std::sqrt(x * x + y * y + z * z), std::abs(w)) * RadiansToDegrees * 1e6);
+    }
+
+    // The distance between two positions, in micrometers, or -1 if either is unknown.
+    int64_t getPositionalError(const XrSpaceLocation& predicted, const XrSpaceLocation& actual) {
+        if (!(predicted.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) ||
+            !(actual.locationFlags & XR_SPACE_LOCATION_POSITION_TRACKED_BIT)) {
+            return -1;
+        }
+
+        return std::llround(Length(predicted.pose.position - actual.pose.position) * 1e6f);
+    }
+
+    // The locations predicted for the sampled frames, until they can be compared with the actual locations. All the
+    // state lives in fixed-size storage.
+    class PredictionErrorSampler {
+      public:
+        void setSettings(const PredictionErrorSettings& settings) {
+            m_settings = settings;
+            m_settings.samplingPeriod = std::max(settings.samplingPeriod, 1u);
+            m_settings.relocateDelay =
+                std::clamp(settings.relocateDelay, 1u, PredictionErrorSettings::MaxRelocateDelay);
+            reset();
+        }
+
+        void reset() {
+            m_frameIndex = 0;
+            for (auto& sample : m_samples) {
+                sample.isPending = false;
+            }
+        }
+
+        // Must be called when the space of a device is replaced.
+        void forgetDevice(uint32_t device) {
+            for (auto& sample : m_samples) {
+                sample.predicted[device].locationFlags = 0;
+            }
+        }
+
+        // The locate function returns the location of a device at a given time, and the record function receives the
+        // errors of a device.
+        template <typename Locate, typename Record>
+        void onWaitFrame(XrTime predictedDisplayTime, const Locate& locate, const Record& record) {
+            const uint64_t frameIndex = m_frameIndex++;
+
+            for (auto& sample : m_samples) {
+                if (!sample.isPending || frameIndex < sample.frameIndex + m_settings.relocateDelay) {
+                    continue;
+                }
+                sample.isPending = false;
+
+                for (uint32_t device = 0; device < DeviceCount; device++) {
+                    const XrSpaceLocation& predicted = sample.predicted[device];
+                    if (!predicted.locationFlags) {
+                        continue;
+                    }
+
+                    XrSpaceLocation actual{XR_TYPE_SPACE_LOCATION};
+                    if (XR_SUCCEEDED(locate(device, sample.time, actual))) {
+                        record(device, getAngularError(predicted, actual), getPositionalError(predicted, actual));
+                    }
+                }
+            }
+
+            if (frameIndex % m_settings.samplingPeriod) {
+                return;
+            }
+
+            Sample& sample = m_samples[(frameIndex / m_settings.samplingPeriod) % Capacity];
+            sample.frameIndex = frameIndex;
+            sample.time = predictedDisplayTime;
+            for (uint32_t device = 0; device < DeviceCount; device++) {
+                XrSpaceLocation& predicted = sample.predicted[device];
+                predicted = {XR_TYPE_SPACE_LOCATION};
+                if (XR_FAILED(locate(device, predictedDisplayTime, predicted))) {
+                    predicted.locationFlags = 0;
+                }
+            }
+            sample.isPending = true;
+        }
+
+      private:
+        // Enough for every sample within the longest relocation delay.
+        static constexpr size_t Capacity = PredictionErrorSettings::MaxRelocateDelay + 1;
+
+        struct Sample {
+            bool isPending{false};
+            uint64_t frameIndex{0};
+            XrTime time{0};
+            XrSpaceLocation predicted[DeviceCount]{};
+        };
+
+        PredictionErrorSettings m_settings;
+        uint64_t m_frameIndex{0};
+        std::array<Sample, Capacity> m_samples;
+    };
+
+    struct PredictionErrorFactory : IPredictionErrorFactory {
+        PredictionErrorFactory(XrInstance instance,
+                               PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                               const PredictionErrorSettings& settings) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "PredictionErrorFactory_Create",
+                                   TLArg(settings.samplingPeriod, "SamplingPeriod"),
+                                   TLArg(settings.relocateDelay, "RelocateDelay"));
+
+            {
+                std::unique_lock lock(factoryMutex);
+                if (factory) {
+                    throw std::runtime_error("There can only be one PredictionError factory");
+                }
+                factory = this;
+            }
+
+            m_sampler.setSettings(settings);
+
+            // Our own spaces are located and managed directly with the runtime.
+            CHECK_XRCMD(xrGetInstanceProcAddr(
+                instance, "xrLocateSpace", reinterpret_cast<PFN_xrVoidFunction*>(&m_xrLocateSpace)));
+            CHECK_XRCMD(xrGetInstanceProcAddr(instance,
+                                              "xrCreateReferenceSpace",
+                                              reinterpret_cast<PFN_xrVoidFunction*>(&m_xrCreateReferenceSpace)));
+            CHECK_XRCMD(xrGetInstanceProcAddr(
+                instance, "xrDestroySpace", reinterpret_cast<PFN_xrVoidFunction*>(&m_xrDestroySpace)));
+
+            PFN_xrStringToPath xrStringToPath;
+            CHECK_XRCMD(xrGetInstanceProcAddr(
+                instance, "xrStringToPath", reinterpret_cast<PFN_xrVoidFunction*>(&xrStringToPath)));
+            CHECK_XRCMD(xrStringToPath(instance, "/user/hand/left", &m_handPath[0]));
+            CHECK_XRCMD(xrStringToPath(instance, "/user/hand/right", &m_handPath[1]));
+
+            TraceLoggingWriteStop(local, "PredictionErrorFactory_Create", TLPArg(this, "PredictionErrorFactory"));
+        }
+
+        ~PredictionErrorFactory() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "PredictionErrorFactory_Destroy");
+
+            {
+                std::unique_lock lock(factoryMutex);
+
+                factory = nullptr;
+            }
+
+            TraceLoggingWriteStop(local, "PredictionErrorFactory_Destroy");
+        }
+
+        void xrGetInstanceProcAddr_post(XrInstance instance, const char* name, PFN_xrVoidFunction* function) override {
+            const std::string_view functionName(name);
+            if (functionName == "xrCreateSession") {
+                xrCreateSession = reinterpret_cast<PFN_xrCreateSession>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookCreateSession);
+            } else if (functionName == "xrDestroySession") {
+                xrDestroySession = reinterpret_cast<PFN_xrDestroySession>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySession);
+            } else if (functionName == "xrWaitFrame") {
+                xrWaitFrame = reinterpret_cast<PFN_xrWaitFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookWaitFrame);
+            } else if (functionName == "xrCreateActionSpace") {
+                xrCreateActionSpace = reinterpret_cast<PFN_xrCreateActionSpace>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookCreateActionSpace);
+            } else if (functionName == "xrDestroySpace") {
+                xrDestroySpace = reinterpret_cast<PFN_xrDestroySpace>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySpace);
+            }
+        }
+
+        void setSettings(const PredictionErrorSettings& settings) override {
+            std::unique_lock lock(m_mutex);
+
+            m_sampler.setSettings(settings);
+        }
+
+        XrResult xrCreateSession_subst(XrInstance instance, const XrSessionCreateInfo* createInfo, XrSession* session) {
+            const XrResult result = xrCreateSession(instance, createInfo, session);
+            if (XR_SUCCEEDED(result)) {
+                std::unique_lock lock(m_mutex);
+
+                // Only the most recent session is measured. The spaces of a previous session are destroyed with it.
+                m_session = *session;
+                m_spaces = {};
+                m_sampler.reset();
+
+                XrReferenceSpaceCreateInfo referenceSpaceInfo{XR_TYPE_REFERENCE_SPACE_CREATE_INFO};
+                referenceSpaceInfo.poseInReferenceSpace = Pose::Identity();
+                referenceSpaceInfo.referenceSpaceType = XR_REFERENCE_SPACE_TYPE_LOCAL;
+                CHECK_XRCMD(m_xrCreateReferenceSpace(m_session, &referenceSpaceInfo, &m_baseSpace));
+                referenceSpaceInfo.referenceSpaceType = XR_REFERENCE_SPACE_TYPE_VIEW;
+                CHECK_XRCMD(m_xrCreateReferenceSpace(m_session, &referenceSpaceInfo, &m_spaces[View]));
+            }
+
+            return result;
+        }
+
+        XrResult xrDestroySession_subst(XrSession session) {
+            {
+                std::unique_lock lock(m_mutex);
+
+                if (session == m_session) {
+                    m_xrDestroySpace(m_spaces[View]);
+                    m_xrDestroySpace(m_baseSpace);
+                    m_session = XR_NULL_HANDLE;
+                    m_baseSpace = XR_NULL_HANDLE;
+                    m_spaces = {};
+                }
+            }
+
+            return xrDestroySession(session);
+        }
+
+        XrResult xrWaitFrame_subst(XrSession session, const XrFrameWaitInfo* frameWaitInfo, XrFrameState* frameState) {
+            const XrResult result = xrWaitFrame(session, frameWaitInfo, frameState);
+            if (XR_SUCCEEDED(result)) {
+                std::unique_lock lock(m_mutex);
+
+                if (session == m_session) {
+                    m_sampler.onWaitFrame(
+                        frameState->predictedDisplayTime,
+                        [&](uint32_t device, XrTime time, XrSpaceLocation& location) {
+                            if (m_spaces[device] == XR_NULL_HANDLE) {
+                                return XR_ERROR_HANDLE_INVALID;
+                            }
+                            return m_xrLocateSpace(m_spaces[device], m_baseSpace, time, &location);
+                        },
+                        [&](uint32_t device, int64_t angularError, int64_t positionalError) {
+                            TraceLoggingWrite(g_traceProvider,
+                                              "PredictionError",
+                                              TLArg(DeviceNames[device], "Device"),
+                                              TLArg(angularError, "AngularErrorMicroDegrees"),
+                                              TLArg(positionalError, "PositionalErrorMicrometers"));
+                            openxr_api_layer::statistics::RecordPredictionError(
+                                DeviceNames[device], angularError, positionalError);
+                        });
+                }
+            }
+
+            return result;
+        }
+
+        // The motion controllers are the first action spaces created for each hand.
+        XrResult xrCreateActionSpace_subst(XrSession session,
+                                           const XrActionSpaceCreateInfo* createInfo,
+                                           XrSpace* space) {
+            const XrResult result = xrCreateActionSpace(session, createInfo, space);
+            if (XR_SUCCEEDED(result) && createInfo->type == XR_TYPE_ACTION_SPACE_CREATE_INFO) {
+                std::unique_lock lock(m_mutex);
+
+                for (uint32_t hand = 0; hand < 2; hand++) {
+                    const uint32_t device = LeftHand + hand;
+                    if (session == m_session && createInfo->subactionPath == m_handPath[hand] &&
+                        m_spaces[device] == XR_NULL_HANDLE) {
+                        m_spaces[device] = *space;
+                        m_sampler.forgetDevice(device);
+                    }
+                }
+            }
+
+            return result;
+        }
+
+        XrResult xrDestroySpace_subst(XrSpace space) {
+            {
+                std::unique_lock lock(m_mutex);
+
+                for (uint32_t device = LeftHand; device < DeviceCount; device++) {
+                    if (m_spaces[device] == space) {
+                        m_spaces[device] = XR_NULL_HANDLE;
+                        m_sampler.forgetDevice(device);
+                    }
+                }
+            }
+
+            return xrDestroySpace(space);
+        }
+
+        std::mutex m_mutex;
+        PredictionErrorSampler m_sampler;
+        XrSession m_session{XR_NULL_HANDLE};
+        XrSpace m_baseSpace{XR_NULL_HANDLE};
+        std::array<XrSpace, DeviceCount> m_spaces{};
+        XrPath m_handPath[2]{XR_NULL_PATH, XR_NULL_PATH};
+
+        PFN_xrLocateSpace m_xrLocateSpace{nullptr};
+        PFN_xrCreateReferenceSpace m_xrCreateReferenceSpace{nullptr};
+        PFN_xrDestroySpace m_xrDestroySpace{nullptr};
+
+        PFN_xrCreateSession xrCreateSession{nullptr};
+        PFN_xrDestroySession xrDestroySession{nullptr};
+        PFN_xrWaitFrame xrWaitFrame{nullptr};
+        PFN_xrCreateActionSpace xrCreateActionSpace{nullptr};
+        PFN_xrDestroySpace xrDestroySpace{nullptr};
+
+        static inline std::mutex factoryMutex;
+        static inline PredictionErrorFactory* factory{nullptr};
+
+        static XrResult XRAPI_CALL hookCreateSession(XrInstance instance,
+                                                     const XrSessionCreateInfo* createInfo,
+                                                     XrSession* session) {
+            return factory->xrCreateSession_subst(instance, createInfo, session);
+        }
+
+        static XrResult XRAPI_CALL hookDestroySession(XrSession session) {
+            return factory->xrDestroySession_subst(session);
+        }
+
+        static XrResult XRAPI_CALL hookWaitFrame(XrSession session,
+                                                 const XrFrameWaitInfo* frameWaitInfo,
+                                                 XrFrameState* frameState) {
+            return factory->xrWaitFrame_subst(session, frameWaitInfo, frameState);
+        }
+
+        static XrResult XRAPI_CALL hookCreateActionSpace(XrSession session,
+                                                         const XrActionSpaceCreateInfo* createInfo,
+                                                         XrSpace* space) {
+            return factory->xrCreateActionSpace_subst(session, createInfo, space);
+        }
+
+        static XrResult XRAPI_CALL hookDestroySpace(XrSpace space) {
+            return factory->xrDestroySpace_subst(space);
+        }
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::tracking {
+
+    std::shared_ptr<IPredictionErrorFactory>
+    createPredictionErrorFactory(XrInstance instance,
+                                 PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                 const PredictionErrorSettings& settings) {
+        return std::make_shared<PredictionErrorFactory>(instance, xrGetInstanceProcAddr, settings);
+    }
+
+} // namespace openxr_api_layer::utils::tracking
@@ -0,0 +1,284 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "graphics.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::graphics;
+
+    // Each level halves the rate of one priority class, starting with the lowest priority. Each class can be halved
+    // twice (down to a quarter of the target rate).
+    constexpr uint32_t MaxThrottleLevel = 4;
+
+    // The weight of a new refresh interval in the effective rate.
+    constexpr double IntervalSmoothing = 0.1;
+
+    uint32_t getRateDivider(OverlayPriority priority, uint32_t throttleLevel) {
+        uint32_t halvings = 0;
+        switch (priority) {
+        case OverlayPriority::Low:
+            halvings = std::min(throttleLevel, 2u);
+            break;
+        case OverlayPriority::Normal:
+            halvings = throttleLevel > 2 ? std::min(throttleLevel - 2, 2u) : 0;
+            break;
+        default:
+            break;
+        }
+        return 1u << halvings;
+    }
+
+    struct Overlay {
+        std::string name;
+        float targetRate;
+        OverlayPriority priority;
+
+        std::optional<XrTime> lastRefreshTime;
+        double averageInterval{0};
+        bool shouldRefresh{true};
+
+        uint64_t refreshCount{0};
+        uint64_t resubmitCount{0};
+    };
+
+    struct OverlayRefreshScheduler : IOverlayRefreshScheduler {
+        OverlayRefreshScheduler(const OverlayRefreshSchedulerOptions& options) : m_options(options) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "OverlayRefreshScheduler_Create",
+                                   TLArg(options.highLoad, "HighLoad"),
+                                   TLArg(options.lowLoad, "LowLoad"),
+                                   TLArg(options.hysteresisFrames, "HysteresisFrames"),
+                                   TLArg(options.smoothing, "Smoothing"));
+
+            if (m_options.lowLoad > m_options.highLoad) {
+                throw std::runtime_error("Low load threshold must not exceed high load threshold");
+            }
+
+            TraceLoggingWriteStop(local, "OverlayRefreshScheduler_Create", TLPArg(this, "Scheduler"));
+        }
+
+        uint32_t registerOverlay(const std::string& name, float targetRate, OverlayPriority priority) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "OverlayRefreshScheduler_RegisterOverlay",
+                                   TLPArg(this, "Scheduler"),
+                                   TLArg(name.c_str(), "Name"),
+                                   TLArg(targetRate, "TargetRate"),
+                                   TLArg((int)priority, "Priority"));
+
+            if (!(targetRate > 0.f)) {
+                throw std::runtime_error("Target rate must be positive");
+            }
+
+            std::unique_lock lock(m_mutex);
+
+            const uint32_t overlay = m_nextOverlay++;
+            Overlay entry;
+            entry.name = name;
+            entry.targetRate = targetRate;
+            entry.priority = priority;
+            m_overlays.insert_or_assign(overlay, std::move(entry));
+
+            TraceLoggingWriteStop(local, "OverlayRefreshScheduler_RegisterOverlay", TLArg(overlay, "Overlay"));
+
+            return overlay;
+        }
+
+        void unregisterOverlay(uint32_t overlay) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "OverlayRefreshScheduler_UnregisterOverlay",
+                                   TLPArg(this, "Scheduler"),
+                                   TLArg(overlay, "Overlay"));
+
+            std::unique_lock lock(m_mutex);
+
+            m_overlays.erase(overlay);
+
+            TraceLoggingWriteStop(local, "OverlayRefreshScheduler_UnregisterOverlay");
+        }
+
+        void submitFrameTiming(uint64_t gpuTimeUs, uint64_t budgetUs) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "OverlayRefreshScheduler_SubmitFrameTiming",
+                                   TLPArg(this, "Scheduler"),
+                                   TLArg(gpuTimeUs, "GpuTimeUs"),
+                                   TLArg(budgetUs, "BudgetUs"),
+                                   TLFrameArg());
+
+            if (!budgetUs) {
+                TraceLoggingWriteStop(local, "OverlayRefreshScheduler_SubmitFrameTiming");
+                return;
+            }
+
+            std::unique_lock lock(m_mutex);
+
+            const float load = static_cast<float>(gpuTimeUs) / budgetUs;
+            m_load = m_load ? m_load.value() + m_options.smoothing * (load - m_load.value()) : load;
+
+            // Only change the rates once the load stays above or below the thresholds.
+            if (m_load.value() > m_options.highLoad) {
+                m_framesAboveHighLoad++;
+                m_framesBelowLowLoad = 0;
+            } else if (m_load.value() < m_options.lowLoad) {
+                m_framesBelowLowLoad++;
+                m_framesAboveHighLoad = 0;
+            } else {
+                m_framesAboveHighLoad = m_framesBelowLowLoad = 0;
+            }
+
+            const uint32_t previousThrottleLevel = m_throttleLevel;
+            if (m_framesAboveHighLoad >= m_options.hysteresisFrames && m_throttleLevel < MaxThrottleLevel) {
+                m_throttleLevel++;
+                m_framesAboveHighLoad = 0;
+            } else if (m_framesBelowLowLoad >= m_options.hysteresisFrames && m_throttleLevel > 0) {
+                m_throttleLevel--;
+                m_framesBelowLowLoad = 0;
+            }
+            if (m_throttleLevel != previousThrottleLevel) {
+                Log(fmt::format("Overlay throttling level {} -> {} (GPU load {:.2f})\n",
+                                previousThrottleLevel,
+                                m_throttleLevel,
+                                m_load.value()));
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "OverlayRefreshScheduler_SubmitFrameTiming",
+                                  TLArg(m_load.value(), "Load"),
+                                  TLArg(m_throttleLevel, "ThrottleLevel"));
+        }
+
+        void beginFrame(XrTime displayTime) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "OverlayRefreshScheduler_BeginFrame",
+                                   TLPArg(this, "Scheduler"),
+                                   TLArg(displayTime, "DisplayTime"),
+                                   TLFrameArg());
+
+            std::unique_lock lock(m_mutex);
+
+            if (m_lastDisplayTime && displayTime > m_lastDisplayTime.value()) {
+                m_displayPeriod = displayTime - m_lastDisplayTime.value();
+            }
+            m_lastDisplayTime = displayTime;
+
+            for (auto& [overlay, entry] : m_overlays) {
+                const uint32_t rateDivider = getRateDivider(entry.priority, m_throttleLevel);
+                const double interval = 1e9 / entry.targetRate * rateDivider;
+
+                // Refresh on the frame closest to the ideal time, ie: when waiting for the next frame would be later
+                // than the ideal time by more than half a display period.
+                entry.shouldRefresh = !entry.lastRefreshTime ||
+                                      static_cast<double>(displayTime - entry.lastRefreshTime.value()) +
+                                              m_displayPeriod / 2.0 >=
+                                          interval;
+                if (entry.shouldRefresh) {
+                    if (entry.lastRefreshTime) {
+                        const double elapsed = static_cast<double>(displayTime - entry.lastRefreshTime.value());
+                        entry.averageInterval = entry.averageInterval
+                                                    ? entry.averageInterval +
+                                                          IntervalSmoothing * (elapsed - entry.averageInterval)
+                                                    : elapsed;
+                    }
+                    entry.lastRefreshTime = displayTime;
+                    entry.refreshCount++;
+                } else {
+                    entry.resubmitCount++;
+                }
+
+                TraceLoggingWriteTagged(local,
+                                        "OverlayRefreshScheduler_BeginFrame",
+                                        TLArg(overlay, "Overlay"),
+                                        TLArg(rateDivider, "RateDivider"),
+                                        TLArg(entry.shouldRefresh, "ShouldRefresh"));
+            }
+
+            TraceLoggingWriteStop(local, "OverlayRefreshScheduler_BeginFrame");
+        }
+
+        bool shouldRefresh(uint32_t overlay) const override {
+            std::unique_lock lock(m_mutex);
+
+            // This is called at frame rate, and rendering an unknown overlay is the safe outcome.
+            const auto it = m_overlays.find(overlay);
+            if (it == m_overlays.cend()) {
+                TraceLoggingWrite(g_traceProvider, "OverlayRefreshScheduler_UnknownOverlay", TLArg(overlay, "Overlay"));
+                return true;
+            }
+
+            return it->second.shouldRefresh;
+        }
+
+        std::vector<OverlayRefreshStatistics> getStatistics() const override {
+            std::unique_lock lock(m_mutex);
+
+            std::vector<OverlayRefreshStatistics> statistics;
+            for (const auto& [overlay, entry] : m_overlays) {
+                OverlayRefreshStatistics overlayStatistics;
+                overlayStatistics.name = entry.name;
+                overlayStatistics.priority = entry.priority;
+                overlayStatistics.targetRate = entry.targetRate;
+                overlayStatistics.effectiveRate =
+                    entry.averageInterval ? static_cast<float>(1e9 / entry.averageInterval) : 0.f;
+                overlayStatistics.rateDivider = getRateDivider(entry.priority, m_throttleLevel);
+                overlayStatistics.refreshCount = entry.refreshCount;
+                overlayStatistics.resubmitCount = entry.resubmitCount;
+                statistics.push_back(std::move(overlayStatistics));
+            }
+
+            return statistics;
+        }
+
+        const OverlayRefreshSchedulerOptions m_options;
+
+        mutable std::mutex m_mutex;
+        std::map<uint32_t, Overlay> m_overlays;
+        uint32_t m_nextOverlay{1};
+
+        std::optional<XrTime> m_lastDisplayTime;
+        XrTime m_displayPeriod{0};
+
+        std::optional<float> m_load;
+        uint32_t m_framesAboveHighLoad{0};
+        uint32_t m_framesBelowLowLoad{0};
+        uint32_t m_throttleLevel{0};
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::graphics {
+
+    std::shared_ptr<IOverlayRefreshScheduler>
+    createOverlayRefreshScheduler(const OverlayRefreshSchedulerOptions& options) {
+        return std::make_shared<OverlayRefreshScheduler>(options);
+    }
+
+} // namespace openxr_api_layer::utils::graphics
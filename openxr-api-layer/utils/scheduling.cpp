@@ -0,0 +1,735 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+
+#include "general.h"
+#include "log.h"
+
+#include <avrt.h>
+#include <winternl.h>
+
+#include <set>
+
+#pragma comment(lib, "avrt.lib")
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::general;
+
+    constexpr uint32_t MaxProcessors = 64;
+
+    // The MMCSS registration of the calling thread.
+    thread_local HANDLE t_mmcssTask{nullptr};
+
+    class WindowsThreadScheduler : public IThreadScheduler {
+      public:
+        uint32_t getCurrentThreadId() const override {
+            return GetCurrentThreadId();
+        }
+
+        uint32_t getCurrentProcessor() const override {
+            PROCESSOR_NUMBER processor{};
+            GetCurrentProcessorNumberEx(&processor);
+            return processor.Group * MaxProcessors + processor.Number;
+        }
+
+        std::vector<uint32_t> getProcessorCores() const override {
+            DWORD length = 0;
+            GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+            std::vector<uint8_t> buffer(length);
+            if (!GetLogicalProcessorInformationEx(
+                    RelationProcessorCore,
+                    reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()),
+                    &length)) {
+                return {};
+            }
+
+            DWORD_PTR processMask = 0;
+            DWORD_PTR systemMask = 0;
+            GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+
+            std::vector<uint32_t> cores(MaxProcessors, NoCore);
+            uint32_t core = 0;
+            for (DWORD offset = 0; offset < length; core++) {
+                const auto info = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(&buffer[offset]);
+                for (WORD i = 0; i < info->Processor.GroupCount; i++) {
+                    const GROUP_AFFINITY& affinity = info->Processor.GroupMask[i];
+                    if (affinity.Group != 0) {
+                        continue;
+                    }
+                    for (uint32_t processor = 0; processor < sizeof(KAFFINITY) * 8; processor++) {
+                        if ((affinity.Mask & processMask) & (KAFFINITY{1} << processor)) {
+                            cores[processor] = core;
+                        }
+                    }
+                }
+                offset += info->Size;
+            }
+
+            return cores;
+        }
+
+        bool raiseCurrentThreadPriority() override {
+            if (!t_mmcssTask) {
+                DWORD taskIndex = 0;
+                t_mmcssTask = AvSetMmThreadCharacteristicsW(L"Games", &taskIndex);
+            }
+            return t_mmcssTask != nullptr;
+        }
+
+        void restoreCurrentThreadPriority() override {
+            if (t_mmcssTask) {
+                AvRevertMmThreadCharacteristics(t_mmcssTask);
+                t_mmcssTask = nullptr;
+            }
+        }
+
+        void setCurrentThreadIdealProcessor(uint32_t processor) override {
+            PROCESSOR_NUMBER idealProcessor{};
+            idealProcessor.Number = static_cast<BYTE>(processor);
+            SetThreadIdealProcessorEx(GetCurrentThread(), &idealProcessor, nullptr);
+        }
+
+        bool setThreadAffinity(uint32_t threadId, uint64_t processorMask) override {
+            wil::unique_handle thread(
+                OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, threadId));
+            if (!thread) {
+                return false;
+            }
+            return SetThreadAffinityMask(thread.get(), static_cast<DWORD_PTR>(processorMask)) != 0;
+        }
+
+        // There is no documented per-thread counter of the context switches. They are read from the system process
+        // information, which is expensive (it lists every thread of the system) and must only be sampled periodically.
+        std::vector<uint64_t> getContextSwitchCounts(const std::vector<uint32_t>& threadIds) override {
+            std::vector<uint64_t> counts(threadIds.size(), 0);
+
+            static const auto ntQuerySystemInformation = reinterpret_cast<decltype(&NtQuerySystemInformation)>(
+                GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtQuerySystemInformation"));
+            if (!ntQuerySystemInformation) {
+                return counts;
+            }
+
+            constexpr NTSTATUS StatusInfoLengthMismatch = static_cast<NTSTATUS>(0xC0000004L);
+            NTSTATUS status;
+            while (true) {
+                ULONG length = 0;
+                status = ntQuerySystemInformation(SystemProcessInformation,
+                                                  m_processInformation.data(),
+                                                  static_cast<ULONG>(m_processInformation.size()),
+                                                  &length);
+                if (status != StatusInfoLengthMismatch) {
+                    break;
+                }
+                // Leave room for the threads created in the meantime.
+                m_processInformation.resize(std::max(size_t{length} + length / 4, m_processInformation.size() * 2));
+            }
+            if (!NT_SUCCESS(status)) {
+                return counts;
+            }
+
+            const HANDLE processId = ULongToHandle(GetCurrentProcessId());
+            for (size_t offset = 0; offset < m_processInformation.size();) {
+                const auto process =
+                    reinterpret_cast<const SYSTEM_PROCESS_INFORMATION*>(&m_processInformation[offset]);
+                if (process->UniqueProcessId == processId) {
+                    // The threads follow the process entry. Reserved3 is the number of context switches.
+                    const auto threads = reinterpret_cast<const SYSTEM_THREAD_INFORMATION*>(process + 1);
+                    for (ULONG i = 0; i < process->NumberOfThreads; i++) {
+                        const auto it = std::find(threadIds.cbegin(),
+                                                  threadIds.cend(),
+                                                  HandleToULong(threads[i].ClientId.UniqueThread));
+                        if (it != threadIds.cend()) {
+                            counts[it - threadIds.cbegin()] = threads[i].Reserved3;
+                        }
+                    }
+                    break;
+                }
+                if (!process->NextEntryOffset) {
+                    break;
+                }
+                offset += process->NextEntryOffset;
+            }
+
+            return counts;
+        }
+
+      private:
+        std::vector<uint8_t> m_processInformation = std::vector<uint8_t>(256 * 1024);
+    };
+
+    // The threads of the layer, and the logical processors they are restricted to.
+    class LayerThreadRegistry {
+      public:
+        void add(uint32_t threadId) {
+            std::unique_lock lock(m_mutex);
+
+            m_threads.push_back(threadId);
+            if (m_scheduler) {
+                m_scheduler->setThreadAffinity(threadId, m_affinityMask);
+            }
+        }
+
+        void remove(uint32_t threadId) {
+            std::unique_lock lock(m_mutex);
+
+            m_threads.erase(std::remove(m_threads.begin(), m_threads.end(), threadId), m_threads.end());
+        }
+
+        void restrictAffinity(std::shared_ptr<IThreadScheduler> scheduler, uint64_t affinityMask) {
+            std::unique_lock lock(m_mutex);
+
+            m_scheduler = scheduler;
+            m_affinityMask = affinityMask;
+            for (const uint32_t threadId : m_threads) {
+                m_scheduler->setThreadAffinity(threadId, m_affinityMask);
+            }
+        }
+
+        // The threads are given back all the logical processors of the process.
+        void releaseAffinity(uint64_t availableMask) {
+            std::unique_lock lock(m_mutex);
+
+            if (!m_scheduler) {
+                return;
+            }
+            for (const uint32_t threadId : m_threads) {
+                m_scheduler->setThreadAffinity(threadId, availableMask);
+            }
+            m_scheduler.reset();
+            m_affinityMask = 0;
+        }
+
+      private:
+        std::mutex m_mutex;
+        std::vector<uint32_t> m_threads;
+        std::shared_ptr<IThreadScheduler> m_scheduler;
+        uint64_t m_affinityMask{0};
+    };
+
+    LayerThreadRegistry& getLayerThreadRegistry() {
+        static LayerThreadRegistry registry;
+        return registry;
+    }
+
+    // Detects the frame threads from the calls to xrWaitFrame() and xrEndFrame(), and manages their scheduling.
+    class FrameThreadTracker {
+      public:
+        // A thread must make this many consecutive calls to be considered a frame thread.
+        static constexpr uint32_t DetectionFrames = 30;
+
+        // The layer threads are not restricted unless this many cores remain available to them.
+        static constexpr uint32_t MinimumLayerCores = 2;
+
+        FrameThreadTracker(const SchedulingSettings& settings,
+                           std::shared_ptr<IThreadScheduler> scheduler,
+                           LayerThreadRegistry& registry)
+            : m_settings(settings), m_scheduler(scheduler), m_registry(registry) {
+            m_cores = m_scheduler->getProcessorCores();
+            m_cores.resize(std::min(m_cores.size(), size_t{MaxProcessors}));
+            for (uint32_t processor = 0; processor < m_cores.size(); processor++) {
+                if (m_cores[processor] != IThreadScheduler::NoCore) {
+                    m_availableMask |= 1ull << processor;
+                }
+            }
+        }
+
+        // MMCSS registrations can only be reverted by their own thread. The frame threads that did not call the layer
+        // again since the end of their session keep their priority until they exit.
+        ~FrameThreadTracker() {
+            std::unique_lock lock(m_mutex);
+
+            restoreCurrentThread();
+            releaseLayerThreads();
+            for (const uint32_t threadId : m_raisedThreads) {
+                Log(fmt::format("Priority of thread {} could not be restored\n", threadId));
+            }
+        }
+
+        void onWaitFrame() {
+            onFrameCall(WaitFrame);
+        }
+
+        void onEndFrame() {
+            onFrameCall(EndFrame);
+        }
+
+        // The frame threads are detected again for the next session. The priority of the former frame threads is
+        // restored now for the calling thread, and on their next call otherwise.
+        void onDestroySession() {
+            std::unique_lock lock(m_mutex);
+
+            for (auto& role : m_roles) {
+                role = {};
+            }
+            restoreCurrentThread();
+            releaseLayerThreads();
+            updateFormerFrameThreads();
+        }
+
+        // Must be called from all the hooks that a former frame thread may call, so that it restores its own priority.
+        void onCall() {
+            if (!m_hasFormerFrameThreads.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            std::unique_lock lock(m_mutex);
+
+            restoreFormerFrameThread(m_scheduler->getCurrentThreadId());
+        }
+
+        void sampleContextSwitches() {
+            std::vector<uint32_t> threadIds;
+            {
+                std::unique_lock lock(m_mutex);
+
+                for (const auto& role : m_roles) {
+                    threadIds.push_back(role.threadId);
+                }
+                if (threadIds[WaitFrame] == threadIds[EndFrame]) {
+                    threadIds[WaitFrame] = 0;
+                }
+            }
+
+            const std::vector<uint64_t> counts = m_scheduler->getContextSwitchCounts(threadIds);
+
+            std::unique_lock lock(m_mutex);
+            for (uint32_t i = 0; i < RoleCount; i++) {
+                Role& role = m_roles[i];
+                if (!threadIds[i] || role.threadId != threadIds[i] || !counts[i]) {
+                    continue;
+                }
+
+                // The first sample of a thread is the reference.
+                if (role.hasContextSwitches && counts[i] >= role.contextSwitches) {
+                    const uint64_t contextSwitches = counts[i] - role.contextSwitches;
+                    m_contextSwitches += contextSwitches;
+                    TraceLoggingWrite(g_traceProvider,
+                                      "FrameThread_ContextSwitches",
+                                      TLArg(role.threadId, "ThreadId"),
+                                      TLArg(contextSwitches, "ContextSwitches"));
+                }
+                role.contextSwitches = counts[i];
+                role.hasContextSwitches = true;
+            }
+        }
+
+        SchedulingStatistics getStatistics() const {
+            std::unique_lock lock(m_mutex);
+
+            SchedulingStatistics statistics{};
+            statistics.waitFrameThreadId = m_roles[WaitFrame].threadId;
+            statistics.endFrameThreadId = m_roles[EndFrame].threadId;
+            statistics.isPriorityRaised =
+                statistics.endFrameThreadId && m_raisedThreads.count(statistics.endFrameThreadId);
+            statistics.layerThreadsAffinityMask = m_layerThreadsMask;
+            statistics.frameCount = m_frameCount;
+            statistics.migrations = m_migrations;
+            statistics.contextSwitches = m_contextSwitches;
+            return statistics;
+        }
+
+      private:
+        enum RoleIndex : uint32_t { WaitFrame = 0, EndFrame, RoleCount };
+
+        struct Role {
+            uint32_t threadId{0};
+            uint32_t processor{0};
+            uint32_t reservedProcessor{0};
+
+            uint32_t candidateThreadId{0};
+            uint32_t candidateCalls{0};
+
+            uint64_t contextSwitches{0};
+            bool hasContextSwitches{false};
+        };
+
+        void onFrameCall(RoleIndex index) {
+            const uint32_t threadId = m_scheduler->getCurrentThreadId();
+
+            std::unique_lock lock(m_mutex);
+
+            Role& role = m_roles[index];
+            if (threadId == role.threadId) {
+                role.candidateThreadId = 0;
+                role.candidateCalls = 0;
+
+                if (index == EndFrame) {
+                    m_frameCount++;
+                }
+
+                // A frame thread calling both functions is only accounted for once per frame.
+                const uint32_t processor = m_scheduler->getCurrentProcessor();
+                if (processor != role.processor) {
+                    if (index == EndFrame || threadId != m_roles[EndFrame].threadId) {
+                        m_migrations++;
+                        TraceLoggingWrite(g_traceProvider,
+                                          "FrameThread_Migration",
+                                          TLArg(threadId, "ThreadId"),
+                                          TLArg(role.processor, "FromProcessor"),
+                                          TLArg(processor, "ToProcessor"));
+                    }
+                    role.processor = processor;
+                }
+                return;
+            }
+
+            // The priority of a former frame thread is restored once another thread took over.
+            restoreFormerFrameThread(threadId);
+
+            if (threadId != role.candidateThreadId) {
+                role.candidateThreadId = threadId;
+                role.candidateCalls = 0;
+            }
+            if (++role.candidateCalls < DetectionFrames) {
+                return;
+            }
+
+            adopt(index, threadId);
+        }
+
+        void adopt(RoleIndex index, uint32_t threadId) {
+            Role& role = m_roles[index];
+            const uint32_t previousThreadId = role.threadId;
+            role = {};
+            role.threadId = threadId;
+            role.processor = role.reservedProcessor = m_scheduler->getCurrentProcessor();
+
+            Log(fmt::format("Detected {} thread {} (previously {}) on processor {}\n",
+                            index == WaitFrame ? "xrWaitFrame()" : "xrEndFrame()",
+                            threadId,
+                            previousThreadId,
+                            role.processor));
+            TraceLoggingWrite(g_traceProvider,
+                              "FrameThread_Detected",
+                              TLArg(index == WaitFrame ? "WaitFrame" : "EndFrame", "Role"),
+                              TLArg(threadId, "ThreadId"),
+                              TLArg(previousThreadId, "PreviousThreadId"),
+                              TLArg(role.processor, "Processor"));
+
+            if (m_settings.raiseFrameThreadPriority && !m_raisedThreads.count(threadId)) {
+                if (m_scheduler->raiseCurrentThreadPriority()) {
+                    m_raisedThreads.insert(threadId);
+                } else {
+                    ErrorLog(fmt::format("Failed to raise the priority of thread {}\n", threadId));
+                }
+            }
+
+            if (m_settings.isolateFrameThreadCores) {
+                m_scheduler->setCurrentThreadIdealProcessor(role.reservedProcessor);
+                restrictLayerThreads();
+            }
+
+            // The previous thread may not hold any role anymore.
+            updateFormerFrameThreads();
+        }
+
+        // Keep the layer threads off the physical cores where the frame threads were detected, including their SMT
+        // siblings.
+        void restrictLayerThreads() {
+            std::set<uint32_t> reservedCores;
+            for (const auto& role : m_roles) {
+                if (role.threadId && role.reservedProcessor < m_cores.size() &&
+                    m_cores[role.reservedProcessor] != IThreadScheduler::NoCore) {
+                    reservedCores.insert(m_cores[role.reservedProcessor]);
+                }
+            }
+
+            uint64_t layerThreadsMask = 0;
+            std::set<uint32_t> layerCores;
+            for (uint32_t processor = 0; processor < m_cores.size(); processor++) {
+                const uint32_t core = m_cores[processor];
+                if (core != IThreadScheduler::NoCore && !reservedCores.count(core)) {
+                    layerThreadsMask |= 1ull << processor;
+                    layerCores.insert(core);
+                }
+            }
+
+            if (reservedCores.empty() || layerCores.size() < MinimumLayerCores) {
+                releaseLayerThreads();
+                return;
+            }
+            if (layerThreadsMask == m_layerThreadsMask) {
+                return;
+            }
+
+            m_registry.restrictAffinity(m_scheduler, layerThreadsMask);
+            m_layerThreadsMask = layerThreadsMask;
+            Log(fmt::format("Layer threads are restricted to processors {:#x}\n", layerThreadsMask));
+        }
+
+        void releaseLayerThreads() {
+            if (m_layerThreadsMask) {
+                m_registry.releaseAffinity(m_availableMask);
+                m_layerThreadsMask = 0;
+            }
+        }
+
+        void restoreCurrentThread() {
+            const uint32_t threadId = m_scheduler->getCurrentThreadId();
+            if (m_raisedThreads.erase(threadId)) {
+                m_scheduler->restoreCurrentThreadPriority();
+                TraceLoggingWrite(g_traceProvider, "FrameThread_PriorityRestored", TLArg(threadId, "ThreadId"));
+            }
+        }
+
+        bool isFormerFrameThread(uint32_t threadId) const {
+            return m_raisedThreads.count(threadId) && threadId != m_roles[WaitFrame].threadId &&
+                   threadId != m_roles[EndFrame].threadId;
+        }
+
+        // threadId must be the calling thread.
+        void restoreFormerFrameThread(uint32_t threadId) {
+            if (isFormerFrameThread(threadId)) {
+                restoreCurrentThread();
+                updateFormerFrameThreads();
+            }
+        }
+
+        // Lets onCall() skip the lock while there is no priority to restore.
+        void updateFormerFrameThreads() {
+            const bool hasFormerFrameThreads =
+                std::any_of(m_raisedThreads.cbegin(), m_raisedThreads.cend(), [&](uint32_t threadId) {
+                    return isFormerFrameThread(threadId);
+                });
+            m_hasFormerFrameThreads.store(hasFormerFrameThreads, std::memory_order_release);
+        }
+
+        const SchedulingSettings m_settings;
+        const std::shared_ptr<IThreadScheduler> m_scheduler;
+        LayerThreadRegistry& m_registry;
+        std::vector<uint32_t> m_cores;
+        uint64_t m_availableMask{0};
+
+        mutable std::mutex m_mutex;
+        std::array<Role, RoleCount> m_roles;
+        std::set<uint32_t> m_raisedThreads;
+        std::atomic<bool> m_hasFormerFrameThreads{false};
+        uint64_t m_layerThreadsMask{0};
+        uint64_t m_frameCount{0};
+        uint64_t m_migrations{0};
+        uint64_t m_contextSwitches{0};
+    };
+
+    struct SchedulingManager : ISchedulingManager {
+        SchedulingManager(const SchedulingSettings& settings, std::shared_ptr<IThreadScheduler> scheduler)
+            : m_tracker(settings, scheduler, getLayerThreadRegistry()) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "SchedulingManager_Create",
+                                   TLArg(settings.raiseFrameThreadPriority, "RaiseFrameThreadPriority"),
+                                   TLArg(settings.isolateFrameThreadCores, "IsolateFrameThreadCores"));
+
+            {
+                std::unique_lock lock(factoryMutex);
+                if (factory) {
+                    throw std::runtime_error("There can only be one SchedulingManager factory");
+                }
+                factory = this;
+            }
+
+            m_thread = std::thread([this] {
+                SetThreadDescription(GetCurrentThread(), L"Layer Scheduler");
+                ScopedLayerThread layerThread;
+                samplerThread();
+            });
+
+            TraceLoggingWriteStop(local, "SchedulingManager_Create", TLPArg(this, "SchedulingManager"));
+        }
+
+        ~SchedulingManager() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "SchedulingManager_Destroy");
+
+            {
+                std::unique_lock lock(m_mutex);
+                m_exiting = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread.join();
+
+            {
+                std::unique_lock lock(factoryMutex);
+
+                factory = nullptr;
+            }
+
+            const SchedulingStatistics statistics = getStatistics();
+            Log(fmt::format("Frame thread: {} frames, {} migrations, {} context switches\n",
+                            statistics.frameCount,
+                            statistics.migrations,
+                            statistics.contextSwitches));
+
+            TraceLoggingWriteStop(local, "SchedulingManager_Destroy");
+        }
+
+        void xrGetInstanceProcAddr_post(XrInstance instance, const char* name, PFN_xrVoidFunction* function) override {
+            const std::string_view functionName(name);
+            if (functionName == "xrEndSession") {
+                xrEndSession = reinterpret_cast<PFN_xrEndSession>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookEndSession);
+            } else if (functionName == "xrDestroySession") {
+                xrDestroySession = reinterpret_cast<PFN_xrDestroySession>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookDestroySession);
+            } else if (functionName == "xrPollEvent") {
+                xrPollEvent = reinterpret_cast<PFN_xrPollEvent>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookPollEvent);
+            } else if (functionName == "xrWaitFrame") {
+                xrWaitFrame = reinterpret_cast<PFN_xrWaitFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookWaitFrame);
+            } else if (functionName == "xrBeginFrame") {
+                xrBeginFrame = reinterpret_cast<PFN_xrBeginFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookBeginFrame);
+            } else if (functionName == "xrEndFrame") {
+                xrEndFrame = reinterpret_cast<PFN_xrEndFrame>(*function);
+                *function = reinterpret_cast<PFN_xrVoidFunction>(hookEndFrame);
+            }
+        }
+
+        SchedulingStatistics getStatistics() const override {
+            return m_tracker.getStatistics();
+        }
+
+        XrResult xrEndSession_subst(XrSession session) {
+            m_tracker.onCall();
+
+            return xrEndSession(session);
+        }
+
+        XrResult xrDestroySession_subst(XrSession session) {
+            m_tracker.onDestroySession();
+
+            return xrDestroySession(session);
+        }
+
+        XrResult xrPollEvent_subst(XrInstance instance, XrEventDataBuffer* eventData) {
+            m_tracker.onCall();
+
+            return xrPollEvent(instance, eventData);
+        }
+
+        XrResult xrWaitFrame_subst(XrSession session, const XrFrameWaitInfo* frameWaitInfo, XrFrameState* frameState) {
+            const XrResult result = xrWaitFrame(session, frameWaitInfo, frameState);
+            if (XR_SUCCEEDED(result)) {
+                m_tracker.onWaitFrame();
+            } else {
+                m_tracker.onCall();
+            }
+
+            return result;
+        }
+
+        XrResult xrBeginFrame_subst(XrSession session, const XrFrameBeginInfo* frameBeginInfo) {
+            m_tracker.onCall();
+
+            return xrBeginFrame(session, frameBeginInfo);
+        }
+
+        XrResult xrEndFrame_subst(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            const XrResult result = xrEndFrame(session, frameEndInfo);
+            if (XR_SUCCEEDED(result)) {
+                m_tracker.onEndFrame();
+            } else {
+                m_tracker.onCall();
+            }
+
+            return result;
+        }
+
+      private:
+        void samplerThread() {
+            std::unique_lock lock(m_mutex);
+            while (!m_wakeUp.wait_for(lock, 1s, [&] { return m_exiting; })) {
+                lock.unlock();
+                m_tracker.sampleContextSwitches();
+                lock.lock();
+            }
+        }
+
+        FrameThreadTracker m_tracker;
+
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        bool m_exiting{false};
+
+        PFN_xrEndSession xrEndSession{nullptr};
+        PFN_xrDestroySession xrDestroySession{nullptr};
+        PFN_xrPollEvent xrPollEvent{nullptr};
+        PFN_xrWaitFrame xrWaitFrame{nullptr};
+        PFN_xrBeginFrame xrBeginFrame{nullptr};
+        PFN_xrEndFrame xrEndFrame{nullptr};
+
+        static inline std::mutex factoryMutex;
+        static inline SchedulingManager* factory{nullptr};
+
+        static XrResult XRAPI_CALL hookEndSession(XrSession session) {
+            return factory->xrEndSession_subst(session);
+        }
+
+        static XrResult XRAPI_CALL hookDestroySession(XrSession session) {
+            return factory->xrDestroySession_subst(session);
+        }
+
+        static XrResult XRAPI_CALL hookPollEvent(XrInstance instance, XrEventDataBuffer* eventData) {
+            return factory->xrPollEvent_subst(instance, eventData);
+        }
+
+        static XrResult XRAPI_CALL hookWaitFrame(XrSession session,
+                                                 const XrFrameWaitInfo* frameWaitInfo,
+                                                 XrFrameState* frameState) {
+            return factory->xrWaitFrame_subst(session, frameWaitInfo, frameState);
+        }
+
+        static XrResult XRAPI_CALL hookBeginFrame(XrSession session, const XrFrameBeginInfo* frameBeginInfo) {
+            return factory->xrBeginFrame_subst(session, frameBeginInfo);
+        }
+
+        static XrResult XRAPI_CALL hookEndFrame(XrSession session, const XrFrameEndInfo* frameEndInfo) {
+            return factory->xrEndFrame_subst(session, frameEndInfo);
+        }
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::general {
+
+    ScopedLayerThread::ScopedLayerThread() {
+        getLayerThreadRegistry().add(GetCurrentThreadId());
+    }
+
+    ScopedLayerThread::~ScopedLayerThread() {
+        getLayerThreadRegistry().remove(GetCurrentThreadId());
+    }
+
+    std::shared_ptr<IThreadScheduler> createThreadScheduler() {
+        return std::make_shared<WindowsThreadScheduler>();
+    }
+
+    std::shared_ptr<ISchedulingManager> createSchedulingManager(const SchedulingSettings& settings,
+                                                                std::shared_ptr<IThreadScheduler> scheduler) {
+        return std::make_shared<SchedulingManager>(settings, scheduler ? scheduler : createThreadScheduler());
+    }
+
+} // namespace openxr_api_layer::utils::general
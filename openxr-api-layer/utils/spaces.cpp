@@ -0,0 +1,162 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "tracking.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::tracking;
+
+    class SpacesLocator : public ISpacesLocator {
+      public:
+        SpacesLocator(PFN_xrLocateSpace xrLocateSpace,
+                      std::shared_ptr<general::IWorkerPool> workerPool,
+                      uint32_t spacesPerTask)
+            : m_xrLocateSpace(xrLocateSpace), m_workerPool(workerPool), m_spacesPerTask(std::max(spacesPerTask, 1u)) {
+        }
+
+        XrResult locateSpaces(const XrSpacesLocateInfoKHR& locateInfo, XrSpaceLocationsKHR& spaceLocations) override {
+            if (locateInfo.type != XR_TYPE_SPACES_LOCATE_INFO_KHR ||
+                spaceLocations.type != XR_TYPE_SPACE_LOCATIONS_KHR) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+            if (!locateInfo.spaceCount || !locateInfo.spaces || spaceLocations.locationCount != locateInfo.spaceCount ||
+                !spaceLocations.locations) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+
+            XrSpaceVelocitiesKHR* velocities = nullptr;
+            XrBaseOutStructure* entry = reinterpret_cast<XrBaseOutStructure*>(spaceLocations.next);
+            while (entry) {
+                if (entry->type == XR_TYPE_SPACE_VELOCITIES_KHR) {
+                    velocities = reinterpret_cast<XrSpaceVelocitiesKHR*>(entry);
+                }
+                entry = entry->next;
+            }
+            if (velocities && (velocities->velocityCount != locateInfo.spaceCount || !velocities->velocities)) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+
+            if (locateInfo.time <= 0) {
+                return XR_ERROR_TIME_INVALID;
+            }
+
+            const uint32_t spaceCount = locateInfo.spaceCount;
+            const uint32_t taskCount =
+                m_workerPool ? std::min((spaceCount + m_spacesPerTask - 1) / m_spacesPerTask,
+                                        m_workerPool->getThreadCount() + 1)
+                             : 1;
+            if (taskCount <= 1) {
+                return locateRange(locateInfo, spaceLocations, velocities, 0, spaceCount);
+            }
+
+            // The calling thread locates the first batch while the worker threads handle the others.
+            std::vector<XrResult> results(taskCount, XR_SUCCESS);
+            std::mutex mutex;
+            std::condition_variable done;
+            uint32_t pendingTasks = taskCount - 1;
+            const uint32_t spacesPerTask = (spaceCount + taskCount - 1) / taskCount;
+            for (uint32_t i = 1; i < taskCount; i++) {
+                m_workerPool->submit([&, i]() {
+                    const uint32_t begin = i * spacesPerTask;
+                    const uint32_t end = std::min(begin + spacesPerTask, spaceCount);
+                    results[i] = locateRange(locateInfo, spaceLocations, velocities, begin, end);
+
+                    std::unique_lock lock(mutex);
+                    if (!--pendingTasks) {
+                        done.notify_one();
+                    }
+                });
+            }
+            results[0] = locateRange(locateInfo, spaceLocations, velocities, 0, spacesPerTask);
+            {
+                std::unique_lock lock(mutex);
+                done.wait(lock, [&]() { return !pendingTasks; });
+            }
+
+            // Report the error of the first space that failed to be located, otherwise any qualified success.
+            XrResult result = XR_SUCCESS;
+            for (const XrResult taskResult : results) {
+                if (XR_FAILED(taskResult)) {
+                    return taskResult;
+                }
+                if (taskResult != XR_SUCCESS) {
+                    result = taskResult;
+                }
+            }
+            return result;
+        }
+
+      private:
+        XrResult locateRange(const XrSpacesLocateInfoKHR& locateInfo,
+                             XrSpaceLocationsKHR& spaceLocations,
+                             XrSpaceVelocitiesKHR* velocities,
+                             uint32_t begin,
+                             uint32_t end) const {
+            XrSpaceVelocity velocity{XR_TYPE_SPACE_VELOCITY};
+            XrSpaceLocation location{XR_TYPE_SPACE_LOCATION, velocities ? &velocity : nullptr};
+
+            XrResult result = XR_SUCCESS;
+            for (uint32_t i = begin; i < end; i++) {
+                const XrResult locateResult =
+                    m_xrLocateSpace(locateInfo.spaces[i], locateInfo.baseSpace, locateInfo.time, &location);
+                if (XR_FAILED(locateResult)) {
+                    return locateResult;
+                }
+                if (locateResult != XR_SUCCESS) {
+                    result = locateResult;
+                }
+
+                spaceLocations.locations[i].locationFlags = location.locationFlags;
+                spaceLocations.locations[i].pose = location.pose;
+                if (velocities) {
+                    velocities->velocities[i].velocityFlags = velocity.velocityFlags;
+                    velocities->velocities[i].linearVelocity = velocity.linearVelocity;
+                    velocities->velocities[i].angularVelocity = velocity.angularVelocity;
+                }
+            }
+
+            return result;
+        }
+
+        const PFN_xrLocateSpace m_xrLocateSpace;
+        const std::shared_ptr<general::IWorkerPool> m_workerPool;
+        const uint32_t m_spacesPerTask;
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::tracking {
+
+    std::shared_ptr<ISpacesLocator> createSpacesLocator(PFN_xrLocateSpace xrLocateSpace,
+                                                        std::shared_ptr<general::IWorkerPool> workerPool,
+                                                        uint32_t spacesPerTask) {
+        return std::make_shared<SpacesLocator>(xrLocateSpace, workerPool, spacesPerTask);
+    }
+
+} // namespace openxr_api_layer::utils::tracking
@@ -0,0 +1,104 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "general.h"
+
+namespace openxr_api_layer::utils::tracking {
+
+    struct LocateCacheStatistics {
+        uint64_t hitCount{0};
+        uint64_t missCount{0};
+
+        // Calls with extension structures, or sizing calls of xrLocateViews(), that are always forwarded.
+        uint64_t bypassCount{0};
+
+        // The hit count multiplied by the average duration of the forwarded calls.
+        double timeSavedUs{0};
+    };
+
+    // A factory to memoize the application's xrLocateSpace() and xrLocateViews() results within a frame, keyed by
+    // handles and time. The results are discarded in xrWaitFrame(), xrSyncActions() and xrDestroySpace(). Locating the
+    // same space again within a frame returns the first prediction, even if the runtime could have refined it.
+    struct ILocateCacheFactory {
+        virtual ~ILocateCacheFactory() = default;
+
+        // Must be called after chaining to the upstream xrGetInstanceProcAddr() implementation.
+        virtual void xrGetInstanceProcAddr_post(XrInstance instance,
+                                                const char* name,
+                                                PFN_xrVoidFunction* function) = 0;
+
+        virtual LocateCacheStatistics getStatistics() const = 0;
+    };
+
+    std::shared_ptr<ILocateCacheFactory> createLocateCacheFactory();
+
+    struct PredictionErrorSettings {
+        // Sample one frame out of samplingPeriod.
+        uint32_t samplingPeriod{9};
+
+        // Locate a sampled frame again this many frames later, when the runtime has observed the actual poses (at most
+        // MaxRelocateDelay).
+        uint32_t relocateDelay{4};
+        static constexpr uint32_t MaxRelocateDelay = 30;
+    };
+
+    // A factory to measure the prediction errors of the runtime: for the sampled frames, the view and the motion
+    // controllers are located upon xrWaitFrame() for the predicted display time, and located again for the same time
+    // a few frames later. The errors are recorded per device in the session report (see
+    // statistics::RecordPredictionError()). The motion controllers are the application's action spaces created with a
+    // /user/hand/left or /user/hand/right subaction path. The errors are only recorded for the most recently created
+    // session, in fixed memory.
+    struct IPredictionErrorFactory {
+        virtual ~IPredictionErrorFactory() = default;
+
+        // Must be called after chaining to the upstream xrGetInstanceProcAddr() implementation.
+        virtual void xrGetInstanceProcAddr_post(XrInstance instance,
+                                                const char* name,
+                                                PFN_xrVoidFunction* function) = 0;
+
+        virtual void setSettings(const PredictionErrorSettings& settings) = 0;
+    };
+
+    std::shared_ptr<IPredictionErrorFactory>
+    createPredictionErrorFactory(XrInstance instance,
+                                 PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr,
+                                 const PredictionErrorSettings& settings = {});
+
+    // An implementation of XR_KHR_locate_spaces on top of the runtime's xrLocateSpace().
+    struct ISpacesLocator {
+        virtual ~ISpacesLocator() = default;
+
+        // Follows the validation rules of xrLocateSpacesKHR(). Velocities are located when XrSpaceVelocitiesKHR is
+        // chained to spaceLocations.
+        virtual XrResult locateSpaces(const XrSpacesLocateInfoKHR& locateInfo, XrSpaceLocationsKHR& spaceLocations) = 0;
+    };
+
+    // When a worker pool is passed, the spaces are split in batches of spacesPerTask and located concurrently. This
+    // must only be used with runtimes that do not serialize xrLocateSpace() internally.
+    std::shared_ptr<ISpacesLocator> createSpacesLocator(PFN_xrLocateSpace xrLocateSpace,
+                                                        std::shared_ptr<general::IWorkerPool> workerPool = nullptr,
+                                                        uint32_t spacesPerTask = 16);
+
+} // namespace openxr_api_layer::utils::tracking
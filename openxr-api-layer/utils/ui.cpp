@@ -0,0 +1,558 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "general.h"
+#include "graphics.h"
+#include "image.h"
+#include "log.h"
+#include "ui.h"
+
+#include <util.h>
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils;
+    using namespace openxr_api_layer::utils::graphics;
+    using namespace openxr_api_layer::utils::ui;
+
+    // Past this number of regions, the damage is repainted as a single bounding rectangle.
+    constexpr size_t MaxDamageRegions = 8;
+
+    bool isEmpty(const XrRect2Di& rect) {
+        return rect.extent.width <= 0 || rect.extent.height <= 0;
+    }
+
+    uint64_t getArea(const XrRect2Di& rect) {
+        return isEmpty(rect) ? 0 : static_cast<uint64_t>(rect.extent.width) * rect.extent.height;
+    }
+
+    XrRect2Di intersect(const XrRect2Di& a, const XrRect2Di& b) {
+        const int32_t left = std::max(a.offset.x, b.offset.x);
+        const int32_t top = std::max(a.offset.y, b.offset.y);
+        const int32_t right = std::min(a.offset.x + a.extent.width, b.offset.x + b.extent.width);
+        const int32_t bottom = std::min(a.offset.y + a.extent.height, b.offset.y + b.extent.height);
+        return {{left, top}, {std::max(right - left, 0), std::max(bottom - top, 0)}};
+    }
+
+    XrRect2Di unite(const XrRect2Di& a, const XrRect2Di& b) {
+        const int32_t left = std::min(a.offset.x, b.offset.x);
+        const int32_t top = std::min(a.offset.y, b.offset.y);
+        const int32_t right = std::max(a.offset.x + a.extent.width, b.offset.x + b.extent.width);
+        const int32_t bottom = std::max(a.offset.y + a.extent.height, b.offset.y + b.extent.height);
+        return {{left, top}, {right - left, bottom - top}};
+    }
+
+    XrRect2Di translate(const XrRect2Di& rect, const XrOffset2Di& offset) {
+        return {{rect.offset.x + offset.x, rect.offset.y + offset.y}, rect.extent};
+    }
+
+    // Clip the regions to the canvas, and merge the overlapping ones.
+    void mergeDamage(std::vector<XrRect2Di>& damage, const XrRect2Di& canvasBounds) {
+        std::vector<XrRect2Di> merged;
+        for (const XrRect2Di& rect : damage) {
+            XrRect2Di clipped = intersect(rect, canvasBounds);
+            if (isEmpty(clipped)) {
+                continue;
+            }
+
+            // Absorb all the regions overlapping the new one. The union may now overlap other regions, so repeat
+            // until it is stable.
+            bool hasMerged;
+            do {
+                hasMerged = false;
+                for (auto it = merged.begin(); it != merged.end(); ++it) {
+                    if (!isEmpty(intersect(*it, clipped))) {
+                        clipped = unite(*it, clipped);
+                        merged.erase(it);
+                        hasMerged = true;
+                        break;
+                    }
+                }
+            } while (hasMerged);
+            merged.push_back(clipped);
+        }
+
+        if (merged.size() > MaxDamageRegions) {
+            XrRect2Di bounds = merged[0];
+            for (const XrRect2Di& rect : merged) {
+                bounds = unite(bounds, rect);
+            }
+            merged = {bounds};
+        }
+        damage = std::move(merged);
+    }
+
+    // A view of a region of an image, without copy.
+    image::Image crop(const image::Image& image, const XrRect2Di& rect) {
+        image::Image view = image;
+        view.data += rect.offset.y * image.rowPitch + rect.offset.x * image::getBytesPerPixel(image.format);
+        view.width = rect.extent.width;
+        view.height = rect.extent.height;
+        return view;
+    }
+
+    struct UiRenderer : IUiRenderer {
+        UiRenderer(IGraphicsDevice* device, std::shared_ptr<ISwapchain> swapchain)
+            : m_device(device), m_swapchain(std::move(swapchain)) {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "UiRenderer_Create", TLPArg(m_swapchain.get(), "Swapchain"));
+
+            const XrSwapchainCreateInfo& info = m_swapchain->getInfoOnCompositionDevice();
+            const DXGI_FORMAT format = m_device->translateToGenericFormat(info.format);
+            if (!image::isFormatSupported(format)) {
+                throw std::runtime_error("Swapchain format is not supported");
+            }
+            switch (m_device->getApi()) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            case Api::D3D11:
+#endif
+            case Api::CPU:
+                break;
+            default:
+                throw std::runtime_error("Graphics API is not supported");
+            }
+
+            // The canvas is tightly packed, so that it can be wrapped as a texture on the CPU device.
+            const size_t rowPitch = static_cast<size_t>(info.width) * image::getBytesPerPixel(format);
+            m_canvasPixels.resize(rowPitch * info.height);
+            m_canvas = {m_canvasPixels.data(), rowPitch, info.width, info.height, format};
+            m_canvasBounds = {{0, 0}, {static_cast<int32_t>(info.width), static_cast<int32_t>(info.height)}};
+            if (m_device->getApi() == Api::CPU) {
+                XrSwapchainCreateInfo canvasInfo = info;
+                canvasInfo.arraySize = canvasInfo.mipCount = canvasInfo.sampleCount = canvasInfo.faceCount = 1;
+                m_canvasTexture = m_device->openTexturePtr(m_canvasPixels.data(), canvasInfo);
+            }
+
+            m_root = std::make_shared<Widget>();
+            m_root->setBounds(m_canvasBounds);
+
+            TraceLoggingWriteStop(local,
+                                  "UiRenderer_Create",
+                                  TLPArg(this, "Renderer"),
+                                  TLArg(info.width, "Width"),
+                                  TLArg(info.height, "Height"),
+                                  TLArg((int)format, "Format"));
+        }
+
+        ~UiRenderer() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "UiRenderer_Destroy", TLPArg(this, "Renderer"));
+
+            // Uploads might still be reading from the canvas.
+            if (m_canvasTexture) {
+                m_device->getNativeContext<CPU>()->flush();
+            }
+
+            TraceLoggingWriteStop(local, "UiRenderer_Destroy");
+        }
+
+        std::shared_ptr<Widget> getRoot() const override {
+            return m_root;
+        }
+
+        bool render() override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local, "UiRenderer_Render", TLPArg(this, "Renderer"), TLFrameArg());
+
+            std::unique_lock lock(m_mutex);
+
+            m_statistics.framesCount++;
+
+            std::vector<XrRect2Di> damage;
+            m_root->collectDamage({0, 0}, damage);
+            mergeDamage(damage, m_canvasBounds);
+
+            m_statistics.damagedRegionsLastFrame = static_cast<uint32_t>(damage.size());
+            m_statistics.pixelsPaintedLastFrame = m_statistics.pixelsUploadedLastFrame = 0;
+            if (damage.empty() && !m_isUploadPending) {
+                m_statistics.framesSkipped++;
+
+                TraceLoggingWriteStop(local, "UiRenderer_Render", TLArg(false, "Updated"));
+
+                return false;
+            }
+
+            // The previous uploads must complete before the canvas is overwritten.
+            if (m_canvasTexture) {
+                m_device->getNativeContext<CPU>()->flush();
+            }
+
+            // Erase and repaint the damaged regions.
+            const uint32_t bytesPerPixel = image::getBytesPerPixel(m_canvas.format);
+            for (const XrRect2Di& rect : damage) {
+                for (int32_t y = rect.offset.y; y < rect.offset.y + rect.extent.height; y++) {
+                    ZeroMemory(m_canvas.data + y * m_canvas.rowPitch + rect.offset.x * bytesPerPixel,
+                               static_cast<size_t>(rect.extent.width) * bytesPerPixel);
+                }
+                m_root->paintTree(m_canvas, rect, {0, 0});
+                m_statistics.pixelsPaintedLastFrame += getArea(rect);
+
+                TraceLoggingWriteTagged(local, "UiRenderer_Render", TLArg(xr::ToString(rect).c_str(), "Damage"));
+            }
+            m_statistics.pixelsPaintedTotal += m_statistics.pixelsPaintedLastFrame;
+
+            // Each swapchain image must catch up with the damage that occurred since it was last written.
+            for (auto& [texture, pendingDamage] : m_pendingDamage) {
+                pendingDamage.insert(pendingDamage.end(), damage.cbegin(), damage.cend());
+                mergeDamage(pendingDamage, m_canvasBounds);
+            }
+
+            // On failure, the damage remains pending for every swapchain image and is uploaded on the next frame.
+            const auto image = m_swapchain->tryAcquireImage();
+            if (!image) {
+                ErrorLog(fmt::format("Failed to acquire UI swapchain image: {}\n", image.what()));
+                m_isUploadPending = true;
+
+                TraceLoggingWriteStop(local,
+                                      "UiRenderer_Render",
+                                      TLArg(false, "Updated"),
+                                      TLArg(xr::ToCString(image.result()), "Result"));
+
+                return false;
+            }
+            IGraphicsTexture* const texture = image.value()->getTextureForWrite();
+            std::vector<XrRect2Di> uploads{m_canvasBounds};
+            auto it = m_pendingDamage.find(texture);
+            if (it != m_pendingDamage.end()) {
+                uploads = std::move(it->second);
+            }
+            m_pendingDamage[texture].clear();
+
+            for (const XrRect2Di& rect : uploads) {
+                upload(rect, texture);
+                m_statistics.pixelsUploadedLastFrame += getArea(rect);
+            }
+
+            auto released = m_swapchain->tryReleaseImage();
+            if (released) {
+                released = m_swapchain->tryCommitLastReleasedImage();
+            }
+            if (!released) {
+                ErrorLog(fmt::format("Failed to release UI swapchain image: {}\n", released.what()));
+                m_isUploadPending = true;
+
+                TraceLoggingWriteStop(local,
+                                      "UiRenderer_Render",
+                                      TLArg(false, "Updated"),
+                                      TLArg(xr::ToCString(released.result()), "Result"));
+
+                return false;
+            }
+            m_isUploadPending = false;
+
+            TraceLoggingWriteStop(local,
+                                  "UiRenderer_Render",
+                                  TLArg(true, "Updated"),
+                                  TLArg(m_statistics.pixelsPaintedLastFrame, "PixelsPainted"),
+                                  TLArg(m_statistics.pixelsUploadedLastFrame, "PixelsUploaded"));
+
+            return true;
+        }
+
+        std::shared_ptr<ISwapchain> getSwapchain() const override {
+            return m_swapchain;
+        }
+
+        bool dispatchPointerEvent(PointerEventType type,
+                                  const XrPosef& ray,
+                                  const XrPosef& quadPose,
+                                  const XrExtent2Df& quadSize) override {
+            TraceLocalActivity(local);
+            TraceLoggingWriteStart(local,
+                                   "UiRenderer_DispatchPointerEvent",
+                                   TLPArg(this, "Renderer"),
+                                   TLArg((int)type, "Type"),
+                                   TLArg(xr::ToString(ray).c_str(), "Ray"),
+                                   TLArg(xr::ToString(quadPose).c_str(), "QuadPose"));
+
+            std::unique_lock lock(m_mutex);
+
+            std::shared_ptr<Widget> target;
+            XrOffset2Di position{};
+            XrPosef hitPose;
+            if (type != PointerEventType::Leave && general::hitTest(ray, quadPose, quadSize, hitPose)) {
+                const POINT point = general::getUVCoordinates(
+                    hitPose.position - quadPose.position, quadPose, quadSize, m_canvasBounds.extent);
+                target = m_root->findWidgetAt({static_cast<int32_t>(point.x), static_cast<int32_t>(point.y)}, position);
+            }
+
+            // Notify the widget that the pointer left it.
+            const std::shared_ptr<Widget> hovered = m_hovered.lock();
+            if (hovered && hovered != target) {
+                hovered->onPointerEvent({PointerEventType::Leave, {}});
+            }
+            m_hovered = target;
+
+            bool handled = false;
+
+            // Bubble up the event until a widget handles it.
+            for (Widget* widget = target.get(); widget && !handled; widget = widget->getParent()) {
+                handled = widget->onPointerEvent({type, position});
+                position.x += widget->getBounds().offset.x;
+                position.y += widget->getBounds().offset.y;
+            }
+
+            TraceLoggingWriteStop(local,
+                                  "UiRenderer_DispatchPointerEvent",
+                                  TLPArg(target.get(), "Widget"),
+                                  TLArg(position.x, "X"),
+                                  TLArg(position.y, "Y"),
+                                  TLArg(handled, "Handled"));
+
+            return handled;
+        }
+
+        UiStatistics getStatistics() const override {
+            std::unique_lock lock(m_mutex);
+
+            return m_statistics;
+        }
+
+        void upload(const XrRect2Di& rect, IGraphicsTexture* texture) {
+            switch (m_device->getApi()) {
+#ifdef XR_USE_GRAPHICS_API_D3D11
+            case Api::D3D11: {
+                D3D11_BOX box{};
+                box.left = rect.offset.x;
+                box.top = rect.offset.y;
+                box.right = rect.offset.x + rect.extent.width;
+                box.bottom = rect.offset.y + rect.extent.height;
+                box.back = 1;
+                m_device->getNativeContext<D3D11>()->UpdateSubresource(
+                    texture->getNativeTexture<D3D11>(), 0, &box, crop(m_canvas, rect).data, (UINT)m_canvas.rowPitch, 0);
+            } break;
+#endif
+            case Api::CPU:
+                m_device->getNativeContext<CPU>()->blit(m_canvasTexture.get(), rect, texture, rect.offset);
+                break;
+            default:
+                break;
+            }
+        }
+
+        IGraphicsDevice* const m_device;
+        const std::shared_ptr<ISwapchain> m_swapchain;
+
+        std::vector<uint8_t> m_canvasPixels;
+        image::Image m_canvas{};
+        XrRect2Di m_canvasBounds{};
+        std::shared_ptr<IGraphicsTexture> m_canvasTexture;
+
+        std::shared_ptr<Widget> m_root;
+        std::weak_ptr<Widget> m_hovered;
+
+        // The damage that each texture written by the swapchain has not received yet. A texture that is not present
+        // has never been written.
+        std::map<IGraphicsTexture*, std::vector<XrRect2Di>> m_pendingDamage;
+
+        // The canvas was repainted, but it could not be copied to a swapchain image.
+        bool m_isUploadPending{false};
+
+        mutable std::mutex m_mutex;
+        UiStatistics m_statistics;
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::ui {
+
+    void Widget::addChild(std::shared_ptr<Widget> child) {
+        if (child->m_parent) {
+            throw std::runtime_error("Widget already has a parent");
+        }
+        child->m_parent = this;
+        m_children.push_back(child);
+        child->invalidate();
+    }
+
+    void Widget::removeChild(const std::shared_ptr<Widget>& child) {
+        const auto it = std::find(m_children.begin(), m_children.end(), child);
+        if (it == m_children.end()) {
+            return;
+        }
+
+        // Erase the area where the widget was last painted during the next frame.
+        if (child->m_paintedBounds) {
+            m_removedBounds.push_back(child->m_paintedBounds.value());
+            for (Widget* parent = m_parent; parent && !parent->m_hasDirtyChildren; parent = parent->m_parent) {
+                parent->m_hasDirtyChildren = true;
+            }
+        }
+        child->m_parent = nullptr;
+        child->m_paintedBounds = {};
+        m_children.erase(it);
+    }
+
+    void Widget::setBounds(const XrRect2Di& bounds) {
+        if (!memcmp(&m_bounds, &bounds, sizeof(bounds))) {
+            return;
+        }
+        m_bounds = bounds;
+
+        // The children move along with the widget.
+        std::function<void(Widget*)> invalidateTree = [&](Widget* widget) {
+            widget->invalidate();
+            for (const auto& child : widget->m_children) {
+                invalidateTree(child.get());
+            }
+        };
+        invalidateTree(this);
+    }
+
+    void Widget::setVisible(bool visible) {
+        if (m_isVisible != visible) {
+            m_isVisible = visible;
+            invalidate();
+        }
+    }
+
+    void Widget::invalidate() {
+        m_isDirty = true;
+        for (Widget* parent = m_parent; parent && !parent->m_hasDirtyChildren; parent = parent->m_parent) {
+            parent->m_hasDirtyChildren = true;
+        }
+    }
+
+    void Widget::collectDamage(const XrOffset2Di& parentOrigin, std::vector<XrRect2Di>& damage) {
+        damage.insert(damage.end(), m_removedBounds.cbegin(), m_removedBounds.cend());
+        m_removedBounds.clear();
+
+        const XrRect2Di bounds = translate(m_bounds, parentOrigin);
+        if (m_isDirty) {
+            // Erase the previous location, and paint the new one.
+            if (m_paintedBounds) {
+                damage.push_back(m_paintedBounds.value());
+            }
+            if (m_isVisible) {
+                damage.push_back(bounds);
+                m_paintedBounds = bounds;
+            } else {
+                m_paintedBounds = {};
+            }
+            m_isDirty = false;
+        }
+
+        if (m_hasDirtyChildren) {
+            for (const auto& child : m_children) {
+                child->collectDamage(bounds.offset, damage);
+            }
+            m_hasDirtyChildren = false;
+        }
+    }
+
+    void Widget::paintTree(const image::Image& canvas, const XrRect2Di& clip, const XrOffset2Di& parentOrigin) {
+        if (!m_isVisible) {
+            return;
+        }
+
+        const XrRect2Di bounds = translate(m_bounds, parentOrigin);
+        const XrRect2Di widgetClip = intersect(clip, bounds);
+        if (isEmpty(widgetClip)) {
+            return;
+        }
+
+        paint(canvas, widgetClip, bounds.offset);
+        for (const auto& child : m_children) {
+            child->paintTree(canvas, widgetClip, bounds.offset);
+        }
+    }
+
+    std::shared_ptr<Widget> Widget::findWidgetAt(const XrOffset2Di& position, XrOffset2Di& localPosition) {
+        if (!m_isVisible || isEmpty(intersect(m_bounds, {position, {1, 1}}))) {
+            return nullptr;
+        }
+
+        // Children are painted in order, so the last one is on top.
+        const XrOffset2Di local{position.x - m_bounds.offset.x, position.y - m_bounds.offset.y};
+        for (auto it = m_children.rbegin(); it != m_children.rend(); ++it) {
+            std::shared_ptr<Widget> hit = (*it)->findWidgetAt(local, localPosition);
+            if (hit) {
+                return hit;
+            }
+        }
+
+        localPosition = local;
+        return shared_from_this();
+    }
+
+    void SolidWidget::setColor(const XrColor4f& color) {
+        if (memcmp(&m_color, &color, sizeof(color))) {
+            m_color = color;
+            invalidate();
+        }
+    }
+
+    void SolidWidget::paint(const image::Image& canvas, const XrRect2Di& clip, const XrOffset2Di& origin) {
+        if (m_color.a <= 0.f && m_color.r <= 0.f && m_color.g <= 0.f && m_color.b <= 0.f) {
+            return;
+        }
+
+        // Blend one row of the color at a time.
+        m_row.assign(clip.extent.width, m_color);
+        const image::Image row{reinterpret_cast<uint8_t*>(m_row.data()),
+                               m_row.size() * sizeof(XrColor4f),
+                               static_cast<uint32_t>(clip.extent.width),
+                               1,
+                               DXGI_FORMAT_R32G32B32A32_FLOAT};
+        for (int32_t y = clip.offset.y; y < clip.offset.y + clip.extent.height; y++) {
+            image::blendPremultiplied(row, canvas, {clip.offset.x, y});
+        }
+    }
+
+    void ImageWidget::setImage(const image::Image& image) {
+        const uint32_t bytesPerPixel = image::getBytesPerPixel(image.format);
+        if (!image::isFormatSupported(image.format)) {
+            throw std::runtime_error("Image format is not supported");
+        }
+
+        const size_t rowPitch = static_cast<size_t>(image.width) * bytesPerPixel;
+        m_pixels.resize(rowPitch * image.height);
+        for (uint32_t y = 0; y < image.height; y++) {
+            memcpy(m_pixels.data() + y * rowPitch, image.data + y * image.rowPitch, rowPitch);
+        }
+        m_image = {m_pixels.data(), rowPitch, image.width, image.height, image.format};
+        invalidate();
+    }
+
+    void ImageWidget::paint(const image::Image& canvas, const XrRect2Di& clip, const XrOffset2Di& origin) {
+        const XrRect2Di region =
+            intersect(clip, {origin, {static_cast<int32_t>(m_image.width), static_cast<int32_t>(m_image.height)}});
+        if (isEmpty(region)) {
+            return;
+        }
+
+        image::blendPremultiplied(
+            crop(m_image, {{region.offset.x - origin.x, region.offset.y - origin.y}, region.extent}),
+            canvas,
+            region.offset);
+    }
+
+    std::shared_ptr<IUiRenderer> createUiRenderer(graphics::IGraphicsDevice* device,
+                                                  std::shared_ptr<graphics::ISwapchain> swapchain) {
+        return std::make_shared<UiRenderer>(device, std::move(swapchain));
+    }
+
+} // namespace openxr_api_layer::utils::ui
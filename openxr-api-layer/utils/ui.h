@@ -0,0 +1,186 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "general.h"
+#include "graphics.h"
+#include "image.h"
+
+namespace openxr_api_layer::utils::ui {
+
+    enum class PointerEventType {
+        Move = 0,
+        Press,
+        Release,
+
+        // The pointer moved out of the widget, or out of the panel.
+        Leave,
+    };
+
+    struct PointerEvent {
+        PointerEventType type;
+
+        // The position of the pointer relative to the widget.
+        XrOffset2Di position;
+    };
+
+    // A node of the widget tree. The bounds are relative to the parent widget, and the content of a widget (including
+    // its children) is clipped to its bounds. The base widget paints nothing and is used as a container.
+    class Widget : public std::enable_shared_from_this<Widget> {
+      public:
+        virtual ~Widget() = default;
+
+        void addChild(std::shared_ptr<Widget> child);
+        void removeChild(const std::shared_ptr<Widget>& child);
+        const std::vector<std::shared_ptr<Widget>>& getChildren() const {
+            return m_children;
+        }
+        Widget* getParent() const {
+            return m_parent;
+        }
+
+        void setBounds(const XrRect2Di& bounds);
+        const XrRect2Di& getBounds() const {
+            return m_bounds;
+        }
+
+        void setVisible(bool visible);
+        bool isVisible() const {
+            return m_isVisible;
+        }
+
+        // Request the widget to be repainted during the next frame.
+        void invalidate();
+        bool isDirty() const {
+            return m_isDirty;
+        }
+
+        // Paint the content of the widget. The canvas covers the entire panel, the origin is the position of the
+        // widget on the canvas, and only the pixels within the clip rectangle (in canvas coordinates) may be written.
+        virtual void paint(const image::Image& canvas, const XrRect2Di& clip, const XrOffset2Di& origin) {
+        }
+
+        // Return true if the event was handled, otherwise it is forwarded to the parent widget.
+        virtual bool onPointerEvent(const PointerEvent& event) {
+            return false;
+        }
+
+        // Used by the renderer. Append the regions of the canvas to repaint since the last call, and reset the dirty
+        // state of the subtree.
+        void collectDamage(const XrOffset2Di& parentOrigin, std::vector<XrRect2Di>& damage);
+
+        // Used by the renderer. Paint the subtree within the clip rectangle.
+        void paintTree(const image::Image& canvas, const XrRect2Di& clip, const XrOffset2Di& parentOrigin);
+
+        // Used by the renderer. Find the top-most visible widget of the subtree at a position relative to the parent
+        // widget, and the position relative to that widget.
+        std::shared_ptr<Widget> findWidgetAt(const XrOffset2Di& position, XrOffset2Di& localPosition);
+
+      private:
+        Widget* m_parent{nullptr};
+        std::vector<std::shared_ptr<Widget>> m_children;
+        XrRect2Di m_bounds{};
+        bool m_isVisible{true};
+
+        bool m_isDirty{true};
+        bool m_hasDirtyChildren{false};
+
+        // Where the widget was last painted on the canvas, to erase it when it moves or disappears.
+        std::optional<XrRect2Di> m_paintedBounds;
+        std::vector<XrRect2Di> m_removedBounds;
+    };
+
+    // A widget filled with a color. The color is in linear space with premultiplied alpha.
+    class SolidWidget : public Widget {
+      public:
+        void setColor(const XrColor4f& color);
+        const XrColor4f& getColor() const {
+            return m_color;
+        }
+
+        void paint(const image::Image& canvas, const XrRect2Di& clip, const XrOffset2Di& origin) override;
+
+      private:
+        XrColor4f m_color{0, 0, 0, 0};
+        std::vector<XrColor4f> m_row;
+    };
+
+    // A widget displaying an image with premultiplied alpha at its top-left corner. The image is copied.
+    class ImageWidget : public Widget {
+      public:
+        void setImage(const image::Image& image);
+
+        void paint(const image::Image& canvas, const XrRect2Di& clip, const XrOffset2Di& origin) override;
+
+      private:
+        image::Image m_image{};
+        std::vector<uint8_t> m_pixels;
+    };
+
+    struct UiStatistics {
+        uint64_t framesCount{0};
+
+        // Frames where no widget was dirty, and the swapchain was not updated.
+        uint64_t framesSkipped{0};
+
+        uint32_t damagedRegionsLastFrame{0};
+        uint64_t pixelsPaintedLastFrame{0};
+        uint64_t pixelsPaintedTotal{0};
+
+        // Pixels copied to the swapchain image, including the damage accumulated since that image was last written.
+        uint64_t pixelsUploadedLastFrame{0};
+    };
+
+    // A retained-mode renderer for a widget tree into a swapchain. The widgets are painted on the CPU into a canvas,
+    // and only the damaged regions are repainted and copied to the swapchain images.
+    struct IUiRenderer {
+        virtual ~IUiRenderer() = default;
+
+        // The root widget covers the entire swapchain.
+        virtual std::shared_ptr<Widget> getRoot() const = 0;
+
+        // Repaint the damaged regions and update the swapchain. Returns false when no widget is dirty, or when the
+        // swapchain could not be updated (the update is retried on the next call), in which case the last committed
+        // image must be submitted again.
+        virtual bool render() = 0;
+
+        virtual std::shared_ptr<graphics::ISwapchain> getSwapchain() const = 0;
+
+        // Hit test the pointer ray against the quad displaying the swapchain, and dispatch the event to the widget
+        // under the pointer. Both poses must be located using the same base space. Returns true if a widget handled
+        // the event.
+        virtual bool dispatchPointerEvent(PointerEventType type,
+                                          const XrPosef& ray,
+                                          const XrPosef& quadPose,
+                                          const XrExtent2Df& quadSize) = 0;
+
+        virtual UiStatistics getStatistics() const = 0;
+    };
+
+    // The swapchain must be writable and its format supported by the image kernels. The device is the one where the
+    // swapchain images are written, ie: the composition device.
+    std::shared_ptr<IUiRenderer> createUiRenderer(graphics::IGraphicsDevice* device,
+                                                  std::shared_ptr<graphics::ISwapchain> swapchain);
+
+} // namespace openxr_api_layer::utils::ui
@@ -0,0 +1,261 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pch.h"
+
+#include "visibility.h"
+#include "log.h"
+
+namespace {
+
+    using namespace openxr_api_layer::log;
+    using namespace openxr_api_layer::utils::visibility;
+
+    // Tolerance for the jitter of the field of view reported by some runtimes.
+    constexpr float FovTolerance = 0.001f;
+
+    bool isSameFov(const XrFovf& a, const XrFovf& b) {
+        return std::abs(a.angleLeft - b.angleLeft) < FovTolerance &&
+               std::abs(a.angleRight - b.angleRight) < FovTolerance &&
+               std::abs(a.angleUp - b.angleUp) < FovTolerance && std::abs(a.angleDown - b.angleDown) < FovTolerance;
+    }
+
+    class VisibilityMask : public IVisibilityMask {
+      public:
+        VisibilityMask(const LensProfile& profile) : m_profile(profile) {
+        }
+
+        std::vector<uint32_t> updateViews(XrViewConfigurationType viewConfigurationType,
+                                          const XrView* views,
+                                          uint32_t viewCount) override {
+            std::unique_lock lock(m_mutex);
+
+            std::vector<uint32_t> changedViews;
+            for (uint32_t i = 0; i < viewCount; i++) {
+                // Some runtimes return an empty field of view when tracking is lost.
+                if (views[i].fov.angleRight - views[i].fov.angleLeft <= 0.f ||
+                    views[i].fov.angleUp - views[i].fov.angleDown <= 0.f) {
+                    continue;
+                }
+
+                auto it = m_views.find({viewConfigurationType, i});
+                if (it != m_views.end() && isSameFov(it->second.fov, views[i].fov)) {
+                    continue;
+                }
+
+                // The meshes are generated on the next query.
+                m_views.insert_or_assign({viewConfigurationType, i}, View{views[i].fov});
+                changedViews.push_back(i);
+            }
+
+            return changedViews;
+        }
+
+        XrResult getVisibilityMask(XrViewConfigurationType viewConfigurationType,
+                                   uint32_t viewIndex,
+                                   XrVisibilityMaskTypeKHR visibilityMaskType,
+                                   XrVisibilityMaskKHR& visibilityMask) override {
+            if (visibilityMask.type != XR_TYPE_VISIBILITY_MASK_KHR ||
+                visibilityMaskType < XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR ||
+                visibilityMaskType > XR_VISIBILITY_MASK_TYPE_LINE_LOOP_KHR) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+            if ((visibilityMask.vertexCapacityInput && !visibilityMask.vertices) ||
+                (visibilityMask.indexCapacityInput && !visibilityMask.indices)) {
+                return XR_ERROR_VALIDATION_FAILURE;
+            }
+
+            std::unique_lock lock(m_mutex);
+
+            static const VisibilityMesh emptyMesh;
+            const VisibilityMesh* mesh = &emptyMesh;
+            auto it = m_views.find({viewConfigurationType, viewIndex});
+            if (it != m_views.end()) {
+                View& view = it->second;
+                if (view.meshes.empty()) {
+                    TraceLocalActivity(local);
+                    TraceLoggingWriteStart(local,
+                                           "VisibilityMask_Generate",
+                                           TLArg(xr::ToCString(viewConfigurationType), "ViewConfigurationType"),
+                                           TLArg(viewIndex, "ViewIndex"));
+
+                    for (const XrVisibilityMaskTypeKHR type : {XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR,
+                                                               XR_VISIBILITY_MASK_TYPE_VISIBLE_TRIANGLE_MESH_KHR,
+                                                               XR_VISIBILITY_MASK_TYPE_LINE_LOOP_KHR}) {
+                        view.meshes.push_back(generateVisibilityMesh(view.fov, m_profile, viewIndex % 2, type));
+                    }
+
+                    TraceLoggingWriteStop(local, "VisibilityMask_Generate");
+                }
+                mesh = &view.meshes[visibilityMaskType - XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR];
+            }
+
+            visibilityMask.vertexCountOutput = static_cast<uint32_t>(mesh->vertices.size());
+            visibilityMask.indexCountOutput = static_cast<uint32_t>(mesh->indices.size());
+            if ((visibilityMask.vertexCapacityInput &&
+                 visibilityMask.vertexCapacityInput < visibilityMask.vertexCountOutput) ||
+                (visibilityMask.indexCapacityInput &&
+                 visibilityMask.indexCapacityInput < visibilityMask.indexCountOutput)) {
+                return XR_ERROR_SIZE_INSUFFICIENT;
+            }
+
+            if (visibilityMask.vertexCapacityInput) {
+                std::copy(mesh->vertices.cbegin(), mesh->vertices.cend(), visibilityMask.vertices);
+            }
+            if (visibilityMask.indexCapacityInput) {
+                std::copy(mesh->indices.cbegin(), mesh->indices.cend(), visibilityMask.indices);
+            }
+
+            return XR_SUCCESS;
+        }
+
+      private:
+        struct View {
+            XrFovf fov;
+
+            // Indexed by visibility mask type.
+            std::vector<VisibilityMesh> meshes;
+        };
+
+        const LensProfile m_profile;
+
+        std::mutex m_mutex;
+        std::map<std::pair<XrViewConfigurationType, uint32_t>, View> m_views;
+    };
+
+} // namespace
+
+namespace openxr_api_layer::utils::visibility {
+
+    VisibilityMesh generateVisibilityMesh(const XrFovf& fov,
+                                          const LensProfile& profile,
+                                          bool mirror,
+                                          XrVisibilityMaskTypeKHR type,
+                                          uint32_t segmentCount) {
+        // Work in the normalized coordinates of the profile, and convert to the z = -1 plane at the end.
+        const float left = std::tan(fov.angleLeft);
+        const float right = std::tan(fov.angleRight);
+        const float up = std::tan(fov.angleUp);
+        const float down = std::tan(fov.angleDown);
+        const auto toView = [&](const XrVector2f& point) -> XrVector2f {
+            return {(left + right) / 2 + point.x * (right - left) / 2, (up + down) / 2 + point.y * (up - down) / 2};
+        };
+
+        const XrVector2f center{std::clamp(mirror ? -profile.center.x : profile.center.x, -0.99f, 0.99f),
+                                std::clamp(profile.center.y, -0.99f, 0.99f)};
+        const XrVector2f radius{std::max(profile.radius.x, 0.01f), std::max(profile.radius.y, 0.01f)};
+        const float exponent = std::max(profile.exponent, 1.f);
+
+        // Sample the outline uniformly, and towards the corners of the field of view so that the segments between the
+        // outline and the edges never straddle a corner.
+        std::vector<float> angles;
+        for (uint32_t i = 0; i < std::max(segmentCount, 3u); i++) {
+            angles.push_back(2 * static_cast<float>(M_PI) * i / std::max(segmentCount, 3u));
+        }
+        for (const XrVector2f corner : {XrVector2f{1, 1}, XrVector2f{-1, 1}, XrVector2f{-1, -1}, XrVector2f{1, -1}}) {
+            const float angle = std::atan2(corner.y - center.y, corner.x - center.x);
+            angles.push_back(angle < 0 ? angle + 2 * static_cast<float>(M_PI) : angle);
+        }
+        std::sort(angles.begin(), angles.end());
+        angles.erase(std::unique(angles.begin(),
+                                 angles.end(),
+                                 [](float a, float b) { return std::abs(a - b) < 1e-5f; }),
+                     angles.end());
+
+        // For each angle, the point on the outline (clipped to the field of view) and the point on the edge.
+        std::vector<XrVector2f> outline;
+        std::vector<XrVector2f> edge;
+        for (const float angle : angles) {
+            const XrVector2f direction{std::cos(angle), std::sin(angle)};
+
+            float edgeDistance = std::numeric_limits<float>::infinity();
+            if (std::abs(direction.x) > 1e-6f) {
+                edgeDistance = std::min(edgeDistance, ((direction.x > 0 ? 1 : -1) - center.x) / direction.x);
+            }
+            if (std::abs(direction.y) > 1e-6f) {
+                edgeDistance = std::min(edgeDistance, ((direction.y > 0 ? 1 : -1) - center.y) / direction.y);
+            }
+
+            const float outlineDistance =
+                std::pow(std::pow(std::abs(direction.x) / radius.x, exponent) +
+                             std::pow(std::abs(direction.y) / radius.y, exponent),
+                         -1 / exponent);
+
+            const float distance = std::min(outlineDistance, edgeDistance);
+            outline.push_back({center.x + distance * direction.x, center.y + distance * direction.y});
+            edge.push_back({center.x + edgeDistance * direction.x, center.y + edgeDistance * direction.y});
+        }
+
+        const uint32_t pointCount = static_cast<uint32_t>(outline.size());
+        VisibilityMesh mesh;
+        if (type == XR_VISIBILITY_MASK_TYPE_VISIBLE_TRIANGLE_MESH_KHR) {
+            // A fan from the center of the lens.
+            mesh.vertices.push_back(toView(center));
+            for (uint32_t i = 0; i < pointCount; i++) {
+                mesh.vertices.push_back(toView(outline[i]));
+                mesh.indices.insert(mesh.indices.end(), {0, i + 1, (i + 1) % pointCount + 1});
+            }
+        } else if (type == XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR) {
+            // A ring between the outline and the edges, skipping the portions where they meet.
+            const auto isOnEdge = [&](uint32_t i) {
+                return std::abs(outline[i].x - edge[i].x) < 1e-6f && std::abs(outline[i].y - edge[i].y) < 1e-6f;
+            };
+            std::vector<uint32_t> outlineIndices(pointCount, UINT32_MAX);
+            std::vector<uint32_t> edgeIndices(pointCount, UINT32_MAX);
+            const auto addVertex = [&](std::vector<uint32_t>& indices, const XrVector2f& point, uint32_t i) {
+                if (indices[i] == UINT32_MAX) {
+                    indices[i] = static_cast<uint32_t>(mesh.vertices.size());
+                    mesh.vertices.push_back(toView(point));
+                }
+                return indices[i];
+            };
+            for (uint32_t i = 0; i < pointCount; i++) {
+                const uint32_t next = (i + 1) % pointCount;
+                if (!isOnEdge(i)) {
+                    mesh.indices.insert(mesh.indices.end(),
+                                        {addVertex(outlineIndices, outline[i], i),
+                                         addVertex(edgeIndices, edge[i], i),
+                                         addVertex(edgeIndices, edge[next], next)});
+                }
+                if (!isOnEdge(next)) {
+                    mesh.indices.insert(mesh.indices.end(),
+                                        {addVertex(outlineIndices, outline[i], i),
+                                         addVertex(edgeIndices, edge[next], next),
+                                         addVertex(outlineIndices, outline[next], next)});
+                }
+            }
+        } else if (type == XR_VISIBILITY_MASK_TYPE_LINE_LOOP_KHR) {
+            for (uint32_t i = 0; i < pointCount; i++) {
+                mesh.vertices.push_back(toView(outline[i]));
+                mesh.indices.push_back(i);
+            }
+        }
+
+        return mesh;
+    }
+
+    std::shared_ptr<IVisibilityMask> createVisibilityMask(const LensProfile& profile) {
+        return std::make_shared<VisibilityMask>(profile);
+    }
+
+} // namespace openxr_api_layer::utils::visibility
@@ -0,0 +1,72 @@
+// MIT License
+//
+// Copyright(c) 2022-2023 Matthieu Bucchianeri
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+namespace openxr_api_layer::utils::visibility {
+
+    // The outline of a lens as a superellipse, in coordinates normalized to the field of view of a left view ([-1, 1]
+    // on each axis, Y up). The outline is mirrored horizontally for the right views (odd view indices). The default
+    // profile encloses the whole field of view and hides nothing, since any part of it may be visible through the
+    // lenses of an unknown headset.
+    struct LensProfile {
+        XrVector2f center{0.f, 0.f};
+        XrVector2f radius{1.5f, 1.5f};
+        float exponent{2.f};
+    };
+
+    struct VisibilityMesh {
+        std::vector<XrVector2f> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    // Generate a visibility mesh for a view. The vertices are on the z = -1 plane of the view space, and the triangles
+    // are in counter-clockwise order. segmentCount is the number of segments approximating the lens outline.
+    VisibilityMesh generateVisibilityMesh(const XrFovf& fov,
+                                          const LensProfile& profile,
+                                          bool mirror,
+                                          XrVisibilityMaskTypeKHR type,
+                                          uint32_t segmentCount = 64);
+
+    // An implementation of XR_KHR_visibility_mask for one session. The meshes are generated for the field of view of
+    // each view, as last reported by the runtime, and cached until it changes.
+    struct IVisibilityMask {
+        virtual ~IVisibilityMask() = default;
+
+        // Must be called with the views returned by xrLocateViews(). Returns the indices of the views whose field of
+        // view changed, for which XrEventDataVisibilityMaskChangedKHR must be posted to the application.
+        virtual std::vector<uint32_t> updateViews(XrViewConfigurationType viewConfigurationType,
+                                                  const XrView* views,
+                                                  uint32_t viewCount) = 0;
+
+        // Follows the two-call idiom of xrGetVisibilityMaskKHR(). The mask is empty until the field of view of the view
+        // is known.
+        virtual XrResult getVisibilityMask(XrViewConfigurationType viewConfigurationType,
+                                           uint32_t viewIndex,
+                                           XrVisibilityMaskTypeKHR visibilityMaskType,
+                                           XrVisibilityMaskKHR& visibilityMask) = 0;
+    };
+
+    std::shared_ptr<IVisibilityMask> createVisibilityMask(const LensProfile& profile = {});
+
+} // namespace openxr_api_layer::utils::visibility